@@ -0,0 +1,449 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Autotuner of the fast inverse halftoning programs.  The fastest
+kernel of every stage of fastiht1, the fastest tile size and number
+of threads of its tiled mode, and the fastest strip height and number
+of threads of fastiht2 depend on the processor, its caches and its
+cores, so they are measured on this machine, on synthetic halftones of
+all three kinds, and written to the tuning profile that both programs
+read at startup (see tuning_profile.h).  Every configuration computes
+the same result, so the profile changes only the speed; a kernel that
+does not match the reference kernel is never chosen.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "inverse_halftone.h"
+#include "inverse_halftone2.h"
+#include "tiled_halftone.h"
+#include "synthetic_halftone.h"
+#include "tuning_profile.h"
+#include "timer_utils.h"
+#include "memory_usage.h"
+
+/* Constants */
+
+#define DEFAULT_TUNE_SIZE 1024
+#define DEFAULT_TUNE_REPETITIONS 3
+#define MAX_TUNE_THREADS 64
+#define NUM_HALFTONING_TYPES 3
+
+/* Threshold and gain of the edge map, as in the README example */
+#define TUNE_THRESHOLD 0
+#define TUNE_GAIN 4
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define USAGE_STRING \
+  "Usage: %s [options]\n" \
+  "Time the configurations of fastiht1 and fastiht2 on synthetic\n" \
+  "halftones on this machine, and write the fastest to the tuning\n" \
+  "profile that both programs read at startup: the file named by\n" \
+  "$%s, or ~/%s.  The kernel of every stage\n" \
+  "of fastiht1, its tile size and number of threads, and the strip\n" \
+  "height and number of threads of fastiht2 are tuned.\n" \
+  "Options:\n" \
+  "  --size num     size of the square synthetic halftones (default %d)\n" \
+  "  --repetitions num\n" \
+  "                 runs of every configuration, of which the fastest\n" \
+  "                 counts (default %d)\n" \
+  "  --max-threads num\n" \
+  "                 most threads to try (default the number of\n" \
+  "                 processors online)\n" \
+  "  --output file  write the profile to file instead\n" \
+  "  --dry-run      report the timings without writing the profile\n"
+
+/* Candidate tile sizes of fastiht1 and strip heights of fastiht2 */
+static int tileSizes[] = { 128, 256, 512, 1024 };
+static int stripHeights[] = { 16, 32, 64, 128, 256 };
+
+#define NUM_TILE_SIZES ((int) (sizeof(tileSizes) / sizeof(tileSizes[0])))
+#define NUM_STRIP_HEIGHTS \
+    ((int) (sizeof(stripHeights) / sizeof(stripHeights[0])))
+
+/* Synthetic halftones of every kind, and room for the result */
+typedef struct TuneImages {
+    int size;
+    unsigned char* halftones[NUM_HALFTONING_TYPES];
+    unsigned char* output;
+} TuneImages;
+
+/* Print the usage information and exit */
+static void usage(char *programName)
+{
+    fprintf(stderr, USAGE_STRING, programName, TUNING_PROFILE_VARIABLE,
+            DEFAULT_TUNING_PROFILE, DEFAULT_TUNE_SIZE,
+            DEFAULT_TUNE_REPETITIONS);
+    exit(1);
+}
+
+/* Read an integer from the string numericStr; and exit program on failure. */
+static int readIntArg(char *descStr, char *numericStr, int minValue) {
+    int tempInt = 0;
+    if ((sscanf(numericStr, "%d", &tempInt) != 1) || (tempInt < minValue)) {
+        fprintf(stderr,
+                "%s, %s, is not an integer greater than or equal to %d.\n",
+                descStr, numericStr, minValue);
+        exit(1);
+    }
+    return(tempInt);
+}
+
+/* Return the value of the option argv[*argIndexPtr], and exit if missing */
+static char* readOptionValue(int argc, char *argv[], int *argIndexPtr)
+{
+    if (*argIndexPtr + 1 >= argc) {
+        fprintf(stderr, "Option '%s' needs a value.\n", argv[*argIndexPtr]);
+        usage(argv[0]);
+    }
+    (*argIndexPtr)++;
+    return(argv[*argIndexPtr]);
+}
+
+/*
+Store the numbers of threads to try, 1, 2, 4 and so on up to
+maxThreads and maxThreads itself, in threadCounts, and return how many
+there are
+*/
+static int listThreadCounts(int maxThreads, int* threadCounts)
+{
+    int numCounts = 0, count;
+
+    for (count = 1; count < maxThreads; count *= 2) {
+        threadCounts[numCounts++] = count;
+    }
+    threadCounts[numCounts++] = maxThreads;
+    return(numCounts);
+}
+
+/*
+Return the time in seconds that the stage takes with its kernel
+kernel, the fastest of repetitions runs, summed over the halftones of
+every kind.  Returns a negative time if the kernel does not match the
+reference kernel on any of them, or the algorithm fails.
+*/
+static double timeStageKernel(InverseHalftoneWorkspace* workspace,
+                              TuneImages* images, int stage, int kernel,
+                              int repetitions)
+{
+    KernelMismatch mismatches[NUM_INVERSE_HALFTONE_STAGES];
+    double totalTime = 0.0;
+    int type, k;
+
+    if (!setInverseHalftoneKernel(workspace, stage, kernel)) {
+        return(-1.0);
+    }
+    for (type = 0; type < NUM_HALFTONING_TYPES; type++) {
+        double bestTime = 0.0;
+        if ((verifyInverseHalftoneKernels(workspace, images->halftones[type],
+                                          images->size, images->size,
+                                          TUNE_GAIN, TUNE_THRESHOLD,
+                                          type + 1, mismatches) < 0) ||
+            (mismatches[stage].numPixels > 0)) {
+            return(-1.0);
+        }
+        for (k = 0; k < repetitions; k++) {
+            double startTime = workspace->stats.stageTime[stage];
+            double stageTime;
+            if (inverseHalftoneWithWorkspace(workspace,
+                                             images->halftones[type],
+                                             images->output,
+                                             images->size, images->size,
+                                             TUNE_GAIN, TUNE_THRESHOLD,
+                                             FALSE, type + 1) < 0) {
+                return(-1.0);
+            }
+            stageTime = workspace->stats.stageTime[stage] - startTime;
+            if ((k == 0) || (stageTime < bestTime)) bestTime = stageTime;
+        }
+        totalTime += bestTime;
+    }
+    return(totalTime);
+}
+
+/*
+Choose the fastest kernel of every stage that has more than one, and
+write them to the kernel list of profile.  Returns FALSE if memory
+could not be allocated.
+*/
+static int tuneKernels(TuneImages* images, int repetitions,
+                       TuningProfile* profile)
+{
+    InverseHalftoneWorkspace* workspace =
+        allocateInverseHalftoneWorkspace(images->size, images->size);
+    int stage, kernel;
+
+    if (workspace == 0) {
+        return FALSE;
+    }
+    printf("%-10s %-10s %12s\n", "stage", "kernel", "ms");
+    for (stage = 0; stage < NUM_INVERSE_HALFTONE_STAGES; stage++) {
+        int numKernels = numInverseHalftoneKernels(stage);
+        int defaultKernel = workspace->kernels[stage];
+        int bestKernel = defaultKernel;
+        double bestTime = -1.0;
+        if (numKernels < 2) continue;
+        for (kernel = 0; kernel < numKernels; kernel++) {
+            double stageTime = timeStageKernel(workspace, images, stage,
+                                               kernel, repetitions);
+            if (stageTime < 0) {
+                printf("%-10s %-10s %12s\n", inverseHalftoneStageName(stage),
+                       inverseHalftoneKernelName(stage, kernel), "mismatch");
+                continue;
+            }
+            printf("%-10s %-10s %12.3f\n", inverseHalftoneStageName(stage),
+                   inverseHalftoneKernelName(stage, kernel),
+                   1000.0 * stageTime);
+            if ((bestTime < 0) || (stageTime < bestTime)) {
+                bestTime = stageTime;
+                bestKernel = kernel;
+            }
+        }
+        setInverseHalftoneKernel(workspace, stage, defaultKernel);
+        sprintf(profile->kernels + strlen(profile->kernels), "%s%s=%s",
+                (profile->kernels[0] != 0) ? "," : "",
+                inverseHalftoneStageName(stage),
+                inverseHalftoneKernelName(stage, bestKernel));
+    }
+    freeInverseHalftoneWorkspace(workspace);
+    return TRUE;
+}
+
+/*
+Return the time in seconds of fastiht1 in tiles of tileSize with
+numThreads threads, the fastest of repetitions runs, summed over the
+halftones of every kind, or a negative time if it fails
+*/
+static double timeTiles(TuneImages* images, int tileSize, int numThreads,
+                        int repetitions)
+{
+    double totalTime = 0.0;
+    int type, k;
+
+    for (type = 0; type < NUM_HALFTONING_TYPES; type++) {
+        double bestTime = 0.0;
+        for (k = 0; k < repetitions; k++) {
+            double startTime = currentTimeInSeconds();
+            double runTime;
+            if (inverseHalftoneTiled(images->halftones[type], images->output,
+                                     images->size, images->size,
+                                     TUNE_GAIN, TUNE_THRESHOLD, type + 1,
+                                     tileSize, numThreads, 0) < 0) {
+                return(-1.0);
+            }
+            runTime = currentTimeInSeconds() - startTime;
+            if ((k == 0) || (runTime < bestTime)) bestTime = runTime;
+        }
+        totalTime += bestTime;
+    }
+    return(totalTime);
+}
+
+/*
+Return the time in seconds of fastiht2 in strips of stripHeight rows
+with numThreads threads, the fastest of repetitions runs on the error
+diffused halftone, or a negative time if it fails
+*/
+static double timeStrips(TuneImages* images, int stripHeight,
+                         int numThreads, int repetitions)
+{
+    double bestTime = 0.0;
+    int k;
+
+    for (k = 0; k < repetitions; k++) {
+        double startTime = currentTimeInSeconds();
+        double runTime;
+        if (inverseHalftone2Strips(images->halftones[0], images->output,
+                                   images->size, images->size,
+                                   stripHeight, numThreads) != 0) {
+            return(-1.0);
+        }
+        runTime = currentTimeInSeconds() - startTime;
+        if ((k == 0) || (runTime < bestTime)) bestTime = runTime;
+    }
+    return(bestTime);
+}
+
+/* Choose the fastest tile size and number of threads of fastiht1 */
+static void tuneTiles(TuneImages* images, int repetitions,
+                      int* threadCounts, int numCounts,
+                      TuningProfile* profile)
+{
+    double bestTime = -1.0;
+    int s, t;
+
+    printf("\n%-10s %-10s %12s\n", "tile size", "threads", "ms");
+    for (s = 0; s < NUM_TILE_SIZES; s++) {
+        if ((s > 0) && (tileSizes[s] > images->size)) break;
+        for (t = 0; t < numCounts; t++) {
+            double runTime = timeTiles(images, tileSizes[s], threadCounts[t],
+                                       repetitions);
+            if (runTime < 0) continue;
+            printf("%-10d %-10d %12.3f\n", tileSizes[s], threadCounts[t],
+                   1000.0 * runTime);
+            if ((bestTime < 0) || (runTime < bestTime)) {
+                bestTime = runTime;
+                profile->tileSize = tileSizes[s];
+                profile->numThreads = threadCounts[t];
+            }
+        }
+    }
+}
+
+/* Choose the fastest strip height and number of threads of fastiht2 */
+static void tuneStrips(TuneImages* images, int repetitions,
+                       int* threadCounts, int numCounts,
+                       TuningProfile* profile)
+{
+    double bestTime = -1.0;
+    int s, t;
+
+    printf("\n%-10s %-10s %12s\n", "strip", "threads", "ms");
+    for (s = 0; s < NUM_STRIP_HEIGHTS; s++) {
+        if ((s > 0) && (stripHeights[s] > images->size)) break;
+        for (t = 0; t < numCounts; t++) {
+            double runTime = timeStrips(images, stripHeights[s],
+                                        threadCounts[t], repetitions);
+            if (runTime < 0) continue;
+            printf("%-10d %-10d %12.3f\n", stripHeights[s], threadCounts[t],
+                   1000.0 * runTime);
+            if ((bestTime < 0) || (runTime < bestTime)) {
+                bestTime = runTime;
+                profile->stripHeight = stripHeights[s];
+                profile->stripThreads = threadCounts[t];
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int size = DEFAULT_TUNE_SIZE;
+    int repetitions = DEFAULT_TUNE_REPETITIONS;
+    int maxThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int dryRunFlag = FALSE;
+    char *outputFile = 0;
+    char fileName[MAX_PROFILE_NAME_LENGTH];
+    int threadCounts[MAX_TUNE_THREADS];
+    int numCounts;
+    TuneImages images;
+    TuningProfile profile;
+    int argIndex, type;
+
+    for (argIndex = 1; argIndex < argc; argIndex++) {
+        char* option = argv[argIndex];
+        if (strcmp(option, "--size") == 0) {
+            size = readIntArg("Size", readOptionValue(argc, argv, &argIndex),
+                              16);
+        }
+        else if (strcmp(option, "--repetitions") == 0) {
+            repetitions = readIntArg("Number of repetitions",
+                                     readOptionValue(argc, argv, &argIndex), 1);
+        }
+        else if (strcmp(option, "--max-threads") == 0) {
+            maxThreads = readIntArg("Number of threads",
+                                    readOptionValue(argc, argv, &argIndex), 1);
+        }
+        else if (strcmp(option, "--output") == 0) {
+            outputFile = readOptionValue(argc, argv, &argIndex);
+        }
+        else if (strcmp(option, "--dry-run") == 0) {
+            dryRunFlag = TRUE;
+        }
+        else {
+            fprintf(stderr, "Unknown option '%s'.\n", option);
+            usage(argv[0]);
+        }
+    }
+    if (maxThreads < 1) maxThreads = 1;
+    if (maxThreads > MAX_TUNE_THREADS) maxThreads = MAX_TUNE_THREADS;
+    if ((outputFile == 0) && !dryRunFlag) {
+        outputFile = tuningProfileFileName(fileName, sizeof(fileName));
+        if (outputFile == 0) {
+            fprintf(stderr, "The profile is turned off by $%s, or there is "
+                    "no home directory; use --output.\n",
+                    TUNING_PROFILE_VARIABLE);
+            exit(1);
+        }
+    }
+
+    images.size = size;
+    images.output = (unsigned char *) trackedMalloc(size * size);
+    if (images.output == 0) {
+        fprintf(stderr, "Could not allocate %d x %d images.\n", size, size);
+        exit(1);
+    }
+    for (type = 0; type < NUM_HALFTONING_TYPES; type++) {
+        images.halftones[type] = (unsigned char *) trackedMalloc(size * size);
+        if (images.halftones[type] == 0) {
+            fprintf(stderr, "Could not allocate %d x %d images.\n",
+                    size, size);
+            exit(1);
+        }
+        makeSyntheticHalftone(images.halftones[type], size, size, type + 1);
+    }
+
+    /* Tune the kernels first, since the tiles are timed with them */
+    clearTuningProfile(&profile);
+    printf("%d x %d synthetic halftones, fastest of %d runs, summed over "
+           "the three kinds\n\n", size, size, repetitions);
+    if (!tuneKernels(&images, repetitions, &profile)) {
+        fprintf(stderr, "Could not allocate the workspace.\n");
+        exit(1);
+    }
+    if ((profile.kernels[0] != 0) &&
+        !selectInverseHalftoneKernels(profile.kernels)) {
+        fprintf(stderr, "Could not select the kernels %s.\n",
+                profile.kernels);
+        exit(1);
+    }
+    numCounts = listThreadCounts(maxThreads, threadCounts);
+    tuneTiles(&images, repetitions, threadCounts, numCounts, &profile);
+    tuneStrips(&images, repetitions, threadCounts, numCounts, &profile);
+
+    printf("\nfastiht1-kernels      %s\n", profile.kernels);
+    printf("fastiht1-tile-size    %d\n", profile.tileSize);
+    printf("fastiht1-threads      %d\n", profile.numThreads);
+    printf("fastiht2-strip-height %d\n", profile.stripHeight);
+    printf("fastiht2-threads      %d\n", profile.stripThreads);
+    if (!dryRunFlag) {
+        if (!writeTuningProfile(outputFile, &profile)) {
+            fprintf(stderr, "Could not write the profile '%s'.\n",
+                    outputFile);
+            exit(1);
+        }
+        printf("wrote %s\n", outputFile);
+    }
+
+    for (type = 0; type < NUM_HALFTONING_TYPES; type++) {
+        trackedFree(images.halftones[type]);
+    }
+    trackedFree(images.output);
+    return(0);
+}
@@ -0,0 +1,778 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Batch inverse halftoning of the images named in a list file.  Each line
+of the list file holds the name of a halftone and the name of the file
+to receive its inverse halftone; blank lines and lines starting with '#'
+are skipped.  The batch runs as a three-stage pipeline
+
+     read thread  -->  compute thread  -->  write thread
+
+with bounded queues of BATCH_QUEUE_LENGTH images between the stages, so
+reading image N+1 and writing image N-1 overlap the inverse halftoning
+of image N.  The images are written in the order of the list file.
+
+With options->numWorkers, the middle stage instead hands the images to
+a work-stealing task scheduler (see task_scheduler.c).  An image that
+fits in one tile is one task; a larger image is cut into tiles, and its
+task queues the tiles as tasks of their own, which idle workers steal.
+Small and large images thus keep all the workers busy, and the
+finished images are put back into list order by a reorder buffer.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "batch_pipeline.h"
+#include "halftone_classifier.h"
+#include "image_io.h"
+#include "image_metrics.h"
+#include "inverse_halftone.h"
+#include "memory_usage.h"
+#include "readWriteImage.h"
+#include "reorder_buffer.h"
+#include "task_scheduler.h"
+#include "tiled_halftone.h"
+#include "timer_utils.h"
+#include "work_queue.h"
+
+#define MAX_FILE_NAME_LENGTH 1024
+
+/* A tile of an image, or the whole image, inverse halftoned as one task */
+typedef struct BatchPiece {
+    struct BatchImage* image;
+    int firstRow;
+    int firstColumn;
+    int numRows;
+    int numColumns;
+    double status;
+    double startTime;
+    double endTime;
+} BatchPiece;
+
+/* One image travelling through the pipeline */
+typedef struct BatchImage {
+    char halfFile[MAX_FILE_NAME_LENGTH];
+    char inverseFile[MAX_FILE_NAME_LENGTH];
+    char referenceFile[MAX_FILE_NAME_LENGTH];   /* empty if not measured */
+    unsigned char* inputByteImage;
+    unsigned char* outputByteImage;
+    unsigned char* referenceByteImage;
+    int numRows;
+    int numColumns;
+    int imageType;
+    int halftoningType;         /* chosen by the read thread */
+    double execTime;
+    size_t peakBytes;           /* most memory live while processing */
+    struct BatchPipeline* pipeline;
+    int sequence;               /* position in the list file */
+    int tiledFlag;              /* pieces are tiles, not the whole image */
+    BatchPiece* pieces;         /* tasks of the scheduler, or 0 */
+    int numPieces;
+    int piecesLeft;             /* pieces not yet finished */
+} BatchImage;
+
+/* Workspaces of one worker of the scheduler, kept from task to task */
+typedef struct BatchWorker {
+    InverseHalftoneWorkspace* workspace;
+    TileWorkspace* tileWorkspaces[HALFTONING_BY_CLUSTERED_DITHER + 1];
+} BatchWorker;
+
+typedef struct BatchPipeline {
+    FILE* listFile;
+    BatchOptions* options;
+    WorkQueue computeQueue;     /* images read, waiting to be processed */
+    WorkQueue writeQueue;       /* images processed, waiting to be written */
+    TaskScheduler* scheduler;   /* with options->numWorkers, or 0 */
+    BatchWorker* workers;
+    int tileSize;               /* largest piece of an image task */
+    ReorderBuffer writeBuffer;  /* images finished by the scheduler */
+    int numImages;              /* updated by the write thread */
+    int numErrors;
+    int numReadErrors;          /* updated by the read thread */
+    int numMeasured;            /* images measured against an original */
+    ImageMetrics metricsSum;
+} BatchPipeline;
+
+/*
+Read the next pair of file names from the list file into image, and the
+optional name of the original image to measure the result against.
+Return 0 at the end of the list file.
+*/
+static int readNextJob(FILE* listFile, BatchImage* image)
+{
+    char line[3*MAX_FILE_NAME_LENGTH + 3];
+    while (fgets(line, sizeof(line), listFile) != 0) {
+        char* halfFile = strtok(line, " \t\r\n");
+        char* inverseFile = 0;
+        char* referenceFile = 0;
+        if ((halfFile == 0) || (halfFile[0] == '#')) continue;
+        inverseFile = strtok(0, " \t\r\n");
+        if (inverseFile == 0) {
+            fprintf(stderr, "No output file given for '%s' in the batch.\n",
+                    halfFile);
+            continue;
+        }
+        strncpy(image->halfFile, halfFile, MAX_FILE_NAME_LENGTH - 1);
+        strncpy(image->inverseFile, inverseFile, MAX_FILE_NAME_LENGTH - 1);
+        referenceFile = strtok(0, " \t\r\n");
+        if (referenceFile != 0) {
+            strncpy(image->referenceFile, referenceFile,
+                    MAX_FILE_NAME_LENGTH - 1);
+        }
+        return(1);
+    }
+    return(0);
+}
+
+static void freeBatchImage(BatchImage* image)
+{
+    freeByteImage(image->inputByteImage);
+    freeByteImage(image->outputByteImage);
+    freeByteImage(image->referenceByteImage);
+    free(image->pieces);
+    free(image);
+}
+
+/* First stage: read the halftones */
+static void* readStage(void* arg)
+{
+    BatchPipeline* pipeline = (BatchPipeline*) arg;
+    for (;;) {
+        BatchImage* image = (BatchImage*) calloc(1, sizeof(BatchImage));
+        if (image == 0) {
+            fprintf(stderr, "Could not allocate enough memory for images.\n");
+            exit(1);
+        }
+        if (!readNextJob(pipeline->listFile, image)) {
+            free(image);
+            break;
+        }
+        image->numRows = pipeline->options->numRows;
+        image->numColumns = pipeline->options->numColumns;
+        image->imageType = readByteImageChecked(image->halfFile,
+                                                &image->inputByteImage,
+                                                &image->numRows,
+                                                &image->numColumns);
+        if (image->imageType == IMAGE_IO_ERROR) {
+            pipeline->numReadErrors++;
+            free(image);
+            continue;
+        }
+        image->halftoningType =
+            chooseHalftoningType(image->inputByteImage,
+                                 image->numRows, image->numColumns,
+                                 pipeline->options->halftoningType,
+                                 pipeline->options->fastErrorDiffusion);
+        if (image->halftoningType == HALFTONING_NOT_A_HALFTONE) {
+            fprintf(stderr, "'%s' is not a halftone: it has grey levels "
+                    "other than 0 and 255.\n", image->halfFile);
+            pipeline->numReadErrors++;
+            freeBatchImage(image);
+            continue;
+        }
+        image->outputByteImage = allocateByteImage(image->numRows,
+                                                   image->numColumns);
+        if (image->outputByteImage == 0) {
+            fprintf(stderr, "Could not allocate enough memory for images.\n");
+            exit(1);
+        }
+        if (image->referenceFile[0] != 0) {
+            image->referenceByteImage =
+                readReferenceImage(image->referenceFile,
+                                   image->numRows, image->numColumns);
+            if (image->referenceByteImage == 0) {
+                pipeline->numReadErrors++;
+            }
+        }
+        pushWorkQueue(&pipeline->computeQueue, image);
+    }
+    pushWorkQueue(&pipeline->computeQueue, 0);         /* end of batch */
+    return(0);
+}
+
+/* Measure an inverse halftone against its original and add to the totals */
+static void measureImage(BatchPipeline* pipeline, BatchImage* image)
+{
+    ImageMetrics metrics;
+    if (!computeImageMetrics(image->outputByteImage,
+                             image->referenceByteImage,
+                             image->numRows, image->numColumns,
+                             pipeline->options->numThreads, &metrics)) {
+        fprintf(stderr, "Could not allocate enough memory for metrics.\n");
+        return;
+    }
+    printf("%s: ", image->inverseFile);
+    printImageMetrics(stdout, &metrics);
+    pipeline->numMeasured++;
+    pipeline->metricsSum.mse += metrics.mse;
+    pipeline->metricsSum.psnr += metrics.psnr;
+    pipeline->metricsSum.ssim += metrics.ssim;
+    pipeline->metricsSum.wsnr += metrics.wsnr;
+}
+
+/* Last stage: write the inverse halftones in list order */
+static void* writeStage(void* arg)
+{
+    BatchPipeline* pipeline = (BatchPipeline*) arg;
+    BatchImage* image;
+    for (;;) {
+        if (pipeline->scheduler != 0) {
+            image = (BatchImage*) takeReorderBuffer(&pipeline->writeBuffer);
+        }
+        else {
+            image = (BatchImage*) popWorkQueue(&pipeline->writeQueue);
+        }
+        if (image == 0) {
+            break;
+        }
+        if (image->execTime < 0.0) {
+            fprintf(stderr, "Error inverse halftoning '%s'.\n",
+                    image->halfFile);
+            pipeline->numErrors++;
+        }
+        else {
+            if ((pipeline->options->halftoningType ==
+                 HALFTONING_BY_DETECTION) ||
+                pipeline->options->fastErrorDiffusion) {
+                printf("%s: %s\n", image->halfFile,
+                       halftoningTypeName(image->halftoningType));
+            }
+            if (!writeByteImageChecked(image->inverseFile,
+                                       image->outputByteImage,
+                                       &image->numRows, &image->numColumns,
+                                       image->imageType)) {
+                pipeline->numErrors++;
+            }
+            else {
+                if (pipeline->options->memoryFlag) {
+                    printf("%s: %f sec, %.2f MB peak\n", image->halfFile,
+                           image->execTime, image->peakBytes / 1048576.0);
+                }
+                else {
+                    printf("%s: %f sec\n", image->halfFile,
+                           image->execTime);
+                }
+                pipeline->numImages++;
+                if (image->referenceByteImage != 0) {
+                    measureImage(pipeline, image);
+                }
+            }
+        }
+        freeBatchImage(image);
+    }
+    return(0);
+}
+
+/*
+Return workspace if it is large enough for an image of numRows by
+numColumns, or else free it and return a workspace large enough for
+both, set up as options asks.  Returns a null pointer if memory could
+not be allocated.
+*/
+static InverseHalftoneWorkspace* growWorkspace(
+    InverseHalftoneWorkspace* workspace, BatchOptions* options,
+    int numRows, int numColumns)
+{
+    if ((workspace != 0) &&
+        (numRows <= workspace->maxRows) &&
+        (numColumns <= workspace->maxColumns)) {
+        return(workspace);
+    }
+    if (workspace != 0) {
+        if (workspace->maxRows > numRows) numRows = workspace->maxRows;
+        if (workspace->maxColumns > numColumns)
+            numColumns = workspace->maxColumns;
+        freeInverseHalftoneWorkspace(workspace);
+    }
+    workspace = allocateInverseHalftoneWorkspace(numRows, numColumns);
+    if (workspace != 0) {
+        setInverseHalftoneQuality(workspace, options->qualityLevel);
+        if (!setInverseHalftoneRecursiveFilters(workspace,
+                                                options->recursiveStages,
+                                                options->sigmaScale) ||
+            !setInverseHalftonePipeline(workspace, options->pipelineFlag)) {
+            freeInverseHalftoneWorkspace(workspace);
+            workspace = 0;
+        }
+    }
+    return(workspace);
+}
+
+/*
+Middle stage: inverse halftone, growing the workspace as needed.  Each
+image is timed here, as the workers time theirs, since the routines
+only time to the second.
+*/
+static void computeStage(BatchPipeline* pipeline)
+{
+    BatchOptions* options = pipeline->options;
+    InverseHalftoneWorkspace* workspace = 0;
+    BatchImage* image;
+    double startTime;
+
+    while ((image = (BatchImage*)
+                popWorkQueue(&pipeline->computeQueue)) != 0) {
+        startTime = currentTimeInSeconds();
+        if (options->memoryFlag) {
+            startImageMemory();
+        }
+        if (options->tileCache == 0) {
+            workspace = growWorkspace(workspace, options,
+                                      image->numRows, image->numColumns);
+        }
+        if (options->tileCache != 0) {
+            /* Tile by tile through the cache, which needs no workspace */
+            image->execTime =
+                inverseHalftoneTiled(image->inputByteImage,
+                                     image->outputByteImage,
+                                     image->numRows, image->numColumns,
+                                     options->gain, options->threshold,
+                                     image->halftoningType,
+                                     options->tileSize, options->numThreads,
+                                     options->tileCache);
+        }
+        else if (workspace == 0) {
+            image->execTime = INVERSE_HALFTONING_NO_MEMORY;
+        }
+        else {
+            image->execTime =
+                inverseHalftoneWithWorkspace(workspace,
+                                             image->inputByteImage,
+                                             image->outputByteImage,
+                                             image->numRows,
+                                             image->numColumns,
+                                             options->gain,
+                                             options->threshold,
+                                             options->timingFlag,
+                                             image->halftoningType);
+        }
+        if (image->execTime >= 0.0) {
+            image->execTime = currentTimeInSeconds() - startTime;
+        }
+        if (options->memoryFlag) {
+            image->peakBytes = imageMemoryPeak();
+        }
+        pushWorkQueue(&pipeline->writeQueue, image);
+    }
+    freeInverseHalftoneWorkspace(workspace);
+}
+
+/*
+Middle stage with options->numLanes images at a time: consecutive
+images of the same size are gathered, up to one per lane, and inverse
+halftoned together by inverseHalftoneBatch.  An image of another size
+or halftoning type starts the next group.  Every image of a group is
+given the time of the group, measured here, divided among them.
+*/
+static void laneComputeStage(BatchPipeline* pipeline)
+{
+    BatchOptions* options = pipeline->options;
+    InverseHalftoneBatchWorkspace* batch = 0;
+    BatchImage* group[MAX_BATCH_LANES];
+    BatchImage* heldImage = 0;          /* first image of the next group */
+    int endOfBatch = 0;
+
+    while (!endOfBatch || (heldImage != 0)) {
+        unsigned char* inputImages[MAX_BATCH_LANES];
+        unsigned char* outputImages[MAX_BATCH_LANES];
+        double execTime, startTime;
+        int numImages = 0, k;
+
+        if (heldImage != 0) {
+            group[numImages++] = heldImage;
+            heldImage = 0;
+        }
+        while (!endOfBatch && (numImages < options->numLanes)) {
+            BatchImage* image =
+                (BatchImage*) popWorkQueue(&pipeline->computeQueue);
+            if (image == 0) {
+                endOfBatch = 1;
+            }
+            else if ((numImages > 0) &&
+                     ((image->numRows != group[0]->numRows) ||
+                      (image->numColumns != group[0]->numColumns) ||
+                      (image->halftoningType != group[0]->halftoningType))) {
+                heldImage = image;
+                break;
+            }
+            else {
+                group[numImages++] = image;
+            }
+        }
+        if (numImages == 0) {
+            break;
+        }
+
+        if (options->memoryFlag) {
+            startImageMemory();
+        }
+        if ((batch == 0) ||
+            (group[0]->numRows > batch->maxRows) ||
+            (group[0]->numColumns > batch->maxColumns)) {
+            int maxRows = group[0]->numRows;
+            int maxColumns = group[0]->numColumns;
+            if (batch != 0) {
+                if (batch->maxRows > maxRows) maxRows = batch->maxRows;
+                if (batch->maxColumns > maxColumns)
+                    maxColumns = batch->maxColumns;
+                freeInverseHalftoneBatchWorkspace(batch);
+            }
+            batch = allocateInverseHalftoneBatchWorkspace(options->numLanes,
+                                                          maxRows,
+                                                          maxColumns);
+        }
+        for (k = 0; k < numImages; k++) {
+            inputImages[k] = group[k]->inputByteImage;
+            outputImages[k] = group[k]->outputByteImage;
+        }
+        startTime = currentTimeInSeconds();
+        execTime = INVERSE_HALFTONING_NO_MEMORY;
+        if (batch != 0) {
+            execTime = inverseHalftoneBatch(batch, inputImages, outputImages,
+                                            numImages, group[0]->numRows,
+                                            group[0]->numColumns,
+                                            options->gain, options->threshold,
+                                            options->timingFlag,
+                                            group[0]->halftoningType);
+        }
+        if (execTime >= 0.0) {
+            execTime = currentTimeInSeconds() - startTime;
+        }
+        for (k = 0; k < numImages; k++) {
+            group[k]->execTime =
+                (execTime < 0.0) ? execTime : execTime / numImages;
+            if (options->memoryFlag) {
+                group[k]->peakBytes = imageMemoryPeak();
+            }
+            pushWorkQueue(&pipeline->writeQueue, group[k]);
+        }
+    }
+    freeInverseHalftoneBatchWorkspace(batch);
+}
+
+/* Put image into the write buffer once the last of its pieces is done */
+static void finishImage(BatchPipeline* pipeline, BatchImage* image)
+{
+    double startTime = image->pieces[0].startTime;
+    double endTime = image->pieces[0].endTime;
+    int k;
+
+    image->execTime = 0.0;
+    for (k = 0; k < image->numPieces; k++) {
+        BatchPiece* piece = &image->pieces[k];
+        if (piece->status < 0.0) {
+            image->execTime = piece->status;
+        }
+        if (piece->startTime < startTime) startTime = piece->startTime;
+        if (piece->endTime > endTime) endTime = piece->endTime;
+    }
+    if (image->execTime == 0.0) {
+        image->execTime = endTime - startTime;
+    }
+    putReorderBuffer(&pipeline->writeBuffer, image->sequence, image);
+}
+
+/* Tile workspace of worker for halftoningType, allocated when first used */
+static TileWorkspace* workerTileWorkspace(BatchPipeline* pipeline,
+                                          BatchWorker* worker,
+                                          int halftoningType, int tileSize)
+{
+    TileWorkspace** tileWorkspace = &worker->tileWorkspaces[halftoningType];
+    if (*tileWorkspace == 0) {
+        *tileWorkspace = allocateTileWorkspace(tileSize, tileSize,
+                                               halftoningType);
+        if (*tileWorkspace != 0) {
+            (*tileWorkspace)->cache = pipeline->options->tileCache;
+        }
+    }
+    return(*tileWorkspace);
+}
+
+/* Inverse halftone one piece of an image on worker workerIndex */
+static void runPiece(BatchPiece* piece, int workerIndex)
+{
+    BatchImage* image = piece->image;
+    BatchPipeline* pipeline = image->pipeline;
+    BatchOptions* options = pipeline->options;
+    BatchWorker* worker = &pipeline->workers[workerIndex];
+
+    piece->startTime = currentTimeInSeconds();
+    if (image->tiledFlag) {
+        TileWorkspace* tileWorkspace =
+            workerTileWorkspace(pipeline, worker, image->halftoningType,
+                                pipeline->tileSize);
+        piece->status = INVERSE_HALFTONING_NO_MEMORY;
+        if (tileWorkspace != 0) {
+            piece->status =
+                inverseHalftoneRegion(tileWorkspace, image->inputByteImage,
+                                      image->numRows, image->numColumns,
+                                      piece->firstRow, piece->firstColumn,
+                                      piece->numRows, piece->numColumns,
+                                      image->outputByteImage +
+                                        (size_t) piece->firstRow *
+                                        image->numColumns +
+                                        piece->firstColumn,
+                                      image->numColumns,
+                                      options->gain, options->threshold);
+        }
+    }
+    else {
+        worker->workspace = growWorkspace(worker->workspace, options,
+                                          image->numRows, image->numColumns);
+        piece->status = INVERSE_HALFTONING_NO_MEMORY;
+        if (worker->workspace != 0) {
+            piece->status =
+                inverseHalftoneWithWorkspace(worker->workspace,
+                                             image->inputByteImage,
+                                             image->outputByteImage,
+                                             image->numRows,
+                                             image->numColumns,
+                                             options->gain,
+                                             options->threshold,
+                                             0, image->halftoningType);
+        }
+    }
+    piece->endTime = currentTimeInSeconds();
+    if (__atomic_sub_fetch(&image->piecesLeft, 1, __ATOMIC_ACQ_REL) == 0) {
+        finishImage(pipeline, image);
+    }
+}
+
+static void pieceTask(void* arg, int workerIndex)
+{
+    runPiece((BatchPiece*) arg, workerIndex);
+}
+
+/*
+Task for one image: queue all its pieces but the first on this
+worker, where idle workers can steal them, and run the first.
+*/
+static void imageTask(void* arg, int workerIndex)
+{
+    BatchImage* image = (BatchImage*) arg;
+    int k;
+
+    for (k = image->numPieces - 1; k > 0; k--) {
+        if (!submitTask(image->pipeline->scheduler, workerIndex,
+                        pieceTask, &image->pieces[k])) {
+            runPiece(&image->pieces[k], workerIndex);
+        }
+    }
+    runPiece(&image->pieces[0], workerIndex);
+}
+
+/* Cut image into pieces of at most tileSize by tileSize pixels */
+static int splitImage(BatchImage* image, int tileSize)
+{
+    int numTileRows = 1, numTileColumns = 1, k;
+
+    if (image->tiledFlag) {
+        numTileRows = (image->numRows + tileSize - 1) / tileSize;
+        numTileColumns = (image->numColumns + tileSize - 1) / tileSize;
+    }
+    else {
+        tileSize = (image->numRows > image->numColumns) ?
+                   image->numRows : image->numColumns;
+    }
+    image->numPieces = numTileRows * numTileColumns;
+    image->piecesLeft = image->numPieces;
+    image->pieces = (BatchPiece*) calloc(image->numPieces, sizeof(BatchPiece));
+    if (image->pieces == 0) {
+        return(0);
+    }
+    for (k = 0; k < image->numPieces; k++) {
+        BatchPiece* piece = &image->pieces[k];
+        piece->image = image;
+        piece->firstRow = (k / numTileColumns) * tileSize;
+        piece->firstColumn = (k % numTileColumns) * tileSize;
+        piece->numRows = image->numRows - piece->firstRow;
+        if (piece->numRows > tileSize) piece->numRows = tileSize;
+        piece->numColumns = image->numColumns - piece->firstColumn;
+        if (piece->numColumns > tileSize) piece->numColumns = tileSize;
+    }
+    return(1);
+}
+
+/*
+Middle stage with options->numWorkers workers: every image becomes a
+task of the scheduler.  An image larger than options->tileSize, or
+DEFAULT_TILE_SIZE, in either dimension, or every image when the tile
+cache is used, is cut into tiles, which its task queues as tasks of
+their own.  At most as many images as the write buffer holds are in
+flight.
+*/
+static void scheduledComputeStage(BatchPipeline* pipeline)
+{
+    BatchOptions* options = pipeline->options;
+    int sequence = 0, before, after;
+    BatchImage* image;
+
+    while ((image = (BatchImage*)
+                popWorkQueue(&pipeline->computeQueue)) != 0) {
+        image->pipeline = pipeline;
+        image->sequence = sequence++;
+        waitReorderBuffer(&pipeline->writeBuffer, image->sequence);
+        image->tiledFlag = (options->tileCache != 0) ||
+                           (image->numRows > pipeline->tileSize) ||
+                           (image->numColumns > pipeline->tileSize);
+        if (!inverseHalftoneSupport(image->halftoningType, &before, &after)) {
+            image->execTime = INVERSE_HALFTONING_BAD_METHOD;
+        }
+        else if (!splitImage(image, pipeline->tileSize)) {
+            image->execTime = INVERSE_HALFTONING_NO_MEMORY;
+        }
+        else if (submitTask(pipeline->scheduler, -1, imageTask, image)) {
+            continue;
+        }
+        else {
+            image->execTime = INVERSE_HALFTONING_NO_MEMORY;
+        }
+        putReorderBuffer(&pipeline->writeBuffer, image->sequence, image);
+    }
+    putReorderBuffer(&pipeline->writeBuffer, sequence, 0);  /* end of batch */
+}
+
+/* Start the scheduler and the workspaces of its workers */
+static int startScheduler(BatchPipeline* pipeline)
+{
+    int numWorkers = pipeline->options->numWorkers;
+
+    pipeline->tileSize = pipeline->options->tileSize;
+    if (pipeline->tileSize < 1) pipeline->tileSize = DEFAULT_TILE_SIZE;
+    pipeline->workers = (BatchWorker*) calloc(numWorkers, sizeof(BatchWorker));
+    if ((pipeline->workers == 0) ||
+        !initReorderBuffer(&pipeline->writeBuffer,
+                           numWorkers + BATCH_QUEUE_LENGTH)) {
+        free(pipeline->workers);
+        pipeline->workers = 0;
+        return(0);
+    }
+    pipeline->scheduler = createTaskScheduler(numWorkers);
+    if (pipeline->scheduler == 0) {
+        destroyReorderBuffer(&pipeline->writeBuffer);
+        free(pipeline->workers);
+        pipeline->workers = 0;
+        return(0);
+    }
+    return(1);
+}
+
+/* Stop the scheduler, once all images are written, and free the workers */
+static void stopScheduler(BatchPipeline* pipeline)
+{
+    int numTasks, numStolen, k, type;
+
+    if (pipeline->options->timingFlag) {
+        getTaskSchedulerStats(pipeline->scheduler, &numTasks, &numStolen);
+        printf("%d tasks on %d workers, %d stolen\n", numTasks,
+               pipeline->scheduler->numWorkers, numStolen);
+    }
+    destroyTaskScheduler(pipeline->scheduler);
+    pipeline->scheduler = 0;
+    for (k = 0; k < pipeline->options->numWorkers; k++) {
+        BatchWorker* worker = &pipeline->workers[k];
+        freeInverseHalftoneWorkspace(worker->workspace);
+        for (type = 0; type <= HALFTONING_BY_CLUSTERED_DITHER; type++) {
+            freeTileWorkspace(worker->tileWorkspaces[type]);
+        }
+    }
+    free(pipeline->workers);
+    destroyReorderBuffer(&pipeline->writeBuffer);
+}
+
+/*
+Inverse halftone all the images named in the file listFileName.  The
+inverse halftoning runs on the calling thread, or on the workers of a
+task scheduler with options->numWorkers; reading and writing run on
+two helper threads.  Return 0 if all images were processed.
+*/
+int runBatchPipeline(char* listFileName, BatchOptions* options)
+{
+    BatchPipeline pipeline;
+    pthread_t readThread, writeThread;
+    double startTime, totalTime;
+
+    memset(&pipeline, 0, sizeof(pipeline));
+    pipeline.options = options;
+    pipeline.listFile = fopen(listFileName, "r");
+    if (pipeline.listFile == 0) {
+        fprintf(stderr, "Error opening file '%s' for reading.\n",
+                listFileName);
+        return(1);
+    }
+    if (!initWorkQueue(&pipeline.computeQueue, BATCH_QUEUE_LENGTH) ||
+        !initWorkQueue(&pipeline.writeQueue, BATCH_QUEUE_LENGTH)) {
+        fprintf(stderr, "Could not allocate enough memory for the batch.\n");
+        return(1);
+    }
+    if ((options->numWorkers > 0) && !startScheduler(&pipeline)) {
+        fprintf(stderr, "Could not start the batch workers.\n");
+        return(1);
+    }
+
+    startTime = currentTimeInSeconds();
+    if (pthread_create(&readThread, 0, readStage, &pipeline) ||
+        pthread_create(&writeThread, 0, writeStage, &pipeline)) {
+        fprintf(stderr, "Could not start the batch threads.\n");
+        return(1);
+    }
+
+    if (pipeline.scheduler != 0) {
+        scheduledComputeStage(&pipeline);
+    }
+    else if (options->numLanes > 1) {
+        laneComputeStage(&pipeline);
+    }
+    else {
+        computeStage(&pipeline);
+    }
+    pushWorkQueue(&pipeline.writeQueue, 0);            /* end of batch */
+
+    pthread_join(readThread, 0);
+    pthread_join(writeThread, 0);
+    totalTime = currentTimeInSeconds() - startTime;
+
+    if (options->timingFlag) {
+        printf("%d images in %f sec (%f images/sec)\n",
+               pipeline.numImages, totalTime,
+               (totalTime > 0.0) ? pipeline.numImages / totalTime : 0.0);
+    }
+    if (pipeline.scheduler != 0) {
+        stopScheduler(&pipeline);
+    }
+    if (pipeline.numMeasured > 0) {
+        ImageMetrics* sum = &pipeline.metricsSum;
+        sum->mse /= pipeline.numMeasured;
+        sum->psnr /= pipeline.numMeasured;
+        sum->ssim /= pipeline.numMeasured;
+        sum->wsnr /= pipeline.numMeasured;
+        printf("Average of %d images: ", pipeline.numMeasured);
+        printImageMetrics(stdout, sum);
+    }
+
+    destroyWorkQueue(&pipeline.computeQueue);
+    destroyWorkQueue(&pipeline.writeQueue);
+    fclose(pipeline.listFile);
+
+    return((pipeline.numErrors + pipeline.numReadErrors) != 0);
+}
@@ -0,0 +1,49 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _BATCH_PIPELINE_H
+#define _BATCH_PIPELINE_H
+
+#include "tile_cache.h"
+
+/* Number of images in flight between two pipeline stages */
+#define BATCH_QUEUE_LENGTH 2
+
+/* Parameters shared by all images of a batch */
+typedef struct BatchOptions {
+    int threshold;
+    int gain;
+    int halftoningType;         /* HALFTONING_BY_DETECTION to classify */
+    int fastErrorDiffusion;     /* see chooseHalftoningType */
+    int numRows;                /* size of raw images */
+    int numColumns;
+    int timingFlag;
+    int numThreads;             /* threads for quality metrics, 0 for all */
+    int qualityLevel;           /* see setInverseHalftoneQuality */
+    int recursiveStages;        /* see setInverseHalftoneRecursiveFilters */
+    double sigmaScale;
+    int tileSize;               /* tile size for the cache and workers */
+    TileCache* tileCache;       /* null pointer for no cache */
+    int memoryFlag;             /* report the peak memory per image */
+    int numLanes;               /* images per inverseHalftoneBatch, or 0 */
+    int pipelineFlag;           /* see setInverseHalftonePipeline */
+    int numWorkers;             /* work-stealing workers, or 0 */
+} BatchOptions;
+
+int runBatchPipeline(char* listFileName, BatchOptions* options);
+
+#endif
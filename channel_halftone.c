@@ -0,0 +1,142 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Inverse halftoning of color halftones, such as the separations of a
+printed page, one channel at a time.  Every channel is a halftone of
+its own, so the channels are inverse halftoned independently, either
+on threads of their own or interleaved through inverseHalftoneBatch.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "channel_halftone.h"
+#include "image_io.h"
+#include "inverse_halftone.h"
+#include "thread_utils.h"
+#include "timer_utils.h"
+
+/* The channels, and the result of every chunk of them */
+typedef struct ChannelJob {
+    unsigned char* inputImage;
+    unsigned char* outputImage;
+    int numRows;
+    int numColumns;
+    int gain;
+    int threshold;
+    int halftoningType;
+    double status[MAX_IMAGE_CHANNELS];
+} ChannelJob;
+
+/* Inverse halftone channels first through last - 1 with one workspace */
+static void channelTask(void* arg, int first, int last, int chunkIndex)
+{
+    ChannelJob* job = (ChannelJob*) arg;
+    size_t numPixels = (size_t) job->numRows * job->numColumns;
+    InverseHalftoneWorkspace* workspace =
+        allocateInverseHalftoneWorkspace(job->numRows, job->numColumns);
+    int k;
+
+    job->status[chunkIndex] = INVERSE_HALFTONING_NO_MEMORY;
+    if (workspace == 0) {
+        return;
+    }
+    for (k = first; k < last; k++) {
+        job->status[chunkIndex] =
+            inverseHalftoneWithWorkspace(workspace,
+                                         job->inputImage + numPixels*k,
+                                         job->outputImage + numPixels*k,
+                                         job->numRows, job->numColumns,
+                                         job->gain, job->threshold, 0,
+                                         job->halftoningType);
+        if (job->status[chunkIndex] < 0.0) {
+            break;
+        }
+    }
+    freeInverseHalftoneWorkspace(workspace);
+}
+
+/*
+Inverse halftone the numChannels planes of inputImage, each of numRows
+by numColumns pixels, into the planes of outputImage, laid out as by
+readChannelImage.  If numLanes is greater than 1, up to numLanes
+channels are inverse halftoned together, interleaved, by
+inverseHalftoneBatch; otherwise the channels are spread over up to
+numThreads threads, each with a workspace that it reuses for all of
+its channels.  The result is the same either way, and the same as
+inverse halftoning each channel on its own.  Returns the wall clock
+time taken, or a negative value on an error.
+*/
+double inverseHalftoneChannels(unsigned char* inputImage,
+                               unsigned char* outputImage,
+                               int numChannels, int numRows, int numColumns,
+                               int gain, int threshold, int halftoningType,
+                               int numThreads, int numLanes)
+{
+    double startTime = currentTimeInSeconds();
+    double status = 0.0;
+    int k;
+
+    if ((numChannels < 1) || (numChannels > MAX_IMAGE_CHANNELS)) {
+        return(INVERSE_HALFTONING_BAD_METHOD);
+    }
+
+    if (numLanes > 1) {
+        size_t numPixels = (size_t) numRows * numColumns;
+        unsigned char* inputImages[MAX_IMAGE_CHANNELS];
+        unsigned char* outputImages[MAX_IMAGE_CHANNELS];
+        InverseHalftoneBatchWorkspace* batch;
+
+        if (numLanes > numChannels) numLanes = numChannels;
+        batch = allocateInverseHalftoneBatchWorkspace(numLanes, numRows,
+                                                      numColumns);
+        for (k = 0; k < numChannels; k++) {
+            inputImages[k] = inputImage + numPixels*k;
+            outputImages[k] = outputImage + numPixels*k;
+        }
+        status = inverseHalftoneBatch(batch, inputImages, outputImages,
+                                      numChannels, numRows, numColumns,
+                                      gain, threshold, 0, halftoningType);
+        freeInverseHalftoneBatchWorkspace(batch);
+    }
+    else {
+        ChannelJob job;
+        int numChunks;
+
+        job.inputImage = inputImage;
+        job.outputImage = outputImage;
+        job.numRows = numRows;
+        job.numColumns = numColumns;
+        job.gain = gain;
+        job.threshold = threshold;
+        job.halftoningType = halftoningType;
+        numChunks = parallelFor(numChannels, numThreads, channelTask, &job);
+        for (k = 0; k < numChunks; k++) {
+            if (job.status[k] < 0.0) {
+                status = job.status[k];
+            }
+        }
+    }
+
+    if (status < 0.0) {
+        return(status);
+    }
+    return(currentTimeInSeconds() - startTime);
+}
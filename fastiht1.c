@@ -62,21 +62,147 @@ explained in the following paper:
 #include "image_io.h"
 #include "matrix_utils.h"
 #include "inverse_halftone.h"
+#include "batch_pipeline.h"
+#include "tiled_halftone.h"
+#include "image_metrics.h"
+#include "memory_usage.h"
+#include "tuning_profile.h"
+#include "channel_halftone.h"
+#include "halftone_classifier.h"
 
 /* Constants */
 
 #define DEFAULT_IMAGE_DIMENSION 512
 
+#define MAX_SWEEP_VALUES 64
+#define MAX_PYRAMID_LEVELS 16
+#define MAX_FILE_NAME_LENGTH 1024
+
 #define TIME_EXECUTION_FLAG 1
 
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
 #define USAGE_STRING \
-  "Usage: %s halfFile inverseFile threshold gain halfType [rows] [columns]\n" \
+  "Usage: %s [options] halfFile inverseFile threshold gain halfType " \
+  "[rows] [columns]\n" \
+  "       %s --batch [options] listFile threshold gain halfType " \
+  "[rows] [columns]\n" \
   "This is a fast inverse halftoning algorithm, where halfType is 1 for\n" \
-  "error diffusion, 2 for dispersed dither, and 3 for clustered dither. The\n" \
-  "infile can be either a raw image or a portable graymap (PGM) file. For\n" \
-  "raw images, the number of rows and number of columns default to %d.\n" \
+  "error diffusion, 2 for dispersed dither, and 3 for clustered dither, or\n" \
+  "auto to tell from the halftone, which is reported. The\n" \
+  "infile can be either a raw image or a portable graymap (PGM) file, or a\n" \
+  "color halftone: a portable pixmap (PPM) file, or with --cmyk, a raw\n" \
+  "image of four planes. For raw images, the number of rows and number of\n" \
+  "columns default to %d.\n" \
   "See http://www.ece.utexas.edu/~bevans/papers/1998/inverse_halftoning/\n" \
-  "for an explanation of the algorithm.\n"
+  "for an explanation of the algorithm.\n" \
+  "Options:\n" \
+  "  --batch        process the 'halfFile inverseFile' pairs listed one\n" \
+  "                 per line in listFile, overlapping reading, processing\n" \
+  "                 and writing\n" \
+  "  --lanes num    with --batch, inverse halftone up to num (at most %d)\n" \
+  "                 consecutive images of the same size together,\n" \
+  "                 interleaved, which is faster for small images; for a\n" \
+  "                 color halftone, interleave up to num of its channels\n" \
+  "                 instead of giving each channel a thread\n" \
+  "  --workers num  with --batch, inverse halftone the images on num\n" \
+  "                 threads that steal work from each other, cutting\n" \
+  "                 images larger than a tile (--tile, or %d pixels)\n" \
+  "                 into tiles; the images are still written in order\n" \
+  "  --cmyk         the raw halftone holds cyan, magenta, yellow and black\n" \
+  "                 planes of rows by columns pixels, one after the other,\n" \
+  "                 255 meaning ink; the inverse halftone is written as a\n" \
+  "                 PPM file of red, green and blue\n" \
+  "  --fast-ed      inverse halftone halftones that look error diffused as\n" \
+  "                 error diffused, which is fastest, whatever halfType\n" \
+  "                 says, reporting the halftoning type used\n" \
+  "  --tile size    process the image in memory-mapped tiles of size by\n" \
+  "                 size pixels, for images larger than memory; auto\n" \
+  "                 takes the size from the tuning profile, or %d\n" \
+  "  --pipeline     run every stage of the algorithm on a thread of its\n" \
+  "                 own, passing rows from one stage to the next, for\n" \
+  "                 large images; the result is unchanged\n" \
+  "  --threads num  number of threads for processing tiles or the channels\n" \
+  "                 of a color halftone, and measuring quality\n" \
+  "  --reference originalFile\n" \
+  "                 report PSNR, MSE, SSIM and weighted SNR against the\n" \
+  "                 original image; in batch mode, give the original as a\n" \
+  "                 third file name on each line of listFile instead\n" \
+  "  --sweep        threshold and gain are lists such as 0,2,4 or 4:8, and\n" \
+  "                 an output is written for every pair of values, with\n" \
+  "                 _t<threshold>_g<gain> added to the inverseFile name\n" \
+  "  --sparse size  skip the edge map on tiles of size by size pixels that\n" \
+  "                 provably have no edges; the result is unchanged\n" \
+  "  --stage-times  report the time spent in every stage, and the tiles\n" \
+  "                 skipped by --sparse\n" \
+  "  --counters     also report hardware performance counters for every\n" \
+  "                 stage: instructions per cycle, cycles and cache misses\n" \
+  "                 per pixel, and the branch misprediction rate\n" \
+  "  --memory       report the memory allocated for images and\n" \
+  "                 intermediate results: the peak of every stage, the\n" \
+  "                 peak of every image in batch mode, and the overall peak\n" \
+  "  --quality level 3 for the whole algorithm (default), 2 to skip the\n" \
+  "                 median filter, or 1 for the first smoothing filter only\n" \
+  "  --recursive filters\n" \
+  "                 replace the Gaussian filters in the list, such as 1,2,3,\n" \
+  "                 by recursive filters, whose cost does not depend on\n" \
+  "                 their width\n" \
+  "  --resolution dpi\n" \
+  "                 widen the recursive filters, all of them unless\n" \
+  "                 --recursive is given, in proportion to the resolution\n" \
+  "                 of the halftone; the filters are designed for %d dpi\n" \
+  "  --reduce level write the inverse halftone reduced 2^level times in\n" \
+  "                 each direction, computed at the reduced size\n" \
+  "  --pyramid levels\n" \
+  "                 write the inverse halftone at full size and reduced 2,\n" \
+  "                 4, ... 2^levels times, with _l<level> added to the\n" \
+  "                 inverseFile name, all from one pass over the input\n" \
+  "  --region x,y,width,height\n" \
+  "                 write only the width by height pixels whose upper left\n" \
+  "                 corner is in column x and row y, reading only the rows\n" \
+  "                 the region depends on\n" \
+  "  --cache megabytes\n" \
+  "                 keep up to megabytes of inverse halftoned tiles in\n" \
+  "                 memory and copy repeated tiles instead of computing\n" \
+  "                 them again; implies --tile auto unless --tile is\n" \
+  "                 given, with tiles of %d by %d pixels if untuned\n" \
+  "  --cache-dir directory\n" \
+  "                 also keep the tiles in directory, for later runs\n" \
+  "  --kernel list  select the implementation of the stages, as a list of\n" \
+  "                 stage=kernel items, or of kernel names for all the\n" \
+  "                 stages that have them, such as reference or\n" \
+  "                 median=reference,edge-map=sliding; the stages and\n" \
+  "                 their kernels, the fastest being the default, are\n" \
+  "                 smoothing: reference, unrolled\n" \
+  "                 median: reference, network\n" \
+  "                 cascade: reference, rolling\n" \
+  "                 edge-map: reference, sliding\n" \
+  "                 output: reference\n" \
+  "  --verify       also run every stage with the reference kernel on the\n" \
+  "                 input of the stage, and report the largest difference\n" \
+  "                 and the first differing pixel; exit with status 1 if\n" \
+  "                 any stage differs\n" \
+  "The kernels, tile size and number of threads default to those in the\n" \
+  "tuning profile written by fastihttune, the file named by $%s\n" \
+  "or ~/%s, if there is one; the options override it.\n"
+
+/* Print the usage information and exit */
+static void usage(char *programName)
+{
+    fprintf(stderr, USAGE_STRING, programName, programName,
+            DEFAULT_IMAGE_DIMENSION, MAX_BATCH_LANES, DEFAULT_TILE_SIZE,
+            DEFAULT_TILE_SIZE,
+            REFERENCE_RESOLUTION_DPI, DEFAULT_CACHE_TILE_SIZE,
+            DEFAULT_CACHE_TILE_SIZE, TUNING_PROFILE_VARIABLE,
+            DEFAULT_TUNING_PROFILE);
+    exit(1);
+}
 
 /* Read an integer from the string numericStr; and exit program on failure. */
 static int readIntArg(char *descStr, char *numericStr, int minValue) {
@@ -96,55 +222,855 @@ static int readIntArg(char *descStr, char *numericStr, int minValue) {
     return(readValue);
 }
 
+/*
+Read a comma-separated list of integers, each of which may be a range
+first:last, from the string listStr into values.  Return the number of
+values read, and exit program on failure.
+*/
+static int readIntListArg(char *descStr, char *listStr, int minValue,
+                          int *values, int maxValues)
+{
+    char buffer[MAX_FILE_NAME_LENGTH];
+    char *token;
+    int numValues = 0;
+
+    strncpy(buffer, listStr, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = 0;
+    for (token = strtok(buffer, ","); token != 0; token = strtok(0, ",")) {
+        char *colon = strchr(token, ':');
+        int first, last, value;
+        if (colon != 0) {
+            *colon = 0;
+            first = readIntArg(descStr, token, minValue);
+            last = readIntArg(descStr, colon + 1, first);
+        }
+        else {
+            first = last = readIntArg(descStr, token, minValue);
+        }
+        for (value = first; value <= last; value++) {
+            if (numValues == maxValues) {
+                fprintf(stderr, "%s, %s, has more than %d values.\n",
+                        descStr, listStr, maxValues);
+                exit(1);
+            }
+            values[numValues++] = value;
+        }
+    }
+    if (numValues == 0) {
+        fprintf(stderr, "%s, %s, is not a list of integers.\n",
+                descStr, listStr);
+        exit(1);
+    }
+    return(numValues);
+}
+
+/* Insert _t<threshold>_g<gain> before the extension of fileName */
+static void sweepFileName(char *buffer, char *fileName,
+                          int threshold, int gain)
+{
+    char *extension = strrchr(fileName, '.');
+    char *slash = strrchr(fileName, '/');
+    int baseLength = (int) strlen(fileName);
+
+    if ((extension != 0) && ((slash == 0) || (extension > slash))) {
+        baseLength = (int) (extension - fileName);
+    }
+    else {
+        extension = "";
+    }
+    sprintf(buffer, "%.*s_t%d_g%d%s", baseLength, fileName,
+            threshold, gain, extension);
+}
+
+/* Insert _l<level> before the extension of fileName */
+static void levelFileName(char *buffer, char *fileName, int level)
+{
+    char *extension = strrchr(fileName, '.');
+    char *slash = strrchr(fileName, '/');
+    int baseLength = (int) strlen(fileName);
+
+    if ((extension != 0) && ((slash == 0) || (extension > slash))) {
+        baseLength = (int) (extension - fileName);
+    }
+    else {
+        extension = "";
+    }
+    sprintf(buffer, "%.*s_l%d%s", baseLength, fileName, level, extension);
+}
+
+/* Print the quality of image measured against reference after label */
+static void reportMetrics(char *label, unsigned char *image,
+                          unsigned char *reference,
+                          int numRows, int numColumns, int numThreads)
+{
+    ImageMetrics metrics;
+
+    if (computeImageMetrics(image, reference, numRows, numColumns,
+                            numThreads, &metrics)) {
+        printf("%s: ", label);
+        printImageMetrics(stdout, &metrics);
+    }
+    else {
+        fprintf(stderr, "Could not allocate enough memory for metrics.\n");
+    }
+}
+
+/*
+Inverse halftone the image in halfFile for every pair of thresholds and
+gains, sharing the stages that do not depend on them.  Return the exit
+status.
+*/
+static int runSweep(char *halfFile, char *inverseFile,
+                    int *thresholds, int numThresholds,
+                    int *gains, int numGains,
+                    int numRows, int numColumns, int halftoningType,
+                    char *referenceFile, int numThreads)
+{
+    unsigned char *inputByteImage = 0, *referenceByteImage = 0;
+    unsigned char *outputByteImages[MAX_SWEEP_VALUES*MAX_SWEEP_VALUES];
+    InverseHalftoneWorkspace *workspace = 0;
+    int imageType, t, g;
+    double execTime;
+
+    imageType = readByteImage(halfFile, &inputByteImage,
+                              &numRows, &numColumns);
+    if (referenceFile != 0) {
+        referenceByteImage = readReferenceImage(referenceFile,
+                                                numRows, numColumns);
+        if (referenceByteImage == 0) {
+            return(1);
+        }
+    }
+    for (t = 0; t < numThresholds*numGains; t++) {
+        outputByteImages[t] = allocateByteImage(numRows, numColumns);
+        if (outputByteImages[t] == 0) {
+            fprintf(stderr, "Could not allocate enough memory for images.\n");
+            exit(1);
+        }
+    }
+    workspace = allocateInverseHalftoneWorkspace(numRows, numColumns);
+
+    execTime = inverseHalftoneSweep(workspace, inputByteImage,
+                                    outputByteImages, numRows, numColumns,
+                                    thresholds, numThresholds,
+                                    gains, numGains,
+                                    TIME_EXECUTION_FLAG, halftoningType);
+    if (execTime == INVERSE_HALFTONING_NO_MEMORY) {
+        fprintf(stderr,
+          "Could not allocate enough memory in the inverseHalftone routine.\n");
+        return(1);
+    }
+    if (execTime == INVERSE_HALFTONING_BAD_METHOD) {
+        fprintf(stderr, "Invalid halftoning method %d specified.\n",
+                halftoningType);
+        return(1);
+    }
+
+    /* Report computation time and save the results */
+    printf("%f sec for %d outputs\n", execTime, numThresholds*numGains);
+    for (t = 0; t < numThresholds; t++) {
+        for (g = 0; g < numGains; g++) {
+            char fileName[MAX_FILE_NAME_LENGTH + 32];
+            sweepFileName(fileName, inverseFile, thresholds[t], gains[g]);
+            writeByteImage(fileName, outputByteImages[t*numGains + g],
+                           &numRows, &numColumns, imageType);
+            if (referenceByteImage != 0) {
+                reportMetrics(fileName, outputByteImages[t*numGains + g],
+                              referenceByteImage, numRows, numColumns,
+                              numThreads);
+            }
+            freeByteImage(outputByteImages[t*numGains + g]);
+        }
+    }
+
+    freeInverseHalftoneWorkspace(workspace);
+    freeByteImage(inputByteImage);
+    freeByteImage(referenceByteImage);
+    return(0);
+}
+
+/*
+Inverse halftone the image in halfFile at levels firstLevel through
+lastLevel of the resolution pyramid.  A single level is written to
+inverseFile, and several to inverseFile with _l<level> added.  Return
+the exit status.  If stageTimesFlag is TRUE, the time spent in every
+stage over all levels is printed, with the events counted by
+perfCounters unless it is a null pointer.  If memoryFlag is TRUE, the
+peak memory of every stage is printed.
+*/
+static int runPyramid(char *halfFile, char *inverseFile,
+                      int firstLevel, int lastLevel,
+                      int numRows, int numColumns,
+                      int gain, int threshold, int halftoningType,
+                      int stageTimesFlag, PerfCounters *perfCounters,
+                      int memoryFlag)
+{
+    unsigned char *inputByteImage = 0;
+    unsigned char *outputByteImages[MAX_PYRAMID_LEVELS + 1];
+    InverseHalftoneWorkspace *workspace = 0;
+    int imageType, level;
+    double execTime;
+
+    imageType = readByteImage(halfFile, &inputByteImage,
+                              &numRows, &numColumns);
+    for (level = firstLevel; level <= lastLevel; level++) {
+        outputByteImages[level - firstLevel] =
+            allocateByteImage(pyramidLevelSize(numRows, level),
+                              pyramidLevelSize(numColumns, level));
+        if (outputByteImages[level - firstLevel] == 0) {
+            fprintf(stderr, "Could not allocate enough memory for images.\n");
+            exit(1);
+        }
+    }
+    workspace = allocateInverseHalftoneWorkspace(numRows, numColumns);
+    if (workspace != 0) {
+        setInverseHalftoneCounters(workspace, perfCounters);
+    }
+
+    execTime = inverseHalftonePyramid(workspace, inputByteImage,
+                                      outputByteImages, numRows, numColumns,
+                                      firstLevel, lastLevel, gain, threshold,
+                                      TIME_EXECUTION_FLAG, halftoningType);
+    if (execTime == INVERSE_HALFTONING_NO_MEMORY) {
+        fprintf(stderr,
+          "Could not allocate enough memory in the inverseHalftone routine.\n");
+        return(1);
+    }
+    if (execTime == INVERSE_HALFTONING_BAD_METHOD) {
+        fprintf(stderr, "Invalid halftoning method %d specified.\n",
+                halftoningType);
+        return(1);
+    }
+
+    /* Report computation time and save the results */
+    printf("%f sec for %d levels\n", execTime, lastLevel - firstLevel + 1);
+    if (stageTimesFlag) {
+        printInverseHalftoneStats(stdout, &workspace->stats);
+    }
+    if (memoryFlag) {
+        printInverseHalftoneMemory(stdout, &workspace->stats);
+    }
+    for (level = firstLevel; level <= lastLevel; level++) {
+        char fileName[MAX_FILE_NAME_LENGTH + 32];
+        int levelRows = pyramidLevelSize(numRows, level);
+        int levelColumns = pyramidLevelSize(numColumns, level);
+        if (firstLevel == lastLevel) {
+            strcpy(fileName, inverseFile);
+        }
+        else {
+            levelFileName(fileName, inverseFile, level);
+        }
+        writeByteImage(fileName, outputByteImages[level - firstLevel],
+                       &levelRows, &levelColumns, imageType);
+        freeByteImage(outputByteImages[level - firstLevel]);
+    }
+
+    freeInverseHalftoneWorkspace(workspace);
+    freeByteImage(inputByteImage);
+    return(0);
+}
+
+/* Return the value of the option argv[*argIndexPtr], and exit if missing */
+static char* readOptionValue(int argc, char *argv[], int *argIndexPtr)
+{
+    if (*argIndexPtr + 1 >= argc) {
+        fprintf(stderr, "Option '%s' needs a value.\n", argv[*argIndexPtr]);
+        usage(argv[0]);
+    }
+    (*argIndexPtr)++;
+    return(argv[*argIndexPtr]);
+}
+
+/* Print the memory in use and the peak so far if memoryFlag is TRUE */
+static void reportMemory(int memoryFlag)
+{
+    MemoryUsage usage;
+
+    if (memoryFlag) {
+        getMemoryUsage(&usage);
+        printMemoryUsage(stdout, "memory", &usage);
+    }
+}
+
+/*
+Check the kernels of workspace against the reference kernels on the
+input image and print the differences.  Returns 0 if no stage
+differs, and 1 otherwise.
+*/
+static int runVerify(InverseHalftoneWorkspace* workspace,
+                     unsigned char* inputByteImage,
+                     int numRows, int numColumns, int gain, int threshold,
+                     int halftoningType)
+{
+    KernelMismatch mismatches[NUM_INVERSE_HALFTONE_STAGES];
+    int stage, status = 0;
+
+    if (verifyInverseHalftoneKernels(workspace, inputByteImage,
+                                     numRows, numColumns, gain, threshold,
+                                     halftoningType, mismatches) < 0.0) {
+        fprintf(stderr, "Could not allocate enough memory to verify the "
+                "kernels.\n");
+        return(1);
+    }
+    printKernelMismatches(stdout, workspace, mismatches);
+    for (stage = 0; stage < NUM_INVERSE_HALFTONE_STAGES; stage++) {
+        if (mismatches[stage].numPixels > 0.0) {
+            status = 1;
+        }
+    }
+    return(status);
+}
+
 /* Main routine */
 int main(int argc, char *argv[])
 {
     unsigned char *inputByteImage = 0, *outputByteImage = 0;
+    unsigned char *referenceByteImage = 0;
+    char *referenceFile = 0;
+    InverseHalftoneWorkspace *workspace = 0;
     int gain = 0, threshold = 0;
     int numRows = DEFAULT_IMAGE_DIMENSION,
         numColumns = DEFAULT_IMAGE_DIMENSION;
-    int exitStatus = 0;
+    int exitStatus = 0, verifyStatus = 0;
     int halftoningType = 0, imageType = 0;
+    int batchFlag = FALSE, numLanes = 0, numWorkers = 0;
+    int cmykFlag = FALSE, numChannels = 1;
+    int fastErrorDiffusion = FALSE;
+    int pipelineFlag = FALSE;
+    int tileSize = 0, numThreads = 0, autoTileFlag = FALSE;
+    int sweepFlag = FALSE;
+    int sparseTileSize = 0, stageTimesFlag = FALSE;
+    int qualityLevel = INVERSE_HALFTONE_QUALITY_FULL;
+    int recursiveStages = 0, resolution = 0;
+    int reduceLevel = 0, pyramidLevels = 0;
+    int region[4], regionFlag = FALSE;
+    int cacheMegabytes = 0;
+    char *cacheDirectory = 0;
+    TileCache *tileCache = 0;
+    int countersFlag = FALSE, memoryFlag = FALSE;
+    int verifyFlag = FALSE;
+    int status;
+    PerfCounters *perfCounters = 0;
+    int thresholds[MAX_SWEEP_VALUES], gains[MAX_SWEEP_VALUES];
+    int numThresholds = 1, numGains = 1;
+    int argIndex = 1, numFileArgs = 0, numParams = 0;
+    char **params = 0;
     double execTime = 0.0;
+    TuningProfile profile;
+
+    /* Start from the configuration tuned for this machine, if any */
+    loadTuningProfile(&profile);
+    if ((profile.kernels[0] != 0) &&
+        !selectInverseHalftoneKernels(profile.kernels)) {
+        fprintf(stderr, "Ignoring the kernels, %s, of the tuning profile.\n",
+                profile.kernels);
+    }
+    numThreads = profile.numThreads;
+
+    /* Parse the options that precede the positional arguments */
+    while ((argIndex < argc) && (strncmp(argv[argIndex], "--", 2) == 0)) {
+        if (strcmp(argv[argIndex], "--batch") == 0) {
+            batchFlag = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--lanes") == 0) {
+            numLanes = readIntArg("Number of lanes",
+                                  readOptionValue(argc, argv, &argIndex), 1);
+            if (numLanes > MAX_BATCH_LANES) {
+                fprintf(stderr, "Number of lanes, %d, is greater than %d.\n",
+                        numLanes, MAX_BATCH_LANES);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[argIndex], "--workers") == 0) {
+            numWorkers = readIntArg("Number of workers",
+                                    readOptionValue(argc, argv, &argIndex), 1);
+        }
+        else if (strcmp(argv[argIndex], "--cmyk") == 0) {
+            cmykFlag = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--fast-ed") == 0) {
+            fastErrorDiffusion = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--tile") == 0) {
+            char *tileValue = readOptionValue(argc, argv, &argIndex);
+            if (strcmp(tileValue, "auto") == 0) {
+                autoTileFlag = TRUE;
+            }
+            else {
+                tileSize = readIntArg("Tile size", tileValue, 1);
+                autoTileFlag = FALSE;
+            }
+        }
+        else if (strcmp(argv[argIndex], "--pipeline") == 0) {
+            pipelineFlag = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--threads") == 0) {
+            numThreads = readIntArg("Number of threads",
+                                    readOptionValue(argc, argv, &argIndex), 1);
+        }
+        else if (strcmp(argv[argIndex], "--sweep") == 0) {
+            sweepFlag = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--sparse") == 0) {
+            sparseTileSize = readIntArg("Sparse tile size",
+                                        readOptionValue(argc, argv, &argIndex),
+                                        MIN_SPARSE_TILE_SIZE);
+        }
+        else if (strcmp(argv[argIndex], "--stage-times") == 0) {
+            stageTimesFlag = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--memory") == 0) {
+            memoryFlag = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--counters") == 0) {
+            countersFlag = TRUE;
+            stageTimesFlag = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--quality") == 0) {
+            qualityLevel = readIntArg("Quality level",
+                                      readOptionValue(argc, argv, &argIndex),
+                                      INVERSE_HALFTONE_QUALITY_SMOOTHING);
+            if (qualityLevel > INVERSE_HALFTONE_QUALITY_FULL) {
+                fprintf(stderr, "Quality level, %d, is greater than %d.\n",
+                        qualityLevel, INVERSE_HALFTONE_QUALITY_FULL);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[argIndex], "--recursive") == 0) {
+            int stages[MAX_SWEEP_VALUES];
+            int k, numStages = readIntListArg("Recursive filter",
+                                    readOptionValue(argc, argv, &argIndex),
+                                    1, stages, MAX_SWEEP_VALUES);
+            for (k = 0; k < numStages; k++) {
+                if (stages[k] > 3) {
+                    fprintf(stderr, "Recursive filter, %d, is not 1, 2 "
+                            "or 3.\n", stages[k]);
+                    exit(1);
+                }
+                recursiveStages |= 1 << (stages[k] - 1);
+            }
+        }
+        else if (strcmp(argv[argIndex], "--resolution") == 0) {
+            resolution = readIntArg("Resolution",
+                                    readOptionValue(argc, argv, &argIndex), 1);
+        }
+        else if (strcmp(argv[argIndex], "--reduce") == 0) {
+            reduceLevel = readIntArg("Reduction level",
+                                     readOptionValue(argc, argv, &argIndex),
+                                     1);
+        }
+        else if (strcmp(argv[argIndex], "--pyramid") == 0) {
+            pyramidLevels = readIntArg("Number of pyramid levels",
+                                       readOptionValue(argc, argv, &argIndex),
+                                       1);
+        }
+        else if (strcmp(argv[argIndex], "--region") == 0) {
+            if ((readIntListArg("Region", readOptionValue(argc, argv,
+                                                          &argIndex),
+                                0, region, 4) != 4) ||
+                (region[2] < 1) || (region[3] < 1)) {
+                fprintf(stderr, "Region, %s, is not x,y,width,height with "
+                        "a positive width and height.\n", argv[argIndex]);
+                exit(1);
+            }
+            regionFlag = TRUE;
+        }
+        else if (strcmp(argv[argIndex], "--cache") == 0) {
+            cacheMegabytes = readIntArg("Cache size",
+                                        readOptionValue(argc, argv, &argIndex),
+                                        1);
+        }
+        else if (strcmp(argv[argIndex], "--cache-dir") == 0) {
+            cacheDirectory = readOptionValue(argc, argv, &argIndex);
+        }
+        else if (strcmp(argv[argIndex], "--reference") == 0) {
+            referenceFile = readOptionValue(argc, argv, &argIndex);
+        }
+        else if (strcmp(argv[argIndex], "--kernel") == 0) {
+            char *kernelList = readOptionValue(argc, argv, &argIndex);
+            if (!selectInverseHalftoneKernels(kernelList)) {
+                fprintf(stderr, "Kernel list, %s, names an unknown stage "
+                        "or kernel.\n", kernelList);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[argIndex], "--verify") == 0) {
+            verifyFlag = TRUE;
+        }
+        else {
+            fprintf(stderr, "Unknown option '%s'.\n", argv[argIndex]);
+            usage(argv[0]);
+        }
+        argIndex++;
+    }
+    params = &argv[argIndex];
+    numParams = argc - argIndex;
+    numFileArgs = batchFlag ? 1 : 2;
+
+    if (autoTileFlag) {
+        tileSize = (profile.tileSize > 0) ? profile.tileSize :
+                                            DEFAULT_TILE_SIZE;
+    }
 
     /* Check for the right number of arguments */
-    if ((argc < 6) || (argc > 8)) {
-        fprintf(stderr, USAGE_STRING, argv[0], DEFAULT_IMAGE_DIMENSION);
+    if ((numParams < numFileArgs + 3) || (numParams > numFileArgs + 5)) {
         fprintf(stderr,
-                "You passed %d arguments and 5-7 arguments are required.\n",
-                argc - 1);
-        exit(1);
+                "You passed %d arguments and %d-%d arguments are required.\n",
+                numParams, numFileArgs + 3, numFileArgs + 5);
+        usage(argv[0]);
     }
 
     /* Get parameters */
-    threshold = readIntArg("Threshold", argv[3], 0);
-    gain = readIntArg("Gain", argv[4], 0);
-    halftoningType = readIntArg("Type of halftoning", argv[5],
-                                 HALFTONING_BY_ERROR_DIFFUSION);
-    if (argc >= 7) {
-        numRows = readIntArg("Number of rows", argv[6], 1);
+    if (sweepFlag) {
+        numThresholds = readIntListArg("Threshold", params[numFileArgs], 0,
+                                       thresholds, MAX_SWEEP_VALUES);
+        numGains = readIntListArg("Gain", params[numFileArgs + 1], 0,
+                                  gains, MAX_SWEEP_VALUES);
+    }
+    else {
+        threshold = readIntArg("Threshold", params[numFileArgs], 0);
+        gain = readIntArg("Gain", params[numFileArgs + 1], 0);
+    }
+    if (strcmp(params[numFileArgs + 2], "auto") == 0) {
+        halftoningType = HALFTONING_BY_DETECTION;
+    }
+    else {
+        halftoningType = readIntArg("Type of halftoning",
+                                    params[numFileArgs + 2],
+                                    HALFTONING_BY_ERROR_DIFFUSION);
+    }
+    if (numParams >= numFileArgs + 4) {
+        numRows = readIntArg("Number of rows", params[numFileArgs + 3], 1);
     }
-    if (argc == 8) {
-        numColumns = readIntArg("Number of columns", argv[7], 1);
+    if (numParams == numFileArgs + 5) {
+        numColumns = readIntArg("Number of columns", params[numFileArgs + 4], 1);
     }
     else {
         numColumns = numRows;
     }
 
-    /* Read the halftoned image: the filename is given by argv[1] */
-    imageType = readByteImage(argv[1], &inputByteImage, &numRows, &numColumns);
+    if ((cacheMegabytes > 0) || (cacheDirectory != 0)) {
+        if (sweepFlag || regionFlag || (sparseTileSize > 0) ||
+            stageTimesFlag ||
+            (qualityLevel != INVERSE_HALFTONE_QUALITY_FULL) ||
+            (recursiveStages != 0) || (resolution > 0) ||
+            (reduceLevel > 0) || (pyramidLevels > 0)) {
+            fprintf(stderr, "The --cache and --cache-dir options can only be "
+                    "combined with --batch, --workers, --tile, --threads "
+                    "and --reference.\n");
+            exit(1);
+        }
+        tileCache = allocateTileCache((size_t) cacheMegabytes << 20,
+                                      cacheDirectory);
+        if (tileCache == 0) {
+            fprintf(stderr, "Could not allocate the tile cache.\n");
+            exit(1);
+        }
+        if (tileSize == 0) {
+            tileSize = (profile.tileSize > 0) ? profile.tileSize :
+                                                DEFAULT_CACHE_TILE_SIZE;
+        }
+    }
+
+    if ((sparseTileSize > 0 || stageTimesFlag) &&
+        (sweepFlag || batchFlag || (tileSize > 0))) {
+        fprintf(stderr, "The --sparse, --stage-times and --counters options "
+                "cannot be combined with --sweep, --batch or --tile.\n");
+        exit(1);
+    }
+    if (countersFlag) {
+        perfCounters = openPerfCounters();
+        if (perfCounters == 0) {
+            fprintf(stderr, "Hardware performance counters are not "
+                    "available.\n");
+        }
+    }
+    if ((qualityLevel != INVERSE_HALFTONE_QUALITY_FULL) &&
+        (sweepFlag || (tileSize > 0))) {
+        fprintf(stderr, "The --quality option cannot be combined with "
+                "--sweep or --tile.\n");
+        exit(1);
+    }
+    if ((resolution > 0) && (recursiveStages == 0)) {
+        recursiveStages = RECURSIVE_FIRST_FILTER | RECURSIVE_SECOND_FILTER |
+                          RECURSIVE_THIRD_FILTER;
+    }
+    if (resolution == 0) {
+        resolution = REFERENCE_RESOLUTION_DPI;
+    }
+    if ((recursiveStages != 0) && (sweepFlag || (tileSize > 0))) {
+        fprintf(stderr, "The --recursive and --resolution options cannot be "
+                "combined with --sweep or --tile.\n");
+        exit(1);
+    }
+
+    if ((numLanes > 0) &&
+        ((tileSize > 0) || (tileCache != 0) || sweepFlag || regionFlag ||
+         (reduceLevel > 0) || (pyramidLevels > 0) ||
+         (qualityLevel != INVERSE_HALFTONE_QUALITY_FULL) ||
+         (recursiveStages != 0))) {
+        fprintf(stderr, "The --lanes option cannot be combined with --tile, "
+                "--cache, --sweep, --region, --reduce, --pyramid, --quality, "
+                "--recursive or --resolution.\n");
+        exit(1);
+    }
+    if (cmykFlag &&
+        (batchFlag || (tileSize > 0) || sweepFlag || regionFlag ||
+         (reduceLevel > 0) || (pyramidLevels > 0))) {
+        fprintf(stderr, "The --cmyk option cannot be combined with --batch, "
+                "--tile, --cache, --sweep, --region, --reduce or "
+                "--pyramid.\n");
+        exit(1);
+    }
+
+    if (((halftoningType == HALFTONING_BY_DETECTION) || fastErrorDiffusion) &&
+        (((tileSize > 0) && !batchFlag) || sweepFlag || regionFlag ||
+         (reduceLevel > 0) || (pyramidLevels > 0))) {
+        fprintf(stderr, "The auto halfType and the --fast-ed option cannot "
+                "be combined with --tile, --sweep, --region, --reduce or "
+                "--pyramid.\n");
+        exit(1);
+    }
+
+    if (pipelineFlag &&
+        ((tileSize > 0) || (tileCache != 0) || sweepFlag || regionFlag ||
+         (reduceLevel > 0) || (pyramidLevels > 0) || (numLanes > 0) ||
+         (sparseTileSize > 0) || stageTimesFlag || verifyFlag ||
+         (qualityLevel != INVERSE_HALFTONE_QUALITY_FULL) ||
+         (recursiveStages != 0))) {
+        fprintf(stderr, "The --pipeline option cannot be combined with "
+                "--tile, --cache, --sweep, --region, --reduce, --pyramid, "
+                "--lanes, --sparse, --stage-times, --counters, --verify, "
+                "--quality, --recursive or --resolution.\n");
+        exit(1);
+    }
+
+    if ((numWorkers > 0) &&
+        (!batchFlag || (numLanes > 0) || pipelineFlag || memoryFlag ||
+         (qualityLevel != INVERSE_HALFTONE_QUALITY_FULL) ||
+         (recursiveStages != 0))) {
+        fprintf(stderr, "The --workers option requires --batch, and cannot "
+                "be combined with --lanes, --pipeline, --memory, --quality, "
+                "--recursive or --resolution.\n");
+        exit(1);
+    }
 
-    /* Allocate the output byte image */
-    outputByteImage = (unsigned char *) malloc(numRows*numColumns*sizeof(char));
-    if (outputByteImage == 0) {
-        fprintf(stderr, "Could not allocate enough memory for images.\n");
+    if (verifyFlag &&
+        (sweepFlag || batchFlag || (tileSize > 0) || regionFlag ||
+         (reduceLevel > 0) || (pyramidLevels > 0))) {
+        fprintf(stderr, "The --verify option cannot be combined with "
+                "--sweep, --batch, --tile, --cache, --region, --reduce or "
+                "--pyramid.\n");
         exit(1);
     }
 
-    /* Process image in variable inputImage and report the time */
-    execTime = inverseHalftone(inputByteImage, outputByteImage,
-                               numRows, numColumns, gain, threshold,
-                               TIME_EXECUTION_FLAG, halftoningType);
+    if ((reduceLevel > 0) || (pyramidLevels > 0)) {
+        int firstLevel = reduceLevel, lastLevel = reduceLevel;
+        if (pyramidLevels > 0) {
+            firstLevel = 0;
+            lastLevel = pyramidLevels;
+        }
+        if (((reduceLevel > 0) && (pyramidLevels > 0)) ||
+            sweepFlag || batchFlag || (tileSize > 0) ||
+            (sparseTileSize > 0) ||
+            (qualityLevel != INVERSE_HALFTONE_QUALITY_FULL) ||
+            (recursiveStages != 0) || (referenceFile != 0) || regionFlag) {
+            fprintf(stderr, "The --reduce and --pyramid options can only be "
+                    "combined with --stage-times and --counters.\n");
+            exit(1);
+        }
+        if (lastLevel > MAX_PYRAMID_LEVELS) {
+            fprintf(stderr, "At most %d pyramid levels are supported.\n",
+                    MAX_PYRAMID_LEVELS);
+            exit(1);
+        }
+        status = runPyramid(params[0], params[1], firstLevel, lastLevel,
+                            numRows, numColumns, gain, threshold,
+                            halftoningType, stageTimesFlag, perfCounters,
+                            memoryFlag);
+        reportMemory(memoryFlag);
+        return(status);
+    }
+
+    /* Process only the region, straight from and to the files */
+    if (regionFlag) {
+        if (sweepFlag || batchFlag || (tileSize > 0) ||
+            (sparseTileSize > 0) || stageTimesFlag ||
+            (qualityLevel != INVERSE_HALFTONE_QUALITY_FULL) ||
+            (recursiveStages != 0) || (referenceFile != 0)) {
+            fprintf(stderr, "The --region option cannot be combined with "
+                    "other options.\n");
+            exit(1);
+        }
+        execTime = inverseHalftoneFileRegion(params[0], params[1],
+                                             &numRows, &numColumns,
+                                             region[1], region[0],
+                                             region[3], region[2],
+                                             gain, threshold, halftoningType);
+        if (execTime < 0.0) {
+            if (execTime == INVERSE_HALFTONING_BAD_METHOD) {
+                fprintf(stderr, "Invalid halftoning method %d specified.\n",
+                        halftoningType);
+            }
+            else if (execTime == INVERSE_HALFTONING_NO_MEMORY) {
+                fprintf(stderr, "Could not allocate enough memory for the "
+                        "region.\n");
+            }
+            return(1);
+        }
+        printf("%f sec\n", execTime);
+        reportMemory(memoryFlag);
+        return(0);
+    }
+
+    if (sweepFlag) {
+        if (batchFlag || (tileSize > 0)) {
+            fprintf(stderr, "The --sweep option cannot be combined with "
+                    "--batch or --tile.\n");
+            exit(1);
+        }
+        status = runSweep(params[0], params[1], thresholds, numThresholds,
+                          gains, numGains, numRows, numColumns,
+                          halftoningType, referenceFile, numThreads);
+        reportMemory(memoryFlag);
+        return(status);
+    }
+
+    /* Process the images listed in the file given by params[0] */
+    if (batchFlag) {
+        BatchOptions batchOptions;
+        if (referenceFile != 0) {
+            fprintf(stderr, "In batch mode, give the original images in "
+                    "the third column of the list file.\n");
+            exit(1);
+        }
+        batchOptions.threshold = threshold;
+        batchOptions.gain = gain;
+        batchOptions.halftoningType = halftoningType;
+        batchOptions.fastErrorDiffusion = fastErrorDiffusion;
+        batchOptions.numRows = numRows;
+        batchOptions.numColumns = numColumns;
+        batchOptions.timingFlag = TIME_EXECUTION_FLAG;
+        batchOptions.numThreads = numThreads;
+        batchOptions.qualityLevel = qualityLevel;
+        batchOptions.recursiveStages = recursiveStages;
+        batchOptions.sigmaScale =
+            (double) resolution / REFERENCE_RESOLUTION_DPI;
+        batchOptions.tileSize = tileSize;
+        batchOptions.tileCache = tileCache;
+        batchOptions.memoryFlag = memoryFlag;
+        batchOptions.numLanes = numLanes;
+        batchOptions.pipelineFlag = pipelineFlag;
+        batchOptions.numWorkers = numWorkers;
+        status = runBatchPipeline(params[0], &batchOptions);
+        if (tileCache != 0) {
+            printTileCacheStats(stdout, tileCache);
+            freeTileCache(tileCache);
+        }
+        reportMemory(memoryFlag);
+        return(status);
+    }
+
+    /* Process the image tile by tile straight from and to the files */
+    if (tileSize > 0) {
+        execTime = inverseHalftoneFileTiled(params[0], params[1],
+                                            &numRows, &numColumns,
+                                            gain, threshold, halftoningType,
+                                            tileSize, numThreads,
+                                            tileCache);
+    }
+    else {
+        /* Read the halftoned image: the filename is given by params[0] */
+        imageType = readChannelImage(params[0], &inputByteImage,
+                                     &numRows, &numColumns, &numChannels,
+                                     cmykFlag);
+        if ((numChannels == 1) && (numLanes > 0) && !batchFlag) {
+            fprintf(stderr, "The --lanes option applies only to --batch "
+                    "and to color halftones.\n");
+            exit(1);
+        }
+        if ((numChannels > 1) &&
+            ((sparseTileSize > 0) || stageTimesFlag || verifyFlag ||
+             (qualityLevel != INVERSE_HALFTONE_QUALITY_FULL) ||
+             (recursiveStages != 0) || (referenceFile != 0) ||
+             pipelineFlag)) {
+            fprintf(stderr, "Color halftones cannot be combined with "
+                    "--sparse, --stage-times, --counters, --verify, "
+                    "--quality, --recursive, --resolution, --reference "
+                    "or --pipeline.\n");
+            exit(1);
+        }
+
+        /* Tell the halftoning type, treating the channels as one image */
+        if ((halftoningType == HALFTONING_BY_DETECTION) ||
+            fastErrorDiffusion) {
+            halftoningType = chooseHalftoningType(inputByteImage,
+                                                  numRows * numChannels,
+                                                  numColumns, halftoningType,
+                                                  fastErrorDiffusion);
+            if (halftoningType == HALFTONING_NOT_A_HALFTONE) {
+                fprintf(stderr, "'%s' is not a halftone: it has grey levels "
+                        "other than 0 and 255.\n", params[0]);
+                exit(1);
+            }
+            printf("%s: %s\n", params[0], halftoningTypeName(halftoningType));
+        }
+
+        /* Allocate the output byte image */
+        outputByteImage = allocateByteImage(numRows * numChannels,
+                                            numColumns);
+        if (outputByteImage == 0) {
+            fprintf(stderr, "Could not allocate enough memory for images.\n");
+            exit(1);
+        }
+
+        if (numChannels > 1) {
+            /* One channel per thread unless --threads or --lanes is given */
+            execTime = inverseHalftoneChannels(inputByteImage,
+                                               outputByteImage, numChannels,
+                                               numRows, numColumns,
+                                               gain, threshold,
+                                               halftoningType,
+                                               (numThreads > 0) ?
+                                                   numThreads : numChannels,
+                                               numLanes);
+        }
+        else {
+            /* Process image in variable inputImage and report the time */
+            workspace = allocateInverseHalftoneWorkspace(numRows, numColumns);
+            if ((workspace == 0) ||
+                !setInverseHalftoneSparseTiles(workspace, sparseTileSize) ||
+                !setInverseHalftonePipeline(workspace, pipelineFlag) ||
+                !setInverseHalftoneRecursiveFilters(workspace, recursiveStages,
+                                    (double) resolution /
+                                    REFERENCE_RESOLUTION_DPI)) {
+                execTime = INVERSE_HALFTONING_NO_MEMORY;
+            }
+            else {
+                setInverseHalftoneQuality(workspace, qualityLevel);
+                setInverseHalftoneCounters(workspace, perfCounters);
+                execTime = inverseHalftoneWithWorkspace(workspace,
+                                                        inputByteImage,
+                                                        outputByteImage,
+                                                        numRows, numColumns,
+                                                        gain, threshold,
+                                                        TIME_EXECUTION_FLAG,
+                                                        halftoningType);
+                if (stageTimesFlag && (execTime >= 0.0)) {
+                    printInverseHalftoneStats(stdout, &workspace->stats);
+                }
+                if (memoryFlag && (execTime >= 0.0)) {
+                    printInverseHalftoneMemory(stdout, &workspace->stats);
+                }
+                if (verifyFlag && (execTime >= 0.0)) {
+                    verifyStatus = runVerify(workspace, inputByteImage,
+                                             numRows, numColumns, gain,
+                                             threshold, halftoningType);
+                }
+            }
+            freeInverseHalftoneWorkspace(workspace);
+        }
+    }
 
     exitStatus = (execTime < 0.0);
     if (exitStatus) {
@@ -157,6 +1083,11 @@ int main(int argc, char *argv[])
                 "Invalid halftoning method %d specified.\n",
                 halftoningType);
       }
+      else if (execTime == INVERSE_HALFTONING_IO_ERROR) {
+        fprintf(stderr,
+                "Could not inverse halftone '%s' into '%s'.\n",
+                params[0], params[1]);
+      }
       else {
         fprintf(stderr,
           "Error encountered in the inverseHalftone routine.\n");
@@ -165,9 +1096,35 @@ int main(int argc, char *argv[])
     else {
         /* Report computation time and save the result */
         printf("%f sec\n", execTime);
-        writeByteImage(argv[2], outputByteImage,
-                       &numRows, &numColumns, imageType);
+        if (tileCache != 0) {
+            printTileCacheStats(stdout, tileCache);
+        }
+        if (tileSize == 0) {
+            writeChannelImage(params[1], outputByteImage,
+                              &numRows, &numColumns, numChannels, imageType);
+        }
+        else if (referenceFile != 0) {
+            /* The tiled result is only on disk, so read it back */
+            readByteImage(params[1], &outputByteImage, &numRows, &numColumns);
+        }
+
+        /* Measure the result against the original image */
+        if (referenceFile != 0) {
+            referenceByteImage = readReferenceImage(referenceFile,
+                                                    numRows, numColumns);
+            if (referenceByteImage == 0) {
+                exitStatus = 1;
+            }
+            else {
+                reportMetrics(params[1], outputByteImage, referenceByteImage,
+                              numRows, numColumns, numThreads);
+                freeByteImage(referenceByteImage);
+            }
+        }
     }
 
-    return(exitStatus);
+    freeTileCache(tileCache);
+    closePerfCounters(perfCounters);
+    reportMemory(memoryFlag);
+    return(exitStatus || verifyStatus);
 }
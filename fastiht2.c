@@ -38,13 +38,29 @@ or equivalent C compiler.  Run the program using
       
 The arguments are
      
-     halftoneFile input output imageWidth imageHeight
+     [options] halftoneFile output imageWidth imageHeight
 
 where the input file and output file are raw 8-bit grayscale images
 of size xsize by ysize.  The input file is of course binary, and must
 consist of 0 for black and any non-zero integer for white.  With the
 distribution, we have provided a file 'lena_halftone_512x512' which
-is the error diffused halftone of the file 'lena_512x512'.
+is the error diffused halftone of the file 'lena_512x512'.  With the
+--reference option, the program reports the quality of the inverse
+halftone measured against the original greyscale image, e.g.
+
+     ./fastiht2 --reference lena_512x512 lena_halftone_512x512 test2
+
+With --batch, the program inverse halftones the images listed in a
+file, one 'halftoneFile output' pair per line, e.g.
+
+     ./fastiht2 --batch --threads 8 list.txt
+
+The images are cut into strips of rows that are run as tasks of a
+work-stealing scheduler (see task_scheduler.c), so that small and
+large images together keep every thread busy, and the results are
+written in the order of the list.
+
+The algorithm itself is in inverse_halftone2.c.
 */
 
 /*
@@ -62,35 +78,70 @@ explained in the following paper:
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "readWriteImage.h"
 #include "readWritePPM.h"
+#include "inverse_halftone2.h"
+#include "image_io.h"
+#include "image_metrics.h"
+#include "perf_counters.h"
+#include "memory_usage.h"
+#include "tuning_profile.h"
+#include "task_scheduler.h"
+#include "reorder_buffer.h"
+#include "timer_utils.h"
 
 #define DEFAULT_IMAGE_DIMENSION 512
+#define DEFAULT_BATCH_STRIP_HEIGHT 256
+#define MAX_FILE_NAME_LENGTH 1024
 
 #define USAGE_STRING \
-  "Usage: %s infile outfile [xsize] [ysize]\n" \
+  "Usage: %s [--reference originalFile] [--counters] [--memory] " \
+  "[--strip rows] [--threads num] infile outfile [xsize] [ysize]\n" \
+  "       %s --batch [--memory] [--strip rows] [--threads num] " \
+  "listfile [xsize] [ysize]\n" \
   "This is a fast inverse halftoning algorithm for error diffused\n" \
   "halftones. The infile can be either a raw image or a portable\n" \
   "graymap (PGM) file. For raw images, xsize and ysize default to %d.\n" \
+  "With --reference, the PSNR, MSE, SSIM and weighted SNR of the result\n" \
+  "against originalFile are reported.  With --counters, the instructions\n" \
+  "per cycle, cycles and cache misses per pixel, and branch misprediction\n" \
+  "rate of the inverse halftoning are reported from the hardware\n" \
+  "performance counters.  With --memory, the memory allocated for the\n" \
+  "images and the row store is reported.  With --strip and --threads,\n" \
+  "the image is filtered in strips of rows spread over num threads; the\n" \
+  "result is the same.  They default to those in the tuning profile\n" \
+  "written by fastihttune, the file named by $%s or ~/%s, if\n" \
+  "there is one, and otherwise to one strip and one thread.\n" \
+  "With --batch, the 'infile outfile' pairs listed one per line in\n" \
+  "listfile are inverse halftoned in strips by num threads that steal\n" \
+  "images and strips from each other, and written in order.  Unless\n" \
+  "given or tuned, the strips are %d rows and there is a thread per\n" \
+  "processor.\n" \
   "See http://www.ece.utexas.edu/~bevans/papers/1998/error_diffusion/\n" \
   "for an explanation of the algorithm.\n"
 
 struct filedata {                               /* command line arguments */
   FILE *ifp, *ofp;
   short xsize, ysize;
+  char *reference;                              /* original image or 0 */
+  int counters;                                 /* report counters */
+  int memory;                                   /* report memory */
+  int stripHeight;                              /* rows per strip or 0 */
+  int numThreads;                               /* threads for strips */
+  char *list;                                   /* batch list file or 0 */
 };
 
 typedef struct filedata filedata;
 typedef unsigned char pixel;                    /* 8-bit pixels */
-typedef signed char filt;                       /* 8-bit filter coefficients */
-typedef signed short fout;                      /* filter outputs */
 
 /* Allocate and clear memory, and bomb if not available */
 static void* my_alloc(int size)
 {
   static int count=0;
-  void *newptr = (void*) malloc(size);
+  void *newptr = trackedMalloc(size);
   if (!newptr) {
     fprintf(stderr, "Failed to allocate array %d.  Exiting.\n", count);
     exit(-1);
@@ -99,33 +150,104 @@ static void* my_alloc(int size)
   return newptr;
 }
 
-/* Process command line arguments */
-static filedata* process_args(int argc, char *argv[])
+/* Print the usage information and exit */
+static void usage(char *programName)
+{
+  fprintf(stderr, USAGE_STRING, programName, programName,
+          DEFAULT_IMAGE_DIMENSION, TUNING_PROFILE_VARIABLE,
+          DEFAULT_TUNING_PROFILE, DEFAULT_BATCH_STRIP_HEIGHT);
+  exit(-1);
+}
+
+/* Read a positive integer option value, and bomb if it is not one */
+static int read_positive(char *desc, char *value)
+{
+  int number = atoi(value);
+  if (number < 1) {
+    fprintf(stderr, "Invalid %s\n", desc);
+    exit(-1);
+  }
+  return number;
+}
+
+/* Process command line arguments, over the defaults of the profile */
+static filedata* process_args(int argc, char *argv[], TuningProfile *profile)
 {
   filedata* out = (filedata*) my_alloc(sizeof(filedata));
+  int batch = 0, numFiles;
+
+  out->reference = NULL;
+  out->list = NULL;
+  out->counters = 0;
+  out->memory = 0;
+  out->stripHeight = profile->stripHeight;
+  out->numThreads = profile->stripThreads;
+  for (;;) {
+    if ((argc > 2) && (strcmp(argv[1], "--reference") == 0)) {
+      out->reference = argv[2];
+      argc -= 2;
+      argv += 2;
+    }
+    else if ((argc > 1) && (strcmp(argv[1], "--counters") == 0)) {
+      out->counters = 1;
+      argc--;
+      argv++;
+    }
+    else if ((argc > 1) && (strcmp(argv[1], "--batch") == 0)) {
+      batch = 1;
+      argc--;
+      argv++;
+    }
+    else if ((argc > 1) && (strcmp(argv[1], "--memory") == 0)) {
+      out->memory = 1;
+      argc--;
+      argv++;
+    }
+    else if ((argc > 2) && (strcmp(argv[1], "--strip") == 0)) {
+      out->stripHeight = read_positive("strip height", argv[2]);
+      argc -= 2;
+      argv += 2;
+    }
+    else if ((argc > 2) && (strcmp(argv[1], "--threads") == 0)) {
+      out->numThreads = read_positive("number of threads", argv[2]);
+      argc -= 2;
+      argv += 2;
+    }
+    else {
+      break;
+    }
+  }
 
-  if ((argc < 3) || (argc > 5)) {
-    fprintf(stderr, USAGE_STRING, argv[0], DEFAULT_IMAGE_DIMENSION);
+  numFiles = batch ? 1 : 2;
+  if ((argc < numFiles + 1) || (argc > numFiles + 3)) {
     fprintf(stderr,
-            "You passed %d arguments and 2-4 arguments are required.\n",
-            argc - 1);
-    exit(-1);
+            "You passed %d arguments and %d-%d arguments are required.\n",
+            argc - 1, numFiles, numFiles + 2);
+    usage(argv[0]);
   }
-  if ((out->ifp = fopen(argv[1],"r")) == NULL) {
+  if (batch) {
+    if (out->reference || out->counters) {
+      fprintf(stderr, "The --reference and --counters options cannot be "
+              "combined with --batch.\n");
+      exit(-1);
+    }
+    out->list = argv[1];
+  }
+  else if ((out->ifp = fopen(argv[1],"r")) == NULL) {
     fprintf(stderr, "Can't open file %s\n for reading", argv[1]);
     exit(-1);
   }
-  if ((out->ofp = fopen(argv[2],"w")) == NULL) {
+  else if ((out->ofp = fopen(argv[2],"w")) == NULL) {
     fprintf(stderr, "Can't open file %s\n for writing", argv[2]);
     exit(-1);
   }
   out->xsize = DEFAULT_IMAGE_DIMENSION;
-  if ((argc > 3) && (out->xsize=atoi(argv[3])) == 0) {
+  if ((argc > numFiles + 1) && (out->xsize=atoi(argv[numFiles + 1])) == 0) {
     fprintf(stderr, "Invalid xsize\n");
     exit(-1);
   }
   out->ysize = DEFAULT_IMAGE_DIMENSION;
-  if ((argc > 4) && (out->ysize=atoi(argv[4])) == 0) {
+  if ((argc > numFiles + 2) && (out->ysize=atoi(argv[numFiles + 2])) == 0) {
     fprintf(stderr, "Invalid ysize\n");
     exit(-1);
   }
@@ -134,55 +256,239 @@ static filedata* process_args(int argc, char *argv[])
 }
 
 
-void main(int argc, char* argv[])
+/* One image of a batch, inverse halftoned strip by strip */
+struct batch_image;
+
+typedef struct batch_strip {
+  struct batch_image *image;
+  int first_row, num_rows;
+} batch_strip;
+
+typedef struct batch_image {
+  struct batch_state *batch;
+  char infile[MAX_FILE_NAME_LENGTH], outfile[MAX_FILE_NAME_LENGTH];
+  pixel *input, *output;
+  int xsize, ysize, type;
+  int sequence;                                 /* line in the list */
+  batch_strip *strips;
+  int num_strips;
+  int strips_left;                              /* strips not yet done */
+  int failed;
+  double start, end;
+} batch_image;
+
+typedef struct batch_state {
+  TaskScheduler *scheduler;
+  ReorderBuffer written;                        /* images done, in order */
+  int strip_height;
+  int num_images, num_errors;                   /* updated by the writer */
+} batch_state;
+
+/* Read the next 'infile outfile' pair of the list; 0 at the end */
+static int read_batch_line(FILE *list, batch_image *image)
+{
+  char line[2*MAX_FILE_NAME_LENGTH + 2];
+  while (fgets(line, sizeof(line), list) != NULL) {
+    char *infile = strtok(line, " \t\r\n");
+    char *outfile;
+    if ((infile == NULL) || (infile[0] == '#')) continue;
+    if ((outfile = strtok(NULL, " \t\r\n")) == NULL) {
+      fprintf(stderr, "No output file given for '%s' in the batch.\n",
+              infile);
+      continue;
+    }
+    strncpy(image->infile, infile, MAX_FILE_NAME_LENGTH - 1);
+    strncpy(image->outfile, outfile, MAX_FILE_NAME_LENGTH - 1);
+    return 1;
+  }
+  return 0;
+}
+
+/* Filter one strip, and hand the image on when its last strip is done */
+static void run_strip(batch_strip *strip)
+{
+  batch_image *image = strip->image;
+
+  if (inverseHalftone2Strip(image->input, image->output,
+                            image->ysize, image->xsize,
+                            strip->first_row, strip->num_rows) != 0) {
+    __atomic_store_n(&image->failed, 1, __ATOMIC_RELAXED);
+  }
+  if (__atomic_sub_fetch(&image->strips_left, 1, __ATOMIC_ACQ_REL) == 0) {
+    image->end = currentTimeInSeconds();
+    putReorderBuffer(&image->batch->written, image->sequence, image);
+  }
+}
+
+static void strip_task(void *arg, int worker)
+{
+  run_strip((batch_strip*) arg);
+}
+
+/*
+Task for one image: queue all its strips but the first on this
+worker, where idle workers can steal them, and filter the first
+*/
+static void image_task(void *arg, int worker)
+{
+  batch_image *image = (batch_image*) arg;
+  int k;
+
+  image->start = currentTimeInSeconds();
+  for (k = image->num_strips-1; k > 0; k--) {
+    if (!submitTask(image->batch->scheduler, worker, strip_task,
+                    &image->strips[k])) {
+      run_strip(&image->strips[k]);
+    }
+  }
+  run_strip(&image->strips[0]);
+}
+
+/* Write the images in list order as they are finished */
+static void* batch_writer(void *arg)
+{
+  batch_state *batch = (batch_state*) arg;
+  batch_image *image;
+
+  while ((image = (batch_image*) takeReorderBuffer(&batch->written))) {
+    if (image->failed) {
+      fprintf(stderr, "Failed to inverse halftone '%s'.\n", image->infile);
+      batch->num_errors++;
+    }
+    else {
+      printf("%s: %f sec\n", image->infile, image->end - image->start);
+      writeByteImage(image->outfile, image->output,
+                     &image->ysize, &image->xsize, image->type);
+      batch->num_images++;
+    }
+    freeByteImage(image->input);
+    freeByteImage(image->output);
+    free(image->strips);
+    free(image);
+  }
+  return NULL;
+}
+
+/*
+Inverse halftone the images listed in fdata->list.  The calling thread
+reads the images, at most a few more than there are workers ahead of
+the one being written, and submits a task for each.
+*/
+static int run_batch(filedata *fdata)
+{
+  batch_state batch;
+  FILE *list;
+  pthread_t writer;
+  int num_workers = fdata->numThreads, sequence = 0, read_errors = 0;
+  double start = currentTimeInSeconds(), total;
+  int num_tasks, num_stolen;
+
+  if ((list = fopen(fdata->list, "r")) == NULL) {
+    fprintf(stderr, "Can't open file %s for reading\n", fdata->list);
+    return -1;
+  }
+  if (num_workers < 1) num_workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (num_workers < 1) num_workers = 1;
+  memset(&batch, 0, sizeof(batch));
+  batch.strip_height = (fdata->stripHeight > 0) ? fdata->stripHeight :
+                                                  DEFAULT_BATCH_STRIP_HEIGHT;
+  if (!initReorderBuffer(&batch.written, num_workers + 2) ||
+      ((batch.scheduler = createTaskScheduler(num_workers)) == NULL) ||
+      (pthread_create(&writer, NULL, batch_writer, &batch) != 0)) {
+    fprintf(stderr, "Could not start the batch threads.  Exiting.\n");
+    exit(-1);
+  }
+
+  for (;;) {
+    batch_image *image = (batch_image*) calloc(1, sizeof(batch_image));
+    int k;
+
+    if (image == NULL) {
+      fprintf(stderr, "Failed to allocate an image.  Exiting.\n");
+      exit(-1);
+    }
+    if (!read_batch_line(list, image)) {
+      free(image);
+      break;
+    }
+    image->batch = &batch;
+    image->xsize = fdata->xsize;
+    image->ysize = fdata->ysize;
+    image->type = readByteImage(image->infile, &image->input,
+                                &image->ysize, &image->xsize);
+    if ((image->type != RAW) && (image->type != PGM)) {
+      fprintf(stderr, "'%s' is not a greyscale image.\n", image->infile);
+      freeByteImage(image->input);
+      free(image);
+      read_errors++;
+      continue;
+    }
+    image->output = allocateByteImage(image->ysize, image->xsize);
+    image->num_strips = (image->ysize + batch.strip_height - 1) /
+                        batch.strip_height;
+    image->strips = (batch_strip*) calloc(image->num_strips,
+                                          sizeof(batch_strip));
+    if ((image->output == NULL) || (image->strips == NULL)) {
+      fprintf(stderr, "Failed to allocate an image.  Exiting.\n");
+      exit(-1);
+    }
+    for (k = 0; k < image->num_strips; k++) {
+      image->strips[k].image = image;
+      image->strips[k].first_row = k*batch.strip_height;
+      image->strips[k].num_rows = image->ysize - k*batch.strip_height;
+      if (image->strips[k].num_rows > batch.strip_height) {
+        image->strips[k].num_rows = batch.strip_height;
+      }
+    }
+    image->strips_left = image->num_strips;
+    image->sequence = sequence++;
+    waitReorderBuffer(&batch.written, image->sequence);
+    if (!submitTask(batch.scheduler, -1, image_task, image)) {
+      image_task(image, 0);
+    }
+  }
+  putReorderBuffer(&batch.written, sequence, NULL);    /* end of batch */
+
+  pthread_join(writer, NULL);
+  total = currentTimeInSeconds() - start;
+  getTaskSchedulerStats(batch.scheduler, &num_tasks, &num_stolen);
+  printf("%d images in %f sec (%f images/sec)\n", batch.num_images, total,
+         (total > 0.0) ? batch.num_images / total : 0.0);
+  printf("%d tasks on %d workers, %d stolen\n", num_tasks, num_workers,
+         num_stolen);
+  destroyTaskScheduler(batch.scheduler);
+  destroyReorderBuffer(&batch.written);
+  fclose(list);
+  return (batch.num_errors + read_errors) ? -1 : 0;
+}
+
+
+int main(int argc, char* argv[])
 {
   Tk_PhotoImageBlock block;
   filedata* fdata;
   FILE *ifp, *ofp;
-  short xsize, ysize, xpadsize, rowadd, row, col;
+  int xsize, ysize;
   int xsizeInt, ysizeInt;
-  pixel *imtl, *imbr, *imptr2;
-  register pixel *imptr, *imcmp;
-  filt f2x[25]={19,32,0,-32,-19,55,92,0,-92,-55, \
-                72,120,0,-120,-72,55,92,0,-92,-55, \
-                19,32,0,-32,-19};
-  filt f2y[25]={19,55,72,55,19,32,92,120,92,32, \
-                0,0,0,0,0,-32,-92,-120,-92,-32, \
-                -19,-55,-71,-55,-19};
-  filt f3x[49]={12,27,25,0,-25,-27,-12,30,68,64,0,-64,-68,-30, \
-                45,103,96,0,-96,-103,-45,54,124,114,0,-114,-124,-54, \
-                45,103,96,0,-96,-103,-45,30,68,64,0,-64,-68,-30, \
-                12,27,25,0,-25,-27,-12};
-  filt f3y[49]={12,30,45,54,45,30,12,27,68,103,124,103,68,27, \
-                25,64,96,114,96,64,25,0,0,0,0,0,0,0, \
-                -25,-64,-96,-114,-96,-64,-25,-27,-68,-103,-124,-103,-68,-27, \
-                -12,-30,-45,-54,-45,-30,-12};
-  filt *f2xp, *f2yp, *f3xp, *f3yp;
-  register fout t2x, t2y, t3x, t3y;
-  int fx[7]={0,0,0,4*1024,0,0,0}, *fxptr;
-  int fy[7]={0,0,0,4*1024,0,0,0}, *fyptr;
-  int out, outrow;
+  pixel *input, *output;
   int imageType, dummy;
-  float cx1, cy1, cx2, cy2, xcomp, ycomp, out2;
-
-  /*
-    filtscale scales the output of the product of the edge detectors.
-    It is computed as 1/(1024*2048*2048), since that is how much the
-    coefficients of the edge detectors are scaled to get them to fit
-    into one byte each.
-    filtscale2 scales the output of the smoothing filter.  It is 
-    computed as 255/(16*1024*1024).  The 255/16 comes from the need
-    to scale to the full 0-255 range, and the fact that the scaling
-    factor for the separable filter has a 4 in the denominator (see
-    report).  The two factors of 1024 compensate for the multiplication
-    applied to the floating-point coefficients before they are converted
-    to integers for fast implementation.
-  */
-
-  float filtscale = 2.328306436538696e-10;          /* scale edge detector */
-  float filtscale2 = 1.519918441772461e-5;          /* scale smooth filter */
-
-  fdata = process_args(argc, argv);                 /* parse command line */
+  PerfCounters *counters = 0;
+  double startCounts[NUM_PERF_COUNTERS], counts[NUM_PERF_COUNTERS];
+  TuningProfile profile;
+  int k;
+
+  loadTuningProfile(&profile);                      /* tuned defaults */
+  fdata = process_args(argc, argv, &profile);       /* parse command line */
+  if (fdata->list) {
+    int status = run_batch(fdata);
+    if (fdata->memory) {
+      MemoryUsage usage;
+      getMemoryUsage(&usage);
+      printMemoryUsage(stdout, "memory", &usage);
+    }
+    trackedFree(fdata);
+    return status;
+  }
   xsize = fdata->xsize;
   ysize = fdata->ysize;
   ifp = fdata->ifp;
@@ -206,161 +512,73 @@ void main(int argc, char* argv[])
               "File '%s' is a color image, but color images "
               "are currently not supported.\n",
               argv[1]);
-      break;
+      exit(-1);
     default:
       fprintf(stderr, "Unrecognized image type %d.\n", imageType);
       break;
   }
 
-  xpadsize = xsize+6;                               /* extended image size */
-  rowadd = xsize-1;                                 /* to get to next row */
-  imtl = (pixel*) my_alloc(xpadsize*7);             /* 7 row store */
-  imbr = imtl+xpadsize*7;                           /* bottom right + 1 */
-
-  /* Load in the first four image rows.  Mirror at sides and above */
+  /* Read the halftone, inverse halftone it, and write the result */
 
-  for (imptr=imtl+xpadsize*3+3, imptr2 = imptr; imptr<imbr; imptr+=8) {
-    fread(imptr, 1, xsize, ifp);
-    *--imptr2=*++imptr; *--imptr2=*++imptr; *--imptr2=*++imptr;
-    imptr+=xsize-7; imptr2+=xpadsize;
-    *--imptr2=*imptr++; *--imptr2=*imptr++; *--imptr2=*imptr; imptr2+=6;
+  input = (pixel*) my_alloc(xsize*ysize);
+  output = (pixel*) my_alloc(xsize*ysize);
+  memset(input, 0, xsize*ysize);
+  if (fread(input, 1, xsize*ysize, ifp) != (size_t) (xsize*ysize)) {
+    fprintf(stderr, "Warning: the halftone is shorter than %d by %d.\n",
+            xsize, ysize);
+  }
+  if (fdata->counters) {
+    counters = openPerfCounters();
+    if (counters) {
+      readPerfCounters(counters, startCounts);
+    }
+    else {
+      fprintf(stderr, "Hardware performance counters are not available.\n");
+    }
   }
-  imptr2=imtl+(xpadsize<<2);
-  for (imptr = imtl+(xpadsize<<1); imptr>=imtl; imptr-=xpadsize) {
-    memcpy(imptr, imptr2, xpadsize);
-    imptr2+=xpadsize;
+  if (inverseHalftone2Strips(input, output, ysize, xsize,
+                             fdata->stripHeight, fdata->numThreads) != 0) {
+    fprintf(stderr, "Failed to allocate the row store.  Exiting.\n");
+    exit(-1);
   }
-
-  /* Loop over image */
-
-  for (row=0; row<ysize; row++) {                       /* all image rows */
-    for (col=0; col<xsize; col++) {                     /* all image cols */
-
-      /* Compute the four gradient estimator outputs t{2,3}{x,y} */
-
-      t2x=0; t2y=0; f2xp=f2x; f2yp=f2y;                 /* zero totals */
-      t3x=0; t3y=0; f3xp=f3x; f3yp=f3y;                 /* and reset filters */
-      for (imptr=imtl+col, imcmp=imptr+7; imptr<imcmp;) /* row 1 (3) */
-        if (*imptr++) {t3x+=*f3xp++; t3y+=*f3yp++;}
-          else {f3xp++; f3yp++;}
-      for (imptr+=rowadd; imptr<imtl+xpadsize*6; imptr+=rowadd){ /* rows 2-6 */
-        if (*imptr++) {t3x+=*f3xp++; t3y+=*f3yp++;}     /* col 1 (3) */
-          else {f3xp++; f3yp++;}
-        for (imcmp=imptr+5; imptr<imcmp;)               /* cols 2-6 (2,3) */
-          if (*imptr++) {t2x+=*f2xp++; t2y+=*f2yp++;
-                         t3x+=*f3xp++; t3y+=*f3yp++;}
-            else {f2xp++; f2yp++; f3xp++; f3yp++;}
-        if (*imptr++) {t3x+=*f3xp++; t3y+=*f3yp++;}     /* col 7 (3) */
-          else {f3xp++; f3yp++;}
-      }
-      for (imcmp=imptr+7; imptr<imcmp;)                 /* row 7 (3) */
-        if (*imptr++) {t3x+=*f3xp++; t3y+=*f3yp++;}
-          else {f3xp++; f3yp++;}
-
-      /*
-         Compute composite gradients.  First, find the absolute value of 
-         the product of the gradients at two scales.  Then find the cube
-         root of this product.  First, check for the inputs that lead to
-         the limits of 3.33 and 1.95 and exclude them.  For valid inputs,
-         compute a first approximation using a two-line fit, then perform
-         two Newton-Raphson iterations.  Maximum error is 2e-4.
-      */
-
-      xcomp = (float) t2x*t3x*t3x * filtscale;          /* comp gradient */
-      if (xcomp) {                                      /* < max. smoothing? */
-        if (xcomp<0) xcomp=-xcomp;                      /* abs */
-        if (xcomp>0.0141909899) cx1=1.95;               /* min smoothing */
-        else {
-          if (xcomp>0.001) cx1=9.6742*xcomp+0.116165;   /* first linear fit */
-          else cx1=98.87505*xcomp+0.027;                /* second linear fit */
-          xcomp=xcomp*0.3333333333;
-          cx1=0.66666666*cx1+xcomp/(cx1*cx1);           /* Newton-Raphson */
-          cx1=0.66666666*cx1+xcomp/(cx1*cx1);
-          cx1=3.33-5.7*cx1;                             /* filter coeff. */
-        }
-      }
-      else cx1=3.33;                                    /* max smoothing */
-
-      ycomp = (float) t2y*t3y*t3y * filtscale;          /* comp gradient */
-      if (ycomp) {                                      /* < max. smoothing? */
-        if (ycomp<0) ycomp=-ycomp;                      /* abs */
-        if (ycomp>0.0141909899) cy1=1.95;               /* min smoothing */
-        else {
-          if (ycomp>0.001) cy1=9.6742*ycomp+0.116165;   /* first linear fit */
-          else cy1=98.87505*ycomp+0.027;                /* second linear fit */
-          ycomp=ycomp*0.3333333333;
-          cy1=0.66666666*cy1+ycomp/(cy1*cy1);           /* Newton-Raphson */
-          cy1=0.66666666*cy1+ycomp/(cy1*cy1);
-          cy1=3.33-5.7*cy1;                             /* filter coeff. */
-        }
-      }
-      else cy1=3.33;                                    /* max smoothing */
-
-      /* Compute second parameter of filters and construct integer filters */
-      /* with max. 13 bit coefficients */
-
-      cx2=-3.611679+cx1*(4.659894+cx1*(-2.426115+cx1*0.4630577));
-      fx[1]=1024*cx2; cx2+=2; fx[0]=1024*(cx2-cx1); fx[2]=1024*cx1;
-      fx[4]=fx[2]; fx[5]=fx[1]; fx[6]=fx[0];
-
-      cy2=-3.611679+cy1*(4.659894+cy1*(-2.426115+cy1*0.4630577));
-      fy[1]=1024*cy2; cy2+=2; fy[0]=1024*(cy2-cy1); fy[2]=1024*cy1;
-      fy[4]=fy[2]; fy[5]=fy[1]; fy[6]=fy[0];
-
-      /*
-         Compute output by separable filtering.  We treat the first pixel
-         of each row, and the first row sum, uniquely, to avoid an addition.
-         This saves 7 extra additions per pixel.
-       */
-      fyptr=fy; imptr=imtl+col;
-
-      fxptr=fx;
-      if (*imptr++) outrow=*fxptr++;                    /* row 1, col 1 */
-        else {outrow=0; fxptr++;}
-      for (; fxptr<fx+7;)                               /* row 1, cols 2-7 */
-        if (*imptr++) outrow+=*fxptr++;
-          else fxptr++;
-      out = outrow * *fyptr++;                          /* y filter */
-
-      for (imptr+=rowadd; imptr<imbr; imptr+=rowadd) {  /* rows 2-7 */
-        fxptr=fx;
-        if (*imptr++) outrow=*fxptr++;                  /* col 1 */
-          else {outrow=0; fxptr++;}
-        for (; fxptr<fx+7;)                             /* cols 2-7 */
-          if (*imptr++) outrow+=*fxptr++;
-            else fxptr++;
-        out += outrow * *fyptr++;                       /* y filter */
-      }
-
-      /* Scale output and write to file */
-
-      out2=filtscale2 * out / (cx2*cy2) + 0.5;          /* scale and round */
-      out2=(out2<0) ? 0 : (out2>255) ? 255 : out2;      /* clip */
-      putc((unsigned char) out2, ofp);                  /* write to file */
+  if (counters) {
+    readPerfCounters(counters, counts);
+    for (k = 0; k < NUM_PERF_COUNTERS; k++) {
+      counts[k] -= startCounts[k];
     }
+    printPerfCountersHeader(stdout);
+    printPerfCounters(stdout, "fastiht2", counts, (double) xsize*ysize,
+                      counters->availableMask);
+    closePerfCounters(counters);
+  }
+  fwrite(output, 1, xsize*ysize, ofp);
 
-    /* Shift input and either read in row and mirror sides or mirror old row */
+  /* Measure the result against the original image */
 
-    memcpy(imtl, imtl+xpadsize, xpadsize*6);            /* shift up one row */
-    if (row<ysize-4) {                                  /* get new row */
-      imptr=imtl+xpadsize*6+3;                          /* and mirror */
-      imptr2=imptr;
-      fread(imptr, 1, xsize, ifp);
-      *--imptr2=*++imptr; *--imptr2=*++imptr; *--imptr2=*++imptr;
-      imptr+=xsize-7; imptr2+=xpadsize;
-      *--imptr2=*imptr++; *--imptr2=*imptr++; *--imptr2=*imptr;
+  if (fdata->reference) {
+    ImageMetrics metrics;
+    pixel *reference = readReferenceImage(fdata->reference, ysize, xsize);
+    if (reference && computeImageMetrics(output, reference, ysize, xsize,
+                                         0, &metrics)) {
+      printImageMetrics(stdout, &metrics);
     }
-    else if (row!=ysize-1) {                            /* mirror old row */
-      imptr=imtl+xpadsize*6;
-      imptr2=imtl+xpadsize*((ysize-row-2)<<1);
-      memcpy(imptr,imptr2,xpadsize);
+    else {
+      fprintf(stderr, "Could not measure against '%s'.\n", fdata->reference);
     }
+    freeByteImage(reference);
+  }
+  if (fdata->memory) {
+    MemoryUsage usage;
+    getMemoryUsage(&usage);
+    printMemoryUsage(stdout, "memory", &usage);
   }
 
   /* All done */
 
   fclose(ifp);
   fclose(ofp);
-  free(fdata);
-  free(imtl);
+  trackedFree(fdata);
+  trackedFree(input);
+  trackedFree(output);
+  return 0;
 }
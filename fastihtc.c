@@ -0,0 +1,188 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+fastihtc is a command-line client for the fastihtd server.  It takes
+the same arguments as fastiht1 preceded by the name of the server's
+socket file, for example
+
+./fastihtc /tmp/fastiht.sock lena_halftone.pgm test1.pgm 0 4 1
+
+The halftone is handed to the server in a shared memory buffer, and the
+inverse halftone is read back from the same buffer.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+#include "image_io.h"
+#include "inverse_halftone.h"
+#include "job_protocol.h"
+
+/* Constants */
+
+#define DEFAULT_IMAGE_DIMENSION 512
+
+#define USAGE_STRING \
+  "Usage: %s socketFile halfFile inverseFile threshold gain halfType " \
+  "[rows] [columns]\n" \
+  "Send an inverse halftoning job to the fastihtd server listening on\n" \
+  "socketFile.  The other arguments are the same as for fastiht1: halfType\n" \
+  "is 1 for error diffusion, 2 for dispersed dither, and 3 for clustered\n" \
+  "dither.  For raw images, the number of rows and number of columns\n" \
+  "default to %d.\n"
+
+/* Read an integer from the string numericStr; and exit program on failure. */
+static int readIntArg(char *descStr, char *numericStr, int minValue) {
+    int tempInt = 0;
+    int validIntFlag = 0;
+    int readValue = 0;
+    validIntFlag = (sscanf(numericStr, "%d", &tempInt) == 1);
+    if (validIntFlag && (tempInt >= minValue)) {
+        readValue = tempInt;
+    }
+    else {
+        fprintf(stderr,
+                "%s, %s, is not an integer greater than or equal to %d.\n",
+                descStr, numericStr, minValue);
+        exit(1);
+    }
+    return(readValue);
+}
+
+/* Connect to the server listening on socketFile, and exit on failure */
+static int connectToServer(char* socketFile)
+{
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (strlen(socketFile) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket file name '%s' is too long.\n", socketFile);
+        exit(1);
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketFile);
+    if ((fd < 0) ||
+        (connect(fd, (struct sockaddr*) &address, sizeof(address)) != 0)) {
+        fprintf(stderr, "Could not connect to the server at '%s'.\n",
+                socketFile);
+        exit(1);
+    }
+    return(fd);
+}
+
+/* Main routine */
+int main(int argc, char *argv[])
+{
+    JobRequest request;
+    JobReply reply;
+    unsigned char *inputByteImage = 0, *sharedBuffer = 0;
+    int numRows = DEFAULT_IMAGE_DIMENSION,
+        numColumns = DEFAULT_IMAGE_DIMENSION;
+    int imageType = 0, socketFd = -1, bufferFd = -1;
+    size_t imageSize = 0;
+
+    /* Check for the right number of arguments */
+    if ((argc < 7) || (argc > 9)) {
+        fprintf(stderr, USAGE_STRING, argv[0], DEFAULT_IMAGE_DIMENSION);
+        fprintf(stderr,
+                "You passed %d arguments and 6-8 arguments are required.\n",
+                argc - 1);
+        exit(1);
+    }
+
+    /* Get parameters */
+    memset(&request, 0, sizeof(request));
+    request.threshold = readIntArg("Threshold", argv[4], 0);
+    request.gain = readIntArg("Gain", argv[5], 0);
+    request.halftoningType = readIntArg("Type of halftoning", argv[6],
+                                        HALFTONING_BY_ERROR_DIFFUSION);
+    if (argc >= 8) {
+        numRows = readIntArg("Number of rows", argv[7], 1);
+    }
+    if (argc == 9) {
+        numColumns = readIntArg("Number of columns", argv[8], 1);
+    }
+    else {
+        numColumns = numRows;
+    }
+
+    /* Read the halftoned image and copy it into a shared buffer */
+    imageType = readByteImage(argv[2], &inputByteImage, &numRows, &numColumns);
+    imageSize = (size_t) numRows * numColumns;
+    bufferFd = createSharedBuffer(2 * imageSize);
+    if (bufferFd >= 0) {
+        sharedBuffer = (unsigned char*) mmap(0, 2 * imageSize,
+                                             PROT_READ | PROT_WRITE,
+                                             MAP_SHARED, bufferFd, 0);
+    }
+    if ((bufferFd < 0) || (sharedBuffer == (unsigned char*) MAP_FAILED)) {
+        fprintf(stderr, "Could not create the shared image buffer.\n");
+        exit(1);
+    }
+    memcpy(sharedBuffer, inputByteImage, imageSize);
+
+    /* Send the job and wait for the server to finish it */
+    request.numRows = numRows;
+    request.numColumns = numColumns;
+    socketFd = connectToServer(argv[1]);
+    if ((sendJobRequest(socketFd, &request, bufferFd) != 0) ||
+        (receiveJobReply(socketFd, &reply) != 0)) {
+        fprintf(stderr, "Lost the connection to the server.\n");
+        exit(1);
+    }
+    close(socketFd);
+
+    switch (reply.status) {
+      case JOB_STATUS_OK:
+        /* Report computation time and save the result */
+        printf("%f sec\n", reply.execTime);
+        writeByteImage(argv[3], sharedBuffer + imageSize,
+                       &numRows, &numColumns, imageType);
+        break;
+
+      case JOB_STATUS_NO_MEMORY:
+        fprintf(stderr,
+          "Could not allocate enough memory in the inverseHalftone routine.\n");
+        break;
+
+      case JOB_STATUS_BAD_METHOD:
+        fprintf(stderr,
+                "Invalid halftoning method %d specified.\n",
+                request.halftoningType);
+        break;
+
+      default:
+        fprintf(stderr, "The server rejected the job.\n");
+        break;
+    }
+
+    munmap(sharedBuffer, 2 * imageSize);
+    close(bufferFd);
+    freeByteImage(inputByteImage);
+
+    return(reply.status != JOB_STATUS_OK);
+}
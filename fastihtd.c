@@ -0,0 +1,489 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+fastihtd is a long-running inverse halftoning server.  It listens on a
+Unix domain socket and runs the fast inverse halftoning algorithm I of
+fastiht1 on the jobs sent to it by clients such as fastihtc.  Each of
+the worker threads owns a pre-allocated and pre-warmed workspace, so a
+job costs neither process startup nor memory allocation.  The main
+thread polls the listening socket and all open connections; when a
+request arrives on a connection, the connection is queued for the
+workers, and the worker that takes it runs that one job and hands the
+connection back.  Clients that keep a connection open between jobs
+thus hold no worker.  An example of running the server is:
+
+./fastihtd /tmp/fastiht.sock 4 512 512
+
+which starts four workers with workspaces for 512 x 512 images.  The
+workspace of a worker is replaced by one sized to the image when a
+larger image arrives.  See job_protocol.h for the messages exchanged
+with clients.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+
+#include "inverse_halftone.h"
+#include "job_protocol.h"
+#include "timer_utils.h"
+
+/* Constants */
+
+#define DEFAULT_IMAGE_DIMENSION 512
+#define DEFAULT_NUM_WORKERS 4
+#define DEFAULT_MAX_PIXELS (4096 * 4096)
+#define LISTEN_BACKLOG 64
+#define MAX_CONNECTIONS 256
+#define REQUEST_TIMEOUT_SECONDS 10    /* to send the rest of a request */
+
+#define USAGE_STRING \
+  "Usage: %s [--max-pixels num] socketFile [numWorkers] [rows] [columns]\n" \
+  "This is a server for the fast inverse halftoning algorithm of fastiht1.\n" \
+  "It accepts jobs from fastihtc on the Unix domain socket socketFile and\n" \
+  "runs them on numWorkers (default %d) worker threads, each of which\n" \
+  "keeps a workspace for rows by columns images (default %d by %d)\n" \
+  "between jobs.  Jobs for images of more than num pixels (default %d)\n" \
+  "are refused.\n"
+
+/*
+Queue of connections.  Every open connection is in at most one queue or
+in the poll set of the main thread, so MAX_CONNECTIONS entries suffice.
+*/
+typedef struct ConnectionQueue {
+    int fds[MAX_CONNECTIONS];
+    int head;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+} ConnectionQueue;
+
+typedef struct WorkerInfo {
+    pthread_t thread;
+    int index;
+    InverseHalftoneWorkspace* workspace;
+} WorkerInfo;
+
+static ConnectionQueue readyQueue;     /* with a request, for the workers */
+static ConnectionQueue returnQueue;    /* from the workers, -1 if closed */
+static int wakeupPipe[2];              /* wakes the poll of the main thread */
+static volatile sig_atomic_t shutdownFlag = 0;
+static long maxImagePixels = DEFAULT_MAX_PIXELS;
+
+/* Read an integer from the string numericStr; and exit program on failure. */
+static int readIntArg(char *descStr, char *numericStr, int minValue) {
+    int tempInt = 0;
+    int validIntFlag = 0;
+    int readValue = 0;
+    validIntFlag = (sscanf(numericStr, "%d", &tempInt) == 1);
+    if (validIntFlag && (tempInt >= minValue)) {
+        readValue = tempInt;
+    }
+    else {
+        fprintf(stderr,
+                "%s, %s, is not an integer greater than or equal to %d.\n",
+                descStr, numericStr, minValue);
+        exit(1);
+    }
+    return(readValue);
+}
+
+static void handleShutdownSignal(int signalNumber)
+{
+    shutdownFlag = 1;
+}
+
+static void initConnectionQueue(ConnectionQueue* queue)
+{
+    memset(queue, 0, sizeof(ConnectionQueue));
+    pthread_mutex_init(&queue->lock, 0);
+    pthread_cond_init(&queue->notEmpty, 0);
+}
+
+static void pushConnection(ConnectionQueue* queue, int fd)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->fds[(queue->head + queue->count) % MAX_CONNECTIONS] = fd;
+    queue->count++;
+    pthread_cond_signal(&queue->notEmpty);
+    pthread_mutex_unlock(&queue->lock);
+}
+
+/* Take the next connection, waiting for one if waitFlag is set, or -2 */
+static int popConnection(ConnectionQueue* queue, int waitFlag)
+{
+    int fd = -2;
+    pthread_mutex_lock(&queue->lock);
+    while (waitFlag && (queue->count == 0)) {
+        pthread_cond_wait(&queue->notEmpty, &queue->lock);
+    }
+    if (queue->count > 0) {
+        fd = queue->fds[queue->head];
+        queue->head = (queue->head + 1) % MAX_CONNECTIONS;
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return(fd);
+}
+
+/* Give a connection, or -1 for a closed one, back to the main thread */
+static void returnConnection(int fd)
+{
+    char wakeup = 0;
+    pushConnection(&returnQueue, fd);
+    while ((write(wakeupPipe[1], &wakeup, 1) < 0) && (errno == EINTR)) {
+    }
+}
+
+/* Map the shared buffer of a job, run it, and fill in the reply */
+static void runJob(WorkerInfo* worker, JobRequest* request, int bufferFd,
+                   JobReply* reply)
+{
+    struct stat bufferInfo;
+    size_t imageSize, bufferSize;
+    unsigned char* buffer;
+    double execTime, startTime;
+
+    reply->status = JOB_STATUS_OK;
+    reply->execTime = 0.0;
+
+    /* The size bounds the workspace a client can make a worker allocate */
+    if ((request->numRows < 1) || (request->numColumns < 1) ||
+        ((long) request->numRows * request->numColumns > maxImagePixels) ||
+        (request->threshold < 0) || (request->gain < 0)) {
+        reply->status = JOB_STATUS_BAD_REQUEST;
+        return;
+    }
+    imageSize = (size_t) request->numRows * request->numColumns;
+    bufferSize = 2 * imageSize;
+    if ((fstat(bufferFd, &bufferInfo) != 0) ||
+        ((size_t) bufferInfo.st_size < bufferSize)) {
+        reply->status = JOB_STATUS_BAD_REQUEST;
+        return;
+    }
+
+    /* Replace the workspace by one for this image if it does not fit.
+       The old one is kept if the new one cannot be allocated. */
+    if ((request->numRows > worker->workspace->maxRows) ||
+        (request->numColumns > worker->workspace->maxColumns)) {
+        InverseHalftoneWorkspace* workspace =
+            allocateInverseHalftoneWorkspace(request->numRows,
+                                             request->numColumns);
+        if (workspace == 0) {
+            reply->status = JOB_STATUS_NO_MEMORY;
+            return;
+        }
+        freeInverseHalftoneWorkspace(worker->workspace);
+        worker->workspace = workspace;
+    }
+
+    buffer = (unsigned char*) mmap(0, bufferSize, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, bufferFd, 0);
+    if (buffer == (unsigned char*) MAP_FAILED) {
+        reply->status = JOB_STATUS_NO_MEMORY;
+        return;
+    }
+
+    /* Time the job here, since the routine only times to the second */
+    startTime = currentTimeInSeconds();
+    execTime = inverseHalftoneWithWorkspace(worker->workspace,
+                                            buffer, buffer + imageSize,
+                                            request->numRows,
+                                            request->numColumns,
+                                            request->gain,
+                                            request->threshold,
+                                            0, request->halftoningType);
+    if (execTime >= 0.0) {
+        execTime = currentTimeInSeconds() - startTime;
+    }
+    munmap(buffer, bufferSize);
+
+    if (execTime == INVERSE_HALFTONING_NO_MEMORY) {
+        reply->status = JOB_STATUS_NO_MEMORY;
+    }
+    else if (execTime == INVERSE_HALFTONING_BAD_METHOD) {
+        reply->status = JOB_STATUS_BAD_METHOD;
+    }
+    else {
+        reply->execTime = execTime;
+    }
+}
+
+/*
+Serve the one request waiting on a client connection.  Returns 0 if
+the connection is to be closed: the client hung up, or sent a bad
+request, or the reply could not be sent.
+*/
+static int serveRequest(WorkerInfo* worker, int connectionFd)
+{
+    JobRequest request;
+    JobReply reply;
+    int bufferFd = -1;
+    int status = receiveJobRequest(connectionFd, &request, &bufferFd);
+
+    if (status == 0) {
+        return(0);
+    }
+    if (status < 0) {
+        reply.status = JOB_STATUS_BAD_REQUEST;
+        reply.execTime = 0.0;
+        sendJobReply(connectionFd, &reply);
+        return(0);
+    }
+    runJob(worker, &request, bufferFd, &reply);
+    close(bufferFd);
+    return(sendJobReply(connectionFd, &reply) == 0);
+}
+
+static void* workerMain(void* arg)
+{
+    WorkerInfo* worker = (WorkerInfo*) arg;
+    for (;;) {
+        int connectionFd = popConnection(&readyQueue, 1);
+        if (serveRequest(worker, connectionFd)) {
+            returnConnection(connectionFd);
+        }
+        else {
+            close(connectionFd);
+            returnConnection(-1);
+        }
+    }
+    return(0);
+}
+
+/*
+Remove the socket file left by a server that is no longer running.
+Exit if the path names something other than a socket, or if a server
+still accepts connections on it.
+*/
+static void removeStaleSocket(struct sockaddr_un* address)
+{
+    struct stat fileInfo;
+    int probeFd;
+
+    if (lstat(address->sun_path, &fileInfo) != 0) {
+        return;
+    }
+    if (!S_ISSOCK(fileInfo.st_mode)) {
+        fprintf(stderr, "'%s' exists and is not a socket.\n",
+                address->sun_path);
+        exit(1);
+    }
+    probeFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if ((probeFd >= 0) &&
+        (connect(probeFd, (struct sockaddr*) address,
+                 sizeof(struct sockaddr_un)) == 0)) {
+        fprintf(stderr, "A server is already listening on '%s'.\n",
+                address->sun_path);
+        exit(1);
+    }
+    if (probeFd >= 0) {
+        close(probeFd);
+    }
+    unlink(address->sun_path);
+}
+
+/* Main routine */
+int main(int argc, char *argv[])
+{
+    struct sockaddr_un address;
+    struct sigaction action;
+    struct pollfd pollFds[MAX_CONNECTIONS + 2];
+    int idleFds[MAX_CONNECTIONS];       /* connections waiting for requests */
+    int numIdle = 0, numConnections = 0;
+    WorkerInfo* workers;
+    int numWorkers = DEFAULT_NUM_WORKERS;
+    int numRows = DEFAULT_IMAGE_DIMENSION,
+        numColumns = DEFAULT_IMAGE_DIMENSION;
+    int listenFd, i;
+    char* programName = argv[0];
+
+    /* Take the option off the front of the arguments */
+    if ((argc > 2) && (strcmp(argv[1], "--max-pixels") == 0)) {
+        maxImagePixels = readIntArg("Maximum number of pixels", argv[2], 1);
+        argc -= 2;
+        argv += 2;
+    }
+
+    /* Check for the right number of arguments */
+    if ((argc < 2) || (argc > 5)) {
+        fprintf(stderr, USAGE_STRING, programName, DEFAULT_NUM_WORKERS,
+                DEFAULT_IMAGE_DIMENSION, DEFAULT_IMAGE_DIMENSION,
+                DEFAULT_MAX_PIXELS);
+        fprintf(stderr,
+                "You passed %d arguments and 1-4 arguments are required.\n",
+                argc - 1);
+        exit(1);
+    }
+    if (strlen(argv[1]) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket file name '%s' is too long.\n", argv[1]);
+        exit(1);
+    }
+
+    /* Get parameters */
+    if (argc >= 3) {
+        numWorkers = readIntArg("Number of workers", argv[2], 1);
+    }
+    if (argc >= 4) {
+        numRows = readIntArg("Number of rows", argv[3], 1);
+    }
+    if (argc == 5) {
+        numColumns = readIntArg("Number of columns", argv[4], 1);
+    }
+    else {
+        numColumns = numRows;
+    }
+    if ((long) numRows * numColumns > maxImagePixels) {
+        fprintf(stderr, "Workspaces of %d by %d are larger than the %ld "
+                "pixels allowed.\n", numRows, numColumns, maxImagePixels);
+        exit(1);
+    }
+
+    /* Start the workers with pre-warmed workspaces */
+    initConnectionQueue(&readyQueue);
+    initConnectionQueue(&returnQueue);
+    if ((pipe(wakeupPipe) != 0) ||
+        (fcntl(wakeupPipe[1], F_SETFL, O_NONBLOCK) != 0)) {
+        perror("pipe");
+        exit(1);
+    }
+
+    workers = (WorkerInfo*) calloc(numWorkers, sizeof(WorkerInfo));
+    if (workers == 0) {
+        fprintf(stderr, "Could not allocate memory for the workers.\n");
+        exit(1);
+    }
+    for (i = 0; i < numWorkers; i++) {
+        workers[i].index = i;
+        workers[i].workspace = allocateInverseHalftoneWorkspace(numRows,
+                                                                numColumns);
+        if (workers[i].workspace == 0) {
+            fprintf(stderr,
+                    "Could not allocate enough memory for the workspaces.\n");
+            exit(1);
+        }
+        prewarmInverseHalftoneWorkspace(workers[i].workspace);
+        if (pthread_create(&workers[i].thread, 0, workerMain, &workers[i])) {
+            fprintf(stderr, "Could not start worker %d.\n", i);
+            exit(1);
+        }
+    }
+
+    /* Listen on the socket */
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        perror("socket");
+        exit(1);
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, argv[1]);
+    removeStaleSocket(&address);
+    if ((bind(listenFd, (struct sockaddr*) &address, sizeof(address)) != 0) ||
+        (listen(listenFd, LISTEN_BACKLOG) != 0)) {
+        fprintf(stderr, "Could not listen on socket file '%s': %s.\n",
+                argv[1], strerror(errno));
+        exit(1);
+    }
+
+    /* Interrupt accept on SIGINT and SIGTERM so the socket gets removed */
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handleShutdownSignal;
+    sigaction(SIGINT, &action, 0);
+    sigaction(SIGTERM, &action, 0);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("Listening on '%s' with %d workers.\n", argv[1], numWorkers);
+    fflush(stdout);
+
+    /* Poll the socket and the idle connections, and queue the requests */
+    while (!shutdownFlag) {
+        int numPollFds = 0, numReady, fd;
+
+        pollFds[numPollFds].fd = wakeupPipe[0];
+        pollFds[numPollFds++].events = POLLIN;
+        pollFds[numPollFds].fd =
+            (numConnections < MAX_CONNECTIONS) ? listenFd : -1;
+        pollFds[numPollFds++].events = POLLIN;
+        for (i = 0; i < numIdle; i++) {
+            pollFds[numPollFds].fd = idleFds[i];
+            pollFds[numPollFds++].events = POLLIN;
+        }
+        numReady = poll(pollFds, numPollFds, -1);
+        if (numReady < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        /* Queue the connections with a request, or that hung up */
+        for (i = numIdle - 1; i >= 0; i--) {
+            if (pollFds[i + 2].revents != 0) {
+                pushConnection(&readyQueue, idleFds[i]);
+                idleFds[i] = idleFds[--numIdle];
+            }
+        }
+        if (pollFds[0].revents != 0) {
+            char wakeup[64];
+            read(wakeupPipe[0], wakeup, sizeof(wakeup));
+            while ((fd = popConnection(&returnQueue, 0)) != -2) {
+                if (fd == -1) {
+                    numConnections--;
+                }
+                else {
+                    idleFds[numIdle++] = fd;
+                }
+            }
+        }
+        if (pollFds[1].revents != 0) {
+            fd = accept(listenFd, 0, 0);
+            if (fd >= 0) {
+                /* A client that stalls within a request loses its worker */
+                struct timeval timeout;
+                timeout.tv_sec = REQUEST_TIMEOUT_SECONDS;
+                timeout.tv_usec = 0;
+                setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                           sizeof(timeout));
+                idleFds[numIdle++] = fd;
+                numConnections++;
+            }
+            else if (errno != EINTR) {
+                perror("accept");
+                break;
+            }
+        }
+    }
+
+    close(listenFd);
+    unlink(argv[1]);
+    return(0);
+}
@@ -0,0 +1,301 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Guess how a halftone was made from a sample of it, so that the
+filters of the inverse halftoning algorithm can be chosen without
+being told.  Ordered dither repeats its threshold matrix, so in
+smooth parts of the image a block of the halftone as wide as the
+matrix repeats exactly one matrix width away, which error diffusion,
+having no period, almost never does.  Clustered dot dither grows one
+compact dot per matrix cell, whose outline is short for its area,
+while dispersed dot dither scatters isolated pixels, each of which
+differs from most of its neighbours.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+
+#include "halftone_classifier.h"
+#include "inverse_halftone.h"
+
+/*
+The sample: windows of CLASSIFIER_WINDOW by CLASSIFIER_WINDOW pixels
+on a grid of up to CLASSIFIER_GRID by CLASSIFIER_GRID windows spread
+evenly over the image, which for images of up to 512 by 512 pixels
+is the whole image
+*/
+#define CLASSIFIER_WINDOW 64
+#define CLASSIFIER_GRID   8
+
+/*
+Thresholds of the features.  On the bundled halftones and on error
+diffused and Bayer and clustered dot dithered versions of lena.pgm,
+error diffusion repeated at most 6% of the 4 by 4 blocks and 1% of
+the 8 by 8 blocks, and ordered dither at least 16% or 12%.  Clustered
+dot dither had at most 1.7 transitions per minority pixel, dispersed
+dot dither at least 2.2.
+*/
+#define DITHER_REPEAT4     0.10
+#define DITHER_REPEAT8     0.05
+#define CLUSTERED_TRANSITIONS 2.0
+
+/* Count the pixels of a window that are neither black nor white */
+static int countGreyPixels(unsigned char* image, int numColumns,
+                           int firstRow, int firstColumn,
+                           int numRows, int numWindowColumns)
+{
+    int count = 0, y, x;
+
+    for (y = 0; y < numRows; y++) {
+        unsigned char* row = image + (size_t) (firstRow + y) * numColumns +
+                             firstColumn;
+        for (x = 0; x < numWindowColumns; x++) {
+            count += (row[x] != 0) && (row[x] != 255);
+        }
+    }
+    return(count);
+}
+
+/*
+Count the pixels of the size by size block at (i, j) that are set,
+the pixels being set where they are not zero
+*/
+static int countBlock(unsigned char* image, int numColumns,
+                      int i, int j, int size)
+{
+    int count = 0, y, x;
+
+    for (y = 0; y < size; y++) {
+        unsigned char* row = image + (size_t) (i + y) * numColumns + j;
+        for (x = 0; x < size; x++) {
+            count += (row[x] != 0);
+        }
+    }
+    return(count);
+}
+
+/* Return 1 if the size by size blocks at (i, j) and (k, l) are the same */
+static int sameBlock(unsigned char* image, int numColumns,
+                     int i, int j, int k, int l, int size)
+{
+    int y, x;
+
+    for (y = 0; y < size; y++) {
+        unsigned char* row = image + (size_t) (i + y) * numColumns + j;
+        unsigned char* other = image + (size_t) (k + y) * numColumns + l;
+        for (x = 0; x < size; x++) {
+            if ((row[x] != 0) != (other[x] != 0)) {
+                return(0);
+            }
+        }
+    }
+    return(1);
+}
+
+/*
+Compare the size by size block at (i, j), if it has both black and
+white pixels, with the blocks size pixels to the right and below
+that lie in the image.  Adds the comparisons made to *numPtr and the
+blocks found the same to *repeatsPtr.
+*/
+static void compareBlock(unsigned char* image, int numRows, int numColumns,
+                         int i, int j, int size,
+                         int* numPtr, int* repeatsPtr)
+{
+    int count = countBlock(image, numColumns, i, j, size);
+
+    if ((count == 0) || (count == size * size)) {
+        return;
+    }
+    if (j + 2*size <= numColumns) {
+        (*numPtr)++;
+        *repeatsPtr += sameBlock(image, numColumns, i, j, i, j + size, size);
+    }
+    if (i + 2*size <= numRows) {
+        (*numPtr)++;
+        *repeatsPtr += sameBlock(image, numColumns, i, j, i + size, j, size);
+    }
+}
+
+/*
+Count the neighbouring pixels that differ within the 8 by 8 block at
+(i, j), horizontally and vertically
+*/
+static int blockTransitions(unsigned char* image, int numColumns,
+                            int i, int j)
+{
+    int transitions = 0, y, x;
+
+    for (y = 0; y < 8; y++) {
+        unsigned char* row = image + (size_t) (i + y) * numColumns + j;
+        for (x = 0; x < 8; x++) {
+            if ((x < 7) && ((row[x] != 0) != (row[x + 1] != 0))) {
+                transitions++;
+            }
+            if ((y < 7) && ((row[x] != 0) != (row[x + numColumns] != 0))) {
+                transitions++;
+            }
+        }
+    }
+    return(transitions);
+}
+
+/*
+Guess the halftoning type of the numRows by numColumns halftone
+image, whose pixels are set where they are not zero, from a sample of
+its 8 by 8 blocks, and store the statistics the guess was made from
+in *features unless it is a null pointer.  Returns
+HALFTONING_BY_ERROR_DIFFUSION, HALFTONING_BY_DISPERED_DITHER or
+HALFTONING_BY_CLUSTERED_DITHER; a halftone too small or too flat to
+tell is taken to be error diffused.  Only binary images are halftones:
+if the sample holds any pixel other than 0 and 255, such as those of
+a continuous tone image, HALFTONING_NOT_A_HALFTONE is returned.
+*/
+int classifyHalftone(unsigned char* image, int numRows, int numColumns,
+                     HalftoneFeatures* features)
+{
+    HalftoneFeatures sample;
+    int numCompared4 = 0, numRepeats4 = 0;
+    int numCompared8 = 0, numRepeats8 = 0;
+    int transitions = 0, minority = 0;
+    int windowRows = (numRows < CLASSIFIER_WINDOW) ?
+                     numRows : CLASSIFIER_WINDOW;
+    int windowColumns = (numColumns < CLASSIFIER_WINDOW) ?
+                        numColumns : CLASSIFIER_WINDOW;
+    int gridRows = numRows / CLASSIFIER_WINDOW;
+    int gridColumns = numColumns / CLASSIFIER_WINDOW;
+    int type = HALFTONING_BY_ERROR_DIFFUSION;
+    int u, v;
+
+    if (gridRows > CLASSIFIER_GRID) gridRows = CLASSIFIER_GRID;
+    if (gridRows < 1) gridRows = 1;
+    if (gridColumns > CLASSIFIER_GRID) gridColumns = CLASSIFIER_GRID;
+    if (gridColumns < 1) gridColumns = 1;
+
+    sample.numGreyPixels = 0;
+    sample.numBlocks = 0;
+    for (u = 0; u < gridRows; u++) {
+        /* Windows spread evenly, the last one ending at the edge */
+        int firstRow = (gridRows == 1) ? 0 :
+            (int) ((long long) (numRows - windowRows) * u / (gridRows - 1));
+        for (v = 0; v < gridColumns; v++) {
+            int firstColumn = (gridColumns == 1) ? 0 :
+                (int) ((long long) (numColumns - windowColumns) * v /
+                       (gridColumns - 1));
+            int i, j;
+            sample.numGreyPixels +=
+                countGreyPixels(image, numColumns, firstRow, firstColumn,
+                                windowRows, windowColumns);
+            for (i = firstRow; i + 8 <= firstRow + windowRows; i += 8) {
+                for (j = firstColumn; j + 8 <= firstColumn + windowColumns;
+                     j += 8) {
+                    int count = countBlock(image, numColumns, i, j, 8);
+                    if ((count == 0) || (count == 64)) {
+                        continue;
+                    }
+                    sample.numBlocks++;
+                    transitions += blockTransitions(image, numColumns, i, j);
+                    minority += (count < 32) ? count : 64 - count;
+                    compareBlock(image, numRows, numColumns, i, j, 8,
+                                 &numCompared8, &numRepeats8);
+                    compareBlock(image, numRows, numColumns, i, j, 4,
+                                 &numCompared4, &numRepeats4);
+                    compareBlock(image, numRows, numColumns, i, j + 4, 4,
+                                 &numCompared4, &numRepeats4);
+                    compareBlock(image, numRows, numColumns, i + 4, j, 4,
+                                 &numCompared4, &numRepeats4);
+                    compareBlock(image, numRows, numColumns, i + 4, j + 4, 4,
+                                 &numCompared4, &numRepeats4);
+                }
+            }
+        }
+    }
+
+    sample.repeat4 = (numCompared4 > 0) ?
+                     (double) numRepeats4 / numCompared4 : 0.0;
+    sample.repeat8 = (numCompared8 > 0) ?
+                     (double) numRepeats8 / numCompared8 : 0.0;
+    sample.transitionRatio = (minority > 0) ?
+                             (double) transitions / minority : 0.0;
+
+    if (sample.numGreyPixels > 0) {
+        type = HALFTONING_NOT_A_HALFTONE;
+    }
+    else if ((sample.repeat4 >= DITHER_REPEAT4) ||
+             (sample.repeat8 >= DITHER_REPEAT8)) {
+        type = (sample.transitionRatio < CLUSTERED_TRANSITIONS) ?
+               HALFTONING_BY_CLUSTERED_DITHER : HALFTONING_BY_DISPERED_DITHER;
+    }
+    if (features != 0) {
+        *features = sample;
+    }
+    return(type);
+}
+
+/*
+Return the halftoning type to inverse halftone image with: the type
+found by classifyHalftone if halftoningType is HALFTONING_BY_DETECTION,
+otherwise halftoningType, except that if fastErrorDiffusion is TRUE an
+image found to be error diffused is given error diffusion, whose
+filters are the smallest and so the fastest, whatever halftoningType
+says.  With HALFTONING_BY_DETECTION, HALFTONING_NOT_A_HALFTONE is
+returned for an image that is not binary, which is not worth a run.
+*/
+int chooseHalftoningType(unsigned char* image, int numRows, int numColumns,
+                         int halftoningType, int fastErrorDiffusion)
+{
+    int detectedType;
+
+    if ((halftoningType != HALFTONING_BY_DETECTION) && !fastErrorDiffusion) {
+        return(halftoningType);
+    }
+    detectedType = classifyHalftone(image, numRows, numColumns, 0);
+    if ((halftoningType == HALFTONING_BY_DETECTION) ||
+        (detectedType == HALFTONING_BY_ERROR_DIFFUSION)) {
+        return(detectedType);
+    }
+    return(halftoningType);
+}
+
+/* Name of a halftoning type, for messages */
+char* halftoningTypeName(int halftoningType)
+{
+    switch(halftoningType) {
+      case HALFTONING_BY_ERROR_DIFFUSION:
+        return("error diffusion");
+      case HALFTONING_BY_DISPERED_DITHER:
+        return("dispersed dot dither");
+      case HALFTONING_BY_CLUSTERED_DITHER:
+        return("clustered dot dither");
+      case HALFTONING_NOT_A_HALFTONE:
+        return("not a halftone");
+      default:
+        return("unknown");
+    }
+}
+
+/* Print the statistics that classifyHalftone went by */
+void printHalftoneFeatures(FILE* file, HalftoneFeatures* features)
+{
+    fprintf(file, "%d grey pixels, %d blocks, %.1f%% of 4x4 and %.1f%% of "
+            "8x8 repeated, %.2f transitions per minority pixel\n",
+            features->numGreyPixels, features->numBlocks,
+            100.0 * features->repeat4, 100.0 * features->repeat8,
+            features->transitionRatio);
+}
@@ -0,0 +1,52 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _HALFTONE_CLASSIFIER_H
+#define _HALFTONE_CLASSIFIER_H
+
+#include <stdio.h>
+
+/* halfType asking for the type to be found by classifyHalftone */
+#define HALFTONING_BY_DETECTION 0
+
+/* Returned by classifyHalftone for an image with grey levels */
+#define HALFTONING_NOT_A_HALFTONE -1
+
+/*
+Statistics of the blocks of 8 by 8 pixels sampled from a halftone
+that hold both black and white pixels: the fraction of them (and of
+their 4 by 4 quarters) that repeat exactly 8 (4) pixels to the right
+or below, and the number of neighbouring pixels that differ per pixel
+of the minority colour; and the number of pixels sampled that are
+neither 0 nor 255
+*/
+typedef struct HalftoneFeatures {
+    int numGreyPixels;
+    int numBlocks;
+    double repeat4;
+    double repeat8;
+    double transitionRatio;
+} HalftoneFeatures;
+
+int classifyHalftone(unsigned char* image, int numRows, int numColumns,
+                     HalftoneFeatures* features);
+int chooseHalftoningType(unsigned char* image, int numRows, int numColumns,
+                         int halftoningType, int fastErrorDiffusion);
+char* halftoningTypeName(int halftoningType);
+void printHalftoneFeatures(FILE* file, HalftoneFeatures* features);
+
+#endif
@@ -31,51 +31,92 @@ at The University of Texas at Austin, and can be reached at
 #include <stdlib.h>
 
 #include "image_io.h"
+#include "memory_usage.h"
 #include "readWriteImage.h"
 #include "readWritePPM.h"
 
 /* Allocate a raw byte image */
 static unsigned char* allocateImage(int numRows, int numColumns, int pixelSize)
 {
-    return((unsigned char*) calloc(numRows,
+    return((unsigned char*) trackedCalloc(numRows,
                                    numColumns*sizeof(unsigned char)*pixelSize));
 }
 
-/* Read 8 bit per pixel raw image */
-static void readRawByteImage(char* filename, unsigned char *imgBufferPtr,
-                             int *numRowsPtr, int *numColumnsPtr)
+/*
+Allocate a byte image of numRows by numColumns pixels, cleared to 0.
+Images from allocateByteImage and readByteImage are counted by
+memory_usage.h and must be released by freeByteImage.
+*/
+unsigned char* allocateByteImage(int numRows, int numColumns)
+{
+    return(allocateImage(numRows, numColumns, 1));
+}
+
+void freeByteImage(unsigned char* imgBufferPtr)
+{
+    trackedFree(imgBufferPtr);
+}
+
+/* Read 8 bit per pixel raw image.  Returns 0 on an error. */
+static int readRawByteImageChecked(char* filename,
+                                   unsigned char *imgBufferPtr,
+                                   int *numRowsPtr, int *numColumnsPtr)
 {
     FILE *fp = fopen(filename,"r");
-    if (fp != NULL) {
-        if (fread(imgBufferPtr, *numRowsPtr, *numColumnsPtr, fp) == 0) {
-            fprintf(stderr, "Error reading file '%s'.\n", filename);
-            exit(1);
-        }
-    }
-    else {
+    if (fp == NULL) {
         fprintf(stderr, "Error opening file '%s' for reading.\n", filename);
-        exit(1);
+        return(0);
+    }
+    if (fread(imgBufferPtr, *numRowsPtr, *numColumnsPtr, fp) == 0) {
+        fprintf(stderr, "Error reading file '%s'.\n", filename);
+        fclose(fp);
+        return(0);
     }
     fclose(fp);
+    return(1);
 }
 
-/* Write 8 bit per pixel raw image data */
-static void writeRawByteImage(char* filename, unsigned char *imgBufferPtr,
-                              int *numRowsPtr, int *numColumnsPtr)
+/* Read 8 bit per pixel raw image, exiting on an error */
+static void readRawByteImage(char* filename, unsigned char *imgBufferPtr,
+                             int *numRowsPtr, int *numColumnsPtr)
 {
-    FILE *fp = fopen(filename, "w");
-    if (fp != NULL) {
-        if ( fwrite(imgBufferPtr, *numRowsPtr,
-                    (*numColumnsPtr) * sizeof(unsigned char), fp) == 0 ) {
-            fprintf(stderr, "Error writing file '%s'.\n", filename);
-            exit(1);
-        }
+    if (!readRawByteImageChecked(filename, imgBufferPtr,
+                                 numRowsPtr, numColumnsPtr)) {
+        exit(1);
     }
-    else {
+}
+
+/* Write 8 bit per pixel raw image data.  Returns 0 on an error. */
+static int writeRawByteImageChecked(char* filename,
+                                    unsigned char *imgBufferPtr,
+                                    int *numRowsPtr, int *numColumnsPtr)
+{
+    FILE *fp = fopen(filename, "w");
+    if (fp == NULL) {
         fprintf(stderr, "Error opening file '%s' for writing.\n", filename);
+        return(0);
+    }
+    if ( fwrite(imgBufferPtr, *numRowsPtr,
+                (*numColumnsPtr) * sizeof(unsigned char), fp) == 0 ) {
+        fprintf(stderr, "Error writing file '%s'.\n", filename);
+        fclose(fp);
+        return(0);
+    }
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error writing file '%s'.\n", filename);
+        return(0);
+    }
+    return(1);
+}
+
+/* Write 8 bit per pixel raw image data, exiting on an error */
+static void writeRawByteImage(char* filename, unsigned char *imgBufferPtr,
+                              int *numRowsPtr, int *numColumnsPtr)
+{
+    if (!writeRawByteImageChecked(filename, imgBufferPtr,
+                                  numRowsPtr, numColumnsPtr)) {
         exit(1);
     }
-    fclose(fp);
 }
 
 
@@ -115,6 +156,52 @@ int readByteImage(char* filename, unsigned char **imgBufferPtrPtr,
     return(ppmType);
 }
 
+/*
+Read a byte image as readByteImage does, but return IMAGE_IO_ERROR
+rather than exit when the file cannot be read or memory cannot be
+allocated, so that one bad file does not end a batch.  A color image
+is also an error.  On an error, *imgBufferPtrPtr is a null pointer.
+*/
+int readByteImageChecked(char* filename, unsigned char **imgBufferPtrPtr,
+                         int *numRowsPtr, int *numColumnsPtr)
+{
+    int ppmType = FileMatchPPM(filename, numColumnsPtr, numRowsPtr);
+    int status = 0;
+
+    *imgBufferPtrPtr = 0;
+    if (ppmType == PPM) {
+        fprintf(stderr,
+                "File '%s' is a color image, but color images "
+                "are currently not supported.\n",
+                filename);
+        return(IMAGE_IO_ERROR);
+    }
+    if ((ppmType != RAW) && (ppmType != PGM)) {
+        fprintf(stderr, "Unrecognized image type %d.\n", ppmType);
+        return(IMAGE_IO_ERROR);
+    }
+    *imgBufferPtrPtr = allocateImage(*numRowsPtr, *numColumnsPtr, 1);
+    if (*imgBufferPtrPtr == 0) {
+        fprintf(stderr, "Could not allocate enough memory for '%s'.\n",
+                filename);
+        return(IMAGE_IO_ERROR);
+    }
+    if (ppmType == RAW) {
+        status = readRawByteImageChecked(filename, *imgBufferPtrPtr,
+                                         numRowsPtr, numColumnsPtr);
+    }
+    else {
+        status = (FileReadPPM(filename, *imgBufferPtrPtr,
+                              *numColumnsPtr, *numRowsPtr) == TCL_OK);
+    }
+    if (!status) {
+        freeByteImage(*imgBufferPtrPtr);
+        *imgBufferPtrPtr = 0;
+        return(IMAGE_IO_ERROR);
+    }
+    return(ppmType);
+}
+
 /* Write a byte image.  Could be in raw or PGM formats. */
 void writeByteImage(char* filename, unsigned char *imgBufferPtr,
                     int *numRowsPtr, int *numColumnsPtr, int imageType)
@@ -144,3 +231,149 @@ void writeByteImage(char* filename, unsigned char *imgBufferPtr,
         break;
     }
 }
+
+/*
+Write a byte image as writeByteImage does, but return 0 rather than
+exit when the file cannot be written, and 0 for an image type that is
+not written.  Returns 1 on success.
+*/
+int writeByteImageChecked(char* filename, unsigned char *imgBufferPtr,
+                          int *numRowsPtr, int *numColumnsPtr, int imageType)
+{
+    Tk_PhotoImageBlock block;
+
+    if (imageType == RAW) {
+        return(writeRawByteImageChecked(filename, imgBufferPtr,
+                                        numRowsPtr, numColumnsPtr));
+    }
+    if (imageType == PPM) {
+        fprintf(stderr,
+                "Request to write '%s' as a color image was not fulfilled "
+                "because color images are currently not supported.\n",
+                filename);
+        return(0);
+    }
+    if (imageType != PGM) {
+        fprintf(stderr, "Unrecognized image type %d.\n", imageType);
+        return(0);
+    }
+    InitImageInfo(&block, imgBufferPtr, imageType,
+                  *numColumnsPtr, *numRowsPtr);
+    if (FileWritePPM(filename, &block) != TCL_OK) {
+        fprintf(stderr, "Error writing file '%s'.\n", filename);
+        return(0);
+    }
+    return(1);
+}
+
+/*
+Read an image of one or more channels into planes, channel k being
+the numRows by numColumns bytes starting numRows*numColumns*k bytes
+into the buffer.  A PPM file gives its red, green and blue channels; a
+raw image with cmykFlag set holds the four planes cyan, magenta,
+yellow and black one after the other; a PGM file, or a raw image
+without cmykFlag, has one channel.  Returns the type of the image, as
+readByteImage does, and the number of channels in *numChannelsPtr.
+The buffer must be released by freeByteImage.
+*/
+int readChannelImage(char* filename, unsigned char **imgBufferPtrPtr,
+                     int *numRowsPtr, int *numColumnsPtr,
+                     int *numChannelsPtr, int cmykFlag)
+{
+    int ppmType = FileMatchPPM(filename, numColumnsPtr, numRowsPtr);
+    size_t numPixels, i;
+    unsigned char *pixels;
+    int k;
+
+    *numChannelsPtr = 1;
+    if ((ppmType == RAW) && cmykFlag) {
+        *numChannelsPtr = 4;
+        *imgBufferPtrPtr = allocateImage(4 * *numRowsPtr, *numColumnsPtr, 1);
+        if (*imgBufferPtrPtr == 0) {
+            fprintf(stderr, "Could not allocate enough memory for images.\n");
+            exit(1);
+        }
+        *numRowsPtr *= 4;
+        readRawByteImage(filename, *imgBufferPtrPtr, numRowsPtr,
+                         numColumnsPtr);
+        *numRowsPtr /= 4;
+        return(ppmType);
+    }
+    if (ppmType != PPM) {
+        return(readByteImage(filename, imgBufferPtrPtr, numRowsPtr,
+                             numColumnsPtr));
+    }
+
+    /* Read the interleaved pixels, then separate the channels */
+    *numChannelsPtr = 3;
+    numPixels = (size_t) *numRowsPtr * *numColumnsPtr;
+    pixels = allocateImage(*numRowsPtr, *numColumnsPtr, 3);
+    *imgBufferPtrPtr = allocateImage(*numRowsPtr, *numColumnsPtr, 3);
+    if ((pixels == 0) || (*imgBufferPtrPtr == 0)) {
+        fprintf(stderr, "Could not allocate enough memory for images.\n");
+        exit(1);
+    }
+    if (FileReadPPM(filename, pixels, *numColumnsPtr, *numRowsPtr) !=
+        TCL_OK) {
+        exit(1);
+    }
+    for (k = 0; k < 3; k++) {
+        unsigned char *plane = *imgBufferPtrPtr + numPixels*k;
+        for (i = 0; i < numPixels; i++) {
+            plane[i] = pixels[3*i + k];
+        }
+    }
+    freeByteImage(pixels);
+
+    return(ppmType);
+}
+
+/*
+Write an image of numChannels planes, laid out as by readChannelImage.
+Three channels are written as a PPM file of red, green and blue.  Four
+channels are cyan, magenta, yellow and black ink, 255 being full
+coverage, and are converted to red, green and blue by subtracting the
+ink from white, red being 255 - (cyan + black) and so on, then written
+as a PPM file.  One channel is written as writeByteImage does.
+*/
+void writeChannelImage(char* filename, unsigned char *imgBufferPtr,
+                       int *numRowsPtr, int *numColumnsPtr,
+                       int numChannels, int imageType)
+{
+    size_t numPixels = (size_t) *numRowsPtr * *numColumnsPtr, i;
+    Tk_PhotoImageBlock block;
+    unsigned char *pixels;
+    int k;
+
+    if (numChannels == 1) {
+        writeByteImage(filename, imgBufferPtr, numRowsPtr, numColumnsPtr,
+                       imageType);
+        return;
+    }
+
+    pixels = allocateImage(*numRowsPtr, *numColumnsPtr, 3);
+    if (pixels == 0) {
+        fprintf(stderr, "Could not allocate enough memory for images.\n");
+        exit(1);
+    }
+    for (k = 0; k < 3; k++) {
+        unsigned char *plane = imgBufferPtr + numPixels*k;
+        if (numChannels == 4) {
+            unsigned char *black = imgBufferPtr + numPixels*3;
+            for (i = 0; i < numPixels; i++) {
+                int ink = plane[i] + black[i];
+                pixels[3*i + k] = (ink > 255) ? 0 : 255 - ink;
+            }
+        }
+        else {
+            for (i = 0; i < numPixels; i++) {
+                pixels[3*i + k] = plane[i];
+            }
+        }
+    }
+    InitImageInfo(&block, pixels, PPM, *numColumnsPtr, *numRowsPtr);
+    if (FileWritePPM(filename, &block) != TCL_OK) {
+        exit(1);
+    }
+    freeByteImage(pixels);
+}
@@ -28,9 +28,27 @@ at The University of Texas at Austin, and can be reached at
 #ifndef _IMAGE_IO_H
 #define _IMAGE_IO_H
 
+/* Most channels of the images of readChannelImage: C, M, Y and K */
+#define MAX_IMAGE_CHANNELS 4
+
+/* Returned by readByteImageChecked for a file that could not be read */
+#define IMAGE_IO_ERROR -1
+
 int readByteImage(char* filename, unsigned char **imgBufferPtrPtr,
                   int *numRowsPtr, int *numColumnsPtr);
 void writeByteImage(char* filename, unsigned char *imgBufferPtr,
                     int *numRowsPtr, int *numColumnsPtr, int imageType);
+int readByteImageChecked(char* filename, unsigned char **imgBufferPtrPtr,
+                         int *numRowsPtr, int *numColumnsPtr);
+int writeByteImageChecked(char* filename, unsigned char *imgBufferPtr,
+                          int *numRowsPtr, int *numColumnsPtr, int imageType);
+unsigned char* allocateByteImage(int numRows, int numColumns);
+void freeByteImage(unsigned char* imgBufferPtr);
+int readChannelImage(char* filename, unsigned char **imgBufferPtrPtr,
+                     int *numRowsPtr, int *numColumnsPtr,
+                     int *numChannelsPtr, int cmykFlag);
+void writeChannelImage(char* filename, unsigned char *imgBufferPtr,
+                       int *numRowsPtr, int *numColumnsPtr,
+                       int numChannels, int imageType);
 
 #endif
@@ -0,0 +1,435 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Image quality metrics for judging inverse halftones against the original
+greyscale image:
+
+  MSE and PSNR, with a peak value of 255;
+
+  SSIM, the mean structural similarity index of
+
+    Z. Wang, A. C. Bovik, H. R. Sheikh, and E. P. Simoncelli,
+      ``Image Quality Assessment: From Error Visibility to Structural
+      Similarity,'' IEEE Trans. on Image Processing, Apr. 2004,
+
+  with an 11 x 11 Gaussian window of standard deviation 1.5 evaluated
+  at every position where the window fits inside the image;
+
+  WSNR, a weighted SNR in which the reference and the error are both
+  weighted by a low-pass model of the contrast sensitivity of the eye
+  before their energies are compared.  The model is the normalized
+  7 x 7 Gaussian h2 of fastiht1, a spatial stand-in for the contrast
+  sensitivity function at a typical viewing distance.
+
+The metrics are computed in one pass over bands of rows, spread over
+several threads.  The inner loops run along the columns over
+contiguous arrays so that the compiler can vectorize them.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "image_metrics.h"
+#include "image_io.h"
+#include "readWriteImage.h"
+#include "thread_utils.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define MAX_METRIC_THREADS 64
+
+#define SSIM_WINDOW 11
+#define SSIM_SIGMA 1.5
+#define SSIM_C1 ((0.01*255)*(0.01*255))
+#define SSIM_C2 ((0.03*255)*(0.03*255))
+
+#define CSF_TAPS 7
+
+/* Squared errors are summed in 32 bits over runs of at most this length */
+#define MSE_RUN_LENGTH 32768
+
+/* Contrast sensitivity model: the 7-tap Gaussian h2 of fastiht1 */
+static const float csfFilter[CSF_TAPS] =
+    {44.0f/9999, 540.0f/9999, 2420.0f/9999, 3991.0f/9999,
+     2420.0f/9999, 540.0f/9999, 44.0f/9999};
+
+typedef struct MetricsJob {
+    unsigned char* image;
+    unsigned char* reference;
+    int numRows;
+    int numColumns;
+    float ssimWindow[SSIM_WINDOW];
+    double squaredError[MAX_METRIC_THREADS];
+    double ssimSum[MAX_METRIC_THREADS];
+    double weightedSignal[MAX_METRIC_THREADS];
+    double weightedNoise[MAX_METRIC_THREADS];
+    int errorFlag;
+} MetricsJob;
+
+/* Sum of squared differences of rows first through last - 1 */
+static double sumSquaredError(MetricsJob* job, int first, int last)
+{
+    double total = 0.0;
+    size_t k = (size_t) first * job->numColumns;
+    size_t end = (size_t) last * job->numColumns;
+
+    while (k < end) {
+        unsigned int partial = 0;
+        size_t runEnd = k + MSE_RUN_LENGTH;
+        unsigned char* x = job->image;
+        unsigned char* y = job->reference;
+        if (runEnd > end) runEnd = end;
+        for (; k < runEnd; k++) {
+            int d = (int) x[k] - (int) y[k];
+            partial += (unsigned int) (d * d);
+        }
+        total += partial;
+    }
+    return(total);
+}
+
+/* Filter row i of x and y horizontally with the SSIM window */
+static void ssimRowPass(MetricsJob* job, int i, float** rows)
+{
+    int validColumns = job->numColumns - SSIM_WINDOW + 1;
+    unsigned char* x = job->image + (size_t) i * job->numColumns;
+    unsigned char* y = job->reference + (size_t) i * job->numColumns;
+    float *mx = rows[0], *my = rows[1], *mxx = rows[2], *myy = rows[3],
+          *mxy = rows[4];
+    int j, k;
+
+    for (j = 0; j < validColumns; j++) {
+        mx[j] = my[j] = mxx[j] = myy[j] = mxy[j] = 0.0f;
+    }
+    for (k = 0; k < SSIM_WINDOW; k++) {
+        float w = job->ssimWindow[k];
+        unsigned char* xk = x + k;
+        unsigned char* yk = y + k;
+        for (j = 0; j < validColumns; j++) {
+            float a = (float) xk[j];
+            float b = (float) yk[j];
+            mx[j] += w * a;
+            my[j] += w * b;
+            mxx[j] += w * a * a;
+            myy[j] += w * b * b;
+            mxy[j] += w * a * b;
+        }
+    }
+}
+
+/*
+Sum the SSIM map over the output rows first through last - 1.  Output
+row i is the window whose top row is image row i.  The horizontally
+filtered rows are kept in a ring of SSIM_WINDOW rows.
+*/
+static double sumSsim(MetricsJob* job, int first, int last)
+{
+    int validColumns = job->numColumns - SSIM_WINDOW + 1;
+    float* storage = (float*) malloc((SSIM_WINDOW + 1) * 5 *
+                                     validColumns * sizeof(float));
+    float* ring[SSIM_WINDOW][5];
+    float* sums[5];
+    double total = 0.0;
+    int i, j, k, q;
+
+    if (storage == 0) {
+        job->errorFlag = TRUE;
+        return(0.0);
+    }
+    for (k = 0; k < SSIM_WINDOW; k++) {
+        for (q = 0; q < 5; q++) {
+            ring[k][q] = storage + (size_t) (k*5 + q) * validColumns;
+        }
+    }
+    for (q = 0; q < 5; q++) {
+        sums[q] = storage + (size_t) (SSIM_WINDOW*5 + q) * validColumns;
+    }
+
+    for (i = first; i < first + SSIM_WINDOW - 1; i++) {
+        ssimRowPass(job, i, ring[i % SSIM_WINDOW]);
+    }
+    for (i = first; i < last; i++) {
+        float *mx = sums[0], *my = sums[1], *mxx = sums[2], *myy = sums[3],
+              *mxy = sums[4];
+        double rowTotal = 0.0;
+
+        ssimRowPass(job, i + SSIM_WINDOW - 1,
+                    ring[(i + SSIM_WINDOW - 1) % SSIM_WINDOW]);
+        for (q = 0; q < 5; q++) {
+            memset(sums[q], 0, validColumns * sizeof(float));
+        }
+        for (k = 0; k < SSIM_WINDOW; k++) {
+            float w = job->ssimWindow[k];
+            float** rows = ring[(i + k) % SSIM_WINDOW];
+            for (q = 0; q < 5; q++) {
+                float* src = rows[q];
+                float* dst = sums[q];
+                for (j = 0; j < validColumns; j++) {
+                    dst[j] += w * src[j];
+                }
+            }
+        }
+        for (j = 0; j < validColumns; j++) {
+            float muxy = mx[j] * my[j];
+            float mux2 = mx[j] * mx[j];
+            float muy2 = my[j] * my[j];
+            float sxy = mxy[j] - muxy;
+            float sx2 = mxx[j] - mux2;
+            float sy2 = myy[j] - muy2;
+            rowTotal += ((2.0f*muxy + (float) SSIM_C1) *
+                         (2.0f*sxy + (float) SSIM_C2)) /
+                        ((mux2 + muy2 + (float) SSIM_C1) *
+                         (sx2 + sy2 + (float) SSIM_C2));
+        }
+        total += rowTotal;
+    }
+
+    free(storage);
+    return(total);
+}
+
+/* Mirror index p into the range 0 through n - 1 */
+static int mirrorIndex(int p, int n)
+{
+    if (p < 0) p = -p;
+    if (p >= n) p = 2*n - p - 2;
+    if (p < 0) p = 0;
+    return(p);
+}
+
+/*
+Filter row i of the reference and of the error horizontally with the
+contrast sensitivity model, mirroring at the sides.
+*/
+static void csfRowPass(MetricsJob* job, int i, float* signal, float* noise,
+                       float* rawSignal, float* rawNoise)
+{
+    int n = job->numColumns;
+    int half = CSF_TAPS / 2;
+    unsigned char* x = job->image + (size_t) i * n;
+    unsigned char* y = job->reference + (size_t) i * n;
+    int j, k;
+
+    /* Mirrored copies of the row so that the taps need no bounds checks */
+    for (j = -half; j < n + half; j++) {
+        int p = mirrorIndex(j, n);
+        rawSignal[j + half] = (float) y[p];
+        rawNoise[j + half] = (float) x[p] - (float) y[p];
+    }
+    for (j = 0; j < n; j++) {
+        signal[j] = noise[j] = 0.0f;
+    }
+    for (k = 0; k < CSF_TAPS; k++) {
+        float w = csfFilter[k];
+        float* s = rawSignal + k;
+        float* e = rawNoise + k;
+        for (j = 0; j < n; j++) {
+            signal[j] += w * s[j];
+            noise[j] += w * e[j];
+        }
+    }
+}
+
+/*
+Sum the energies of the weighted reference and weighted error over the
+rows first through last - 1.
+*/
+static void sumWeightedEnergies(MetricsJob* job, int first, int last,
+                                double* signalPtr, double* noisePtr)
+{
+    int n = job->numColumns;
+    int half = CSF_TAPS / 2;
+    float* storage = (float*) malloc(((2*CSF_TAPS + 2) * (size_t) n +
+                                      2 * (size_t) (n + 2*half)) *
+                                     sizeof(float));
+    float *signalRing[CSF_TAPS], *noiseRing[CSF_TAPS];
+    float *signal, *noise, *rawSignal, *rawNoise;
+    double signalTotal = 0.0, noiseTotal = 0.0;
+    int i, j, k;
+
+    if (storage == 0) {
+        job->errorFlag = TRUE;
+        return;
+    }
+    for (k = 0; k < CSF_TAPS; k++) {
+        signalRing[k] = storage + (size_t) (2*k) * n;
+        noiseRing[k] = storage + (size_t) (2*k + 1) * n;
+    }
+    signal = storage + (size_t) (2*CSF_TAPS) * n;
+    noise = signal + n;
+    rawSignal = noise + n;
+    rawNoise = rawSignal + n + 2*half;
+
+    /* Ring slot k holds the row pass of image row i - half + k */
+    for (i = first; i < last; i++) {
+        double rowSignal = 0.0, rowNoise = 0.0;
+        if (i == first) {
+            for (k = 0; k < CSF_TAPS; k++) {
+                csfRowPass(job, mirrorIndex(i - half + k, job->numRows),
+                           signalRing[(i - half + k + CSF_TAPS) % CSF_TAPS],
+                           noiseRing[(i - half + k + CSF_TAPS) % CSF_TAPS],
+                           rawSignal, rawNoise);
+            }
+        }
+        else {
+            int newRow = i + half;
+            csfRowPass(job, mirrorIndex(newRow, job->numRows),
+                       signalRing[newRow % CSF_TAPS],
+                       noiseRing[newRow % CSF_TAPS],
+                       rawSignal, rawNoise);
+        }
+        for (j = 0; j < n; j++) {
+            signal[j] = noise[j] = 0.0f;
+        }
+        for (k = 0; k < CSF_TAPS; k++) {
+            int slot = (i - half + k + CSF_TAPS) % CSF_TAPS;
+            float w = csfFilter[k];
+            float* s = signalRing[slot];
+            float* e = noiseRing[slot];
+            for (j = 0; j < n; j++) {
+                signal[j] += w * s[j];
+                noise[j] += w * e[j];
+            }
+        }
+        for (j = 0; j < n; j++) {
+            rowSignal += signal[j] * signal[j];
+            rowNoise += noise[j] * noise[j];
+        }
+        signalTotal += rowSignal;
+        noiseTotal += rowNoise;
+    }
+
+    free(storage);
+    *signalPtr = signalTotal;
+    *noisePtr = noiseTotal;
+}
+
+/* Compute all the partial sums for one band of rows */
+static void metricsTask(void* arg, int first, int last, int chunkIndex)
+{
+    MetricsJob* job = (MetricsJob*) arg;
+    int lastSsimRow = job->numRows - SSIM_WINDOW + 1;
+
+    if (last < lastSsimRow) lastSsimRow = last;
+
+    job->squaredError[chunkIndex] = sumSquaredError(job, first, last);
+    if ((first < lastSsimRow) && (job->numColumns >= SSIM_WINDOW)) {
+        job->ssimSum[chunkIndex] = sumSsim(job, first, lastSsimRow);
+    }
+    sumWeightedEnergies(job, first, last, &job->weightedSignal[chunkIndex],
+                        &job->weightedNoise[chunkIndex]);
+}
+
+/*
+Measure image against reference, both numRows by numColumns pixels,
+using up to numThreads threads, or one per processor if numThreads is
+zero.  Returns FALSE if memory ran out.
+*/
+int computeImageMetrics(unsigned char* image, unsigned char* reference,
+                        int numRows, int numColumns, int numThreads,
+                        ImageMetrics* metrics)
+{
+    MetricsJob* job = (MetricsJob*) calloc(1, sizeof(MetricsJob));
+    double squaredError = 0.0, ssimSum = 0.0, signal = 0.0, noise = 0.0;
+    double windowSum = 0.0, numPixels = (double) numRows * numColumns;
+    int numSsimRows = numRows - SSIM_WINDOW + 1;
+    int numChunks, k;
+
+    if (job == 0) {
+        return FALSE;
+    }
+    job->image = image;
+    job->reference = reference;
+    job->numRows = numRows;
+    job->numColumns = numColumns;
+    for (k = 0; k < SSIM_WINDOW; k++) {
+        double d = k - SSIM_WINDOW/2;
+        job->ssimWindow[k] = (float) exp(-d*d / (2.0*SSIM_SIGMA*SSIM_SIGMA));
+        windowSum += job->ssimWindow[k];
+    }
+    for (k = 0; k < SSIM_WINDOW; k++) {
+        job->ssimWindow[k] /= (float) windowSum;
+    }
+
+    /* The SSIM rows of each band only depend on rows within the band */
+    if (numThreads == 0) numThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (numThreads > MAX_METRIC_THREADS) numThreads = MAX_METRIC_THREADS;
+    if (numThreads < 1) numThreads = 1;
+    numChunks = parallelFor(numRows, numThreads, metricsTask, job);
+
+    for (k = 0; k < numChunks; k++) {
+        squaredError += job->squaredError[k];
+        ssimSum += job->ssimSum[k];
+        signal += job->weightedSignal[k];
+        noise += job->weightedNoise[k];
+    }
+
+    metrics->mse = squaredError / numPixels;
+    metrics->psnr = (metrics->mse > 0.0) ?
+                    10.0 * log10(255.0 * 255.0 / metrics->mse) : HUGE_VAL;
+    metrics->ssim = ((numSsimRows > 0) && (numColumns >= SSIM_WINDOW)) ?
+                    ssimSum / ((double) numSsimRows *
+                               (numColumns - SSIM_WINDOW + 1)) : 0.0;
+    metrics->wsnr = (noise > 0.0) ? 10.0 * log10(signal / noise) : HUGE_VAL;
+
+    k = !job->errorFlag;
+    free(job);
+    return(k);
+}
+
+/* Print the metrics on one line */
+void printImageMetrics(FILE* fp, ImageMetrics* metrics)
+{
+    fprintf(fp, "PSNR %.2f dB, MSE %.2f, SSIM %.4f, WSNR %.2f dB\n",
+            metrics->psnr, metrics->mse, metrics->ssim, metrics->wsnr);
+}
+
+/*
+Read the reference image fileName, which must be a raw or PGM image of
+numRows by numColumns pixels.  Returns a null pointer on an error.
+*/
+unsigned char* readReferenceImage(char* fileName, int numRows, int numColumns)
+{
+    unsigned char* reference = 0;
+    int referenceRows = numRows, referenceColumns = numColumns;
+    int imageType = readByteImageChecked(fileName, &reference,
+                                         &referenceRows, &referenceColumns);
+
+    if (imageType == IMAGE_IO_ERROR) {
+        return(0);
+    }
+    if ((referenceRows != numRows) || (referenceColumns != numColumns)) {
+        fprintf(stderr, "Reference image '%s' is %d by %d, not %d by %d.\n",
+                fileName, referenceRows, referenceColumns,
+                numRows, numColumns);
+        freeByteImage(reference);
+        return(0);
+    }
+    return(reference);
+}
@@ -0,0 +1,38 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _IMAGE_METRICS_H
+#define _IMAGE_METRICS_H
+
+#include <stdio.h>
+
+/* Quality of an 8-bit image measured against a reference image */
+typedef struct ImageMetrics {
+    double mse;                 /* mean squared error */
+    double psnr;                /* peak signal-to-noise ratio in dB */
+    double ssim;                /* mean structural similarity index */
+    double wsnr;                /* weighted signal-to-noise ratio in dB */
+} ImageMetrics;
+
+int computeImageMetrics(unsigned char* image, unsigned char* reference,
+                        int numRows, int numColumns, int numThreads,
+                        ImageMetrics* metrics);
+void printImageMetrics(FILE* fp, ImageMetrics* metrics);
+unsigned char* readReferenceImage(char* fileName,
+                                  int numRows, int numColumns);
+
+#endif
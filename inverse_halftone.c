@@ -35,15 +35,25 @@ explained in the following paper:
     http://www.ece.utexas.edu/~bevans/papers/1998/inverse_halftoning/
 */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
 /* Standard includes */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "matrix_utils.h"
+#include "memory_usage.h"
 #include "inverse_halftone.h"
+#include "recursive_gaussian.h"
+#include "row_queue.h"
+#include "timer_utils.h"
 
 /* Constants */
 
@@ -63,205 +73,703 @@ explained in the following paper:
 #define SWAP(a,b) { temp = (a); (a) = (b); (b) = temp; }
 
 /*
-Filter the entire image with the separable filter given by
-the coefficients in filter.  The filter is assumed to have
-the same response in each dimension.  We mirror the pixel
-values at the boundaries of the image.  The image is
-assumed to be binary, so we implement the filtering using
-only additions.  The results of the filtering are scaled 
-by norm.
+The separable Gaussian filters are symmetric, so each pass adds the
+two pixels that share a coefficient before multiplying.  Rather than
+one function per tap count that reads its coefficients from an array,
+the macros below generate one fully unrolled row filter and column
+filter per set of coefficients, h0 being the outermost tap and hc the
+centre tap.  The coefficients become constants in the code.  Filters
+whose outer taps are zero are generated with the smaller tap count.
+The sums are formed in the same order as the straightforward
+implementation, so the results are identical to it.
+
+A row filter reads one row of source, which must have a mirrored
+border as wide as the filter radius.  A column filter reads the
+2*radius + 1 row filter results in rows, centred on the output row,
+and scales the result by NORMALIZATION_CONSTANT and rounds it.
+*/
+
+/* Radius of the third Gaussian filter, the same for all halftones */
+#define THIRD_FILTER_RADIUS 3
+
+/*
+Standard deviations of the Gaussian filters below, in pixels, which
+the recursive filters reproduce, scaled by the resolution
+*/
+#define FIRST_FILTER_SIGMA            1.1818
+#define DISP_DITH_FIRST_FILTER_SIGMA  1.5520
+#define CLUST_DITH_FIRST_FILTER_SIGMA 2.1854
+#define SECOND_FILTER_SIGMA           0.9976
+#define DITH_SECOND_FILTER_SIGMA      0.9992
+#define THIRD_FILTER_SIGMA            0.7066
+#define MAX_FILTER_SIGMA CLUST_DITH_FIRST_FILTER_SIGMA
+
+/* Rows kept by the rolling buffers of the G2 and G3 cascade */
+#define CASCADE_RING_ROWS 9
+
+typedef void (*BinaryRowFilter)(float *dest, unsigned char *source, int n);
+typedef void (*GreyRowFilter)(float *dest, float *source, int n);
+typedef void (*ColumnFilter)(float *dest, float **rows, int n);
+
+/*
+Define a 9 tap row filter for binary images, whose pixels are 0 or 1,
+so that it needs only integer arithmetic.
+*/
+#define DEFINE_BINARY_ROW_FILTER_9(name, h0, h1, h2, h3, hc) \
+static void name(float *dest, unsigned char *source, int n) \
+{ \
+    int j; \
+    for (j = 0; j < n; j++) { \
+        int sum = hc*source[j] + \
+                  h0*(source[j-4]+source[j+4]) + \
+                  h1*(source[j-3]+source[j+3]) + \
+                  h2*(source[j-2]+source[j+2]) + \
+                  h3*(source[j-1]+source[j+1]); \
+        dest[j] = (float) (255 * sum); \
+    } \
+}
+
+/* Define a 7 tap row filter for grey images */
+#define DEFINE_GREY_ROW_FILTER_7(name, h0, h1, h2, hc) \
+static void name(float *dest, float *source, int n) \
+{ \
+    int j; \
+    for (j = 0; j < n; j++) { \
+        dest[j] = (hc*source[j]) + \
+                  (h0*(source[j-3]+source[j+3])) + \
+                  (h1*(source[j-2]+source[j+2])) + \
+                  (h2*(source[j-1]+source[j+1])); \
+    } \
+}
+
+/* Define a 9 tap row filter for grey images */
+#define DEFINE_GREY_ROW_FILTER_9(name, h0, h1, h2, h3, hc) \
+static void name(float *dest, float *source, int n) \
+{ \
+    int j; \
+    for (j = 0; j < n; j++) { \
+        dest[j] = (hc*source[j]) + \
+                  (h0*(source[j-4]+source[j+4])) + \
+                  (h1*(source[j-3]+source[j+3])) + \
+                  (h2*(source[j-2]+source[j+2])) + \
+                  (h3*(source[j-1]+source[j+1])); \
+    } \
+}
+
+/* Define a 7 tap column filter */
+#define DEFINE_COLUMN_FILTER_7(name, h0, h1, h2, hc) \
+static void name(float *dest, float **rows, int n) \
+{ \
+    float *r0 = rows[0], *r1 = rows[1], *r2 = rows[2], *r3 = rows[3]; \
+    float *r4 = rows[4], *r5 = rows[5], *r6 = rows[6]; \
+    int j; \
+    for (j = 0; j < n; j++) { \
+        float sum = (hc*r3[j]) + \
+                    (h0*(r0[j]+r6[j])) + \
+                    (h1*(r1[j]+r5[j])) + \
+                    (h2*(r2[j]+r4[j])); \
+        dest[j] = (float)((int) (sum/(float) NORMALIZATION_CONSTANT + \
+                                 FLOAT_TO_INT_OFFSET)); \
+    } \
+}
+
+/* Define a 9 tap column filter */
+#define DEFINE_COLUMN_FILTER_9(name, h0, h1, h2, h3, hc) \
+static void name(float *dest, float **rows, int n) \
+{ \
+    float *r0 = rows[0], *r1 = rows[1], *r2 = rows[2], *r3 = rows[3]; \
+    float *r4 = rows[4], *r5 = rows[5], *r6 = rows[6], *r7 = rows[7]; \
+    float *r8 = rows[8]; \
+    int j; \
+    for (j = 0; j < n; j++) { \
+        float sum = (hc*r4[j]) + \
+                    (h0*(r0[j]+r8[j])) + \
+                    (h1*(r1[j]+r7[j])) + \
+                    (h2*(r2[j]+r6[j])) + \
+                    (h3*(r3[j]+r5[j])); \
+        dest[j] = (float)((int) (sum/(float) NORMALIZATION_CONSTANT + \
+                                 FLOAT_TO_INT_OFFSET)); \
+    } \
+}
+
+/*
+Define a 9 tap row filter for binary images that only computes every
+other pixel, dest[j] being the result at source[2*j], for the
+resolution pyramid
+*/
+#define DEFINE_BINARY_HALVING_ROW_FILTER_9(name, h0, h1, h2, h3, hc) \
+static void name(float *dest, unsigned char *source, int n) \
+{ \
+    int j; \
+    for (j = 0; j < n; j++) { \
+        unsigned char *s = source + 2*j; \
+        int sum = hc*s[0] + \
+                  h0*(s[-4]+s[4]) + \
+                  h1*(s[-3]+s[3]) + \
+                  h2*(s[-2]+s[2]) + \
+                  h3*(s[-1]+s[1]); \
+        dest[j] = (float) (255 * sum); \
+    } \
+}
+
+/* Define a 7 tap row filter for grey images that halves the row */
+#define DEFINE_GREY_HALVING_ROW_FILTER_7(name, h0, h1, h2, hc) \
+static void name(float *dest, float *source, int n) \
+{ \
+    int j; \
+    for (j = 0; j < n; j++) { \
+        float *s = source + 2*j; \
+        dest[j] = (hc*s[0]) + \
+                  (h0*(s[-3]+s[3])) + \
+                  (h1*(s[-2]+s[2])) + \
+                  (h2*(s[-1]+s[1])); \
+    } \
+}
+
+/* First Gaussian filter: 9 x 9, {11,135,808,2359,3372,2359,808,135,11} */
+DEFINE_BINARY_ROW_FILTER_9(GaussianFilter1Rows, 11, 135, 808, 2359, 3372)
+DEFINE_BINARY_HALVING_ROW_FILTER_9(GaussianFilter1HalvingRows,
+                                   11, 135, 808, 2359, 3372)
+DEFINE_COLUMN_FILTER_9(GaussianFilter1Columns, 11, 135, 808, 2359, 3372)
+
+/* First Gaussian filter for Dispersed dot dither: 9 x 9  */
+DEFINE_BINARY_ROW_FILTER_9(GaussianFilterDispDith1Rows,
+                           103, 419, 1138, 2074, 2533)
+DEFINE_BINARY_HALVING_ROW_FILTER_9(GaussianFilterDispDith1HalvingRows,
+                                   103, 419, 1138, 2074, 2533)
+DEFINE_COLUMN_FILTER_9(GaussianFilterDispDith1Columns,
+                       103, 419, 1138, 2074, 2533)
+
+/* First Gaussian filter for Clustered dot dither: 9 x 9  */
+DEFINE_BINARY_ROW_FILTER_9(GaussianFilterClustDith1Rows,
+                           583, 903, 1234, 1488, 1584)
+DEFINE_BINARY_HALVING_ROW_FILTER_9(GaussianFilterClustDith1HalvingRows,
+                                   583, 903, 1234, 1488, 1584)
+DEFINE_COLUMN_FILTER_9(GaussianFilterClustDith1Columns,
+                       583, 903, 1234, 1488, 1584)
+
+/*
+Second Gaussian filter: 7 x 7, {44,540,2420,3991,2420,540,44}.  Its
+halving version also smooths each level of the pyramid before it is
+halved again.
+*/
+DEFINE_GREY_ROW_FILTER_7(GaussianFilter2Rows, 44, 540, 2420, 3991)
+DEFINE_GREY_HALVING_ROW_FILTER_7(GaussianFilter2HalvingRows,
+                                 44, 540, 2420, 3991)
+DEFINE_COLUMN_FILTER_7(GaussianFilter2Columns, 44, 540, 2420, 3991)
+
+/* Second Gaussian filter for dither: 9 x 9, {1,44,540,2420,3989,...} */
+DEFINE_GREY_ROW_FILTER_9(GaussianFilterDith2Rows, 1, 44, 540, 2420, 3989)
+DEFINE_COLUMN_FILTER_9(GaussianFilterDith2Columns, 1, 44, 540, 2420, 3989)
+
+/*
+Third Gaussian filter: 7 x 7, {1,103,2075,5641,2075,103,1}.  The third
+filter for dithered halftones, {0,1,103,2075,5641,2075,103,1,0}, has
+zero outer taps, so it is this filter as well.
+*/
+DEFINE_GREY_ROW_FILTER_7(GaussianFilter3Rows, 1, 103, 2075, 5641)
+DEFINE_COLUMN_FILTER_7(GaussianFilter3Columns, 1, 103, 2075, 5641)
+
+/*
+Filter the entire binary image source with the separable 9 x 9 filter
+given by its row and column filters.  The plane source must have a
+mirrored border of 4 pixels, and ws a border of 4 rows.  The border
+of dest is mirrored on return.
 */ 
-static float** separable9x9FIRBinaryImage(int m, int n, float **source,
-                                          float **dest, int *filter,
-                                          float norm)
+static ImagePlane* separable9x9FIRBinaryImage(int m, int n,
+                                              ImagePlane *source,
+                                              ImagePlane *dest,
+                                              ImagePlane *ws,
+                                              BinaryRowFilter rowFilter,
+                                              ColumnFilter columnFilter)
 {
-    int i, j;
-
-    /* Temporary array to hold the result of processing the rows */
-    float **ws = allocateFloatMatrix(m,n);
+    int i, k;
 
     /* Row convolutions */
     for (i = 0; i < m; i++) {
-        float *sourceRow = source[i];
-        for (j = 0; j < n; j++) {
-            float sum = 0.0;
-
-            int p1 = j-4;
-            int p2 = j-3;
-            int p3 = j-2;
-            int p4 = j-1;
-            int p6 = j+1;
-            int p7 = j+2;
-            int p8 = j+3;
-            int p9 = j+4;
-
-            /* reflect negative indices to non-negative values using abs */
-            if (p1 < 0) p1 = -p1;
-            if (p2 < 0) p2 = -p2;
-            if (p3 < 0) p3 = -p3;
-            if (p4 < 0) p4 = -p4;
-
-            /* reflect indices that are too large back into proper range */
-            if (p6 >= n) p6 = 2*n - p6 - 2;
-            if (p7 >= n) p7 = 2*n - p7 - 2; 
-            if (p8 >= n) p8 = 2*n - p8 - 2;
-            if (p9 >= n) p9 = 2*n - p9 - 2;
-
-            if (sourceRow[p1]) sum += filter[0];
-            if (sourceRow[p2]) sum += filter[1];
-            if (sourceRow[p3]) sum += filter[2];
-            if (sourceRow[p4]) sum += filter[3];
-            if (sourceRow[j])  sum += filter[4];
-            if (sourceRow[p6]) sum += filter[5];
-            if (sourceRow[p7]) sum += filter[6];
-            if (sourceRow[p8]) sum += filter[7];
-            if (sourceRow[p9]) sum += filter[8];
-
-            ws[i][j] = 255 * sum; 
-        }
+        rowFilter(FLOAT_PLANE_ROW(ws, i), BYTE_PLANE_ROW(source, i), n);
     }
+    mirrorImagePlaneBorder(ws);
 
     /* Column convolutions */
-    for(j = 0; j < n; j++) {
-        for(i = 0; i < m; i++) {
-            float sum = 0.0;
-
-            int p1 = i-4;
-            int p2 = i-3;
-            int p3 = i-2;
-            int p4 = i-1;
-            int p6 = i+1;
-            int p7 = i+2;
-            int p8 = i+3;
-            int p9 = i+4;
-
-            /* reflect negative indices to non-negative values using abs */
-            if (p1 < 0) p1 = -p1;
-            if (p2 < 0) p2 = -p2;
-            if (p3 < 0) p3 = -p3;
-            if (p4 < 0) p4 = -p4;
-
-            /* reflect indices that are too large back into proper range */
-            if (p6 >= m) p6 = 2*m - p6 - 2; 
-            if (p7 >= m) p7 = 2*m - p7 - 2;
-            if (p8 >= m) p8 = 2*m - p8 - 2;
-            if (p9 >= m) p9 = 2*m - p9 - 2;
-
-            sum = (filter[4]*ws[i][j]) +
-                  (filter[0]*(ws[p1][j]+ws[p9][j])) +
-                  (filter[1]*(ws[p2][j]+ws[p8][j])) +
-                  (filter[2]*(ws[p3][j]+ws[p7][j])) +
-                  (filter[3]*(ws[p4][j]+ws[p6][j]));
-
-            dest[i][j] = (float)((int) (sum/norm + FLOAT_TO_INT_OFFSET)); 
-        }
-    }
-
-    freeFloatMatrix(ws);
+    for (i = 0; i < m; i++) {
+        float *rows[9];
+        for (k = 0; k < 9; k++) {
+            rows[k] = FLOAT_PLANE_ROW(ws, i - 4 + k);
+        }
+        columnFilter(FLOAT_PLANE_ROW(dest, i), rows, n);
+    }
+    mirrorImagePlaneBorder(dest);
+
     return(dest);
 }
 
 /*
-Filter the entire image with the separable filter given by
-the coefficients in filter.  The filter is assumed to have
-the same response in each dimension.  We mirror the pixel
-values at the boundaries of the image.  The image is
-assumed to be grey.  The results of the filtering are scaled 
-by norm.
+Filter the entire grey image source with the separable filter of the
+given radius, at most 4, given by its row and column filters.  The
+plane source must have a mirrored border of radius pixels, and ws a
+border of radius rows.  The border of dest is mirrored on return.
 */ 
-static float** separable7x7FIRGreyImage(int m, int n, float **source,
-                                  float **dest, int *filter, float norm)
+static ImagePlane* separableFIRGreyImage(int m, int n, ImagePlane *source,
+                                         ImagePlane *dest, ImagePlane *ws,
+                                         int radius, GreyRowFilter rowFilter,
+                                         ColumnFilter columnFilter)
 {
-    int i, j;
-
-    /* Temporary array to hold the result of processing the rows */
-    float **ws = allocateFloatMatrix(m,n);
+    int i, k;
 
     /* Row convolutions */
-    for(i = 0; i < m; i++) {
-        float *sourceRow = source[i];
-        for(j = 0; j < n; j++) {
-            int p2 = j-3;
-            int p3 = j-2;
-            int p4 = j-1;
-            int p6 = j+1;
-            int p7 = j+2;
-            int p8 = j+3;
+    for (i = 0; i < m; i++) {
+        rowFilter(FLOAT_PLANE_ROW(ws, i), FLOAT_PLANE_ROW(source, i), n);
+    }
+    mirrorImagePlaneBorder(ws);
+
+    /* Column convolutions */
+    for (i = 0; i < m; i++) {
+        float *rows[9];
+        for (k = 0; k < 2*radius + 1; k++) {
+            rows[k] = FLOAT_PLANE_ROW(ws, i - radius + k);
+        }
+        columnFilter(FLOAT_PLANE_ROW(dest, i), rows, n);
+    }
+    mirrorImagePlaneBorder(dest);
+
+    return(dest);
+}
+
+/*
+Filter the binary image source with the separable 9 x 9 filter given
+by its halving row filter and column filter, keeping only the pixels
+in even rows and columns, so that dest is (m + 1)/2 by (n + 1)/2
+pixels.  The plane source must have a mirrored border of 4 pixels,
+and ws a border of 4 rows.  The border of dest is mirrored on return.
+*/
+static ImagePlane* halveBinaryImage(int m, int n, ImagePlane *source,
+                                    ImagePlane *dest, ImagePlane *ws,
+                                    BinaryRowFilter halvingRowFilter,
+                                    ColumnFilter columnFilter)
+{
+    int m2 = (m + 1)/2, n2 = (n + 1)/2;
+    int i, k;
+
+    setImagePlaneSize(ws, m, n2);
+    for (i = 0; i < m; i++) {
+        halvingRowFilter(FLOAT_PLANE_ROW(ws, i), BYTE_PLANE_ROW(source, i),
+                         n2);
+    }
+    mirrorImagePlaneBorder(ws);
+
+    setImagePlaneSize(dest, m2, n2);
+    for (i = 0; i < m2; i++) {
+        float *rows[9];
+        for (k = 0; k < 9; k++) {
+            rows[k] = FLOAT_PLANE_ROW(ws, 2*i - 4 + k);
+        }
+        columnFilter(FLOAT_PLANE_ROW(dest, i), rows, n2);
+    }
+    mirrorImagePlaneBorder(dest);
+
+    return(dest);
+}
 
-            /* reflect negative indices to non-negative values using abs */
-            if (p2 < 0) p2 = -p2;
-            if (p3 < 0) p3 = -p3;
-            if (p4 < 0) p4 = -p4;
+/*
+Same as halveBinaryImage for a grey image, smoothed by the 7 x 7
+second Gaussian filter before it is halved.  The plane source must
+have a mirrored border of 3 pixels.
+*/
+static ImagePlane* halveGreyImage(int m, int n, ImagePlane *source,
+                                  ImagePlane *dest, ImagePlane *ws)
+{
+    int m2 = (m + 1)/2, n2 = (n + 1)/2;
+    int i, k;
 
-            /* reflect indices that are too large back into proper range */
-            if (p6 >= n) p6 = 2*n - p6 - 2;
-            if (p7 >= n) p7 = 2*n - p7 - 2; 
-            if (p8 >= n) p8 = 2*n - p8 - 2; 
+    setImagePlaneSize(ws, m, n2);
+    for (i = 0; i < m; i++) {
+        GaussianFilter2HalvingRows(FLOAT_PLANE_ROW(ws, i),
+                                   FLOAT_PLANE_ROW(source, i), n2);
+    }
+    mirrorImagePlaneBorder(ws);
 
-            ws[i][j] = (filter[3]*sourceRow[j]) +
-                       (filter[0]*(sourceRow[p2]+sourceRow[p8])) +
-                       (filter[1]*(sourceRow[p3]+sourceRow[p7])) +
-                       (filter[2]*(sourceRow[p4]+sourceRow[p6]));
+    setImagePlaneSize(dest, m2, n2);
+    for (i = 0; i < m2; i++) {
+        float *rows[7];
+        for (k = 0; k < 7; k++) {
+            rows[k] = FLOAT_PLANE_ROW(ws, 2*i - 3 + k);
         }
+        GaussianFilter2Columns(FLOAT_PLANE_ROW(dest, i), rows, n2);
     }
+    mirrorImagePlaneBorder(dest);
 
-    /* Column convolutions */
-    for (j=0; j<n; j++) {
-        for (i=0; i<m; i++) {
-            float sum;
+    return(dest);
+}
+
+/*
+Taps of the Gaussian filters above, from the outermost tap to the
+centre tap, for the reference filters below
+*/
+static int firstFilterTaps[] = { 11, 135, 808, 2359, 3372 };
+static int dispDithFirstFilterTaps[] = { 103, 419, 1138, 2074, 2533 };
+static int clustDithFirstFilterTaps[] = { 583, 903, 1234, 1488, 1584 };
+static int secondFilterTaps[] = { 44, 540, 2420, 3991 };
+static int dithSecondFilterTaps[] = { 1, 44, 540, 2420, 3989 };
+static int thirdFilterTaps[] = { 1, 103, 2075, 5641 };
+
+/*
+Reference version of the column filters: filter the 2*radius + 1 rows
+with the taps h, h[0] being the outermost tap and h[radius] the centre
+tap, in a loop over the taps.  The unrolled filters must give the same
+results, so the sums are formed in the same order.
+*/
+static void referenceColumnFilter(float *dest, float **rows, int n,
+                                  int *h, int radius)
+{
+    int j, k;
+
+    for (j = 0; j < n; j++) {
+        float sum = h[radius]*rows[radius][j];
+        for (k = 0; k < radius; k++) {
+            sum += h[k]*(rows[k][j] + rows[2*radius - k][j]);
+        }
+        dest[j] = (float)((int) (sum/(float) NORMALIZATION_CONSTANT +
+                                 FLOAT_TO_INT_OFFSET));
+    }
+}
 
-            int p2 = i-3;
-            int p3 = i-2;
-            int p4 = i-1;
-            int p6 = i+1;
-            int p7 = i+2;
-            int p8 = i+3;
+/* Apply referenceColumnFilter to every row of ws, into dest */
+static void referenceColumnPass(int m, int n, ImagePlane *ws,
+                                ImagePlane *dest, int *h, int radius)
+{
+    int i, k;
+
+    for (i = 0; i < m; i++) {
+        float *rows[9];
+        for (k = 0; k < 2*radius + 1; k++) {
+            rows[k] = FLOAT_PLANE_ROW(ws, i - radius + k);
+        }
+        referenceColumnFilter(FLOAT_PLANE_ROW(dest, i), rows, n, h, radius);
+    }
+    mirrorImagePlaneBorder(dest);
+}
+
+/*
+Reference version of separable9x9FIRBinaryImage, for the filter of
+the given radius and taps
+*/
+static ImagePlane* referenceFIRBinaryImage(int m, int n, ImagePlane *source,
+                                           ImagePlane *dest, ImagePlane *ws,
+                                           int *h, int radius)
+{
+    int i, j, k;
 
-            /* reflect negative indices to non-negative values using abs */
-            if (p2 < 0) p2 = -p2;
-            if (p3 < 0) p3 = -p3;
-            if (p4 < 0) p4 = -p4;
+    for (i = 0; i < m; i++) {
+        unsigned char *sourceRow = BYTE_PLANE_ROW(source, i);
+        float *wsRow = FLOAT_PLANE_ROW(ws, i);
+        for (j = 0; j < n; j++) {
+            int sum = h[radius]*sourceRow[j];
+            for (k = 0; k < radius; k++) {
+                sum += h[k]*(sourceRow[j - radius + k] +
+                             sourceRow[j + radius - k]);
+            }
+            wsRow[j] = (float) (255 * sum);
+        }
+    }
+    mirrorImagePlaneBorder(ws);
+    referenceColumnPass(m, n, ws, dest, h, radius);
 
-            /* reflect indices that are too large back into proper range */
-            if (p6 >= m) p6 = 2*m - p6 - 2;
-            if (p7 >= m) p7 = 2*m - p7 - 2;
-            if (p8 >= m) p8 = 2*m - p8 - 2;
+    return(dest);
+}
 
-            sum = (filter[3]*ws[i][j]) +
-                  (filter[0]*(ws[p2][j]+ws[p8][j])) +
-                  (filter[1]*(ws[p3][j]+ws[p7][j])) +
-                  (filter[2]*(ws[p4][j]+ws[p6][j]));
+/*
+Reference version of separableFIRGreyImage, for the filter of the
+given radius and taps
+*/
+static ImagePlane* referenceFIRGreyImage(int m, int n, ImagePlane *source,
+                                         ImagePlane *dest, ImagePlane *ws,
+                                         int *h, int radius)
+{
+    int i, j, k;
 
-            dest[i][j] = (float)((int) (sum/norm + FLOAT_TO_INT_OFFSET)); 
+    for (i = 0; i < m; i++) {
+        float *sourceRow = FLOAT_PLANE_ROW(source, i);
+        float *wsRow = FLOAT_PLANE_ROW(ws, i);
+        for (j = 0; j < n; j++) {
+            float sum = h[radius]*sourceRow[j];
+            for (k = 0; k < radius; k++) {
+                sum += h[k]*(sourceRow[j - radius + k] +
+                             sourceRow[j + radius - k]);
+            }
+            wsRow[j] = sum;
         }
     }
-    freeFloatMatrix(ws);
+    mirrorImagePlaneBorder(ws);
+    referenceColumnPass(m, n, ws, dest, h, radius);
+
     return(dest);
 }
 
-/* First Gaussian filter: 9 x 9  */
-static float** GaussianFilter1(int m, int n, float **s, float **dest)
+/* The filters and the grey median for one type of halftone */
+typedef struct HalftoneFilters {
+    BinaryRowFilter g1Rows;
+    BinaryRowFilter g1HalvingRows;
+    ColumnFilter g1Columns;
+    int* g1Taps;                        /* for the reference filters */
+    double g1Sigma;
+    int medianSize;                     /* 3 or 5 */
+    int g2Radius;
+    GreyRowFilter g2Rows;
+    ColumnFilter g2Columns;
+    int* g2Taps;
+    double g2Sigma;
+} HalftoneFilters;
+
+/*
+Select the filters for halftoningType.  The third Gaussian filter is
+the same for all types.  Returns FALSE for an unknown halftoning type.
+*/
+static int selectFilters(int halftoningType, HalftoneFilters* filters)
+{
+    switch(halftoningType) {
+      case HALFTONING_BY_ERROR_DIFFUSION:
+        filters->g1Rows = GaussianFilter1Rows;
+        filters->g1HalvingRows = GaussianFilter1HalvingRows;
+        filters->g1Columns = GaussianFilter1Columns;
+        filters->g1Taps = firstFilterTaps;
+        filters->g1Sigma = FIRST_FILTER_SIGMA;
+        filters->medianSize = 3;
+        filters->g2Radius = 3;
+        filters->g2Rows = GaussianFilter2Rows;
+        filters->g2Columns = GaussianFilter2Columns;
+        filters->g2Taps = secondFilterTaps;
+        filters->g2Sigma = SECOND_FILTER_SIGMA;
+        break;
+
+      case HALFTONING_BY_DISPERED_DITHER:
+        filters->g1Rows = GaussianFilterDispDith1Rows;
+        filters->g1HalvingRows = GaussianFilterDispDith1HalvingRows;
+        filters->g1Columns = GaussianFilterDispDith1Columns;
+        filters->g1Taps = dispDithFirstFilterTaps;
+        filters->g1Sigma = DISP_DITH_FIRST_FILTER_SIGMA;
+        filters->medianSize = 5;
+        filters->g2Radius = 4;
+        filters->g2Rows = GaussianFilterDith2Rows;
+        filters->g2Columns = GaussianFilterDith2Columns;
+        filters->g2Taps = dithSecondFilterTaps;
+        filters->g2Sigma = DITH_SECOND_FILTER_SIGMA;
+        break;
+
+      case HALFTONING_BY_CLUSTERED_DITHER:
+        filters->g1Rows = GaussianFilterClustDith1Rows;
+        filters->g1HalvingRows = GaussianFilterClustDith1HalvingRows;
+        filters->g1Columns = GaussianFilterClustDith1Columns;
+        filters->g1Taps = clustDithFirstFilterTaps;
+        filters->g1Sigma = CLUST_DITH_FIRST_FILTER_SIGMA;
+        filters->medianSize = 5;
+        filters->g2Radius = 4;
+        filters->g2Rows = GaussianFilterDith2Rows;
+        filters->g2Columns = GaussianFilterDith2Columns;
+        filters->g2Taps = dithSecondFilterTaps;
+        filters->g2Sigma = DITH_SECOND_FILTER_SIGMA;
+        break;
+
+      default:
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*
+Compute y2 = G2(y1) and z = G3(y2) in a single sweep down the image,
+and store the difference y2 - z in diff.  If mask is not a null
+pointer, also store 1 in mask where the difference exceeds threshold
+in magnitude and 0 elsewhere.  Only the rows of the row filter results
+and of y2 that the column filters still need are kept, in the rolling
+buffers g2RowRing, y2Ring and g3RowRing of the workspace, so neither
+y2 nor z is written out in full.  The plane y1 must have a mirrored
+border as wide as the radius r2 of G2.
+*/
+static void gaussianCascade(InverseHalftoneWorkspace* workspace,
+                            int m, int n, int r2,
+                            GreyRowFilter g2Rows, ColumnFilter g2Columns,
+                            ImagePlane *diff, ImagePlane *mask,
+                            int threshold)
+{
+    ImagePlane *y1 = workspace->y1;
+    ImagePlane *g2RowRing = workspace->g2RowRing;
+    ImagePlane *y2Ring = workspace->y2Ring;
+    ImagePlane *g3RowRing = workspace->g3RowRing;
+    int r3 = THIRD_FILTER_RADIUS;
+    int g2RingRows = 2*r2 + 1, g3RingRows = 2*r3 + 1;
+    int nextG2Row = 0;          /* next row of y1 to filter along the rows */
+    int nextY2Row = 0;          /* next row of y2 to compute */
+    float *rows[CASCADE_RING_ROWS];
+    int i, j, k;
+
+    for (i = 0; i < m; i++) {
+        float *y2Row, *diffRow;
+
+        /* Compute the rows of y2 that row i of z depends on */
+        for (; (nextY2Row <= i + r3) && (nextY2Row < m); nextY2Row++) {
+            int slot = nextY2Row % g3RingRows;
+            for (; (nextG2Row <= nextY2Row + r2) && (nextG2Row < m);
+                 nextG2Row++) {
+                g2Rows(FLOAT_PLANE_ROW(g2RowRing, nextG2Row % g2RingRows),
+                       FLOAT_PLANE_ROW(y1, nextG2Row), n);
+            }
+            for (k = 0; k < g2RingRows; k++) {
+                int source = reflectIndex(nextY2Row - r2 + k, m);
+                rows[k] = FLOAT_PLANE_ROW(g2RowRing, source % g2RingRows);
+            }
+            g2Columns(FLOAT_PLANE_ROW(y2Ring, slot), rows, n);
+            mirrorImagePlaneRowSides(y2Ring, slot);
+            GaussianFilter3Rows(FLOAT_PLANE_ROW(g3RowRing, slot),
+                                FLOAT_PLANE_ROW(y2Ring, slot), n);
+        }
+
+        /* Row i of z, then the difference y2 - z in place */
+        for (k = 0; k < g3RingRows; k++) {
+            int source = reflectIndex(i - r3 + k, m);
+            rows[k] = FLOAT_PLANE_ROW(g3RowRing, source % g3RingRows);
+        }
+        diffRow = FLOAT_PLANE_ROW(diff, i);
+        GaussianFilter3Columns(diffRow, rows, n);
+        y2Row = FLOAT_PLANE_ROW(y2Ring, i % g3RingRows);
+        for (j = 0; j < n; j++) {
+            diffRow[j] = y2Row[j] - diffRow[j];
+        }
+        if (mask != 0) {
+            unsigned char *maskRow = BYTE_PLANE_ROW(mask, i);
+            for (j = 0; j < n; j++) {
+                float pixel = diffRow[j];
+                maskRow[j] = !((pixel <= threshold) && (pixel >= -threshold));
+            }
+        }
+    }
+}
+
+/*
+Filter the plane in place with the recursive Gaussian filter of
+standard deviation sigma times the sigma scale of the workspace, then
+round the result to integers, as the FIR filters do, and mirror its
+border.
+*/
+static void recursiveFilterImage(InverseHalftoneWorkspace* workspace,
+                                 ImagePlane* plane, double sigma)
+{
+    RecursiveGaussian filter;
+    int i, j;
+
+    initRecursiveGaussian(&filter, sigma * workspace->sigmaScale);
+    recursiveGaussianImagePlane(plane, &filter, workspace->recursiveBuffer);
+    for (i = 0; i < plane->numRows; i++) {
+        float *row = FLOAT_PLANE_ROW(plane, i);
+        for (j = 0; j < plane->numColumns; j++) {
+            row[j] = (row[j] > 0.0) ?
+                     (float)((int) (row[j] + FLOAT_TO_INT_OFFSET)) : 0.0;
+        }
+    }
+    mirrorImagePlaneBorder(plane);
+}
+
+/* Compute y2 = G2(y1) for the whole image, into the plane y2 */
+static void secondFilter(InverseHalftoneWorkspace* workspace, int m, int n,
+                         HalftoneFilters* filters, ImagePlane* y2)
+{
+    int i;
+
+    if (workspace->recursiveStages & RECURSIVE_SECOND_FILTER) {
+        for (i = 0; i < m; i++) {
+            memcpy(FLOAT_PLANE_ROW(y2, i), FLOAT_PLANE_ROW(workspace->y1, i),
+                   n*sizeof(float));
+        }
+        recursiveFilterImage(workspace, y2, filters->g2Sigma);
+    }
+    else {
+        separableFIRGreyImage(m, n, workspace->y1, y2, workspace->scratch,
+                              filters->g2Radius, filters->g2Rows,
+                              filters->g2Columns);
+    }
+}
+
+/*
+Store y2 - z in diff, where diff holds z on entry.  If mask is not a
+null pointer, also store 1 in mask where the difference exceeds
+threshold in magnitude and 0 elsewhere.
+*/
+static void differenceAndMask(int m, int n, ImagePlane *y2, ImagePlane *diff,
+                              ImagePlane *mask, int threshold)
+{
+    int i, j;
+
+    for (i = 0; i < m; i++) {
+        float *y2Row = FLOAT_PLANE_ROW(y2, i);
+        float *diffRow = FLOAT_PLANE_ROW(diff, i);
+        for (j = 0; j < n; j++) {
+            diffRow[j] = y2Row[j] - diffRow[j];
+        }
+        if (mask != 0) {
+            unsigned char *maskRow = BYTE_PLANE_ROW(mask, i);
+            for (j = 0; j < n; j++) {
+                float pixel = diffRow[j];
+                maskRow[j] = !((pixel <= threshold) && (pixel >= -threshold));
+            }
+        }
+    }
+}
+
+/*
+Same as gaussianCascade, for when the second or third Gaussian filter
+is recursive and so needs the whole image: y2 is kept in full, in the
+plane y2 of the workspace, and z is computed in diff.
+*/
+static void planeCascade(InverseHalftoneWorkspace* workspace, int m, int n,
+                         HalftoneFilters* filters, ImagePlane *diff,
+                         ImagePlane *mask, int threshold)
 {
-  static int h1[9] =
-    {11,135,808,2359,3372,2359,808,135,11};
-  separable9x9FIRBinaryImage(m, n, s, dest, h1, NORMALIZATION_CONSTANT);
-  return(dest);
+    ImagePlane *y2 = workspace->y2;
+    int i;
+
+    secondFilter(workspace, m, n, filters, y2);
+    if (workspace->recursiveStages & RECURSIVE_THIRD_FILTER) {
+        for (i = 0; i < m; i++) {
+            memcpy(FLOAT_PLANE_ROW(diff, i), FLOAT_PLANE_ROW(y2, i),
+                   n*sizeof(float));
+        }
+        recursiveFilterImage(workspace, diff, THIRD_FILTER_SIGMA);
+    }
+    else {
+        separableFIRGreyImage(m, n, y2, diff, workspace->scratch,
+                              THIRD_FILTER_RADIUS, GaussianFilter3Rows,
+                              GaussianFilter3Columns);
+    }
+    differenceAndMask(m, n, y2, diff, mask, threshold);
 }
 
-/* Second Gaussian filter: 7 x 7 */
-static float** GaussianFilter2(int m, int n, float **s, float **dest)
+/*
+Reference version of gaussianCascade, which filters all of y1 with G2
+into the plane y2 of the workspace, then all of y2 with G3 into diff,
+with the reference filters
+*/
+static void referenceCascade(InverseHalftoneWorkspace* workspace,
+                             int m, int n, HalftoneFilters* filters,
+                             ImagePlane *diff, ImagePlane *mask,
+                             int threshold)
 {
-  static int h2[7] = {44,540,2420,3991,2420,540,44};
-  separable7x7FIRGreyImage(m, n, s, dest, h2, NORMALIZATION_CONSTANT);
-  return(dest);
+    ImagePlane *y2 = workspace->y2;
+
+    referenceFIRGreyImage(m, n, workspace->y1, y2, workspace->scratch,
+                          filters->g2Taps, filters->g2Radius);
+    referenceFIRGreyImage(m, n, y2, diff, workspace->scratch,
+                          thirdFilterTaps, THIRD_FILTER_RADIUS);
+    differenceAndMask(m, n, y2, diff, mask, threshold);
 }
 
-/* Third Gaussian filter: 7 x 7 */
-static float** GaussianFilter3(int m, int n, float **s, float **dest)
+/* Call gaussianCascade with the second filter for the halftone */
+static void rollingCascade(InverseHalftoneWorkspace* workspace,
+                           int m, int n, HalftoneFilters* filters,
+                           ImagePlane *diff, ImagePlane *mask,
+                           int threshold)
 {
-  static int h3[7]= {1,103,2075,5641,2075,103,1};
-  separable7x7FIRGreyImage(m, n, s, dest, h3, NORMALIZATION_CONSTANT);
-  return(dest);
+    gaussianCascade(workspace, m, n, filters->g2Radius, filters->g2Rows,
+                    filters->g2Columns, diff, mask, threshold);
 }
 
 /* Select the kth element from the buffer data of length arrayLen elements */
@@ -304,486 +812,2624 @@ static float selectElement(unsigned int k, unsigned int arrayLen, float *data)
 /*
 Compute a 3x3 median filter on a grey image.  This operation
 amounts to sorting the 9 values in the 3x3 window and picking
-the middle sorted value.
+the middle sorted value.  The plane x must have a mirrored border
+of 1 pixel, and the border of x1 is mirrored on return.
 */
-static float** median3x3GreyImage(int m, int n, float **x, float **x1)
+static ImagePlane* median3x3GreyImage(int m, int n, ImagePlane *x,
+                                      ImagePlane *x1)
 {
     int i;
 
     for(i = 0; i < m; i++) {
+        float *above = FLOAT_PLANE_ROW(x, i-1);
+        float *row = FLOAT_PLANE_ROW(x, i);
+        float *below = FLOAT_PLANE_ROW(x, i+1);
+        float *x1Row = FLOAT_PLANE_ROW(x1, i);
         int j;
         for(j = 0; j < n; j++) { 
             float data[10];         /* selectElement begins indexing at 1 */
 
-            int i1 = i - 1;
-            int j1 = j - 1;
-            if (i1 < 0) i1 = -i1;
-            if (j1 < 0) j1 = -j1;
-
-            data[1] = x[i1][j1];
-            data[2] = x[i1][j];
-
-            if (j+1>=n)
-                data[3] = x[i1][2*n-(j+1)-2];
-            else
-                data[3] = x[i1][j+1];
-
-            data[4] = x[i][j1];
-            data[5] = x[i][j];
-
-            if ((j+1) >= n)
-                data[6] = x[i][2*n-(j+1)-2];
-            else
-                data[6] = x[i][j+1];
-
-            if ((i+1) >= m)
-                data[7] = x[2*m-(i+1)-2][j1];
-            else
-                data[7] = x[i+1][j1];
-
-            if ((i+1) >= m)
-                data[8] = x[2*m-(i+1)-2][j];
-            else
-                data[8] = x[i+1][j];
-
-            if ((i+1) >= m && (j+1) >= n)
-                data[9] = x[2*m-(i+1)-2][2*n-(j+1)-2];
-            if ((i+1) >= m && (j+1) < n) 
-                data[9] = x[2*m-(i+1)-2][j+1];
-            if ((i+1) < m && (j+1) >= n)
-                data[9] = x[i+1][2*n-(j+1)-2];
-            if ((i+1) < m && (j+1) < n)
-                data[9] = x[i+1][j+1];
-
-            x1[i][j] = selectElement(5, 9, data);
+            data[1] = above[j-1];
+            data[2] = above[j];
+            data[3] = above[j+1];
+            data[4] = row[j-1];
+            data[5] = row[j];
+            data[6] = row[j+1];
+            data[7] = below[j-1];
+            data[8] = below[j];
+            data[9] = below[j+1];
+
+            x1Row[j] = selectElement(5, 9, data);
         }    
     }
+    mirrorImagePlaneBorder(x1);
 
     return(x1);
 }
 
 /*
-Compute the 5x5 median on a binary image.  We count the
-number of '1' pixels in the 25 possible pixels in a window.
-If there are 13 or more '1' pixels, then the output is 1.
+Compute the 5x5 median on a binary image over numRows rows and
+numColumns columns starting at row firstRow and column firstColumn.
+We count the number of '1' pixels in the 25 possible pixels in a
+window that extends up and to the left of the output pixel.  If there
+are 13 or more '1' pixels, then the output is 1.  Pixels outside the
+image do not count, so x must have a zeroed border of 4 pixels.  The
+result is stored in t.
 */
-static float** median5x5BinaryImage(int m, int n, float **x)
+static ImagePlane* median5x5BinaryImage(int firstRow, int numRows,
+                                        int firstColumn, int numColumns,
+                                        ImagePlane *x, ImagePlane *t)
 {
     int i;
-    float **t = allocateFloatMatrix(m,n);
 
-    for(i = 0;i < m; i++) {
+    for(i = firstRow; i < firstRow + numRows; i++) {
+        unsigned char *r0 = BYTE_PLANE_ROW(x, i-4) + firstColumn;
+        unsigned char *r1 = BYTE_PLANE_ROW(x, i-3) + firstColumn;
+        unsigned char *r2 = BYTE_PLANE_ROW(x, i-2) + firstColumn;
+        unsigned char *r3 = BYTE_PLANE_ROW(x, i-1) + firstColumn;
+        unsigned char *r4 = BYTE_PLANE_ROW(x, i) + firstColumn;
+        unsigned char *tRow = BYTE_PLANE_ROW(t, i) + firstColumn;
         int j;
-        for(j = 0; j < n; j++) {
+        for(j = 0; j < numColumns; j++) {
             int d = 0;
-            int k;
-            for(k = 0; k < 5; k++) {
-                int l;
-                for(l = 0; l < 5; l++) {
-                    if ((i-k)>=0 && (j-l)>=0 && (i-k)<m && (j-l)<n) {
-                        if (x[i-k][j-l]) d++;
-                        if (d >= 13) break;
-                    }
-                }
-                if (d >= 13) break;
+            int l;
+            for(l = 0; l < 5; l++) {
+                d += r0[j-l] + r1[j-l] + r2[j-l] + r3[j-l] + r4[j-l];
             }
-            if (d >= 13)
-                t[i][j]=1;
-            else
-                t[i][j]=0;
+            tRow[j] = (d >= 13);
+        }
+    }
+    return t;
+}
+
+/* Columns of the running sums of slidingMedian5x5BinaryImage at a time */
+#define SLIDING_MEDIAN_BLOCK 256
+
+/*
+Compute one row of slidingMedian5x5BinaryImage into tRow from the five
+rows of the window, rows[4] being the row of the output, each with 4
+zeroed pixels to the left of it
+*/
+static void slidingMedian5x5BinaryRow(unsigned char *tRow,
+                                      unsigned char **rows, int numColumns)
+{
+    unsigned char *r0 = rows[0], *r1 = rows[1], *r2 = rows[2];
+    unsigned char *r3 = rows[3], *r4 = rows[4];
+    int columnCounts[SLIDING_MEDIAN_BLOCK + 4];
+    int first;
+
+    for(first = 0; first < numColumns; first += SLIDING_MEDIAN_BLOCK) {
+        int width = numColumns - first;
+        int j, d;
+        if (width > SLIDING_MEDIAN_BLOCK) width = SLIDING_MEDIAN_BLOCK;
+
+        /* columnCounts[j + 4] counts the window column first + j */
+        for(j = -4; j < width; j++) {
+            int c = first + j;
+            columnCounts[j + 4] = r0[c] + r1[c] + r2[c] + r3[c] + r4[c];
         }
+        d = columnCounts[0] + columnCounts[1] + columnCounts[2] +
+            columnCounts[3];
+        for(j = 0; j < width; j++) {
+            d += columnCounts[j + 4];
+            tRow[first + j] = (d >= 13);
+            d -= columnCounts[j];
+        }
+    }
+}
+
+/*
+Same as median5x5BinaryImage, with running sums: the five rows of the
+window are added once per column, and the count of the window is
+updated by the column that enters it and the column that leaves it,
+rather than adding all 25 pixels for every output pixel.
+*/
+static ImagePlane* slidingMedian5x5BinaryImage(int firstRow, int numRows,
+                                               int firstColumn,
+                                               int numColumns,
+                                               ImagePlane *x, ImagePlane *t)
+{
+    int i, k;
+
+    for(i = firstRow; i < firstRow + numRows; i++) {
+        unsigned char *rows[5];
+        for(k = 0; k < 5; k++) {
+            rows[k] = BYTE_PLANE_ROW(x, i - 4 + k) + firstColumn;
+        }
+        slidingMedian5x5BinaryRow(BYTE_PLANE_ROW(t, i) + firstColumn, rows,
+                                  numColumns);
     }
     return t;
 }
 
-static float** thresholdDiffImage(int m, int n, float **x,
-                                  float **z, int threshold, float** hie)
+/* The implementations of the 5x5 binary median of the edge mask */
+typedef ImagePlane* (*BinaryMedianKernel)(int firstRow, int numRows,
+                                          int firstColumn, int numColumns,
+                                          ImagePlane *x, ImagePlane *t);
+
+/*
+Store 1 in mask where the difference diff exceeds threshold in
+magnitude and 0 elsewhere.
+*/
+static ImagePlane* thresholdImage(int m, int n, ImagePlane *diff,
+                                  int threshold, ImagePlane *mask)
 {
     int i;
-    float **edgeMap;
 
     for(i = 0; i < m; i++) {
         int j;
-        float *hieRow = hie[i];
-        float *xRow = x[i];
-        float *zRow = z[i];
+        float *diffRow = FLOAT_PLANE_ROW(diff, i);
+        unsigned char *maskRow = BYTE_PLANE_ROW(mask, i);
         for(j = 0; j < n; j++) {
-            /* Compute hie[i][j] = x[i][j] - z[i][j]; */
-            float pixel = (*xRow) - (*zRow);
-            if ((pixel <= threshold) && (pixel >= -threshold)) {
-              *zRow++ = 0.0;
-            }
-            else {
-              *zRow++ = 1.0;
-            }
-            *hieRow++ = pixel;
-            xRow++;
+            float pixel = diffRow[j];
+            maskRow[j] = !((pixel <= threshold) && (pixel >= -threshold));
         }      
     }
+    return(mask);
+}
 
-    edgeMap = median5x5BinaryImage(m, n, z);
+/*
+Compute hie = diff over a region of the image as for applyEdgeMap,
+whose mask must already have a zeroed border.
+*/
+static void applyEdgeMapRegion(BinaryMedianKernel binaryMedian,
+                               int firstRow, int numRows,
+                               int firstColumn, int numColumns,
+                               ImagePlane *diff, ImagePlane *mask,
+                               ImagePlane *edgeMap, ImagePlane *hie)
+{
+    int i;
 
-    for(i = 0; i < m; i++) {
+    binaryMedian(firstRow, numRows, firstColumn, numColumns, mask, edgeMap);
+
+    for(i = firstRow; i < firstRow + numRows; i++) {
         int j;
-        float *hieRow = hie[i];
-        float *edgeMapRow = edgeMap[i];
-        float *zRow = z[i];
-        for(j = 0; j < n; j++) {
-            /* Compute z[i][j] *= edgeMap[i][j]; hie[i][j] *= z[i][j]; */
-            *hieRow++ *= (*zRow++) * (*edgeMapRow++);
+        float *hieRow = FLOAT_PLANE_ROW(hie, i) + firstColumn;
+        float *diffRow = FLOAT_PLANE_ROW(diff, i) + firstColumn;
+        unsigned char *edgeMapRow = BYTE_PLANE_ROW(edgeMap, i) + firstColumn;
+        unsigned char *maskRow = BYTE_PLANE_ROW(mask, i) + firstColumn;
+        for(j = 0; j < numColumns; j++) {
+            /* Compute mask[i][j] *= edgeMap[i][j]; hie[i][j] *= mask[i][j]; */
+            hieRow[j] = diffRow[j] * (float) (maskRow[j] & edgeMapRow[j]);
         }
     }
+}
 
-    freeFloatMatrix(edgeMap);
-
+/*
+Compute hie = diff, keeping only the pixels that are set in the edge
+mask and that survive a 5x5 binary median of the edge mask, computed
+by binaryMedian.  The mask needs a border of 4 pixels, and the result
+of the median is stored in edgeMap.  The planes hie and diff may be
+the same.
+*/
+static ImagePlane* applyEdgeMap(BinaryMedianKernel binaryMedian,
+                                int m, int n, ImagePlane *diff,
+                                ImagePlane *mask, ImagePlane *edgeMap,
+                                ImagePlane *hie)
+{
+    clearImagePlaneBorder(mask);
+    applyEdgeMapRegion(binaryMedian, 0, m, 0, n, diff, mask, edgeMap, hie);
     return(hie);
 }
 
+/*
+Compute n pixels of the last stage of the inverse halftoning
+algorithm, which consists of only pointwise operations.
+*/
+static void lastStageSegment(unsigned char* outputPtr, float* hieRowPtr,
+                             float* y1RowPtr, int n, float gainAsFloat)
+{
+    int j;
+    for (j = 0; j < n; j++) {
+       unsigned char pixelValue;
+       float outputValue = FLOAT_TO_INT_OFFSET;
+       outputValue += gainAsFloat * (*hieRowPtr++) + (*y1RowPtr++);
+       if (outputValue < 0.0) {
+           pixelValue = 0;
+       }
+       else if (outputValue > 255.0) {
+           pixelValue = 255;
+       }
+       else {
+           pixelValue = (unsigned char) outputValue;
+       }
+       *outputPtr++ = pixelValue;
+    }
+}
+
+/*
+Compute n pixels of the last stage where hie is known to be zero, so
+that the output is y1 rounded.
+*/
+static void flatLastStageSegment(unsigned char* outputPtr, float* y1RowPtr,
+                                 int n)
+{
+    int j;
+    for (j = 0; j < n; j++) {
+       float outputValue = FLOAT_TO_INT_OFFSET;
+       outputValue += *y1RowPtr++;
+       *outputPtr++ = (outputValue > 255.0) ?
+                      255 : (unsigned char) outputValue;
+    }
+}
+
 /*
 Compute the last stage of the inverse halftoning algorithm.
 The last stage consists of only pointwise operations.
-The float and byte matrices are of dimension nrow x ncol.
+The planes and the byte image are of dimension nrow x ncol.
 */
 static unsigned char* lastStage(int nrow, int ncol, int gain,
-                                float **hie, float **y1,
+                                ImagePlane *hie, ImagePlane *y1,
                                 unsigned char* outputByteImage)
 {
     int i;
-    unsigned char* outputPtr = outputByteImage;
     float gainAsFloat = (float) gain;
     for (i = 0; i < nrow; i++) {
-        int j = 0;
-        float* hieRowPtr = hie[i];
-        float* y1RowPtr = y1[i];
-        for (j = 0; j < ncol; j++) {
-           unsigned char pixelValue;
-           float outputValue = FLOAT_TO_INT_OFFSET;
-           outputValue += gainAsFloat * (*hieRowPtr++) + (*y1RowPtr++);
-           if (outputValue < 0.0) {
-               pixelValue = 0;
-           }
-           else if (outputValue > 255.0) {
-               pixelValue = 255;
-           }
-           else {
-               pixelValue = (unsigned char) outputValue;
-           }
-           *outputPtr++ = pixelValue;
-        }
+        lastStageSegment(outputByteImage + i*ncol, FLOAT_PLANE_ROW(hie, i),
+                         FLOAT_PLANE_ROW(y1, i), ncol, gainAsFloat);
     }
     return(outputByteImage);
 }
 
-float** separable9x9FIRGreyImage(int m, int n, float** s, float** st,
-                                 int* h, float norm)
+/*
+Compute a 5x5 median filter on a grey image, whose plane x must have
+a mirrored border of 2 pixels.  The border of x1 is mirrored on return.
+*/
+static ImagePlane* median5x5GreyImage(int m, int n, ImagePlane* x,
+                                      ImagePlane* x1)
+{
+    int i;
+ 
+    for(i = 0; i < m; i++) {
+        float *x1Row = FLOAT_PLANE_ROW(x1, i);
+        int j;
+        for(j = 0; j < n; j++) { 
+            float data[26];         /* selectElement begins indexing at 1 */
+            int k, l, d = 1;
+            for(k = -2; k <= 2; k++) {
+                float *row = FLOAT_PLANE_ROW(x, i+k);
+                for(l = -2; l <= 2; l++) {
+                    data[d++] = row[j+l];
+                }
+            }
+            x1Row[j] = selectElement(13, 25, data);
+        }    
+    }
+    mirrorImagePlaneBorder(x1);
+
+    return x1;
+}
+
+/*
+Comparators of the selection networks for the median of 9 and of 25
+values: Batcher's odd-even merge sort of 16 (32) values, less the
+comparators that involve the missing values or that cannot affect the
+middle value
+*/
+static unsigned char median9Network[][2] = {
+    {0,1}, {2,3}, {4,5}, {6,7}, {0,2}, {1,3}, {4,6}, {5,7}, {1,2}, {5,6},
+    {0,4}, {1,5}, {2,6}, {3,7}, {2,4}, {3,5}, {1,2}, {3,4}, {5,6}, {0,8},
+    {4,8}, {2,4}, {3,5}, {3,4}
+};
+static unsigned char median25Network[][2] = {
+    {0,1}, {2,3}, {4,5}, {6,7}, {8,9}, {10,11}, {12,13}, {14,15}, {16,17},
+    {18,19}, {20,21}, {22,23}, {0,2}, {1,3}, {4,6}, {5,7}, {8,10}, {9,11},
+    {12,14}, {13,15}, {16,18}, {17,19}, {20,22}, {21,23}, {1,2}, {5,6},
+    {9,10}, {13,14}, {17,18}, {21,22}, {0,4}, {1,5}, {2,6}, {3,7}, {8,12},
+    {9,13}, {10,14}, {11,15}, {16,20}, {17,21}, {18,22}, {19,23}, {2,4},
+    {3,5}, {10,12}, {11,13}, {18,20}, {19,21}, {1,2}, {3,4}, {5,6}, {9,10},
+    {11,12}, {13,14}, {17,18}, {19,20}, {21,22}, {0,8}, {1,9}, {2,10}, {3,11},
+    {4,12}, {5,13}, {6,14}, {7,15}, {16,24}, {4,8}, {5,9}, {6,10}, {7,11},
+    {20,24}, {2,4}, {3,5}, {6,8}, {7,9}, {10,12}, {11,13}, {18,20}, {19,21},
+    {22,24}, {1,2}, {3,4}, {5,6}, {7,8}, {9,10}, {11,12}, {13,14}, {17,18},
+    {19,20}, {21,22}, {23,24}, {0,16}, {1,17}, {2,18}, {3,19}, {4,20}, {5,21},
+    {6,22}, {7,23}, {8,24}, {8,16}, {9,17}, {10,18}, {11,19}, {12,20},
+    {13,21}, {6,10}, {7,11}, {12,16}, {13,17}, {10,12}, {11,13}, {11,12}
+};
+
+/* Output pixels to which networkMedianGreyImage applies a comparator */
+#define NETWORK_MEDIAN_BLOCK 64
+
+/*
+Compute one row of networkMedianGreyImage into x1Row from the size
+rows of the window, centred on the row of the output, each with a
+mirrored border of size/2 pixels and holding lanes interleaved images
+*/
+static void networkMedianGreyRow(float* x1Row, float** rows, int n,
+                                 int size, int lanes)
+{
+    float values[25][NETWORK_MEDIAN_BLOCK];
+    unsigned char (*network)[2] = median25Network;
+    int numComparators = sizeof(median25Network) / sizeof(median25Network[0]);
+    int radius = size / 2, middle = size * size / 2;
+    int first;
+
+    n *= lanes;
+
+    if (size == 3) {
+        network = median9Network;
+        numComparators = sizeof(median9Network) / sizeof(median9Network[0]);
+    }
+    for(first = 0; first < n; first += NETWORK_MEDIAN_BLOCK) {
+        int width = n - first;
+        int c, d = 0, j, k, l;
+        if (width > NETWORK_MEDIAN_BLOCK) width = NETWORK_MEDIAN_BLOCK;
+
+        for(k = 0; k < size; k++) {
+            float *row = rows[k] + first;
+            for(l = -radius; l <= radius; l++) {
+                memcpy(values[d++], row + l*lanes, width * sizeof(float));
+            }
+        }
+        for(c = 0; c < numComparators; c++) {
+            float *a = values[network[c][0]];
+            float *b = values[network[c][1]];
+            for(j = 0; j < width; j++) {
+                float low = (a[j] < b[j]) ? a[j] : b[j];
+                float high = (a[j] < b[j]) ? b[j] : a[j];
+                a[j] = low;
+                b[j] = high;
+            }
+        }
+        memcpy(x1Row + first, values[middle], width * sizeof(float));
+    }
+}
+
+/*
+Compute the size x size median filter, size being 3 or 5, of a grey
+image with a selection network: a fixed sequence of comparators, each
+of which puts the smaller of two values first, leaves the median in
+the middle.  Unlike selectElement, the network has no branches that
+depend on the data, and each comparator is applied to a block of
+output pixels at a time, which the compiler can vectorize.  The
+result is the same as that of median3x3GreyImage and
+median5x5GreyImage, whose borders it needs and leaves.  Planes of
+interleaved images are filtered lane by lane.
+*/
+static ImagePlane* networkMedianGreyImage(int m, int n, int size,
+                                          ImagePlane* x, ImagePlane* x1)
+{
+    int radius = size / 2;
+    int i, k;
+
+    for(i = 0; i < m; i++) {
+        float *rows[5];
+        for(k = 0; k < size; k++) {
+            rows[k] = FLOAT_PLANE_ROW(x, i - radius + k);
+        }
+        networkMedianGreyRow(FLOAT_PLANE_ROW(x1, i), rows, n, size,
+                             x->numLanes);
+    }
+    mirrorImagePlaneBorder(x1);
+
+    return x1;
+}
+
+/* The implementations of the stages, in the order of stageKernels */
+typedef void (*SmoothingKernel)(int m, int n, HalftoneFilters* filters,
+                                ImagePlane* source, ImagePlane* dest,
+                                ImagePlane* ws);
+typedef ImagePlane* (*GreyMedianKernel)(int m, int n, int size,
+                                        ImagePlane* x, ImagePlane* x1);
+typedef void (*CascadeKernel)(InverseHalftoneWorkspace* workspace,
+                              int m, int n, HalftoneFilters* filters,
+                              ImagePlane *diff, ImagePlane *mask,
+                              int threshold);
+typedef unsigned char* (*OutputKernel)(int nrow, int ncol, int gain,
+                                       ImagePlane *hie, ImagePlane *y1,
+                                       unsigned char* outputByteImage);
+
+static void referenceSmoothing(int m, int n, HalftoneFilters* filters,
+                               ImagePlane* source, ImagePlane* dest,
+                               ImagePlane* ws)
+{
+    referenceFIRBinaryImage(m, n, source, dest, ws, filters->g1Taps, 4);
+}
+
+static void unrolledSmoothing(int m, int n, HalftoneFilters* filters,
+                              ImagePlane* source, ImagePlane* dest,
+                              ImagePlane* ws)
+{
+    separable9x9FIRBinaryImage(m, n, source, dest, ws,
+                               filters->g1Rows, filters->g1Columns);
+}
+
+static ImagePlane* selectMedianGreyImage(int m, int n, int size,
+                                         ImagePlane* x, ImagePlane* x1)
+{
+    if (size == 3) {
+        return(median3x3GreyImage(m, n, x, x1));
+    }
+    return(median5x5GreyImage(m, n, x, x1));
+}
+
+static SmoothingKernel smoothingKernels[] = {
+    referenceSmoothing, unrolledSmoothing
+};
+static GreyMedianKernel greyMedianKernels[] = {
+    selectMedianGreyImage, networkMedianGreyImage
+};
+static CascadeKernel cascadeKernels[] = {
+    referenceCascade, rollingCascade
+};
+static BinaryMedianKernel binaryMedianKernels[] = {
+    median5x5BinaryImage, slidingMedian5x5BinaryImage
+};
+static OutputKernel outputKernels[] = {
+    lastStage
+};
+
+/*
+Names of the stages and of their implementations, in the order of the
+arrays above.  The first implementation of every stage is the
+straightforward one, against which verifyInverseHalftoneKernels
+checks the others.
+*/
+typedef struct StageKernels {
+    char* stageName;
+    int numKernels;
+    char* kernelNames[MAX_INVERSE_HALFTONE_KERNELS];
+} StageKernels;
+
+static StageKernels stageKernels[NUM_INVERSE_HALFTONE_STAGES] = {
+    { "smoothing", 2, { "reference", "unrolled" } },
+    { "median",    2, { "reference", "network" } },
+    { "cascade",   2, { "reference", "rolling" } },
+    { "edge-map",  2, { "reference", "sliding" } },
+    { "output",    1, { "reference" } }
+};
+
+/* Implementations given to new workspaces: the fastest, unless selected */
+static int defaultKernels[NUM_INVERSE_HALFTONE_STAGES] = { 1, 1, 1, 1, 0 };
+
+/*
+Use numRows by numColumns pixels of every plane of the workspace.
+Returns FALSE if the workspace is too small.
+*/
+static int setWorkspaceSize(InverseHalftoneWorkspace* workspace,
+                            int numRows, int numColumns)
+{
+    if ((workspace == 0) ||
+        (numRows > workspace->maxRows) ||
+        (numColumns > workspace->maxColumns)) {
+        return FALSE;
+    }
+    setImagePlaneSize(workspace->inputImage, numRows, numColumns);
+    setImagePlaneSize(workspace->y0, numRows, numColumns);
+    setImagePlaneSize(workspace->y1, numRows, numColumns);
+    setImagePlaneSize(workspace->g2RowRing, CASCADE_RING_ROWS, numColumns);
+    setImagePlaneSize(workspace->y2Ring, 2*THIRD_FILTER_RADIUS + 1,
+                      numColumns);
+    setImagePlaneSize(workspace->g3RowRing, 2*THIRD_FILTER_RADIUS + 1,
+                      numColumns);
+    setImagePlaneSize(workspace->hie, numRows, numColumns);
+    setImagePlaneSize(workspace->scratch, numRows, numColumns);
+    setImagePlaneSize(workspace->mask, numRows, numColumns);
+    setImagePlaneSize(workspace->edgeMap, numRows, numColumns);
+    if (workspace->y2 != 0) {
+        setImagePlaneSize(workspace->y2, numRows, numColumns);
+    }
+    workspace->stats.numPixels += (double) numRows * numColumns;
+    return TRUE;
+}
+
+/*
+Convert the byte input image to the binary input plane, in which
+every non-zero pixel becomes 1, and mirror its border.
+*/
+static void convertInputImage(InverseHalftoneWorkspace* workspace,
+                              unsigned char* inputByteImage,
+                              int numRows, int numColumns)
+{
+    int i;
+    unsigned char* tempBytePtr = inputByteImage;
+    for (i = 0; i < numRows; i++) {
+        int j = 0;
+        unsigned char *binaryRowPtr = BYTE_PLANE_ROW(workspace->inputImage, i);
+        for (j = 0; j < numColumns; j++) {
+            *binaryRowPtr++ = (*tempBytePtr++ != 0);
+        }
+    }
+    mirrorImagePlaneBorder(workspace->inputImage);
+}
+
+/*
+Start the clock, the peak memory, and the performance counters if any,
+for a stage
+*/
+static void startStage(InverseHalftoneWorkspace* workspace,
+                       double* startTimePtr)
+{
+    startMemoryInterval();
+    if (workspace->perfCounters != 0) {
+        readPerfCounters(workspace->perfCounters,
+                         workspace->stageStartCounts);
+    }
+    *startTimePtr = currentTimeInSeconds();
+}
+
+/*
+Add the time since *startTimePtr, the peak memory since then, and the
+events counted since then if performance counters are on, to stage,
+and restart the clock
+*/
+static void endStage(InverseHalftoneWorkspace* workspace, int stage,
+                     double* startTimePtr)
+{
+    double now = currentTimeInSeconds();
+    size_t peakBytes = memoryIntervalPeak();
+    workspace->stats.stageTime[stage] += now - *startTimePtr;
+    *startTimePtr = now;
+    if (peakBytes > workspace->stats.stagePeakBytes[stage]) {
+        workspace->stats.stagePeakBytes[stage] = peakBytes;
+    }
+    startMemoryInterval();
+    if (workspace->perfCounters != 0) {
+        double counts[NUM_PERF_COUNTERS];
+        int k;
+        readPerfCounters(workspace->perfCounters, counts);
+        for (k = 0; k < NUM_PERF_COUNTERS; k++) {
+            workspace->stats.stageCounts[stage][k] +=
+                counts[k] - workspace->stageStartCounts[k];
+            workspace->stageStartCounts[k] = counts[k];
+        }
+    }
+}
+
+/*
+Run the stages that depend on neither the threshold nor the gain:
+smooth the halftone into y0, and take its median into y1.  If
+medianFlag is FALSE, the halftone is smoothed straight into y1.
+*/
+static void smoothingStages(InverseHalftoneWorkspace* workspace,
+                            int numRows, int numColumns,
+                            HalftoneFilters* filters, int medianFlag)
+{
+    ImagePlane *smoothed = medianFlag ? workspace->y0 : workspace->y1;
+    double startTime;
+
+    startStage(workspace, &startTime);
+    if (workspace->recursiveStages & RECURSIVE_FIRST_FILTER) {
+        int i, j;
+        for (i = 0; i < numRows; i++) {
+            unsigned char *inputRow = BYTE_PLANE_ROW(workspace->inputImage, i);
+            float *smoothedRow = FLOAT_PLANE_ROW(smoothed, i);
+            for (j = 0; j < numColumns; j++) {
+                smoothedRow[j] = (float) (255 * inputRow[j]);
+            }
+        }
+        recursiveFilterImage(workspace, smoothed, filters->g1Sigma);
+    }
+    else {
+        smoothingKernels[workspace->kernels[STAGE_SMOOTHING]](
+            numRows, numColumns, filters, workspace->inputImage, smoothed,
+            workspace->scratch);
+    }
+    endStage(workspace, STAGE_SMOOTHING, &startTime);
+
+    if (!medianFlag) {
+        return;
+    }
+    greyMedianKernels[workspace->kernels[STAGE_MEDIAN]](
+        numRows, numColumns, filters->medianSize, workspace->y0,
+        workspace->y1);
+    endStage(workspace, STAGE_MEDIAN, &startTime);
+}
+
+/*
+Run the stages up to the edge mask: smooth the halftone into y0, take
+its median into y1, and smooth y1 twice, into y2 and z, storing the
+difference y2 - z in diff.  If mask is not a null pointer, the edge
+mask for threshold is stored in it as well.  Only the edge mask
+depends on the threshold, and none of the stages on the gain.  If
+medianFlag is FALSE, the median is skipped and y1 is y0.
+*/
+static void frontStages(InverseHalftoneWorkspace* workspace,
+                        int numRows, int numColumns,
+                        HalftoneFilters* filters, int medianFlag,
+                        ImagePlane* diff, ImagePlane* mask, int threshold)
+{
+    double startTime;
+
+    smoothingStages(workspace, numRows, numColumns, filters, medianFlag);
+    startStage(workspace, &startTime);
+    if (workspace->recursiveStages &
+        (RECURSIVE_SECOND_FILTER | RECURSIVE_THIRD_FILTER)) {
+        planeCascade(workspace, numRows, numColumns, filters,
+                     diff, mask, threshold);
+    }
+    else {
+        cascadeKernels[workspace->kernels[STAGE_CASCADE]](
+            workspace, numRows, numColumns, filters, diff, mask, threshold);
+    }
+    endStage(workspace, STAGE_CASCADE, &startTime);
+}
+
+/*
+Mark the edge-free tiles of the block-sparse mode in tileFlat.  The
+edge mask can only be set where y2 differs from z = G3(y2) by more than
+threshold.  Since G3 is a normalized smoothing filter of positive
+coefficients whose result is rounded, and y2 is integer valued, z lies
+between the smallest and the largest value of y2 within the support
+of G3.  A tile is therefore edge-free if y2 varies by at most
+threshold over the tile and the pixels within the radius of G3 around
+it, which the neighbouring tiles cover.  Returns the number of
+edge-free tiles.
+*/
+static int findFlatTiles(InverseHalftoneWorkspace* workspace,
+                         int numRows, int numColumns, ImagePlane* y2,
+                         int threshold)
+{
+    ImagePlane *tileMin = workspace->tileMin, *tileMax = workspace->tileMax;
+    ImagePlane *tileFlat = workspace->tileFlat;
+    int tileSize = workspace->sparseTileSize;
+    int numTileRows = (numRows + tileSize - 1) / tileSize;
+    int numTileColumns = (numColumns + tileSize - 1) / tileSize;
+    int numFlatTiles = 0;
+    int i, j, ti, tj;
+
+    setImagePlaneSize(tileMin, numTileRows, numTileColumns);
+    setImagePlaneSize(tileMax, numTileRows, numTileColumns);
+    setImagePlaneSize(tileFlat, numTileRows, numTileColumns);
+
+    /* Range of y2 over each tile */
+    for (i = 0; i < numRows; i++) {
+        float *y2Row = FLOAT_PLANE_ROW(y2, i);
+        float *minRow = FLOAT_PLANE_ROW(tileMin, i / tileSize);
+        float *maxRow = FLOAT_PLANE_ROW(tileMax, i / tileSize);
+        for (tj = 0; tj < numTileColumns; tj++) {
+            int firstColumn = tj * tileSize;
+            int lastColumn = firstColumn + tileSize;
+            float low, high;
+            if (lastColumn > numColumns) lastColumn = numColumns;
+            if (i % tileSize == 0) {
+                low = high = y2Row[firstColumn];
+            }
+            else {
+                low = minRow[tj];
+                high = maxRow[tj];
+            }
+            for (j = firstColumn; j < lastColumn; j++) {
+                if (y2Row[j] < low) low = y2Row[j];
+                if (y2Row[j] > high) high = y2Row[j];
+            }
+            minRow[tj] = low;
+            maxRow[tj] = high;
+        }
+    }
+    mirrorImagePlaneBorder(tileMin);
+    mirrorImagePlaneBorder(tileMax);
+
+    /* Range over each tile and its eight neighbours */
+    for (ti = 0; ti < numTileRows; ti++) {
+        unsigned char *flatRow = BYTE_PLANE_ROW(tileFlat, ti);
+        for (tj = 0; tj < numTileColumns; tj++) {
+            float low = FLOAT_PLANE_ROW(tileMin, ti)[tj];
+            float high = FLOAT_PLANE_ROW(tileMax, ti)[tj];
+            int k, l;
+            for (k = -1; k <= 1; k++) {
+                float *minRow = FLOAT_PLANE_ROW(tileMin, ti + k);
+                float *maxRow = FLOAT_PLANE_ROW(tileMax, ti + k);
+                for (l = -1; l <= 1; l++) {
+                    if (minRow[tj + l] < low) low = minRow[tj + l];
+                    if (maxRow[tj + l] > high) high = maxRow[tj + l];
+                }
+            }
+            flatRow[tj] = (high - low <= threshold);
+            numFlatTiles += flatRow[tj];
+        }
+    }
+    return(numFlatTiles);
+}
+
+/*
+Block-sparse version of the stages after the median.  The second
+Gaussian filter is applied to the whole image, into y0.  The third
+Gaussian filter, the difference, the edge mask and its median, and the
+gain are only computed for the tiles that findFlatTiles cannot prove
+edge-free; in the edge-free tiles, the edge mask is zero and the
+output is y1.  The result is the same as that of the dense stages.
+*/
+static void sparseStages(InverseHalftoneWorkspace* workspace,
+                         int numRows, int numColumns,
+                         HalftoneFilters* filters, int threshold, int gain,
+                         unsigned char* outputByteImage)
+{
+    ImagePlane *y1 = workspace->y1, *y2 = workspace->y0;
+    ImagePlane *ws = workspace->scratch, *hie = workspace->hie;
+    ImagePlane *mask = workspace->mask, *tileFlat = workspace->tileFlat;
+    int tileSize = workspace->sparseTileSize;
+    int numTileRows = (numRows + tileSize - 1) / tileSize;
+    int numTileColumns = (numColumns + tileSize - 1) / tileSize;
+    int r3 = THIRD_FILTER_RADIUS;
+    float gainAsFloat = (float) gain;
+    double startTime;
+    int i, j, k, ti, tj;
+
+    startStage(workspace, &startTime);
+    secondFilter(workspace, numRows, numColumns, filters, y2);
+    workspace->stats.numTiles += numTileRows * numTileColumns;
+    workspace->stats.numFlatTiles +=
+        findFlatTiles(workspace, numRows, numColumns, y2, threshold);
+
+    /* Third filter, difference and edge mask of the tiles with edges */
+    for (ti = 0; ti < numTileRows; ti++) {
+        unsigned char *flatRow = BYTE_PLANE_ROW(tileFlat, ti);
+        int firstRow = ti * tileSize;
+        int lastRow = firstRow + tileSize;
+        int firstFilterRow = firstRow - r3, lastFilterRow;
+        if (lastRow > numRows) lastRow = numRows;
+        if (firstFilterRow < 0) firstFilterRow = 0;
+        lastFilterRow = lastRow + r3;
+        if (lastFilterRow > numRows) lastFilterRow = numRows;
+
+        for (tj = 0; tj < numTileColumns; tj++) {
+            int firstColumn = tj * tileSize;
+            int width = tileSize;
+            if (firstColumn + width > numColumns) {
+                width = numColumns - firstColumn;
+            }
+            if (flatRow[tj]) {
+                for (i = firstRow; i < lastRow; i++) {
+                    memset(BYTE_PLANE_ROW(mask, i) + firstColumn, 0, width);
+                }
+                continue;
+            }
+            for (i = firstFilterRow; i < lastFilterRow; i++) {
+                GaussianFilter3Rows(FLOAT_PLANE_ROW(ws, i) + firstColumn,
+                                    FLOAT_PLANE_ROW(y2, i) + firstColumn,
+                                    width);
+            }
+            for (i = firstRow; i < lastRow; i++) {
+                float *rows[2*THIRD_FILTER_RADIUS + 1];
+                float *y2Row = FLOAT_PLANE_ROW(y2, i) + firstColumn;
+                float *diffRow = FLOAT_PLANE_ROW(hie, i) + firstColumn;
+                unsigned char *maskRow = BYTE_PLANE_ROW(mask, i) + firstColumn;
+                for (k = 0; k < 2*r3 + 1; k++) {
+                    rows[k] = FLOAT_PLANE_ROW(ws, reflectIndex(i - r3 + k,
+                                                               numRows)) +
+                              firstColumn;
+                }
+                GaussianFilter3Columns(diffRow, rows, width);
+                for (j = 0; j < width; j++) {
+                    float pixel = y2Row[j] - diffRow[j];
+                    diffRow[j] = pixel;
+                    maskRow[j] = !((pixel <= threshold) &&
+                                   (pixel >= -threshold));
+                }
+            }
+        }
+    }
+    endStage(workspace, STAGE_CASCADE, &startTime);
+
+    /* Median of the edge mask and masking of the tiles with edges */
+    clearImagePlaneBorder(mask);
+    for (ti = 0; ti < numTileRows; ti++) {
+        unsigned char *flatRow = BYTE_PLANE_ROW(tileFlat, ti);
+        int firstRow = ti * tileSize;
+        int height = (firstRow + tileSize > numRows) ?
+                     numRows - firstRow : tileSize;
+        for (tj = 0; tj < numTileColumns; tj++) {
+            int firstColumn = tj * tileSize;
+            int width = (firstColumn + tileSize > numColumns) ?
+                        numColumns - firstColumn : tileSize;
+            if (!flatRow[tj]) {
+                applyEdgeMapRegion(
+                    binaryMedianKernels[workspace->kernels[STAGE_EDGE_MAP]],
+                    firstRow, height, firstColumn, width,
+                    hie, mask, workspace->edgeMap, hie);
+            }
+        }
+    }
+    endStage(workspace, STAGE_EDGE_MAP, &startTime);
+
+    /* Last stage, in which the edge-free tiles just round y1 */
+    for (i = 0; i < numRows; i++) {
+        unsigned char *flatRow = BYTE_PLANE_ROW(tileFlat, i / tileSize);
+        unsigned char *outputRow = outputByteImage + i*numColumns;
+        float *hieRow = FLOAT_PLANE_ROW(hie, i);
+        float *y1Row = FLOAT_PLANE_ROW(y1, i);
+        for (tj = 0; tj < numTileColumns; tj++) {
+            int firstColumn = tj * tileSize;
+            int width = (firstColumn + tileSize > numColumns) ?
+                        numColumns - firstColumn : tileSize;
+            if (flatRow[tj]) {
+                flatLastStageSegment(outputRow + firstColumn,
+                                     y1Row + firstColumn, width);
+            }
+            else {
+                lastStageSegment(outputRow + firstColumn,
+                                 hieRow + firstColumn, y1Row + firstColumn,
+                                 width, gainAsFloat);
+            }
+        }
+    }
+    endStage(workspace, STAGE_OUTPUT, &startTime);
+}
+
+/*
+Rows of every queue of the pipelined mode: enough for the 9 rows that
+the widest filter reads, and as many again, so that a stage can run
+ahead of the next one
+*/
+#define PIPELINE_QUEUE_ROWS 16
+
+/* Threads of the pipelined mode besides the calling thread */
+#define NUM_PIPELINE_THREADS 4
+
+/*
+The pipelined mode runs the stages on threads of their own, which
+pass the rows they complete down a RowQueue to the next stage:
+
+    G1 --y0--> median --y1--> G2 --y2, y1--> G3 --y2 - z, y1, mask--> output
+
+The threads of the Gaussian filters keep the rows of their row filter
+results that their column filters still need in rings of their own,
+as gaussianCascade does.  The second and third filters pass y1 on with
+their results, for the output stage, so that every queue has a single
+consumer.  The third filter also thresholds the difference into the
+edge mask, and the calling thread takes the binary median of the mask
+and the last stage.
+
+The threads are started with the pipeline and wait between images, so
+that an image costs no thread creation.  For every image the calling
+thread sets the job, increments the generation and wakes them up, and
+it waits for them all to finish before returning.
+*/
+
+/* What the threads of the pipelined mode work on */
+typedef struct PipelineJob {
+    InverseHalftonePipeline* pipeline;
+    HalftoneFilters* filters;
+    unsigned char* inputByteImage;
+    unsigned char* outputByteImage;
+    int numRows;
+    int numColumns;
+    int threshold;
+    int gain;
+} PipelineJob;
+
+/* A thread of the pipelined mode, running the stage of stageIndex */
+typedef struct PipelineThread {
+    InverseHalftonePipeline* pipeline;
+    pthread_t thread;
+    int stageIndex;
+} PipelineThread;
+
+struct InverseHalftonePipeline {
+    RowQueue smoothed;          /* y0 */
+    RowQueue median;            /* y1 */
+    RowQueue second;            /* y2 and y1 */
+    RowQueue difference;        /* y2 - z, y1 and the edge mask */
+    ImagePlane* inputRow;       /* binary row of the halftone */
+    ImagePlane* g1RowRing;      /* last rows of G1 row filter results */
+    ImagePlane* g2RowRing;      /* last rows of G2 row filter results */
+    ImagePlane* g3RowRing;      /* last rows of G3 row filter results */
+    ImagePlane* zeroMaskRow;    /* the edge mask above the image */
+    ImagePlane* edgeRow;        /* 5x5 binary median of the edge mask */
+    ImagePlane* hieRow;
+    PipelineThread threads[NUM_PIPELINE_THREADS];
+    int numStarted;
+    PipelineJob job;            /* the image being inverse halftoned */
+    int generation;             /* images given to the threads so far */
+    int numFinished;            /* threads done with the current image */
+    int stopping;
+    pthread_mutex_t lock;       /* guards the three fields above */
+    pthread_cond_t start;
+    pthread_cond_t finished;
+};
+
+/* Planes of the queues of the pipelined mode */
+#define PIPELINE_RESULT 0       /* y0, y1, y2 or y2 - z */
+#define PIPELINE_Y1     1
+#define PIPELINE_MASK   2
+
+/* First stage of the pipelined mode: y0 = G1(halftone) */
+static void smoothingPipelineStage(PipelineJob* job)
+{
+    InverseHalftonePipeline* pipeline = job->pipeline;
+    RowQueue* out = &pipeline->smoothed;
+    unsigned char* binaryRow = BYTE_PLANE_ROW(pipeline->inputRow, 0);
+    int m = job->numRows, n = job->numColumns;
+    int nextRow = 0;            /* next row to filter along the rows */
+    float *rows[9];
+    int i, j, k;
+
+    for (i = 0; i < m; i++) {
+        for (; (nextRow <= i + 4) && (nextRow < m); nextRow++) {
+            unsigned char* inputRow = job->inputByteImage +
+                                      (size_t) nextRow * n;
+            for (j = 0; j < n; j++) {
+                binaryRow[j] = (inputRow[j] != 0);
+            }
+            mirrorImagePlaneRowSides(pipeline->inputRow, 0);
+            job->filters->g1Rows(FLOAT_PLANE_ROW(pipeline->g1RowRing,
+                                                 nextRow % 9),
+                                 binaryRow, n);
+        }
+        for (k = 0; k < 9; k++) {
+            int source = reflectIndex(i - 4 + k, m);
+            rows[k] = FLOAT_PLANE_ROW(pipeline->g1RowRing, source % 9);
+        }
+        if (!waitRowQueueSpace(out, i)) {
+            break;
+        }
+        job->filters->g1Columns(FLOAT_ROW_QUEUE_ROW(out, PIPELINE_RESULT, i),
+                                rows, n);
+        mirrorImagePlaneRowSides(out->planes[PIPELINE_RESULT],
+                                 ROW_QUEUE_SLOT(out, i));
+        publishRowQueueRows(out, i + 1);
+    }
+}
+
+/* Second stage of the pipelined mode: y1 = median(y0) */
+static void medianPipelineStage(PipelineJob* job)
+{
+    RowQueue* in = &job->pipeline->smoothed;
+    RowQueue* out = &job->pipeline->median;
+    int m = job->numRows, n = job->numColumns;
+    int size = job->filters->medianSize, radius = size / 2;
+    float *rows[5];
+    int i, k;
+
+    for (i = 0; i < m; i++) {
+        int lastRow = (i + radius < m) ? i + radius : m - 1;
+        if (!waitRowQueueRows(in, lastRow + 1) ||
+            !waitRowQueueSpace(out, i)) {
+            break;
+        }
+        for (k = 0; k < size; k++) {
+            rows[k] = FLOAT_ROW_QUEUE_ROW(in, PIPELINE_RESULT,
+                                          reflectIndex(i - radius + k, m));
+        }
+        networkMedianGreyRow(FLOAT_ROW_QUEUE_ROW(out, PIPELINE_RESULT, i),
+                             rows, n, size, 1);
+        mirrorImagePlaneRowSides(out->planes[PIPELINE_RESULT],
+                                 ROW_QUEUE_SLOT(out, i));
+        publishRowQueueRows(out, i + 1);
+        releaseRowQueueRows(in, i - radius + 1);
+    }
+}
+
+/* Third stage of the pipelined mode: y2 = G2(y1), passing y1 on */
+static void secondPipelineStage(PipelineJob* job)
+{
+    HalftoneFilters* filters = job->filters;
+    ImagePlane* rowRing = job->pipeline->g2RowRing;
+    RowQueue* in = &job->pipeline->median;
+    RowQueue* out = &job->pipeline->second;
+    int m = job->numRows, n = job->numColumns;
+    int r2 = filters->g2Radius, ringRows = 2*r2 + 1;
+    int nextRow = 0;            /* next row of y1 to filter along the rows */
+    float *rows[9];
+    int i, k;
+
+    for (i = 0; i < m; i++) {
+        for (; (nextRow <= i + r2) && (nextRow < m); nextRow++) {
+            if (!waitRowQueueRows(in, nextRow + 1)) {
+                return;
+            }
+            filters->g2Rows(FLOAT_PLANE_ROW(rowRing, nextRow % ringRows),
+                            FLOAT_ROW_QUEUE_ROW(in, PIPELINE_RESULT, nextRow),
+                            n);
+        }
+        for (k = 0; k < ringRows; k++) {
+            int source = reflectIndex(i - r2 + k, m);
+            rows[k] = FLOAT_PLANE_ROW(rowRing, source % ringRows);
+        }
+        if (!waitRowQueueSpace(out, i)) {
+            break;
+        }
+        filters->g2Columns(FLOAT_ROW_QUEUE_ROW(out, PIPELINE_RESULT, i),
+                           rows, n);
+        mirrorImagePlaneRowSides(out->planes[PIPELINE_RESULT],
+                                 ROW_QUEUE_SLOT(out, i));
+        memcpy(FLOAT_ROW_QUEUE_ROW(out, PIPELINE_Y1, i),
+               FLOAT_ROW_QUEUE_ROW(in, PIPELINE_RESULT, i), n*sizeof(float));
+        publishRowQueueRows(out, i + 1);
+        releaseRowQueueRows(in, i + 1);
+    }
+}
+
+/*
+Fourth stage of the pipelined mode: z = G3(y2), then the difference
+y2 - z and the edge mask, passing y1 on
+*/
+static void thirdPipelineStage(PipelineJob* job)
+{
+    ImagePlane* rowRing = job->pipeline->g3RowRing;
+    RowQueue* in = &job->pipeline->second;
+    RowQueue* out = &job->pipeline->difference;
+    int m = job->numRows, n = job->numColumns;
+    int threshold = job->threshold;
+    int r3 = THIRD_FILTER_RADIUS, ringRows = 2*THIRD_FILTER_RADIUS + 1;
+    int nextRow = 0;            /* next row of y2 to filter along the rows */
+    float *rows[2*THIRD_FILTER_RADIUS + 1];
+    int i, j, k;
+
+    for (i = 0; i < m; i++) {
+        float *diffRow, *y2Row;
+        unsigned char *maskRow;
+
+        for (; (nextRow <= i + r3) && (nextRow < m); nextRow++) {
+            if (!waitRowQueueRows(in, nextRow + 1)) {
+                return;
+            }
+            GaussianFilter3Rows(FLOAT_PLANE_ROW(rowRing, nextRow % ringRows),
+                                FLOAT_ROW_QUEUE_ROW(in, PIPELINE_RESULT,
+                                                    nextRow),
+                                n);
+        }
+        for (k = 0; k < ringRows; k++) {
+            int source = reflectIndex(i - r3 + k, m);
+            rows[k] = FLOAT_PLANE_ROW(rowRing, source % ringRows);
+        }
+        if (!waitRowQueueSpace(out, i)) {
+            break;
+        }
+        diffRow = FLOAT_ROW_QUEUE_ROW(out, PIPELINE_RESULT, i);
+        GaussianFilter3Columns(diffRow, rows, n);
+        y2Row = FLOAT_ROW_QUEUE_ROW(in, PIPELINE_RESULT, i);
+        maskRow = BYTE_ROW_QUEUE_ROW(out, PIPELINE_MASK, i);
+        for (j = 0; j < n; j++) {
+            float pixel = y2Row[j] - diffRow[j];
+            diffRow[j] = pixel;
+            maskRow[j] = !((pixel <= threshold) && (pixel >= -threshold));
+        }
+        memcpy(FLOAT_ROW_QUEUE_ROW(out, PIPELINE_Y1, i),
+               FLOAT_ROW_QUEUE_ROW(in, PIPELINE_Y1, i), n*sizeof(float));
+        publishRowQueueRows(out, i + 1);
+        releaseRowQueueRows(in, i + 1);
+    }
+}
+
+/*
+Last stage of the pipelined mode, on the calling thread: the binary
+median of the edge mask, which only looks at the rows above, and the
+output
+*/
+static void outputPipelineStage(PipelineJob* job)
+{
+    InverseHalftonePipeline* pipeline = job->pipeline;
+    RowQueue* in = &pipeline->difference;
+    unsigned char* edgeRow = BYTE_PLANE_ROW(pipeline->edgeRow, 0);
+    float* hieRow = FLOAT_PLANE_ROW(pipeline->hieRow, 0);
+    float gainAsFloat = (float) job->gain;
+    int m = job->numRows, n = job->numColumns;
+    unsigned char *rows[5];
+    int i, j, k;
+
+    for (i = 0; i < m; i++) {
+        float *diffRow;
+        unsigned char *maskRow;
+
+        if (!waitRowQueueRows(in, i + 1)) {
+            return;
+        }
+        for (k = 0; k < 5; k++) {
+            rows[k] = (i - 4 + k < 0) ?
+                      BYTE_PLANE_ROW(pipeline->zeroMaskRow, 0) :
+                      BYTE_ROW_QUEUE_ROW(in, PIPELINE_MASK, i - 4 + k);
+        }
+        slidingMedian5x5BinaryRow(edgeRow, rows, n);
+        diffRow = FLOAT_ROW_QUEUE_ROW(in, PIPELINE_RESULT, i);
+        maskRow = BYTE_ROW_QUEUE_ROW(in, PIPELINE_MASK, i);
+        for (j = 0; j < n; j++) {
+            hieRow[j] = diffRow[j] * (float) (maskRow[j] & edgeRow[j]);
+        }
+        lastStageSegment(job->outputByteImage + (size_t) i * n, hieRow,
+                         FLOAT_ROW_QUEUE_ROW(in, PIPELINE_Y1, i), n,
+                         gainAsFloat);
+        releaseRowQueueRows(in, i - 3);
+    }
+}
+
+/* The stages of the threads of the pipelined mode, by stageIndex */
+static void (*pipelineThreadStages[NUM_PIPELINE_THREADS])(PipelineJob*) = {
+    smoothingPipelineStage, medianPipelineStage,
+    secondPipelineStage, thirdPipelineStage
+};
+
+/*
+Body of a thread of the pipelined mode: run its stage on every image
+given to the pipeline, until the pipeline stops
+*/
+static void* runPipelineThread(void* arg)
+{
+    PipelineThread* thread = (PipelineThread*) arg;
+    InverseHalftonePipeline* pipeline = thread->pipeline;
+    int generation = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&pipeline->lock);
+        while ((pipeline->generation == generation) && !pipeline->stopping) {
+            pthread_cond_wait(&pipeline->start, &pipeline->lock);
+        }
+        if (pipeline->stopping) {
+            pthread_mutex_unlock(&pipeline->lock);
+            break;
+        }
+        generation = pipeline->generation;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        pipelineThreadStages[thread->stageIndex](&pipeline->job);
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (++pipeline->numFinished == NUM_PIPELINE_THREADS) {
+            pthread_cond_signal(&pipeline->finished);
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+    }
+    return(0);
+}
+
+/*
+Pin the k-th thread of the pipeline to the (k + 1)-th processor that
+the process may run on, counting round, which leaves the first one to
+the calling thread.  With as many processors as stages, every stage
+keeps a core of its own and the rows it works on stay in its cache.
+Does nothing on a single processor or where threads cannot be pinned.
+*/
+static void pinPipelineThreads(InverseHalftonePipeline* pipeline)
+{
+#ifdef __linux__
+    cpu_set_t allowed, cpuSet;
+    int numAllowed, k;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        return;
+    }
+    numAllowed = CPU_COUNT(&allowed);
+    if (numAllowed < 2) {
+        return;
+    }
+    for (k = 0; k < pipeline->numStarted; k++) {
+        int index = (k + 1) % numAllowed, cpu;
+        for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed) && (index-- == 0)) {
+                break;
+            }
+        }
+        CPU_ZERO(&cpuSet);
+        CPU_SET(cpu, &cpuSet);
+        pthread_setaffinity_np(pipeline->threads[k].thread, sizeof(cpuSet),
+                               &cpuSet);
+    }
+#endif
+}
+
+/*
+Inverse halftone the numRows by numColumns inputByteImage into
+outputByteImage with every stage on a thread of the pipeline, the
+calling thread taking the last one
+*/
+static void pipelineStages(InverseHalftoneWorkspace* workspace,
+                           unsigned char* inputByteImage,
+                           unsigned char* outputByteImage,
+                           int numRows, int numColumns,
+                           HalftoneFilters* filters, int threshold, int gain)
+{
+    InverseHalftonePipeline* pipeline = workspace->pipeline;
+    PipelineJob* job = &pipeline->job;
+
+    resetRowQueue(&pipeline->smoothed, numColumns);
+    resetRowQueue(&pipeline->median, numColumns);
+    resetRowQueue(&pipeline->second, numColumns);
+    resetRowQueue(&pipeline->difference, numColumns);
+    clearImagePlaneBorder(pipeline->difference.planes[PIPELINE_MASK]);
+    setImagePlaneSize(pipeline->inputRow, 1, numColumns);
+    setImagePlaneSize(pipeline->g1RowRing, 9, numColumns);
+    setImagePlaneSize(pipeline->g2RowRing, 2*filters->g2Radius + 1,
+                      numColumns);
+    setImagePlaneSize(pipeline->g3RowRing, 2*THIRD_FILTER_RADIUS + 1,
+                      numColumns);
+
+    job->filters = filters;
+    job->inputByteImage = inputByteImage;
+    job->outputByteImage = outputByteImage;
+    job->numRows = numRows;
+    job->numColumns = numColumns;
+    job->threshold = threshold;
+    job->gain = gain;
+
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->numFinished = 0;
+    pipeline->generation++;
+    pthread_cond_broadcast(&pipeline->start);
+    pthread_mutex_unlock(&pipeline->lock);
+
+    outputPipelineStage(job);
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (pipeline->numFinished < NUM_PIPELINE_THREADS) {
+        pthread_cond_wait(&pipeline->finished, &pipeline->lock);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+}
+
+/* Stop the threads of the pipeline and deallocate it */
+static void freeInverseHalftonePipeline(InverseHalftonePipeline* pipeline)
+{
+    int k;
+
+    if (pipeline == 0) {
+        return;
+    }
+    pthread_mutex_lock(&pipeline->lock);
+    pipeline->stopping = TRUE;
+    pthread_cond_broadcast(&pipeline->start);
+    pthread_mutex_unlock(&pipeline->lock);
+    for (k = 0; k < pipeline->numStarted; k++) {
+        pthread_join(pipeline->threads[k].thread, 0);
+    }
+    pthread_mutex_destroy(&pipeline->lock);
+    pthread_cond_destroy(&pipeline->start);
+    pthread_cond_destroy(&pipeline->finished);
+    destroyRowQueue(&pipeline->smoothed);
+    destroyRowQueue(&pipeline->median);
+    destroyRowQueue(&pipeline->second);
+    destroyRowQueue(&pipeline->difference);
+    freeImagePlane(pipeline->inputRow);
+    freeImagePlane(pipeline->g1RowRing);
+    freeImagePlane(pipeline->g2RowRing);
+    freeImagePlane(pipeline->g3RowRing);
+    freeImagePlane(pipeline->zeroMaskRow);
+    freeImagePlane(pipeline->edgeRow);
+    freeImagePlane(pipeline->hieRow);
+    trackedFree(pipeline);
+}
+
+/*
+Compute the support of the whole inverse halftoning pipeline: an output
+pixel depends on the input pixels up to *beforePtr rows (columns) above
+(to the left of) it and up to *afterPtr rows (columns) below (to the
+right of) it.  The support is the sum of the radii of the first
+Gaussian filter, the grey median, the second and third Gaussian filters,
+plus the 5x5 binary median of the edge mask, which only looks up and to
+the left.  Returns FALSE for an unknown halftoning type.
+*/
+int inverseHalftoneSupport(int halftoningType, int* beforePtr, int* afterPtr)
+{
+    int radius = 0;
+
+    switch(halftoningType) {
+      case HALFTONING_BY_ERROR_DIFFUSION:
+        radius = 4 + 1 + 3 + 3;         /* 9x9, 3x3 median, 7x7, 7x7 */
+        break;
+
+      case HALFTONING_BY_DISPERED_DITHER:
+      case HALFTONING_BY_CLUSTERED_DITHER:
+        radius = 4 + 2 + 4 + 3;         /* 9x9, 5x5 median, 9x9, 7x7 */
+        break;
+
+      default:
+        return FALSE;
+    }
+
+    *beforePtr = radius + 4;            /* 5x5 binary median of edge mask */
+    *afterPtr = radius;
+    return TRUE;
+}
+
+/*
+Allocate the intermediate images needed to inverse halftone images
+of up to maxRows by maxColumns pixels.  A workspace can be reused for
+any number of calls to inverseHalftoneWithWorkspace, which avoids the
+allocation and first-touch cost for every image.  The borders of the
+planes are as wide as the filters that read them need.  Returns a null
+pointer if memory could not be allocated.
+*/
+InverseHalftoneWorkspace* allocateInverseHalftoneWorkspace(int maxRows,
+                                                           int maxColumns)
+{
+    InverseHalftoneWorkspace* workspace = (InverseHalftoneWorkspace*)
+        trackedCalloc(1, sizeof(InverseHalftoneWorkspace));
+    int stage;
+
+    if (workspace == 0) {
+        return(0);
+    }
+    workspace->maxRows = maxRows;
+    workspace->maxColumns = maxColumns;
+    workspace->qualityLevel = INVERSE_HALFTONE_QUALITY_FULL;
+    workspace->sigmaScale = 1.0;
+    workspace->inputImage =
+        allocateImagePlane(IMAGE_PLANE_UINT8, maxRows, maxColumns, 4);
+    workspace->y0 =
+        allocateImagePlane(IMAGE_PLANE_FLOAT, maxRows, maxColumns, 4);
+    workspace->y1 =
+        allocateImagePlane(IMAGE_PLANE_FLOAT, maxRows, maxColumns, 4);
+    workspace->g2RowRing = allocateImagePlane(IMAGE_PLANE_FLOAT,
+                                              CASCADE_RING_ROWS, maxColumns, 0);
+    workspace->y2Ring =
+        allocateImagePlane(IMAGE_PLANE_FLOAT, 2*THIRD_FILTER_RADIUS + 1,
+                           maxColumns, THIRD_FILTER_RADIUS);
+    workspace->g3RowRing =
+        allocateImagePlane(IMAGE_PLANE_FLOAT, 2*THIRD_FILTER_RADIUS + 1,
+                           maxColumns, 0);
+    workspace->hie =
+        allocateImagePlane(IMAGE_PLANE_FLOAT, maxRows, maxColumns, 0);
+    workspace->scratch =
+        allocateImagePlane(IMAGE_PLANE_FLOAT, maxRows, maxColumns, 4);
+    workspace->mask =
+        allocateImagePlane(IMAGE_PLANE_UINT8, maxRows, maxColumns, 4);
+    workspace->edgeMap =
+        allocateImagePlane(IMAGE_PLANE_UINT8, maxRows, maxColumns, 0);
+
+    /* Check memory allocation, and return an error upon failure */
+    if ((workspace->inputImage == 0) ||
+        (workspace->y0 == 0) || (workspace->y1 == 0) ||
+        (workspace->g2RowRing == 0) || (workspace->y2Ring == 0) ||
+        (workspace->g3RowRing == 0) || (workspace->hie == 0) ||
+        (workspace->scratch == 0) || (workspace->mask == 0) ||
+        (workspace->edgeMap == 0)) {
+        freeInverseHalftoneWorkspace(workspace);
+        return(0);
+    }
+    for (stage = 0; stage < NUM_INVERSE_HALFTONE_STAGES; stage++) {
+        if (!setInverseHalftoneKernel(workspace, stage,
+                                      defaultKernels[stage])) {
+            freeInverseHalftoneWorkspace(workspace);
+            return(0);
+        }
+    }
+
+    return(workspace);
+}
+
+/* Touch every page of the workspace so that the first image is not slowed
+   down by page faults */
+void prewarmInverseHalftoneWorkspace(InverseHalftoneWorkspace* workspace)
+{
+    memset(workspace->inputImage->memory, 0, workspace->inputImage->numBytes);
+    memset(workspace->y0->memory, 0, workspace->y0->numBytes);
+    memset(workspace->y1->memory, 0, workspace->y1->numBytes);
+    memset(workspace->g2RowRing->memory, 0, workspace->g2RowRing->numBytes);
+    memset(workspace->y2Ring->memory, 0, workspace->y2Ring->numBytes);
+    memset(workspace->g3RowRing->memory, 0, workspace->g3RowRing->numBytes);
+    memset(workspace->hie->memory, 0, workspace->hie->numBytes);
+    memset(workspace->scratch->memory, 0, workspace->scratch->numBytes);
+    memset(workspace->mask->memory, 0, workspace->mask->numBytes);
+    memset(workspace->edgeMap->memory, 0, workspace->edgeMap->numBytes);
+}
+
+/* Deallocate the intermediate images and the workspace itself */
+void freeInverseHalftoneWorkspace(InverseHalftoneWorkspace* workspace)
+{
+    if (workspace == 0) {
+        return;
+    }
+    freeImagePlane(workspace->inputImage);
+    freeImagePlane(workspace->y0);
+    freeImagePlane(workspace->y1);
+    freeImagePlane(workspace->g2RowRing);
+    freeImagePlane(workspace->y2Ring);
+    freeImagePlane(workspace->g3RowRing);
+    freeImagePlane(workspace->hie);
+    freeImagePlane(workspace->scratch);
+    freeImagePlane(workspace->mask);
+    freeImagePlane(workspace->edgeMap);
+    freeImagePlane(workspace->tileMin);
+    freeImagePlane(workspace->tileMax);
+    freeImagePlane(workspace->tileFlat);
+    freeImagePlane(workspace->y2);
+    freeImagePlane(workspace->recursiveBuffer);
+    freeImagePlane(workspace->pyramid);
+    freeInverseHalftonePipeline(workspace->pipeline);
+    trackedFree(workspace);
+}
+
+/*
+Inverse halftone the images given to the workspace in block-sparse
+mode, with square tiles of tileSize pixels, or in the dense mode if
+tileSize is 0.  In block-sparse mode, the third Gaussian filter, the
+edge map and the gain are skipped for the tiles in which the edge mask
+is provably zero, which saves time on images with large flat regions.
+The output is the same in both modes.  The sweep is always dense.
+Returns FALSE if the tile size is too small or memory could not be
+allocated.
+*/
+int setInverseHalftoneSparseTiles(InverseHalftoneWorkspace* workspace,
+                                  int tileSize)
+{
+    int maxTileRows, maxTileColumns;
+
+    if (tileSize == 0) {
+        workspace->sparseTileSize = 0;
+        return TRUE;
+    }
+    if (tileSize < MIN_SPARSE_TILE_SIZE) {
+        return FALSE;
+    }
+    freeImagePlane(workspace->tileMin);
+    freeImagePlane(workspace->tileMax);
+    freeImagePlane(workspace->tileFlat);
+    maxTileRows = (workspace->maxRows + tileSize - 1) / tileSize;
+    maxTileColumns = (workspace->maxColumns + tileSize - 1) / tileSize;
+    workspace->tileMin = allocateImagePlane(IMAGE_PLANE_FLOAT, maxTileRows,
+                                            maxTileColumns, 1);
+    workspace->tileMax = allocateImagePlane(IMAGE_PLANE_FLOAT, maxTileRows,
+                                            maxTileColumns, 1);
+    workspace->tileFlat = allocateImagePlane(IMAGE_PLANE_UINT8, maxTileRows,
+                                             maxTileColumns, 0);
+    if ((workspace->tileMin == 0) || (workspace->tileMax == 0) ||
+        (workspace->tileFlat == 0)) {
+        workspace->sparseTileSize = 0;
+        return FALSE;
+    }
+    workspace->sparseTileSize = tileSize;
+    return TRUE;
+}
+
+/*
+Trade quality for speed in the images given to the workspace.  At
+INVERSE_HALFTONE_QUALITY_FULL, the default, the whole algorithm runs.
+At INVERSE_HALFTONE_QUALITY_NO_MEDIAN, the grey median, which takes
+most of the time, is skipped, and the edges are enhanced on the
+smoothed halftone itself.  At INVERSE_HALFTONE_QUALITY_SMOOTHING, only
+the first Gaussian filter runs.  The sweep always runs the whole
+algorithm.  Returns FALSE for an unknown level.
+*/
+int setInverseHalftoneQuality(InverseHalftoneWorkspace* workspace,
+                              int qualityLevel)
+{
+    if ((qualityLevel < INVERSE_HALFTONE_QUALITY_SMOOTHING) ||
+        (qualityLevel > INVERSE_HALFTONE_QUALITY_FULL)) {
+        return FALSE;
+    }
+    workspace->qualityLevel = qualityLevel;
+    return TRUE;
+}
+
+/*
+Replace the Gaussian filters given by stages, a combination of
+RECURSIVE_FIRST_FILTER, RECURSIVE_SECOND_FILTER and
+RECURSIVE_THIRD_FILTER, by recursive filters, whose cost per pixel
+does not depend on their width.  The standard deviation of each
+recursive filter is that of the FIR filter it replaces times
+sigmaScale, such as the resolution of the halftone divided by
+REFERENCE_RESOLUTION_DPI.  The block-sparse mode is not used with a
+recursive third filter.  Returns FALSE if sigmaScale is not positive
+or memory could not be allocated.
+*/
+int setInverseHalftoneRecursiveFilters(InverseHalftoneWorkspace* workspace,
+                                       int stages, double sigmaScale)
+{
+    RecursiveGaussian widest;
+
+    if (sigmaScale <= 0.0) {
+        return FALSE;
+    }
+    workspace->recursiveStages = 0;
+    workspace->sigmaScale = sigmaScale;
+    if (stages == 0) {
+        return TRUE;
+    }
+    freeImagePlane(workspace->y2);
+    freeImagePlane(workspace->recursiveBuffer);
+    initRecursiveGaussian(&widest, MAX_FILTER_SIGMA * sigmaScale);
+    workspace->y2 = allocateImagePlane(IMAGE_PLANE_FLOAT, workspace->maxRows,
+                                       workspace->maxColumns, 4);
+    workspace->recursiveBuffer =
+        allocateRecursiveGaussianBuffer(widest.padding,
+                                        workspace->maxColumns);
+    if ((workspace->y2 == 0) || (workspace->recursiveBuffer == 0)) {
+        return FALSE;
+    }
+    workspace->recursiveStages = stages;
+    return TRUE;
+}
+
+/*
+Run the stages of the algorithm on threads of their own if
+pipelineFlag is TRUE, or all on the calling thread otherwise.  In the
+pipelined mode every stage passes the rows it completes to the next
+one through a RowQueue, so each stage works on a few rows at a time,
+which stay in the cache of its core, and the first rows of the output
+are ready as soon as the first rows of the input have gone through
+all the stages.  Unlike splitting the image into strips, no rows are
+filtered twice.  The mode uses five threads whatever the image, and
+always the fastest kernels; it applies to the whole algorithm with FIR
+filters and without block-sparse tiles, and other images are inverse
+halftoned on the calling thread.  The output is the same either way.
+The four threads besides the calling thread are started here, pinned
+to processors of their own where there are enough, and kept until the
+workspace is freed.  Returns FALSE if memory could not be allocated or
+the threads could not be started.
+*/
+int setInverseHalftonePipeline(InverseHalftoneWorkspace* workspace,
+                                int pipelineFlag)
+{
+    InverseHalftonePipeline* pipeline;
+    int n = workspace->maxColumns;
+    int k;
+
+    freeInverseHalftonePipeline(workspace->pipeline);
+    workspace->pipeline = 0;
+    if (!pipelineFlag) {
+        return TRUE;
+    }
+    pipeline = (InverseHalftonePipeline*)
+        trackedCalloc(1, sizeof(InverseHalftonePipeline));
+    if (pipeline == 0) {
+        return FALSE;
+    }
+    pthread_mutex_init(&pipeline->lock, 0);
+    pthread_cond_init(&pipeline->start, 0);
+    pthread_cond_init(&pipeline->finished, 0);
+    pipeline->job.pipeline = pipeline;
+    initRowQueue(&pipeline->smoothed, PIPELINE_QUEUE_ROWS);
+    initRowQueue(&pipeline->median, PIPELINE_QUEUE_ROWS);
+    initRowQueue(&pipeline->second, PIPELINE_QUEUE_ROWS);
+    initRowQueue(&pipeline->difference, PIPELINE_QUEUE_ROWS);
+    pipeline->inputRow = allocateImagePlane(IMAGE_PLANE_UINT8, 1, n, 4);
+    pipeline->g1RowRing = allocateImagePlane(IMAGE_PLANE_FLOAT, 9, n, 0);
+    pipeline->g2RowRing = allocateImagePlane(IMAGE_PLANE_FLOAT, 9, n, 0);
+    pipeline->g3RowRing = allocateImagePlane(IMAGE_PLANE_FLOAT,
+                                             2*THIRD_FILTER_RADIUS + 1, n, 0);
+    pipeline->zeroMaskRow = allocateImagePlane(IMAGE_PLANE_UINT8, 1, n, 4);
+    pipeline->edgeRow = allocateImagePlane(IMAGE_PLANE_UINT8, 1, n, 0);
+    pipeline->hieRow = allocateImagePlane(IMAGE_PLANE_FLOAT, 1, n, 0);
+    if ((pipeline->inputRow == 0) || (pipeline->g1RowRing == 0) ||
+        (pipeline->g2RowRing == 0) || (pipeline->g3RowRing == 0) ||
+        (pipeline->zeroMaskRow == 0) || (pipeline->edgeRow == 0) ||
+        (pipeline->hieRow == 0) ||
+        (addRowQueuePlane(&pipeline->smoothed, IMAGE_PLANE_FLOAT, n,
+                          2) == 0) ||
+        (addRowQueuePlane(&pipeline->median, IMAGE_PLANE_FLOAT, n,
+                          4) == 0) ||
+        (addRowQueuePlane(&pipeline->second, IMAGE_PLANE_FLOAT, n,
+                          THIRD_FILTER_RADIUS) == 0) ||
+        (addRowQueuePlane(&pipeline->second, IMAGE_PLANE_FLOAT, n, 0) == 0) ||
+        (addRowQueuePlane(&pipeline->difference, IMAGE_PLANE_FLOAT, n,
+                          0) == 0) ||
+        (addRowQueuePlane(&pipeline->difference, IMAGE_PLANE_FLOAT, n,
+                          0) == 0) ||
+        (addRowQueuePlane(&pipeline->difference, IMAGE_PLANE_UINT8, n,
+                          4) == 0)) {
+        freeInverseHalftonePipeline(pipeline);
+        return FALSE;
+    }
+    memset(pipeline->zeroMaskRow->memory, 0, pipeline->zeroMaskRow->numBytes);
+    for (k = 0; k < NUM_PIPELINE_THREADS; k++) {
+        PipelineThread* thread = &pipeline->threads[k];
+        thread->pipeline = pipeline;
+        thread->stageIndex = k;
+        if (pthread_create(&thread->thread, 0, runPipelineThread,
+                           thread) != 0) {
+            freeInverseHalftonePipeline(pipeline);
+            return FALSE;
+        }
+        pipeline->numStarted++;
+    }
+    pinPipelineThreads(pipeline);
+    workspace->pipeline = pipeline;
+    return TRUE;
+}
+
+/*
+Count hardware events in every stage with counters, as opened by
+openPerfCounters, or stop counting if counters is a null pointer.
+The counters must belong to the thread that inverse halftones.
+*/
+void setInverseHalftoneCounters(InverseHalftoneWorkspace* workspace,
+                                PerfCounters* counters)
+{
+    workspace->perfCounters = counters;
+    workspace->stats.counterMask =
+        (counters != 0) ? counters->availableMask : 0;
+}
+
+/* Name of stage, as given to selectInverseHalftoneKernels */
+char* inverseHalftoneStageName(int stage)
+{
+    return(stageKernels[stage].stageName);
+}
+
+/* Number of implementations of stage */
+int numInverseHalftoneKernels(int stage)
+{
+    return(stageKernels[stage].numKernels);
+}
+
+/* Name of implementation kernel of stage */
+char* inverseHalftoneKernelName(int stage, int kernel)
+{
+    return(stageKernels[stage].kernelNames[kernel]);
+}
+
+/*
+Use implementation kernel of stage for the images given to the
+workspace.  Returns FALSE for an unknown stage or implementation, or
+if memory could not be allocated for the reference cascade, which
+keeps y2 in full.
+*/
+int setInverseHalftoneKernel(InverseHalftoneWorkspace* workspace,
+                             int stage, int kernel)
+{
+    if ((stage < 0) || (stage >= NUM_INVERSE_HALFTONE_STAGES) ||
+        (kernel < 0) || (kernel >= stageKernels[stage].numKernels)) {
+        return FALSE;
+    }
+    if ((stage == STAGE_CASCADE) &&
+        (kernel == INVERSE_HALFTONE_REFERENCE_KERNEL) &&
+        (workspace->y2 == 0)) {
+        workspace->y2 = allocateImagePlane(IMAGE_PLANE_FLOAT,
+                                           workspace->maxRows,
+                                           workspace->maxColumns, 4);
+        if (workspace->y2 == 0) {
+            return FALSE;
+        }
+    }
+    workspace->kernels[stage] = kernel;
+    return TRUE;
+}
+
+/* Return TRUE if the length characters at text spell name */
+static int matchesName(char* name, char* text, int length)
+{
+    return(((int) strlen(name) == length) &&
+           (strncmp(name, text, length) == 0));
+}
+
+/* Index of the implementation of stage named by length characters */
+static int findKernel(int stage, char* text, int length)
+{
+    int kernel;
+
+    for (kernel = 0; kernel < stageKernels[stage].numKernels; kernel++) {
+        if (matchesName(stageKernels[stage].kernelNames[kernel], text,
+                        length)) {
+            return(kernel);
+        }
+    }
+    return(-1);
+}
+
+/*
+Select the implementations of the stages of the workspaces allocated
+from now on, from a comma-separated list of stage=kernel items, such
+as median=reference, or of kernel names alone, such as reference,
+which select that implementation for every stage that has it.  Call
+it before any workspace is allocated, since the workspaces of all
+threads follow it.  Returns FALSE, and changes nothing, if a stage or
+an implementation is unknown.
+*/
+int selectInverseHalftoneKernels(char* list)
+{
+    int kernels[NUM_INVERSE_HALFTONE_STAGES];
+    char *item = list;
+    int stage;
+
+    memcpy(kernels, defaultKernels, sizeof(kernels));
+    while (*item != 0) {
+        char *end = strchr(item, ',');
+        int length = (end != 0) ? (int) (end - item) : (int) strlen(item);
+        char *equals = (char *) memchr(item, '=', length);
+        if (equals != 0) {
+            int stageLength = (int) (equals - item);
+            int kernel = -1;
+            for (stage = 0; stage < NUM_INVERSE_HALFTONE_STAGES; stage++) {
+                if (matchesName(stageKernels[stage].stageName, item,
+                                stageLength)) {
+                    kernel = findKernel(stage, equals + 1,
+                                        length - stageLength - 1);
+                    break;
+                }
+            }
+            if (kernel < 0) {
+                return FALSE;
+            }
+            kernels[stage] = kernel;
+        }
+        else {
+            int found = FALSE;
+            for (stage = 0; stage < NUM_INVERSE_HALFTONE_STAGES; stage++) {
+                int kernel = findKernel(stage, item, length);
+                if (kernel >= 0) {
+                    kernels[stage] = kernel;
+                    found = TRUE;
+                }
+            }
+            if (!found) {
+                return FALSE;
+            }
+        }
+        item += length;
+        if (*item == ',') item++;
+    }
+    memcpy(defaultKernels, kernels, sizeof(kernels));
+    return TRUE;
+}
+
+/*
+Print the time spent in every stage, the edge-free tiles, and the
+hardware events counted in every stage
+*/
+void printInverseHalftoneStats(FILE* file, InverseHalftoneStats* stats)
+{
+    static char* stageNames[NUM_INVERSE_HALFTONE_STAGES] = {
+        "smoothing", "median", "cascade", "edge map", "output"
+    };
+    double totalTime = 0.0;
+    int k;
+
+    for (k = 0; k < NUM_INVERSE_HALFTONE_STAGES; k++) {
+        fprintf(file, "%-10s %10.6f s\n", stageNames[k], stats->stageTime[k]);
+        totalTime += stats->stageTime[k];
+    }
+    fprintf(file, "%-10s %10.6f s\n", "total", totalTime);
+    if (stats->numTiles > 0) {
+        fprintf(file, "skipped %d of %d tiles (%.1f%%)\n",
+                stats->numFlatTiles, stats->numTiles,
+                100.0 * stats->numFlatTiles / stats->numTiles);
+    }
+    if (stats->counterMask != 0) {
+        double totalCounts[NUM_PERF_COUNTERS];
+        int j;
+        for (j = 0; j < NUM_PERF_COUNTERS; j++) {
+            totalCounts[j] = 0.0;
+        }
+        printPerfCountersHeader(file);
+        for (k = 0; k < NUM_INVERSE_HALFTONE_STAGES; k++) {
+            printPerfCounters(file, stageNames[k], stats->stageCounts[k],
+                              stats->numPixels, stats->counterMask);
+            for (j = 0; j < NUM_PERF_COUNTERS; j++) {
+                totalCounts[j] += stats->stageCounts[k][j];
+            }
+        }
+        printPerfCounters(file, "total", totalCounts, stats->numPixels,
+                          stats->counterMask);
+    }
+}
+
+/*
+Print the most memory allocated through trackedMalloc, by all threads,
+during every stage
+*/
+void printInverseHalftoneMemory(FILE* file, InverseHalftoneStats* stats)
+{
+    static char* stageNames[NUM_INVERSE_HALFTONE_STAGES] = {
+        "smoothing", "median", "cascade", "edge map", "output"
+    };
+    int k;
+
+    for (k = 0; k < NUM_INVERSE_HALFTONE_STAGES; k++) {
+        fprintf(file, "%-10s %10.2f MB peak\n", stageNames[k],
+                stats->stagePeakBytes[k] / 1048576.0);
+    }
+}
+
+/*
+Compute the inverse halftone of inputImage and store the result in
+outputImage.  The inputImage and outputImage is of size numRows by
+numColumns.  The return value is the amount of computation time
+if timingFlag is TRUE, and 0.0 otherwise.  A negative return value 
+indicates an error.
+*/
+double inverseHalftone(unsigned char* inputByteImage,
+                       unsigned char* outputByteImage,
+                       int numRows, int numColumns,
+                       int gain, int threshold,
+                       int timingFlag, int halftoningType)
 {
-    int i, j;
-    float **ws = allocateFloatMatrix(m,n);
+    double computationTime = 0.0;
+    InverseHalftoneWorkspace* workspace =
+        allocateInverseHalftoneWorkspace(numRows, numColumns);
 
-    /* Row convolutions */
-    for (i = 0; i < m; i++) {
-        float *wsRow = ws[i];
-        float *sourceRow = s[i];
-        for (j = 0; j < n; j++) {
-            int p1 = j-4;
-            int p2 = j-3;
-            int p3 = j-2;
-            int p4 = j-1;
-            int p6 = j+1;
-            int p7 = j+2;
-            int p8 = j+3;
-            int p9 = j+4;
-
-            /* reflect negative indices to non-negative values using abs */
-            if (p1 < 0) p1 = -p1;
-            if (p2 < 0) p2 = -p2;
-            if (p3 < 0) p3 = -p3;
-            if (p4 < 0) p4 = -p4;
-
-            /* reflect indices that are too large back into proper range */
-            if (p6>=n) p6 = 2*n - p6 -2; 
-            if (p7>=n) p7 = 2*n - p7 - 2;
-            if (p8>=n) p8 = 2*n - p8 - 2;
-            if (p9>=n) p9 = 2*n - p9 - 2;
-
-            wsRow[j] = (h[4]*sourceRow[j]) +
-                       (h[0]*(sourceRow[p1]+sourceRow[p9])) +
-                       (h[1]*(sourceRow[p2]+sourceRow[p8])) +
-                       (h[2]*(sourceRow[p3]+sourceRow[p7])) +
-                       (h[3]*(sourceRow[p4]+sourceRow[p6]));
-        }
+    /* Check memory allocation, and return an error upon failure */
+    if (workspace == 0) {
+        computationTime = INVERSE_HALFTONING_NO_MEMORY;
+        return(computationTime);
     }
 
-    /* Column convolutions */
-    for (j = 0; j < n; j++) {
-        for (i = 0; i < m; i++) {
-            float sum = 0.0;
-
-            int p1 = i-4;
-            int p2 = i-3;
-            int p3 = i-2;
-            int p4 = i-1;
-            int p6 = i+1;
-            int p7 = i+2;
-            int p8 = i+3;
-            int p9 = i+4;
-
-            /* reflect negative indices to non-negative values using abs */
-            if (p1 < 0) p1 = -p1;
-            if (p2 < 0) p2 = -p2;
-            if (p3 < 0) p3 = -p3;
-            if (p4 < 0) p4 = -p4;
-
-            /* reflect indices that are too large back into proper range */
-            if (p6>=m) p6 = 2*m - p6 - 2; 
-            if (p7>=m) p7 = 2*m - p7 - 2;
-            if (p8>=m) p8 = 2*m - p8 - 2;
-            if (p9>=m) p9 = 2*m - p9 - 2;
-
-            sum = (h[4]*ws[i][j]) +
-                  (h[0]*(ws[p1][j]+ws[p9][j])) +
-                  (h[1]*(ws[p2][j]+ws[p8][j])) +
-                  (h[2]*(ws[p3][j]+ws[p7][j])) +
-                  (h[3]*(ws[p4][j]+ws[p6][j]));
- 
-            st[i][j]= (float)((int) (sum/norm + FLOAT_TO_INT_OFFSET)); 
+    computationTime = inverseHalftoneWithWorkspace(workspace,
+                                                   inputByteImage,
+                                                   outputByteImage,
+                                                   numRows, numColumns,
+                                                   gain, threshold,
+                                                   timingFlag,
+                                                   halftoningType);
+
+    /* Deallocate intermediate images */ 
+    freeInverseHalftoneWorkspace(workspace);
+
+    return(computationTime);
+}
+
+/*
+Same as inverseHalftone, but use the intermediate images in workspace,
+which must have been allocated for at least numRows by numColumns pixels.
+*/
+double inverseHalftoneWithWorkspace(InverseHalftoneWorkspace* workspace,
+                                    unsigned char* inputByteImage,
+                                    unsigned char* outputByteImage,
+                                    int numRows, int numColumns,
+                                    int gain, int threshold,
+                                    int timingFlag, int halftoningType)
+{
+    int errorFlag = FALSE;
+    int quality = workspace->qualityLevel;
+    int medianFlag = (quality >= INVERSE_HALFTONE_QUALITY_FULL);
+    int pipelineFlag = (workspace->pipeline != 0) && medianFlag &&
+                       (workspace->recursiveStages == 0) &&
+                       (workspace->sparseTileSize == 0);
+    double computationTime = 0.0;
+    time_t startTime, finishTime;
+    HalftoneFilters filters;
+
+    if (!setWorkspaceSize(workspace, numRows, numColumns)) {
+        computationTime = INVERSE_HALFTONING_NO_MEMORY;
+        return(computationTime);
+    }
+
+    /* The pipelined stages read the input a row at a time */
+    if (!pipelineFlag) {
+        convertInputImage(workspace, inputByteImage, numRows, numColumns);
+    }
+
+    /* Perform inverse halftoning on inputImage and report the time */
+    /* The last two steps are the same for all three algorithms. */
+    if (timingFlag) time(&startTime);
+
+    if (!selectFilters(halftoningType, &filters)) {
+        errorFlag = TRUE;
+    }
+    else if (quality == INVERSE_HALFTONE_QUALITY_SMOOTHING) {
+        double stageStartTime;
+        int i;
+        smoothingStages(workspace, numRows, numColumns, &filters, FALSE);
+        startStage(workspace, &stageStartTime);
+        for (i = 0; i < numRows; i++) {
+            flatLastStageSegment(outputByteImage + i*numColumns,
+                                 FLOAT_PLANE_ROW(workspace->y1, i),
+                                 numColumns);
         }
+        endStage(workspace, STAGE_OUTPUT, &stageStartTime);
+    }
+    else if (pipelineFlag) {
+        pipelineStages(workspace, inputByteImage, outputByteImage,
+                       numRows, numColumns, &filters, threshold, gain);
+    }
+    else if ((workspace->sparseTileSize > 0) &&
+             !(workspace->recursiveStages & RECURSIVE_THIRD_FILTER)) {
+        smoothingStages(workspace, numRows, numColumns, &filters,
+                        medianFlag);
+        sparseStages(workspace, numRows, numColumns, &filters,
+                     threshold, gain, outputByteImage);
+    }
+    else {
+        double stageStartTime;
+        frontStages(workspace, numRows, numColumns, &filters, medianFlag,
+                    workspace->hie, workspace->mask, threshold);
+        startStage(workspace, &stageStartTime);
+        applyEdgeMap(binaryMedianKernels[workspace->kernels[STAGE_EDGE_MAP]],
+                     numRows, numColumns, workspace->hie, workspace->mask,
+                     workspace->edgeMap, workspace->hie);
+        endStage(workspace, STAGE_EDGE_MAP, &stageStartTime);
+        outputKernels[workspace->kernels[STAGE_OUTPUT]](
+            numRows, numColumns, gain, workspace->hie, workspace->y1,
+            outputByteImage);
+        endStage(workspace, STAGE_OUTPUT, &stageStartTime);
+    }
+
+    if (errorFlag) {
+        computationTime = INVERSE_HALFTONING_BAD_METHOD;
+    }
+    else if (timingFlag) {
+        time(&finishTime);
+        computationTime = difftime(finishTime, startTime);
     }
-    freeFloatMatrix(ws);
-    return(st);
+
+    return(computationTime);
 }
 
-float** median5x5GreyImage(int m, int n, float** x, float** x1)
+/*
+Inverse halftone inputImage once for every combination of the
+numThresholds values in thresholds and the numGains values in gains.
+The result for thresholds[t] and gains[g] is stored in
+outputImages[t*numGains + g].  The smoothing and median stages depend
+on neither parameter, so they run only once; the edge map depends only
+on the threshold, so it is computed once per threshold and reused for
+all gains.  The return value is as for inverseHalftone.
+*/
+double inverseHalftoneSweep(InverseHalftoneWorkspace* workspace,
+                            unsigned char* inputByteImage,
+                            unsigned char** outputByteImages,
+                            int numRows, int numColumns,
+                            int* thresholds, int numThresholds,
+                            int* gains, int numGains,
+                            int timingFlag, int halftoningType)
 {
-int i;
- 
-for(i=0;i<m;i++){
-   int j;
-   for(j=0;j<n;j++){ 
-       float data[26];         /* selectElement begins indexing at 1 */
-       data[1]=x[abs(i-2)][abs(j-2)];
-       data[2]=x[abs(i-2)][abs(j-1)];
-       data[3]=x[abs(i-2)][j];
-       if(j+1>=n)
-           data[4]=x[abs(i-2)][2*n-(j+1)-2];
-       else
-           data[4]=x[abs(i-2)][j+1];
-
-       if(j+2>=n)
-           data[5]=x[abs(i-2)][2*n-(j+2)-2];
-       else
-           data[5]=x[abs(i-2)][j+2];
-       
-       data[6]=x[abs(i-1)][abs(j-2)];
-       data[7]=x[abs(i-1)][abs(j-1)];
-       data[8]=x[abs(i-1)][j];
-    
-       if((j+1)>=n)
-           data[9]=x[abs(i-1)][2*n-(j+1)-2];
-       else
-           data[9]=x[abs(i-1)][j+1];
-
-       if((j+2)>=n)
-           data[10]=x[abs(i-1)][2*n-(j+2)-2];
-       else
-           data[10]=x[abs(i-1)][j+2];   
-
-       data[11]=x[i][abs(j-2)];        
-       data[12]=x[i][abs(j-1)];
-       data[13]=x[i][j];
-   
-       if((j+1)>=n)
-           data[14]=x[i][2*n-(j+1)-2];
-       else
-           data[14]=x[i][j+1];
-
-       if((j+2)>=n)
-           data[15]=x[i][2*n-(j+2)-2];
-       else
-           data[15]=x[i][j+2];
-
-       if((i+1)>=m){
-           data[16]=x[2*m-(i+1)-2][abs(j-2)];
-           data[17]=x[2*m-(i+1)-2][abs(j-1)];
-           data[18]=x[2*m-(i+1)-2][j];
-       }
-       else {
-           data[16]=x[i+1][abs(j-2)];
-           data[17]=x[i+1][abs(j-1)];
-           data[18]=x[i+1][abs(j)];
-       }
+    double computationTime = 0.0;
+    time_t startTime, finishTime;
+    HalftoneFilters filters;
+    int t;
 
-       if((i+1)>=m && (j+1)>=n)data[19]=x[2*m-(i+1)-2][2*n-(j+1)-2];
-       if((i+1)>=m && (j+1)<n)data[19]=x[2*m-(i+1)-2][j+1];
-       if((i+1)<m && (j+1)>=n)data[19]=x[i+1][2*n-(j+1)-2];
-       if((i+1)<m && (j+1)<n)data[19]=x[i+1][j+1];      
-
-       if((i+1)>=m && (j+2)>=n)data[20]=x[2*m-(i+1)-2][2*n-(j+2)-2];
-       if((i+1)>=m && (j+2)<n)data[20]=x[2*m-(i+1)-2][j+2];
-       if((i+1)<m && (j+2)>=n)data[20]=x[i+1][2*n-(j+2)-2];
-       if((i+1)<m && (j+2)<n)data[20]=x[i+1][j+2];
-
-       if((i+2)>=m && (j+1)>=n)data[24]=x[2*m-(i+2)-2][2*n-(j+1)-2];
-       if((i+2)>=m && (j+1)<n)data[24]=x[2*m-(i+2)-2][j+1];
-       if((i+2)<m && (j+1)>=n)data[24]=x[i+2][2*n-(j+1)-2];
-       if((i+2)<m && (j+1)<n)data[24]=x[i+2][j+1];
-
-       if((i+2)>=m && (j+2)>=n)data[25]=x[2*m-(i+2)-2][2*n-(j+2)-2];
-       if((i+2)>=m && (j+2)<n)data[25]=x[2*m-(i+2)-2][j+2];
-       if((i+2)<m && (j+2)>=n)data[25]=x[i+2][2*n-(j+2)-2];
-       if((i+2)<m && (j+2)<n)data[25]=x[i+2][j+2];
-
-       if((i+2)>=m) {
-           data[21]=x[2*m-(i+2)-2][abs(j-2)];
-           data[22]=x[2*m-(i+2)-2][abs(j-1)];
-           data[23]=x[2*m-(i+2)-2][j];
-       }
-       else {
-           data[21]=x[i+2][abs(j-2)];
-           data[22]=x[i+2][abs(j-1)];
-           data[23]=x[i+2][j];
-       }
+    if (!setWorkspaceSize(workspace, numRows, numColumns)) {
+        computationTime = INVERSE_HALFTONING_NO_MEMORY;
+        return(computationTime);
+    }
+
+    convertInputImage(workspace, inputByteImage, numRows, numColumns);
+
+    if (timingFlag) time(&startTime);
+
+    if (!selectFilters(halftoningType, &filters)) {
+        computationTime = INVERSE_HALFTONING_BAD_METHOD;
+        return(computationTime);
+    }
+
+    /* y0 is no longer needed after the median, so it keeps y2 - z */
+    frontStages(workspace, numRows, numColumns, &filters, TRUE,
+                workspace->y0, 0, 0);
+
+    for (t = 0; t < numThresholds; t++) {
+        int g;
+        thresholdImage(numRows, numColumns, workspace->y0, thresholds[t],
+                       workspace->mask);
+        applyEdgeMap(binaryMedianKernels[workspace->kernels[STAGE_EDGE_MAP]],
+                     numRows, numColumns, workspace->y0, workspace->mask,
+                     workspace->edgeMap, workspace->hie);
+        for (g = 0; g < numGains; g++) {
+            outputKernels[workspace->kernels[STAGE_OUTPUT]](
+                numRows, numColumns, gains[g], workspace->hie,
+                workspace->y1, outputByteImages[t*numGains + g]);
+        }
+    }
+
+    if (timingFlag) {
+        time(&finishTime);
+        computationTime = difftime(finishTime, startTime);
+    }
 
-       x1[i][j] = selectElement(13, 25, data);
-    }    
+    return(computationTime);
 }
-return x1;
+
+/*
+Run the stages after the first Gaussian filter on the smoothed
+halftone y0 of numRows by numColumns pixels, which need not be the
+plane y0 of the workspace, and store the result in outputByteImage.
+*/
+static void laterStages(InverseHalftoneWorkspace* workspace,
+                        int numRows, int numColumns,
+                        HalftoneFilters* filters, ImagePlane* y0,
+                        int gain, int threshold,
+                        unsigned char* outputByteImage)
+{
+    double startTime;
+
+    startStage(workspace, &startTime);
+    greyMedianKernels[workspace->kernels[STAGE_MEDIAN]](
+        numRows, numColumns, filters->medianSize, y0, workspace->y1);
+    endStage(workspace, STAGE_MEDIAN, &startTime);
+
+    cascadeKernels[workspace->kernels[STAGE_CASCADE]](
+        workspace, numRows, numColumns, filters, workspace->hie,
+        workspace->mask, threshold);
+    endStage(workspace, STAGE_CASCADE, &startTime);
+
+    applyEdgeMap(binaryMedianKernels[workspace->kernels[STAGE_EDGE_MAP]],
+                 numRows, numColumns, workspace->hie, workspace->mask,
+                 workspace->edgeMap, workspace->hie);
+    endStage(workspace, STAGE_EDGE_MAP, &startTime);
+
+    outputKernels[workspace->kernels[STAGE_OUTPUT]](
+        numRows, numColumns, gain, workspace->hie, workspace->y1,
+        outputByteImage);
+    endStage(workspace, STAGE_OUTPUT, &startTime);
 }
 
-/* First Gaussian filter for Dispersed dot dither: 9 x 9  */
-static float** GaussianFilterDispDith1(int m, int n, float **s, float **dest)
+/* Start a comparison of the results of a stage */
+static void clearMismatch(KernelMismatch* mismatch)
 {
-  static int hd[9] =
-    {103,419,1138,2074,2533,2074,1138,419,103};
-  separable9x9FIRBinaryImage(m, n, s, dest, hd, NORMALIZATION_CONSTANT);
-  return(dest);
+    mismatch->maxDifference = 0.0;
+    mismatch->numPixels = 0.0;
+    mismatch->firstRow = -1;
+    mismatch->firstColumn = -1;
 }
 
-/* First Gaussian filter for Clustered dot dither: 9 x 9  */
-static float** GaussianFilterClustDith1(int m, int n, float **s, float **dest)
+/* Account for a difference between the results at pixel (i, j) */
+static void noteDifference(KernelMismatch* mismatch, int i, int j,
+                           double difference)
 {
-  static int hc[9] =
-    {583, 903, 1234, 1488, 1584, 1488, 1234, 903, 583};
-  separable9x9FIRBinaryImage(m, n, s, dest, hc, NORMALIZATION_CONSTANT);
-  return(dest);
+    if (difference < 0.0) difference = -difference;
+    if (difference == 0.0) {
+        return;
+    }
+    if ((mismatch->numPixels == 0.0) || (i < mismatch->firstRow) ||
+        ((i == mismatch->firstRow) && (j < mismatch->firstColumn))) {
+        mismatch->firstRow = i;
+        mismatch->firstColumn = j;
+    }
+    if (difference > mismatch->maxDifference) {
+        mismatch->maxDifference = difference;
+    }
+    mismatch->numPixels++;
 }
 
-/* Second Gaussian filter: 9 x 9 */
-static float** GaussianFilterDith2(int m, int n, float **s, float **dest)
+/* Compare the m x n pixels of two planes of the same element type */
+static void comparePlanes(int m, int n, ImagePlane* result,
+                          ImagePlane* reference, KernelMismatch* mismatch)
 {
-  static int hD2[9] = 
-     {1,44,540,2420,3989,2420,540,44,1};
-  separable9x9FIRGreyImage(m, n, s, dest, hD2, NORMALIZATION_CONSTANT);
-  return(dest);
+    int i, j;
+
+    for (i = 0; i < m; i++) {
+        if (result->elementType == IMAGE_PLANE_FLOAT) {
+            float *resultRow = FLOAT_PLANE_ROW(result, i);
+            float *referenceRow = FLOAT_PLANE_ROW(reference, i);
+            for (j = 0; j < n; j++) {
+                noteDifference(mismatch, i, j,
+                               (double) resultRow[j] - referenceRow[j]);
+            }
+        }
+        else {
+            unsigned char *resultRow = BYTE_PLANE_ROW(result, i);
+            unsigned char *referenceRow = BYTE_PLANE_ROW(reference, i);
+            for (j = 0; j < n; j++) {
+                noteDifference(mismatch, i, j,
+                               (double) resultRow[j] - referenceRow[j]);
+            }
+        }
+    }
 }
 
-/* Third Gaussian filter: 9 x 9 */
-static float** GaussianFilterDith3(int m, int n, float **s, float **dest)
+/*
+Check the implementations of the stages selected in workspace against
+the reference implementations, on the full algorithm for inputImage.
+A second workspace runs the reference implementations, and every stage
+of workspace is given the result of the reference for the stage
+before it, so that a difference is charged to the stage that causes
+it rather than to all the stages after it.  The difference of every
+stage is stored in mismatches[stage].  The quality level, recursive
+filters and block-sparse mode of the workspace are not used.  Returns
+0, or a negative error code as for inverseHalftone.
+*/
+double verifyInverseHalftoneKernels(InverseHalftoneWorkspace* workspace,
+                                    unsigned char* inputByteImage,
+                                    int numRows, int numColumns,
+                                    int gain, int threshold,
+                                    int halftoningType,
+                                    KernelMismatch* mismatches)
 {
-  static int hD3[9]= 
-     {0,1,103,2075,5641,2075,103,1,0};
-  separable9x9FIRGreyImage(m, n, s, dest, hD3, NORMALIZATION_CONSTANT);
-  return(dest);
+    InverseHalftoneWorkspace *reference;
+    HalftoneFilters filters;
+    unsigned char *output, *referenceOutput;
+    int *kernels = workspace->kernels;
+    int m = numRows, n = numColumns;
+    int stage, border, i, j;
+
+    if (!selectFilters(halftoningType, &filters)) {
+        return(INVERSE_HALFTONING_BAD_METHOD);
+    }
+    reference = allocateInverseHalftoneWorkspace(workspace->maxRows,
+                                                 workspace->maxColumns);
+    output = (unsigned char *) trackedMalloc(2 * (size_t) m * n);
+    if ((reference == 0) || (output == 0) ||
+        !setWorkspaceSize(workspace, m, n) ||
+        !setWorkspaceSize(reference, m, n)) {
+        freeInverseHalftoneWorkspace(reference);
+        trackedFree(output);
+        return(INVERSE_HALFTONING_NO_MEMORY);
+    }
+    for (stage = 0; stage < NUM_INVERSE_HALFTONE_STAGES; stage++) {
+        clearMismatch(&mismatches[stage]);
+        if (!setInverseHalftoneKernel(reference, stage,
+                                      INVERSE_HALFTONE_REFERENCE_KERNEL)) {
+            freeInverseHalftoneWorkspace(reference);
+            trackedFree(output);
+            return(INVERSE_HALFTONING_NO_MEMORY);
+        }
+    }
+    referenceOutput = output + (size_t) m * n;
+    convertInputImage(reference, inputByteImage, m, n);
+
+    /* Smoothing: y0 = G1(halftone) */
+    smoothingKernels[INVERSE_HALFTONE_REFERENCE_KERNEL](
+        m, n, &filters, reference->inputImage, reference->y0,
+        reference->scratch);
+    smoothingKernels[kernels[STAGE_SMOOTHING]](
+        m, n, &filters, reference->inputImage, workspace->y0,
+        workspace->scratch);
+    comparePlanes(m, n, workspace->y0, reference->y0,
+                  &mismatches[STAGE_SMOOTHING]);
+
+    /* Median: y1 = median(y0) */
+    greyMedianKernels[INVERSE_HALFTONE_REFERENCE_KERNEL](
+        m, n, filters.medianSize, reference->y0, reference->y1);
+    greyMedianKernels[kernels[STAGE_MEDIAN]](
+        m, n, filters.medianSize, reference->y0, workspace->y1);
+    comparePlanes(m, n, workspace->y1, reference->y1,
+                  &mismatches[STAGE_MEDIAN]);
+
+    /* Cascade: hie = y2 - z and the edge mask, from y1 with its border; */
+    /* the planes may start at different offsets in their blocks */
+    border = reference->y1->border;
+    for (i = -border; i < m + border; i++) {
+        memcpy(FLOAT_PLANE_ROW(workspace->y1, i) - border,
+               FLOAT_PLANE_ROW(reference->y1, i) - border,
+               (n + 2*border) * sizeof(float));
+    }
+    cascadeKernels[INVERSE_HALFTONE_REFERENCE_KERNEL](
+        reference, m, n, &filters, reference->hie, reference->mask,
+        threshold);
+    cascadeKernels[kernels[STAGE_CASCADE]](
+        workspace, m, n, &filters, workspace->hie, workspace->mask,
+        threshold);
+    comparePlanes(m, n, workspace->hie, reference->hie,
+                  &mismatches[STAGE_CASCADE]);
+    comparePlanes(m, n, workspace->mask, reference->mask,
+                  &mismatches[STAGE_CASCADE]);
+
+    /* Edge map: hie masked by the median of the edge mask, in place */
+    applyEdgeMap(binaryMedianKernels[kernels[STAGE_EDGE_MAP]], m, n,
+                 reference->hie, reference->mask, workspace->edgeMap,
+                 workspace->hie);
+    applyEdgeMap(binaryMedianKernels[INVERSE_HALFTONE_REFERENCE_KERNEL],
+                 m, n, reference->hie, reference->mask, reference->edgeMap,
+                 reference->hie);
+    comparePlanes(m, n, workspace->hie, reference->hie,
+                  &mismatches[STAGE_EDGE_MAP]);
+
+    /* Output: y1 + gain * hie, rounded */
+    outputKernels[INVERSE_HALFTONE_REFERENCE_KERNEL](
+        m, n, gain, reference->hie, reference->y1, referenceOutput);
+    outputKernels[kernels[STAGE_OUTPUT]](
+        m, n, gain, reference->hie, reference->y1, output);
+    for (i = 0; i < m; i++) {
+        for (j = 0; j < n; j++) {
+            noteDifference(&mismatches[STAGE_OUTPUT], i, j,
+                           (double) output[i*n + j] -
+                           referenceOutput[i*n + j]);
+        }
+    }
+
+    freeInverseHalftoneWorkspace(reference);
+    trackedFree(output);
+    return(0.0);
 }
 
+/*
+Print the implementation of every stage of workspace and its
+difference from the reference, as found by verifyInverseHalftoneKernels
+*/
+void printKernelMismatches(FILE* file, InverseHalftoneWorkspace* workspace,
+                           KernelMismatch* mismatches)
+{
+    int stage;
+
+    fprintf(file, "%-10s %-10s %12s %10s  %s\n", "stage", "kernel",
+            "max diff", "pixels", "first mismatch");
+    for (stage = 0; stage < NUM_INVERSE_HALFTONE_STAGES; stage++) {
+        KernelMismatch *mismatch = &mismatches[stage];
+        fprintf(file, "%-10s %-10s %12g %10.0f  ",
+                inverseHalftoneStageName(stage),
+                inverseHalftoneKernelName(stage, workspace->kernels[stage]),
+                mismatch->maxDifference, mismatch->numPixels);
+        if (mismatch->numPixels > 0.0) {
+            fprintf(file, "row %d, column %d\n", mismatch->firstRow,
+                    mismatch->firstColumn);
+        }
+        else {
+            fprintf(file, "none\n");
+        }
+    }
+}
 
 /*
-Compute the inverse halftone of inputImage and store the result in
-outputImage.  The inputImage and outputImage is of size numRows by
-numColumns.  The return value is the amount of computation time
-if timingFlag is TRUE, and 0.0 otherwise.  A negative return value 
-indicates an error.
+Number of rows (columns) at level of the resolution pyramid of an
+image of size rows (columns): every level halves the one above,
+rounding up.
 */
-double inverseHalftone(unsigned char* inputByteImage,
-                       unsigned char* outputByteImage,
-                       int numRows, int numColumns,
-                       int gain, int threshold,
-                       int timingFlag, int halftoningType)
+int pyramidLevelSize(int size, int level)
+{
+    for (; level > 0; level--) {
+        size = (size + 1)/2;
+    }
+    return(size);
+}
+
+/*
+Inverse halftone inputImage at levels firstLevel through lastLevel of
+a resolution pyramid, level k being reduced by 2^k in both directions,
+and store level k in outputImages[k - firstLevel], of
+pyramidLevelSize(numRows, k) by pyramidLevelSize(numColumns, k) pixels.
+Level 0 is the result of inverseHalftone.  At level 1, the first
+Gaussian filter is only evaluated at the even rows and columns of the
+halftone, which it already low-passes.  Every further level is the
+smoothed halftone of the level above, filtered by the second Gaussian
+filter at its even rows and columns.  The later stages then run on the
+reduced image, so level k costs about 4^-k of level 0, and all levels
+come from a single pass over the input.  The quality level, the
+recursive filters and the block-sparse mode of the workspace are not
+used.  The return value is as for inverseHalftone.
+*/
+double inverseHalftonePyramid(InverseHalftoneWorkspace* workspace,
+                              unsigned char* inputByteImage,
+                              unsigned char** outputByteImages,
+                              int numRows, int numColumns,
+                              int firstLevel, int lastLevel,
+                              int gain, int threshold,
+                              int timingFlag, int halftoningType)
 {
-    int maxRows = numRows;
-    int maxColumns = numColumns;
-    int i;
-    int errorFlag = FALSE;
     double computationTime = 0.0;
-    unsigned char* tempBytePtr = 0;
     time_t startTime, finishTime;
+    HalftoneFilters filters;
+    ImagePlane *levelImages[2];
+    int level;
 
-    /* Allocation intermediate images */
-    float** inputImage = allocateFloatMatrix(maxRows, maxColumns);
-    float** z = allocateFloatMatrix(maxRows, maxColumns);
-    float** y0 = allocateFloatMatrix(maxRows, maxColumns);
-    float** y1 = allocateFloatMatrix(maxRows, maxColumns);
-    float** y2 = allocateFloatMatrix(maxRows, maxColumns);
-    float** hie = allocateFloatMatrix(maxRows, maxColumns);
-
-    /* Check memory allocation, and return an error upon failure */
-    if ((inputImage == 0) || (z == 0) ||
-        (y0 == 0) || (y1 == 0) || (y2 == 0) || (hie == 0)) {
-        computationTime = -1.0;        /* Fixes a Visual C++ warning */
+    if (!setWorkspaceSize(workspace, numRows, numColumns)) {
+        computationTime = INVERSE_HALFTONING_NO_MEMORY;
         return(computationTime);
     }
 
-    /* Convert the byte input image to a float-point image */
-    tempBytePtr = inputByteImage;
-    for (i = 0; i < numRows; i++) {
-        int j = 0;
-        float *floatRowImagePtr = inputImage[i];
-        for (j = 0; j < numColumns; j++) {
-            *floatRowImagePtr++ = (float) *tempBytePtr++;
+    /* Even levels below the first are kept in a plane of their own */
+    if ((lastLevel >= 2) && (workspace->pyramid == 0)) {
+        workspace->pyramid =
+            allocateImagePlane(IMAGE_PLANE_FLOAT,
+                               pyramidLevelSize(workspace->maxRows, 2),
+                               pyramidLevelSize(workspace->maxColumns, 2), 4);
+        if (workspace->pyramid == 0) {
+            computationTime = INVERSE_HALFTONING_NO_MEMORY;
+            return(computationTime);
         }
     }
+    levelImages[0] = workspace->pyramid;
+    levelImages[1] = workspace->y0;
 
-    /* Perform inverse halftoning on inputImage and report the time */
-    /* The last two steps are the same for all three algorithms. */
-    if (timingFlag) time(&startTime);
+    convertInputImage(workspace, inputByteImage, numRows, numColumns);
 
-    switch(halftoningType) {
-      case HALFTONING_BY_ERROR_DIFFUSION:
-        GaussianFilter1(numRows, numColumns, inputImage, y0);      /* set y0 */
-        median3x3GreyImage(numRows, numColumns, y0, y1);           /* set y1 */
-        GaussianFilter2(numRows, numColumns, y1, y2);              /* set y2 */
-        GaussianFilter3(numRows, numColumns, y2, z);               /* set z  */
-        thresholdDiffImage(numRows, numColumns, y2, z, threshold, hie); 
-        lastStage(numRows, numColumns, gain, hie, y1, outputByteImage);
-        break;
+    if (timingFlag) time(&startTime);
 
-      case HALFTONING_BY_DISPERED_DITHER:
-        GaussianFilterDispDith1(numRows, numColumns, inputImage, y0);
-        median5x5GreyImage(numRows, numColumns, y0, y1);           /* set y1 */
-        GaussianFilterDith2(numRows, numColumns, y1, y2);          /* set y2 */
-        GaussianFilterDith3(numRows, numColumns, y2, z);           /* set z  */
-        thresholdDiffImage(numRows, numColumns, y2, z, threshold, hie); 
-        lastStage(numRows, numColumns, gain, hie, y1, outputByteImage);
-        break;
+    if (!selectFilters(halftoningType, &filters)) {
+        computationTime = INVERSE_HALFTONING_BAD_METHOD;
+        return(computationTime);
+    }
 
-      case HALFTONING_BY_CLUSTERED_DITHER:
-        GaussianFilterClustDith1(numRows, numColumns, inputImage, y0);
-        median5x5GreyImage(numRows, numColumns, y0, y1);           /* set y1 */
-        GaussianFilterDith2(numRows, numColumns, y1, y2);          /* set y2 */
-        GaussianFilterDith3(numRows, numColumns, y2, z);           /* set z  */
-        thresholdDiffImage(numRows, numColumns, y2, z, threshold, hie); 
-        lastStage(numRows, numColumns, gain, hie, y1, outputByteImage);
-        break;
+    if (firstLevel == 0) {
+        double stageStartTime;
 
-      default:
-        errorFlag = TRUE;
+        startStage(workspace, &stageStartTime);
+        smoothingKernels[workspace->kernels[STAGE_SMOOTHING]](
+            numRows, numColumns, &filters, workspace->inputImage,
+            workspace->y0, workspace->scratch);
+        endStage(workspace, STAGE_SMOOTHING, &stageStartTime);
+        laterStages(workspace, numRows, numColumns, &filters,
+                    workspace->y0, gain, threshold, outputByteImages[0]);
     }
 
-    if (errorFlag) {
-        computationTime = -2.0;
+    for (level = 1; level <= lastLevel; level++) {
+        int levelRows = pyramidLevelSize(numRows, level);
+        int levelColumns = pyramidLevelSize(numColumns, level);
+        ImagePlane *levelImage = levelImages[level % 2];
+        double stageStartTime;
+
+        startStage(workspace, &stageStartTime);
+        if (level == 1) {
+            halveBinaryImage(numRows, numColumns, workspace->inputImage,
+                             levelImage, workspace->scratch,
+                             filters.g1HalvingRows, filters.g1Columns);
+        }
+        else {
+            halveGreyImage(pyramidLevelSize(numRows, level - 1),
+                           pyramidLevelSize(numColumns, level - 1),
+                           levelImages[(level - 1) % 2], levelImage,
+                           workspace->scratch);
+        }
+        endStage(workspace, STAGE_SMOOTHING, &stageStartTime);
+
+        if (level >= firstLevel) {
+            setWorkspaceSize(workspace, levelRows, levelColumns);
+            laterStages(workspace, levelRows, levelColumns, &filters,
+                        levelImage, gain, threshold,
+                        outputByteImages[level - firstLevel]);
+        }
     }
-    else if (timingFlag) {
+
+    if (timingFlag) {
         time(&finishTime);
         computationTime = difftime(finishTime, startTime);
     }
 
-    /* Deallocate intermediate images */ 
-    freeFloatMatrix(inputImage);
-    freeFloatMatrix(z);
-    freeFloatMatrix(y0);
-    freeFloatMatrix(y1);
-    freeFloatMatrix(y2);
-    freeFloatMatrix(hie);
+    return(computationTime);
+}
+
+/*
+Allocate the intermediate images needed to inverse halftone numLanes
+images of up to maxRows by maxColumns pixels at a time with
+inverseHalftoneBatch.  Every plane interleaves the numLanes images, one
+per lane (see allocateLaneImagePlane), so that every filter works on a
+row of all of them at once.  Returns a null pointer if numLanes is not
+1 to MAX_BATCH_LANES or if memory could not be allocated.
+*/
+InverseHalftoneBatchWorkspace* allocateInverseHalftoneBatchWorkspace(
+    int numLanes, int maxRows, int maxColumns)
+{
+    InverseHalftoneBatchWorkspace* batch;
+
+    if ((numLanes < 1) || (numLanes > MAX_BATCH_LANES)) {
+        return(0);
+    }
+    batch = (InverseHalftoneBatchWorkspace*)
+        trackedCalloc(1, sizeof(InverseHalftoneBatchWorkspace));
+    if (batch == 0) {
+        return(0);
+    }
+    batch->numLanes = numLanes;
+    batch->maxRows = maxRows;
+    batch->maxColumns = maxColumns;
+    batch->inputImage = allocateLaneImagePlane(IMAGE_PLANE_FLOAT, numLanes,
+                                               maxRows, maxColumns, 4);
+    batch->y0 = allocateLaneImagePlane(IMAGE_PLANE_FLOAT, numLanes,
+                                       maxRows, maxColumns, 4);
+    batch->y1 = allocateLaneImagePlane(IMAGE_PLANE_FLOAT, numLanes,
+                                       maxRows, maxColumns, 4);
+    batch->scratch = allocateLaneImagePlane(IMAGE_PLANE_FLOAT, numLanes,
+                                            maxRows, maxColumns, 4);
+    batch->hie = allocateLaneImagePlane(IMAGE_PLANE_FLOAT, numLanes,
+                                        maxRows, maxColumns, 0);
+    batch->mask = allocateLaneImagePlane(IMAGE_PLANE_UINT8, numLanes,
+                                         maxRows, maxColumns, 4);
+    batch->edgeMap = allocateLaneImagePlane(IMAGE_PLANE_UINT8, numLanes,
+                                            maxRows, maxColumns, 0);
+    batch->columnCounts = (int*)
+        trackedMalloc((size_t) (maxColumns + 4) * numLanes * sizeof(int));
+    batch->outputRow = (unsigned char*)
+        trackedMalloc((size_t) maxColumns * numLanes);
+
+    /* Check memory allocation, and return an error upon failure */
+    if ((batch->inputImage == 0) || (batch->y0 == 0) || (batch->y1 == 0) ||
+        (batch->scratch == 0) || (batch->hie == 0) || (batch->mask == 0) ||
+        (batch->edgeMap == 0) || (batch->columnCounts == 0) ||
+        (batch->outputRow == 0)) {
+        freeInverseHalftoneBatchWorkspace(batch);
+        return(0);
+    }
+
+    return(batch);
+}
+
+/* Deallocate the intermediate images and the batch workspace itself */
+void freeInverseHalftoneBatchWorkspace(InverseHalftoneBatchWorkspace* batch)
+{
+    if (batch == 0) {
+        return;
+    }
+    freeImagePlane(batch->inputImage);
+    freeImagePlane(batch->y0);
+    freeImagePlane(batch->y1);
+    freeImagePlane(batch->scratch);
+    freeImagePlane(batch->hie);
+    freeImagePlane(batch->mask);
+    freeImagePlane(batch->edgeMap);
+    trackedFree(batch->columnCounts);
+    trackedFree(batch->outputRow);
+    trackedFree(batch);
+}
+
+/*
+Filter n values of an interleaved row with the taps h of the given
+radius, as the reference row filters do, the neighbours of a value
+being lanes values apart.  The loop over the taps is outside the loop
+over the values, so that the inner loop runs over whole rows of all
+the lanes, and every sum is still formed in the order of the reference
+filters.
+*/
+static void laneRowFilter(float *dest, float *source, int n, int lanes,
+                          int *h, int radius)
+{
+    int j, k;
+
+    for (j = 0; j < n; j++) {
+        dest[j] = h[radius]*source[j];
+    }
+    for (k = 0; k < radius; k++) {
+        int offset = (radius - k)*lanes;
+        float tap = (float) h[k];
+        for (j = 0; j < n; j++) {
+            dest[j] += tap*(source[j - offset] + source[j + offset]);
+        }
+    }
+}
+
+/*
+Filter the interleaved images of source with the separable filter of
+the given radius, at most 4, given by its taps and column filter,
+into dest, as separableFIRGreyImage does.  The column filters of the
+single image path already work on any number of values, so they are
+given whole interleaved rows.  If binaryFlag is TRUE, the source holds
+0 and 1, and the row pass is scaled by 255 as the binary row filters
+do; the partial sums are integers below 2^24, so the float row pass
+gives the same results as their integer arithmetic.
+*/
+static void laneFIRImage(int m, int n, int lanes, ImagePlane *source,
+                         ImagePlane *dest, ImagePlane *ws, int *h,
+                         int radius, ColumnFilter columnFilter,
+                         int binaryFlag)
+{
+    int i, j, k;
+
+    for (i = 0; i < m; i++) {
+        float *wsRow = FLOAT_PLANE_ROW(ws, i);
+        laneRowFilter(wsRow, FLOAT_PLANE_ROW(source, i), n*lanes, lanes,
+                      h, radius);
+        if (binaryFlag) {
+            for (j = 0; j < n*lanes; j++) {
+                wsRow[j] *= 255.0;
+            }
+        }
+    }
+    mirrorImagePlaneBorder(ws);
+
+    for (i = 0; i < m; i++) {
+        float *rows[9];
+        for (k = 0; k < 2*radius + 1; k++) {
+            rows[k] = FLOAT_PLANE_ROW(ws, i - radius + k);
+        }
+        columnFilter(FLOAT_PLANE_ROW(dest, i), rows, n*lanes);
+    }
+    mirrorImagePlaneBorder(dest);
+}
+
+/*
+Same as slidingMedian5x5BinaryImage on every lane of the interleaved
+plane x: the five rows of the window are added once per value into
+columnCounts, and the count of the window of a value is the sum of
+the counts of its lane in five consecutive columns.  The plane x
+must have a zeroed border of 4 pixels.
+*/
+static void laneMedian5x5BinaryImage(int m, int n, int lanes,
+                                     ImagePlane *x, ImagePlane *t,
+                                     int *columnCounts)
+{
+    int *counts = columnCounts + 4*lanes;
+    int i;
+
+    for (i = 0; i < m; i++) {
+        unsigned char *r0 = BYTE_PLANE_ROW(x, i-4);
+        unsigned char *r1 = BYTE_PLANE_ROW(x, i-3);
+        unsigned char *r2 = BYTE_PLANE_ROW(x, i-2);
+        unsigned char *r3 = BYTE_PLANE_ROW(x, i-1);
+        unsigned char *r4 = BYTE_PLANE_ROW(x, i);
+        unsigned char *tRow = BYTE_PLANE_ROW(t, i);
+        int c;
+        for (c = -4*lanes; c < n*lanes; c++) {
+            counts[c] = r0[c] + r1[c] + r2[c] + r3[c] + r4[c];
+        }
+        for (c = 0; c < n*lanes; c++) {
+            int d = counts[c] + counts[c - lanes] + counts[c - 2*lanes] +
+                    counts[c - 3*lanes] + counts[c - 4*lanes];
+            tRow[c] = (d >= 13);
+        }
+    }
+}
+
+/*
+Inverse halftone up to numLanes images of numRows by numColumns pixels
+at once, one per lane of the planes of batch.  Lanes beyond numImages
+repeat the last image, and their results are discarded.
+*/
+static void inverseHalftoneLanes(InverseHalftoneBatchWorkspace* batch,
+                                 unsigned char** inputByteImages,
+                                 unsigned char** outputByteImages,
+                                 int numImages, int m, int n,
+                                 int gain, int threshold,
+                                 HalftoneFilters* filters)
+{
+    int lanes = batch->numLanes;
+    int i, j, l;
+
+    /* Interleave the binary input images */
+    for (l = 0; l < lanes; l++) {
+        unsigned char* inputPtr =
+            inputByteImages[(l < numImages) ? l : numImages - 1];
+        for (i = 0; i < m; i++) {
+            float *inputRow = FLOAT_PLANE_ROW(batch->inputImage, i) + l;
+            for (j = 0; j < n; j++) {
+                inputRow[j*lanes] = (float) (*inputPtr++ != 0);
+            }
+        }
+    }
+    mirrorImagePlaneBorder(batch->inputImage);
+
+    /* Smoothing and grey median */
+    laneFIRImage(m, n, lanes, batch->inputImage, batch->y0, batch->scratch,
+                 filters->g1Taps, 4, filters->g1Columns, TRUE);
+    networkMedianGreyImage(m, n, filters->medianSize, batch->y0, batch->y1);
+
+    /* y0 is no longer needed after the median, so it keeps y2 */
+    laneFIRImage(m, n, lanes, batch->y1, batch->y0, batch->scratch,
+                 filters->g2Taps, filters->g2Radius, filters->g2Columns,
+                 FALSE);
+    laneFIRImage(m, n, lanes, batch->y0, batch->hie, batch->scratch,
+                 thirdFilterTaps, THIRD_FILTER_RADIUS,
+                 GaussianFilter3Columns, FALSE);
+    differenceAndMask(m, n*lanes, batch->y0, batch->hie, batch->mask,
+                      threshold);
+
+    /* Edge map */
+    clearImagePlaneBorder(batch->mask);
+    laneMedian5x5BinaryImage(m, n, lanes, batch->mask, batch->edgeMap,
+                             batch->columnCounts);
+    for (i = 0; i < m; i++) {
+        float *hieRow = FLOAT_PLANE_ROW(batch->hie, i);
+        unsigned char *edgeMapRow = BYTE_PLANE_ROW(batch->edgeMap, i);
+        unsigned char *maskRow = BYTE_PLANE_ROW(batch->mask, i);
+        for (j = 0; j < n*lanes; j++) {
+            hieRow[j] = hieRow[j] * (float) (maskRow[j] & edgeMapRow[j]);
+        }
+    }
+
+    /* Output, separated into the images again */
+    for (i = 0; i < m; i++) {
+        lastStageSegment(batch->outputRow, FLOAT_PLANE_ROW(batch->hie, i),
+                         FLOAT_PLANE_ROW(batch->y1, i), n*lanes,
+                         (float) gain);
+        for (l = 0; l < numImages; l++) {
+            unsigned char *outputPtr = outputByteImages[l] + i*n;
+            for (j = 0; j < n; j++) {
+                outputPtr[j] = batch->outputRow[j*lanes + l];
+            }
+        }
+    }
+}
+
+/*
+Inverse halftone the numImages images in inputImages, all of numRows
+by numColumns pixels, storing the results in outputImages, as
+inverseHalftone does for each of them.  The images are taken
+batch->numLanes at a time and processed interleaved, one image per
+lane, through every stage, so that the filters run over rows as long
+as those of all the images together.  For small images, whose rows are
+too short to keep the vector units and the prefetchers busy, this is
+faster than inverse halftoning the images one at a time.  The result
+is the same as that of the reference kernels.  The return value is as
+for inverseHalftone, for all the images.
+*/
+double inverseHalftoneBatch(InverseHalftoneBatchWorkspace* batch,
+                            unsigned char** inputByteImages,
+                            unsigned char** outputByteImages,
+                            int numImages, int numRows, int numColumns,
+                            int gain, int threshold,
+                            int timingFlag, int halftoningType)
+{
+    double computationTime = 0.0;
+    time_t startTime, finishTime;
+    HalftoneFilters filters;
+    int first;
+
+    if ((batch == 0) ||
+        (numRows > batch->maxRows) || (numColumns > batch->maxColumns)) {
+        computationTime = INVERSE_HALFTONING_NO_MEMORY;
+        return(computationTime);
+    }
+    if (!selectFilters(halftoningType, &filters)) {
+        computationTime = INVERSE_HALFTONING_BAD_METHOD;
+        return(computationTime);
+    }
+
+    if (timingFlag) time(&startTime);
+
+    setImagePlaneSize(batch->inputImage, numRows, numColumns);
+    setImagePlaneSize(batch->y0, numRows, numColumns);
+    setImagePlaneSize(batch->y1, numRows, numColumns);
+    setImagePlaneSize(batch->scratch, numRows, numColumns);
+    setImagePlaneSize(batch->hie, numRows, numColumns);
+    setImagePlaneSize(batch->mask, numRows, numColumns);
+    setImagePlaneSize(batch->edgeMap, numRows, numColumns);
+
+    for (first = 0; first < numImages; first += batch->numLanes) {
+        int count = numImages - first;
+        if (count > batch->numLanes) count = batch->numLanes;
+        inverseHalftoneLanes(batch, inputByteImages + first,
+                             outputByteImages + first, count,
+                             numRows, numColumns, gain, threshold, &filters);
+    }
+
+    if (timingFlag) {
+        time(&finishTime);
+        computationTime = difftime(finishTime, startTime);
+    }
 
     return(computationTime);
 }
@@ -38,17 +38,206 @@ explained in the following paper:
 #ifndef _INVERSE_HALFTONE_H
 #define _INVERSE_HALFTONE_H
 
+#include <stdio.h>
+#include "matrix_utils.h"
+#include "perf_counters.h"
+
 #define HALFTONING_BY_ERROR_DIFFUSION 1
 #define HALFTONING_BY_DISPERED_DITHER 2
 #define HALFTONING_BY_CLUSTERED_DITHER 3
 
 #define INVERSE_HALFTONING_NO_MEMORY  -1.0
 #define INVERSE_HALFTONING_BAD_METHOD -2.0
+#define INVERSE_HALFTONING_IO_ERROR   -3.0
+
+/* Quality levels, from the fastest to the whole algorithm */
+#define INVERSE_HALFTONE_QUALITY_SMOOTHING 1    /* first filter only */
+#define INVERSE_HALFTONE_QUALITY_NO_MEDIAN 2    /* skip the grey median */
+#define INVERSE_HALFTONE_QUALITY_FULL      3
+
+/* Gaussian filters that can be replaced by recursive filters */
+#define RECURSIVE_FIRST_FILTER  1
+#define RECURSIVE_SECOND_FILTER 2
+#define RECURSIVE_THIRD_FILTER  4
+
+/* Resolution for which the Gaussian filters were designed */
+#define REFERENCE_RESOLUTION_DPI 300
+
+/* Stages of the algorithm, as timed in InverseHalftoneStats */
+#define STAGE_SMOOTHING 0       /* first Gaussian filter */
+#define STAGE_MEDIAN    1       /* grey median */
+#define STAGE_CASCADE   2       /* second and third Gaussian filters */
+#define STAGE_EDGE_MAP  3       /* binary median of the edge mask */
+#define STAGE_OUTPUT    4       /* gain and rounding */
+#define NUM_INVERSE_HALFTONE_STAGES 5
+
+/*
+Every stage has one or more implementations, selected by their index.
+The reference implementation of a stage is straightforward scalar
+code, against which verifyInverseHalftoneKernels checks the others.
+*/
+#define INVERSE_HALFTONE_REFERENCE_KERNEL 0
+#define MAX_INVERSE_HALFTONE_KERNELS 4
+
+/*
+Difference between the result of the implementation of a stage and
+that of the reference implementation on the same input: the largest
+absolute difference, the number of pixels that differ, and the first
+of them in raster order, or -1 if none does
+*/
+typedef struct KernelMismatch {
+    double maxDifference;
+    double numPixels;
+    int firstRow;
+    int firstColumn;
+} KernelMismatch;
+
+/*
+Time spent in every stage, in seconds, the number of tiles that the
+block-sparse mode examined and found edge-free, the hardware events
+counted in every stage if performance counters are on, and the most
+memory live during every stage (see memory_usage.h), accumulated over
+all images inverse halftoned with a workspace.
+*/
+typedef struct InverseHalftoneStats {
+    double stageTime[NUM_INVERSE_HALFTONE_STAGES];
+    int numTiles;
+    int numFlatTiles;
+    double numPixels;
+    int counterMask;            /* PerfCounters availableMask, 0 if off */
+    double stageCounts[NUM_INVERSE_HALFTONE_STAGES][NUM_PERF_COUNTERS];
+    size_t stagePeakBytes[NUM_INVERSE_HALFTONE_STAGES];
+} InverseHalftoneStats;
+
+/* Queues between the threads of the stages, see setInverseHalftonePipeline */
+typedef struct InverseHalftonePipeline InverseHalftonePipeline;
+
+/*
+Intermediate images for inverseHalftone.  Allocating them once and
+reusing them for a stream of images avoids an allocation per image.
+*/
+typedef struct InverseHalftoneWorkspace {
+    int maxRows;
+    int maxColumns;
+    ImagePlane* inputImage;     /* binary halftone, 0 or 1 */
+    ImagePlane* y0;
+    ImagePlane* y1;
+    ImagePlane* g2RowRing;      /* last rows of G2 row filter results */
+    ImagePlane* y2Ring;         /* last rows of y2 */
+    ImagePlane* g3RowRing;      /* last rows of G3 row filter results */
+    ImagePlane* hie;
+    ImagePlane* scratch;        /* row pass results */
+    ImagePlane* mask;           /* thresholded difference, 0 or 1 */
+    ImagePlane* edgeMap;        /* 5x5 binary median of mask */
+    int qualityLevel;           /* INVERSE_HALFTONE_QUALITY_FULL or less */
+    int sparseTileSize;         /* 0 unless block-sparse */
+    ImagePlane* tileMin;        /* smallest y2 per tile */
+    ImagePlane* tileMax;        /* largest y2 per tile */
+    ImagePlane* tileFlat;       /* 1 for edge-free tiles */
+    int recursiveStages;        /* RECURSIVE_FIRST_FILTER, ... */
+    double sigmaScale;          /* of the recursive filters */
+    ImagePlane* y2;             /* only for recursive filters */
+    ImagePlane* recursiveBuffer;
+    ImagePlane* pyramid;        /* even levels of the pyramid */
+    InverseHalftonePipeline* pipeline;  /* null pointer unless pipelined */
+    int kernels[NUM_INVERSE_HALFTONE_STAGES];   /* implementation of each */
+    PerfCounters* perfCounters; /* null pointer unless counting events */
+    double stageStartCounts[NUM_PERF_COUNTERS];
+    InverseHalftoneStats stats;
+} InverseHalftoneWorkspace;
+
+/* Smallest tile of the block-sparse mode */
+#define MIN_SPARSE_TILE_SIZE 4
+
+/* Most images that inverseHalftoneBatch interleaves */
+#define MAX_BATCH_LANES 16
+
+/*
+Intermediate images for inverseHalftoneBatch, each holding numLanes
+images interleaved, one per lane
+*/
+typedef struct InverseHalftoneBatchWorkspace {
+    int numLanes;
+    int maxRows;
+    int maxColumns;
+    ImagePlane* inputImage;     /* binary halftones, 0.0 or 1.0 */
+    ImagePlane* y0;             /* then y2 */
+    ImagePlane* y1;
+    ImagePlane* scratch;        /* row pass results */
+    ImagePlane* hie;            /* z, then y2 - z, then hie */
+    ImagePlane* mask;
+    ImagePlane* edgeMap;
+    int* columnCounts;          /* for the binary median */
+    unsigned char* outputRow;   /* interleaved row of the outputs */
+} InverseHalftoneBatchWorkspace;
+
+int inverseHalftoneSupport(int halftoningType, int* beforePtr, int* afterPtr);
+
+InverseHalftoneWorkspace* allocateInverseHalftoneWorkspace(int maxRows,
+                                                           int maxColumns);
+void prewarmInverseHalftoneWorkspace(InverseHalftoneWorkspace* workspace);
+void freeInverseHalftoneWorkspace(InverseHalftoneWorkspace* workspace);
+int setInverseHalftoneQuality(InverseHalftoneWorkspace* workspace,
+                              int qualityLevel);
+int setInverseHalftoneRecursiveFilters(InverseHalftoneWorkspace* workspace,
+                                       int stages, double sigmaScale);
+int setInverseHalftoneSparseTiles(InverseHalftoneWorkspace* workspace,
+                                  int tileSize);
+int setInverseHalftonePipeline(InverseHalftoneWorkspace* workspace,
+                                int pipelineFlag);
+void setInverseHalftoneCounters(InverseHalftoneWorkspace* workspace,
+                                PerfCounters* counters);
+char* inverseHalftoneStageName(int stage);
+int numInverseHalftoneKernels(int stage);
+char* inverseHalftoneKernelName(int stage, int kernel);
+int setInverseHalftoneKernel(InverseHalftoneWorkspace* workspace,
+                             int stage, int kernel);
+int selectInverseHalftoneKernels(char* list);
+void printInverseHalftoneStats(FILE* file, InverseHalftoneStats* stats);
+void printInverseHalftoneMemory(FILE* file, InverseHalftoneStats* stats);
 
 double inverseHalftone(unsigned char* inputImage, unsigned char* outputImage,
                        int numRows, int numColumns,
                        int gain, int threshold, int timingFlag,
 		       int halftoningType);
+double inverseHalftoneWithWorkspace(InverseHalftoneWorkspace* workspace,
+                                    unsigned char* inputImage,
+                                    unsigned char* outputImage,
+                                    int numRows, int numColumns,
+                                    int gain, int threshold, int timingFlag,
+                                    int halftoningType);
+double inverseHalftoneSweep(InverseHalftoneWorkspace* workspace,
+                            unsigned char* inputImage,
+                            unsigned char** outputImages,
+                            int numRows, int numColumns,
+                            int* thresholds, int numThresholds,
+                            int* gains, int numGains,
+                            int timingFlag, int halftoningType);
+double verifyInverseHalftoneKernels(InverseHalftoneWorkspace* workspace,
+                                    unsigned char* inputImage,
+                                    int numRows, int numColumns,
+                                    int gain, int threshold,
+                                    int halftoningType,
+                                    KernelMismatch* mismatches);
+void printKernelMismatches(FILE* file, InverseHalftoneWorkspace* workspace,
+                           KernelMismatch* mismatches);
+int pyramidLevelSize(int size, int level);
+double inverseHalftonePyramid(InverseHalftoneWorkspace* workspace,
+                              unsigned char* inputImage,
+                              unsigned char** outputImages,
+                              int numRows, int numColumns,
+                              int firstLevel, int lastLevel,
+                              int gain, int threshold,
+                              int timingFlag, int halftoningType);
+InverseHalftoneBatchWorkspace* allocateInverseHalftoneBatchWorkspace(
+    int numLanes, int maxRows, int maxColumns);
+void freeInverseHalftoneBatchWorkspace(InverseHalftoneBatchWorkspace* batch);
+double inverseHalftoneBatch(InverseHalftoneBatchWorkspace* batch,
+                            unsigned char** inputImages,
+                            unsigned char** outputImages,
+                            int numImages, int numRows, int numColumns,
+                            int gain, int threshold,
+                            int timingFlag, int halftoningType);
 
 #endif
 
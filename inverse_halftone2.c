@@ -0,0 +1,332 @@
+/*
+Copyright (c) 1997-1998 The University of Texas
+All Rights Reserved.
+ 
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+ 
+Programmer:	Thomas D. Kite
+
+The author is with the Laboratory for Image and Video Engineering
+at The University of Texas at Austin, and can be reached at
+tom@vision.ece.utexas.edu.
+*/
+
+/*
+The inverse halftoning algorithm implemented by this program is
+explained in the following paper:
+
+    T. D. Kite, N. Damera-Venkata, B. L. Evans, and A. C. Bovik,
+    ``A High Quality, Fast Inverse Halftoning Algorithm for Error
+    Diffused Halftones,'' Proc. IEEE Int. Conf. on Image
+    Processing, Oct. 4-7, 1998, to appear.
+    http://www.ece.utexas.edu/~bevans/papers/1998/error_diffusion/
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "inverse_halftone2.h"
+#include "thread_utils.h"
+#include "memory_usage.h"
+
+typedef unsigned char pixel;                    /* 8-bit pixels */
+typedef signed char filt;                       /* 8-bit filter coefficients */
+typedef signed short fout;                      /* filter outputs */
+
+/*
+Reflect row or column index about the first and last of size, without
+repeating them, as the seven-row window is mirrored at the borders
+*/
+static int mirrorIndex(int index, int size)
+{
+  if (size == 1) return 0;
+  while ((index < 0) || (index >= size)) {
+    if (index < 0) index = -index;
+    if (index >= size) index = 2*size - index - 2;
+  }
+  return index;
+}
+
+/*
+Copy the image row inptr of xsize pixels into the window row imptr of
+xsize+6 pixels, mirrored three pixels out at both sides
+*/
+static void loadWindowRow(pixel *imptr, unsigned char *inptr, int xsize)
+{
+  int col;
+
+  memcpy(imptr+3, inptr, xsize);
+  for (col=1; col<=3; col++) {
+    imptr[3-col] = inptr[mirrorIndex(-col, xsize)];
+    imptr[xsize+2+col] = inptr[mirrorIndex(xsize-1+col, xsize)];
+  }
+}
+
+/*
+Inverse halftone rows firstRow through firstRow+numRows-1 of the error
+diffused halftone inputImage of ysize rows by xsize columns into the
+same rows of outputImage.  The halftone is 0 for black and any
+non-zero value for white.  Only a window of seven rows of the
+halftone, mirrored at the image borders, is kept while filtering, so
+a strip reads the three rows on either side of it and its result does
+not depend on how the image is split into strips.  Returns 0, or -1
+if memory could not be allocated.
+*/
+int inverseHalftone2Strip(unsigned char* inputImage,
+                          unsigned char* outputImage,
+                          int ysize, int xsize, int firstRow, int numRows)
+{
+  int xpadsize, rowadd, row, col, lastRow = firstRow+numRows-1;
+  pixel *imtl, *imbr;
+  register pixel *imptr, *imcmp;
+  unsigned char *outptr = outputImage+firstRow*xsize;
+  filt f2x[25]={19,32,0,-32,-19,55,92,0,-92,-55, \
+                72,120,0,-120,-72,55,92,0,-92,-55, \
+                19,32,0,-32,-19};
+  filt f2y[25]={19,55,72,55,19,32,92,120,92,32, \
+                0,0,0,0,0,-32,-92,-120,-92,-32, \
+                -19,-55,-71,-55,-19};
+  filt f3x[49]={12,27,25,0,-25,-27,-12,30,68,64,0,-64,-68,-30, \
+                45,103,96,0,-96,-103,-45,54,124,114,0,-114,-124,-54, \
+                45,103,96,0,-96,-103,-45,30,68,64,0,-64,-68,-30, \
+                12,27,25,0,-25,-27,-12};
+  filt f3y[49]={12,30,45,54,45,30,12,27,68,103,124,103,68,27, \
+                25,64,96,114,96,64,25,0,0,0,0,0,0,0, \
+                -25,-64,-96,-114,-96,-64,-25,-27,-68,-103,-124,-103,-68,-27, \
+                -12,-30,-45,-54,-45,-30,-12};
+  filt *f2xp, *f2yp, *f3xp, *f3yp;
+  register fout t2x, t2y, t3x, t3y;
+  int fx[7]={0,0,0,4*1024,0,0,0}, *fxptr;
+  int fy[7]={0,0,0,4*1024,0,0,0}, *fyptr;
+  int out, outrow;
+  float cx1, cy1, cx2, cy2, xcomp, ycomp, out2;
+
+  /*
+    filtscale scales the output of the product of the edge detectors.
+    It is computed as 1/(1024*2048*2048), since that is how much the
+    coefficients of the edge detectors are scaled to get them to fit
+    into one byte each.
+    filtscale2 scales the output of the smoothing filter.  It is 
+    computed as 255/(16*1024*1024).  The 255/16 comes from the need
+    to scale to the full 0-255 range, and the fact that the scaling
+    factor for the separable filter has a 4 in the denominator (see
+    report).  The two factors of 1024 compensate for the multiplication
+    applied to the floating-point coefficients before they are converted
+    to integers for fast implementation.
+  */
+
+  float filtscale = 2.328306436538696e-10;          /* scale edge detector */
+  float filtscale2 = 1.519918441772461e-5;          /* scale smooth filter */
+
+  xpadsize = xsize+6;                               /* extended image size */
+  rowadd = xsize-1;                                 /* to get to next row */
+  imtl = (pixel*) trackedMalloc(xpadsize*7);        /* 7 row store */
+  if (!imtl) return -1;
+  imbr = imtl+xpadsize*7;                           /* bottom right + 1 */
+
+  /* Load in the three rows above the strip, its first row and the */
+  /* three rows below it, mirrored at the image borders */
+
+  for (row=0; row<7; row++) {
+    loadWindowRow(imtl+xpadsize*row,
+                  inputImage+mirrorIndex(firstRow-3+row, ysize)*xsize, xsize);
+  }
+
+  /* Loop over the strip */
+
+  for (row=firstRow; row<=lastRow; row++) {             /* all strip rows */
+    for (col=0; col<xsize; col++) {                     /* all image cols */
+
+      /* Compute the four gradient estimator outputs t{2,3}{x,y} */
+
+      t2x=0; t2y=0; f2xp=f2x; f2yp=f2y;                 /* zero totals */
+      t3x=0; t3y=0; f3xp=f3x; f3yp=f3y;                 /* and reset filters */
+      for (imptr=imtl+col, imcmp=imptr+7; imptr<imcmp;) /* row 1 (3) */
+        if (*imptr++) {t3x+=*f3xp++; t3y+=*f3yp++;}
+          else {f3xp++; f3yp++;}
+      for (imptr+=rowadd; imptr<imtl+xpadsize*6; imptr+=rowadd){ /* rows 2-6 */
+        if (*imptr++) {t3x+=*f3xp++; t3y+=*f3yp++;}     /* col 1 (3) */
+          else {f3xp++; f3yp++;}
+        for (imcmp=imptr+5; imptr<imcmp;)               /* cols 2-6 (2,3) */
+          if (*imptr++) {t2x+=*f2xp++; t2y+=*f2yp++;
+                         t3x+=*f3xp++; t3y+=*f3yp++;}
+            else {f2xp++; f2yp++; f3xp++; f3yp++;}
+        if (*imptr++) {t3x+=*f3xp++; t3y+=*f3yp++;}     /* col 7 (3) */
+          else {f3xp++; f3yp++;}
+      }
+      for (imcmp=imptr+7; imptr<imcmp;)                 /* row 7 (3) */
+        if (*imptr++) {t3x+=*f3xp++; t3y+=*f3yp++;}
+          else {f3xp++; f3yp++;}
+
+      /*
+         Compute composite gradients.  First, find the absolute value of 
+         the product of the gradients at two scales.  Then find the cube
+         root of this product.  First, check for the inputs that lead to
+         the limits of 3.33 and 1.95 and exclude them.  For valid inputs,
+         compute a first approximation using a two-line fit, then perform
+         two Newton-Raphson iterations.  Maximum error is 2e-4.
+      */
+
+      xcomp = (float) t2x*t3x*t3x * filtscale;          /* comp gradient */
+      if (xcomp) {                                      /* < max. smoothing? */
+        if (xcomp<0) xcomp=-xcomp;                      /* abs */
+        if (xcomp>0.0141909899) cx1=1.95;               /* min smoothing */
+        else {
+          if (xcomp>0.001) cx1=9.6742*xcomp+0.116165;   /* first linear fit */
+          else cx1=98.87505*xcomp+0.027;                /* second linear fit */
+          xcomp=xcomp*0.3333333333;
+          cx1=0.66666666*cx1+xcomp/(cx1*cx1);           /* Newton-Raphson */
+          cx1=0.66666666*cx1+xcomp/(cx1*cx1);
+          cx1=3.33-5.7*cx1;                             /* filter coeff. */
+        }
+      }
+      else cx1=3.33;                                    /* max smoothing */
+
+      ycomp = (float) t2y*t3y*t3y * filtscale;          /* comp gradient */
+      if (ycomp) {                                      /* < max. smoothing? */
+        if (ycomp<0) ycomp=-ycomp;                      /* abs */
+        if (ycomp>0.0141909899) cy1=1.95;               /* min smoothing */
+        else {
+          if (ycomp>0.001) cy1=9.6742*ycomp+0.116165;   /* first linear fit */
+          else cy1=98.87505*ycomp+0.027;                /* second linear fit */
+          ycomp=ycomp*0.3333333333;
+          cy1=0.66666666*cy1+ycomp/(cy1*cy1);           /* Newton-Raphson */
+          cy1=0.66666666*cy1+ycomp/(cy1*cy1);
+          cy1=3.33-5.7*cy1;                             /* filter coeff. */
+        }
+      }
+      else cy1=3.33;                                    /* max smoothing */
+
+      /* Compute second parameter of filters and construct integer filters */
+      /* with max. 13 bit coefficients */
+
+      cx2=-3.611679+cx1*(4.659894+cx1*(-2.426115+cx1*0.4630577));
+      fx[1]=1024*cx2; cx2+=2; fx[0]=1024*(cx2-cx1); fx[2]=1024*cx1;
+      fx[4]=fx[2]; fx[5]=fx[1]; fx[6]=fx[0];
+
+      cy2=-3.611679+cy1*(4.659894+cy1*(-2.426115+cy1*0.4630577));
+      fy[1]=1024*cy2; cy2+=2; fy[0]=1024*(cy2-cy1); fy[2]=1024*cy1;
+      fy[4]=fy[2]; fy[5]=fy[1]; fy[6]=fy[0];
+
+      /*
+         Compute output by separable filtering.  We treat the first pixel
+         of each row, and the first row sum, uniquely, to avoid an addition.
+         This saves 7 extra additions per pixel.
+       */
+      fyptr=fy; imptr=imtl+col;
+
+      fxptr=fx;
+      if (*imptr++) outrow=*fxptr++;                    /* row 1, col 1 */
+        else {outrow=0; fxptr++;}
+      for (; fxptr<fx+7;)                               /* row 1, cols 2-7 */
+        if (*imptr++) outrow+=*fxptr++;
+          else fxptr++;
+      out = outrow * *fyptr++;                          /* y filter */
+
+      for (imptr+=rowadd; imptr<imbr; imptr+=rowadd) {  /* rows 2-7 */
+        fxptr=fx;
+        if (*imptr++) outrow=*fxptr++;                  /* col 1 */
+          else {outrow=0; fxptr++;}
+        for (; fxptr<fx+7;)                             /* cols 2-7 */
+          if (*imptr++) outrow+=*fxptr++;
+            else fxptr++;
+        out += outrow * *fyptr++;                       /* y filter */
+      }
+
+      /* Scale output and write to file */
+
+      out2=filtscale2 * out / (cx2*cy2) + 0.5;          /* scale and round */
+      out2=(out2<0) ? 0 : (out2>255) ? 255 : out2;      /* clip */
+      *outptr++ = (unsigned char) out2;                 /* store output */
+    }
+
+    /* Shift input and read in the next row, mirrored at the borders */
+
+    if (row!=lastRow) {
+      memmove(imtl, imtl+xpadsize, xpadsize*6);         /* shift up one row */
+      loadWindowRow(imtl+xpadsize*6,
+                    inputImage+mirrorIndex(row+4, ysize)*xsize, xsize);
+    }
+  }
+
+  /* All done */
+
+  trackedFree(imtl);
+  return 0;
+}
+
+
+/*
+Inverse halftone the error diffused halftone inputImage of ysize rows
+by xsize columns into outputImage.  Returns 0, or -1 if memory could
+not be allocated.
+*/
+int inverseHalftone2(unsigned char* inputImage, unsigned char* outputImage,
+                     int ysize, int xsize)
+{
+  return inverseHalftone2Strip(inputImage, outputImage, ysize, xsize,
+                               0, ysize);
+}
+
+/* Strips of one image, shared by the threads that filter them */
+typedef struct StripJob {
+  unsigned char *inputImage, *outputImage;
+  int ysize, xsize, stripHeight;
+  int failed;
+} StripJob;
+
+static void stripTask(void* arg, int first, int last, int chunkIndex)
+{
+  StripJob* job = (StripJob*) arg;
+  int strip;
+
+  for (strip=first; strip<last; strip++) {
+    int firstRow = strip*job->stripHeight;
+    int numRows = job->ysize-firstRow;
+    if (numRows > job->stripHeight) numRows = job->stripHeight;
+    if (inverseHalftone2Strip(job->inputImage, job->outputImage,
+                              job->ysize, job->xsize,
+                              firstRow, numRows) != 0) {
+      job->failed = 1;
+    }
+  }
+}
+
+/*
+Inverse halftone inputImage as in inverseHalftone2, in strips of
+stripHeight rows spread over numThreads threads.  Every strip reloads
+the six rows around it, so short strips cost more but balance the
+threads better.  The result is the same for every stripHeight and
+numThreads.  Returns 0, or -1 if memory could not be allocated.
+*/
+int inverseHalftone2Strips(unsigned char* inputImage,
+                           unsigned char* outputImage,
+                           int ysize, int xsize,
+                           int stripHeight, int numThreads)
+{
+  StripJob job;
+
+  if ((stripHeight < 1) || (stripHeight > ysize)) stripHeight = ysize;
+  job.inputImage = inputImage;
+  job.outputImage = outputImage;
+  job.ysize = ysize;
+  job.xsize = xsize;
+  job.stripHeight = stripHeight;
+  job.failed = 0;
+  parallelFor((ysize+stripHeight-1)/stripHeight, numThreads, stripTask, &job);
+  return job.failed ? -1 : 0;
+}
@@ -0,0 +1,52 @@
+/*
+Copyright (c) 1997-1998 The University of Texas
+All Rights Reserved.
+ 
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+ 
+Programmer:	Thomas D. Kite
+
+The author is with the Laboratory for Image and Video Engineering
+at The University of Texas at Austin, and can be reached at
+tom@vision.ece.utexas.edu.
+*/
+
+/*
+The inverse halftoning algorithm implemented by this program is
+explained in the following paper:
+
+    T. D. Kite, N. Damera-Venkata, B. L. Evans, and A. C. Bovik,
+    ``A High Quality, Fast Inverse Halftoning Algorithm for Error
+    Diffused Halftones,'' Proc. IEEE Int. Conf. on Image
+    Processing, Oct. 4-7, 1998, to appear.
+    http://www.ece.utexas.edu/~bevans/papers/1998/error_diffusion/
+*/
+
+#ifndef _INVERSE_HALFTONE2_H
+#define _INVERSE_HALFTONE2_H
+
+int inverseHalftone2(unsigned char* inputImage, unsigned char* outputImage,
+                     int numRows, int numColumns);
+int inverseHalftone2Strip(unsigned char* inputImage,
+                          unsigned char* outputImage,
+                          int numRows, int numColumns,
+                          int firstRow, int stripRows);
+int inverseHalftone2Strips(unsigned char* inputImage,
+                           unsigned char* outputImage,
+                           int numRows, int numColumns,
+                           int stripHeight, int numThreads);
+
+#endif
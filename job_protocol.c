@@ -0,0 +1,194 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/* Standard includes */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+
+#include "job_protocol.h"
+
+/* Write all numBytes bytes of buffer, restarting after signals */
+static int writeFully(int fd, void* buffer, size_t numBytes)
+{
+    char* bytePtr = (char*) buffer;
+    while (numBytes > 0) {
+        ssize_t numWritten = write(fd, bytePtr, numBytes);
+        if (numWritten < 0) {
+            if (errno == EINTR) continue;
+            return(-1);
+        }
+        bytePtr += numWritten;
+        numBytes -= numWritten;
+    }
+    return(0);
+}
+
+/*
+Read all numBytes bytes into buffer.  Return 1 on success, 0 if the
+peer closed the connection before the first byte, and -1 on error.
+*/
+static int readFully(int fd, void* buffer, size_t numBytes)
+{
+    char* bytePtr = (char*) buffer;
+    size_t numLeft = numBytes;
+    while (numLeft > 0) {
+        ssize_t numRead = read(fd, bytePtr, numLeft);
+        if (numRead < 0) {
+            if (errno == EINTR) continue;
+            return(-1);
+        }
+        if (numRead == 0) {
+            return((numLeft == numBytes) ? 0 : -1);
+        }
+        bytePtr += numRead;
+        numLeft -= numRead;
+    }
+    return(1);
+}
+
+/* Send a job request and pass the shared image buffer descriptor along */
+int sendJobRequest(int socketFd, JobRequest* request, int bufferFd)
+{
+    struct msghdr message;
+    struct iovec iov;
+    struct cmsghdr* control;
+    char controlBuffer[CMSG_SPACE(sizeof(int))];
+    ssize_t numSent;
+
+    memset(&message, 0, sizeof(message));
+    memset(controlBuffer, 0, sizeof(controlBuffer));
+    request->magic = JOB_PROTOCOL_MAGIC;
+    iov.iov_base = request;
+    iov.iov_len = sizeof(JobRequest);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = controlBuffer;
+    message.msg_controllen = sizeof(controlBuffer);
+
+    control = CMSG_FIRSTHDR(&message);
+    control->cmsg_level = SOL_SOCKET;
+    control->cmsg_type = SCM_RIGHTS;
+    control->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(control), &bufferFd, sizeof(int));
+
+    do {
+        numSent = sendmsg(socketFd, &message, 0);
+    } while ((numSent < 0) && (errno == EINTR));
+
+    return((numSent == (ssize_t) sizeof(JobRequest)) ? 0 : -1);
+}
+
+/*
+Receive a job request and the shared image buffer descriptor.  Return
+1 on success, 0 if the client closed the connection, and -1 on error.
+*/
+int receiveJobRequest(int socketFd, JobRequest* request, int* bufferFdPtr)
+{
+    struct msghdr message;
+    struct iovec iov;
+    struct cmsghdr* control;
+    char controlBuffer[CMSG_SPACE(sizeof(int))];
+    ssize_t numReceived;
+
+    memset(&message, 0, sizeof(message));
+    iov.iov_base = request;
+    iov.iov_len = sizeof(JobRequest);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = controlBuffer;
+    message.msg_controllen = sizeof(controlBuffer);
+    *bufferFdPtr = -1;
+
+    do {
+        numReceived = recvmsg(socketFd, &message, MSG_WAITALL);
+    } while ((numReceived < 0) && (errno == EINTR));
+
+    if (numReceived == 0) {
+        return(0);
+    }
+
+    /* Pick up the descriptor even on a short read so that it is closed */
+    control = CMSG_FIRSTHDR(&message);
+    if ((control != 0) &&
+        (control->cmsg_level == SOL_SOCKET) &&
+        (control->cmsg_type == SCM_RIGHTS)) {
+        memcpy(bufferFdPtr, CMSG_DATA(control), sizeof(int));
+    }
+
+    if ((numReceived != (ssize_t) sizeof(JobRequest)) ||
+        (request->magic != JOB_PROTOCOL_MAGIC) ||
+        (*bufferFdPtr < 0)) {
+        if (*bufferFdPtr >= 0) {
+            close(*bufferFdPtr);
+            *bufferFdPtr = -1;
+        }
+        return(-1);
+    }
+    return(1);
+}
+
+/* Send the reply for a finished job */
+int sendJobReply(int socketFd, JobReply* reply)
+{
+    reply->magic = JOB_PROTOCOL_MAGIC;
+    return(writeFully(socketFd, reply, sizeof(JobReply)));
+}
+
+/* Wait for the reply to a job */
+int receiveJobReply(int socketFd, JobReply* reply)
+{
+    if (readFully(socketFd, reply, sizeof(JobReply)) != 1) {
+        return(-1);
+    }
+    return((reply->magic == JOB_PROTOCOL_MAGIC) ? 0 : -1);
+}
+
+/*
+Create an anonymous shared memory buffer of numBytes bytes and return
+its file descriptor, or -1 on failure.  We fall back to an unlinked
+temporary file where memfd_create is not available.
+*/
+int createSharedBuffer(size_t numBytes)
+{
+    int fd = -1;
+
+#ifdef MFD_CLOEXEC
+    fd = memfd_create("fastiht", MFD_CLOEXEC);
+#endif
+    if (fd < 0) {
+        char fileName[] = "/tmp/fastihtXXXXXX";
+        fd = mkstemp(fileName);
+        if (fd < 0) {
+            return(-1);
+        }
+        unlink(fileName);
+    }
+    if (ftruncate(fd, (off_t) numBytes) != 0) {
+        close(fd);
+        return(-1);
+    }
+    return(fd);
+}
@@ -0,0 +1,62 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Messages exchanged between the fastihtd inverse halftoning server and
+its clients over a Unix domain socket.  The image data does not travel
+over the socket: the client creates a shared memory buffer of
+2 * numRows * numColumns bytes holding the halftone in the first half,
+passes its file descriptor along with the JobRequest, and the server
+writes the inverse halftone into the second half before sending the
+JobReply.
+*/
+
+#ifndef _JOB_PROTOCOL_H
+#define _JOB_PROTOCOL_H
+
+#include <stddef.h>
+
+#define JOB_PROTOCOL_MAGIC 0x49485431           /* "IHT1" */
+
+#define JOB_STATUS_OK          0
+#define JOB_STATUS_BAD_REQUEST 1
+#define JOB_STATUS_NO_MEMORY   2
+#define JOB_STATUS_BAD_METHOD  3
+
+typedef struct JobRequest {
+    int magic;
+    int numRows;
+    int numColumns;
+    int halftoningType;
+    int threshold;
+    int gain;
+} JobRequest;
+
+typedef struct JobReply {
+    int magic;
+    int status;
+    double execTime;
+} JobReply;
+
+int sendJobRequest(int socketFd, JobRequest* request, int bufferFd);
+int receiveJobRequest(int socketFd, JobRequest* request, int* bufferFdPtr);
+int sendJobReply(int socketFd, JobReply* reply);
+int receiveJobReply(int socketFd, JobReply* reply);
+
+int createSharedBuffer(size_t numBytes);
+
+#endif
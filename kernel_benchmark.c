@@ -0,0 +1,498 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+/*
+Microbenchmark of the kernels of the fast inverse halftoning
+algorithms.  Every kernel runs on its own, on a synthetic error
+diffused halftone of each size and on planes derived from it, so that
+a change to one kernel can be measured without the noise of the rest
+of the algorithm.  Each kernel is warmed up, then called in batches
+long enough for the clock to resolve, and the minimum, median and
+maximum times per pixel over the repetitions are reported.
+
+The kernels of fastiht1 are static functions of inverse_halftone.c,
+which is therefore compiled into this program rather than linked.
+fastiht2 computes its gradients and its filter in one loop, so
+inverseHalftone2 is measured as a whole.
+*/
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* The kernels under test */
+#include "inverse_halftone.c"
+#include "inverse_halftone2.h"
+#include "synthetic_halftone.h"
+
+/* Constants */
+
+#define MAX_BENCH_SIZES 16
+#define DEFAULT_BENCH_REPETITIONS 7
+#define DEFAULT_BENCH_WARMUP 2
+#define DEFAULT_BENCH_MIN_TIME_MS 20
+
+/* Threshold and gain of the edge map kernels, as in the README example */
+#define BENCH_THRESHOLD 0
+#define BENCH_GAIN 4
+
+#define USAGE_STRING \
+  "Usage: %s [options]\n" \
+  "Time every kernel of the inverse halftoning algorithms on its own, on\n" \
+  "synthetic error diffused halftones, and report nanoseconds per pixel.\n" \
+  "Options:\n" \
+  "  --sizes list   square image sizes, such as 256,512 (default\n" \
+  "                 256,512,1024)\n" \
+  "  --kernel name  time only the kernel name; see --list\n" \
+  "  --list         list the kernels and exit\n" \
+  "  --repetitions num\n" \
+  "                 timed repetitions of every kernel (default %d)\n" \
+  "  --warmup num   untimed calls before the repetitions (default %d)\n" \
+  "  --min-time ms  call the kernel in batches of at least ms\n" \
+  "                 milliseconds, so that the clock resolves them\n" \
+  "                 (default %d)\n" \
+  "  --cpu num      pin the benchmark to processor num\n"
+
+/*
+The synthetic halftone of one size, and the planes that the kernels
+read and write.  The binary plane holds the halftone as 0 and 1 with a
+mirrored border; grey is its first Gaussian filter, as the smoothing
+and median kernels see in the algorithm; diff is grey minus its third
+Gaussian filter, and mask is diff thresholded, with a zeroed border.
+*/
+typedef struct BenchImages {
+    int numRows;
+    int numColumns;
+    unsigned char* halftone;
+    unsigned char* output;
+    ImagePlane* binary;
+    ImagePlane* grey;
+    ImagePlane* diff;
+    ImagePlane* mask;
+    ImagePlane* edgeMap;
+    ImagePlane* dest;
+    ImagePlane* ws;
+} BenchImages;
+
+typedef void (*BenchKernel)(BenchImages* images);
+
+typedef struct BenchKernelEntry {
+    char* name;
+    BenchKernel kernel;
+} BenchKernelEntry;
+
+/* Wrappers that call each kernel as the algorithm does */
+
+static void benchFirstFilter(BenchImages* images)
+{
+    separable9x9FIRBinaryImage(images->numRows, images->numColumns,
+                               images->binary, images->dest, images->ws,
+                               GaussianFilter1Rows, GaussianFilter1Columns);
+}
+
+static void benchReferenceFirstFilter(BenchImages* images)
+{
+    referenceFIRBinaryImage(images->numRows, images->numColumns,
+                            images->binary, images->dest, images->ws,
+                            firstFilterTaps, 4);
+}
+
+static void benchSecondFilter(BenchImages* images)
+{
+    separableFIRGreyImage(images->numRows, images->numColumns, images->grey,
+                          images->dest, images->ws, 3, GaussianFilter2Rows,
+                          GaussianFilter2Columns);
+}
+
+static void benchDitherSecondFilter(BenchImages* images)
+{
+    separableFIRGreyImage(images->numRows, images->numColumns, images->grey,
+                          images->dest, images->ws, 4, GaussianFilterDith2Rows,
+                          GaussianFilterDith2Columns);
+}
+
+static void benchThirdFilter(BenchImages* images)
+{
+    separableFIRGreyImage(images->numRows, images->numColumns, images->grey,
+                          images->dest, images->ws, THIRD_FILTER_RADIUS,
+                          GaussianFilter3Rows, GaussianFilter3Columns);
+}
+
+static void benchMedian3x3Grey(BenchImages* images)
+{
+    median3x3GreyImage(images->numRows, images->numColumns, images->grey,
+                       images->dest);
+}
+
+static void benchMedian5x5Grey(BenchImages* images)
+{
+    median5x5GreyImage(images->numRows, images->numColumns, images->grey,
+                       images->dest);
+}
+
+static void benchNetworkMedian3x3Grey(BenchImages* images)
+{
+    networkMedianGreyImage(images->numRows, images->numColumns, 3,
+                           images->grey, images->dest);
+}
+
+static void benchNetworkMedian5x5Grey(BenchImages* images)
+{
+    networkMedianGreyImage(images->numRows, images->numColumns, 5,
+                           images->grey, images->dest);
+}
+
+static void benchThreshold(BenchImages* images)
+{
+    thresholdImage(images->numRows, images->numColumns, images->diff,
+                   BENCH_THRESHOLD, images->mask);
+}
+
+static void benchMedian5x5Binary(BenchImages* images)
+{
+    median5x5BinaryImage(0, images->numRows, 0, images->numColumns,
+                         images->mask, images->edgeMap);
+}
+
+static void benchSlidingMedian5x5Binary(BenchImages* images)
+{
+    slidingMedian5x5BinaryImage(0, images->numRows, 0, images->numColumns,
+                                images->mask, images->edgeMap);
+}
+
+static void benchLastStage(BenchImages* images)
+{
+    lastStage(images->numRows, images->numColumns, BENCH_GAIN, images->diff,
+              images->grey, images->output);
+}
+
+static void benchInverseHalftone2(BenchImages* images)
+{
+    inverseHalftone2(images->halftone, images->output, images->numRows,
+                     images->numColumns);
+}
+
+static BenchKernelEntry benchKernels[] = {
+    { "separable9x9FIRBinaryImage", benchFirstFilter },
+    { "referenceFIRBinaryImage", benchReferenceFirstFilter },
+    { "separableFIRGreyImage/G2", benchSecondFilter },
+    { "separableFIRGreyImage/G2dith", benchDitherSecondFilter },
+    { "separableFIRGreyImage/G3", benchThirdFilter },
+    { "median3x3GreyImage", benchMedian3x3Grey },
+    { "median5x5GreyImage", benchMedian5x5Grey },
+    { "networkMedianGreyImage/3", benchNetworkMedian3x3Grey },
+    { "networkMedianGreyImage/5", benchNetworkMedian5x5Grey },
+    { "thresholdImage", benchThreshold },
+    { "median5x5BinaryImage", benchMedian5x5Binary },
+    { "slidingMedian5x5BinaryImage", benchSlidingMedian5x5Binary },
+    { "lastStage", benchLastStage },
+    { "inverseHalftone2", benchInverseHalftone2 }
+};
+
+#define NUM_BENCH_KERNELS \
+    ((int) (sizeof(benchKernels) / sizeof(benchKernels[0])))
+
+/* Print the usage information and exit */
+static void usage(char *programName)
+{
+    fprintf(stderr, USAGE_STRING, programName, DEFAULT_BENCH_REPETITIONS,
+            DEFAULT_BENCH_WARMUP, DEFAULT_BENCH_MIN_TIME_MS);
+    exit(1);
+}
+
+/* Read an integer from the string numericStr; and exit program on failure. */
+static int readIntArg(char *descStr, char *numericStr, int minValue) {
+    int tempInt = 0;
+    if ((sscanf(numericStr, "%d", &tempInt) != 1) || (tempInt < minValue)) {
+        fprintf(stderr,
+                "%s, %s, is not an integer greater than or equal to %d.\n",
+                descStr, numericStr, minValue);
+        exit(1);
+    }
+    return(tempInt);
+}
+
+/* Return the value of the option argv[*argIndexPtr], and exit if missing */
+static char* readOptionValue(int argc, char *argv[], int *argIndexPtr)
+{
+    if (*argIndexPtr + 1 >= argc) {
+        fprintf(stderr, "Option '%s' needs a value.\n", argv[*argIndexPtr]);
+        usage(argv[0]);
+    }
+    (*argIndexPtr)++;
+    return(argv[*argIndexPtr]);
+}
+
+/*
+Allocate the images for a size by size halftone and derive the planes
+from it.  Returns a null pointer if memory could not be allocated.
+*/
+static BenchImages* allocateBenchImages(int size)
+{
+    BenchImages* images = (BenchImages *) trackedCalloc(1,
+                                                        sizeof(BenchImages));
+    int i, j;
+
+    if (images == 0) {
+        return(0);
+    }
+    images->numRows = size;
+    images->numColumns = size;
+    images->halftone = (unsigned char *) trackedMalloc(size * size);
+    images->output = (unsigned char *) trackedMalloc(size * size);
+    images->binary = allocateImagePlane(IMAGE_PLANE_UINT8, size, size, 4);
+    images->grey = allocateImagePlane(IMAGE_PLANE_FLOAT, size, size, 4);
+    images->diff = allocateImagePlane(IMAGE_PLANE_FLOAT, size, size, 4);
+    images->mask = allocateImagePlane(IMAGE_PLANE_UINT8, size, size, 4);
+    images->edgeMap = allocateImagePlane(IMAGE_PLANE_UINT8, size, size, 4);
+    images->dest = allocateImagePlane(IMAGE_PLANE_FLOAT, size, size, 4);
+    images->ws = allocateImagePlane(IMAGE_PLANE_FLOAT, size, size, 4);
+    if ((images->halftone == 0) || (images->output == 0) ||
+        (images->binary == 0) || (images->grey == 0) ||
+        (images->diff == 0) || (images->mask == 0) ||
+        (images->edgeMap == 0) || (images->dest == 0) ||
+        (images->ws == 0)) {
+        return(0);
+    }
+
+    makeSyntheticHalftone(images->halftone, size, size,
+                          HALFTONING_BY_ERROR_DIFFUSION);
+    for (i = 0; i < size; i++) {
+        unsigned char* binaryRow = BYTE_PLANE_ROW(images->binary, i);
+        for (j = 0; j < size; j++) {
+            binaryRow[j] = (images->halftone[i*size + j] != 0);
+        }
+    }
+    mirrorImagePlaneBorder(images->binary);
+
+    separable9x9FIRBinaryImage(size, size, images->binary, images->grey,
+                               images->ws, GaussianFilter1Rows,
+                               GaussianFilter1Columns);
+    benchThirdFilter(images);
+    for (i = 0; i < size; i++) {
+        float* greyRow = FLOAT_PLANE_ROW(images->grey, i);
+        float* destRow = FLOAT_PLANE_ROW(images->dest, i);
+        float* diffRow = FLOAT_PLANE_ROW(images->diff, i);
+        for (j = 0; j < size; j++) {
+            diffRow[j] = greyRow[j] - destRow[j];
+        }
+    }
+    mirrorImagePlaneBorder(images->diff);
+    clearImagePlaneBorder(images->mask);
+    benchThreshold(images);
+
+    return(images);
+}
+
+static void freeBenchImages(BenchImages* images)
+{
+    if (images == 0) {
+        return;
+    }
+    trackedFree(images->halftone);
+    trackedFree(images->output);
+    freeImagePlane(images->binary);
+    freeImagePlane(images->grey);
+    freeImagePlane(images->diff);
+    freeImagePlane(images->mask);
+    freeImagePlane(images->edgeMap);
+    freeImagePlane(images->dest);
+    freeImagePlane(images->ws);
+    trackedFree(images);
+}
+
+/* Return the time in seconds taken by numCalls calls of kernel */
+static double timeKernelCalls(BenchKernel kernel, BenchImages* images,
+                              int numCalls)
+{
+    double startTime = currentTimeInSeconds();
+    int k;
+
+    for (k = 0; k < numCalls; k++) {
+        kernel(images);
+    }
+    return(currentTimeInSeconds() - startTime);
+}
+
+static int compareDoubles(const void* a, const void* b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return((x > y) - (x < y));
+}
+
+/*
+Warm up the kernel, find how many calls take at least minTime seconds,
+and store the time per pixel in nanoseconds of every repetition of
+that many calls in nsPerPixel, sorted.
+*/
+static void benchmarkKernel(BenchKernel kernel, BenchImages* images,
+                            int warmup, int repetitions, double minTime,
+                            double* nsPerPixel)
+{
+    double numPixels = (double) images->numRows * images->numColumns;
+    int numCalls = 1;
+    int k;
+
+    for (k = 0; k < warmup; k++) {
+        kernel(images);
+    }
+    while (timeKernelCalls(kernel, images, numCalls) < minTime) {
+        numCalls *= 2;
+    }
+    for (k = 0; k < repetitions; k++) {
+        nsPerPixel[k] = 1.0e9 * timeKernelCalls(kernel, images, numCalls) /
+                        (numCalls * numPixels);
+    }
+    qsort(nsPerPixel, repetitions, sizeof(double), compareDoubles);
+}
+
+/*
+Restrict the process to processor cpu, so that it neither migrates
+nor competes with itself.  Returns FALSE where it cannot be pinned.
+*/
+static int pinToProcessor(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t cpuSet;
+
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    return(sched_setaffinity(0, sizeof(cpuSet), &cpuSet) == 0);
+#else
+    return(FALSE);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    int sizes[MAX_BENCH_SIZES] = { 256, 512, 1024 };
+    int numSizes = 3;
+    int repetitions = DEFAULT_BENCH_REPETITIONS;
+    int warmup = DEFAULT_BENCH_WARMUP;
+    int minTimeMs = DEFAULT_BENCH_MIN_TIME_MS;
+    int cpu = -1;
+    char* kernelName = 0;
+    double* nsPerPixel;
+    int argIndex, s, k;
+
+    for (argIndex = 1; argIndex < argc; argIndex++) {
+        char* option = argv[argIndex];
+        if (strcmp(option, "--sizes") == 0) {
+            char* token = strtok(readOptionValue(argc, argv, &argIndex), ",");
+            numSizes = 0;
+            for (; token != 0; token = strtok(0, ",")) {
+                if (numSizes == MAX_BENCH_SIZES) {
+                    fprintf(stderr, "More than %d sizes.\n", MAX_BENCH_SIZES);
+                    exit(1);
+                }
+                sizes[numSizes++] = readIntArg("Size", token, 8);
+            }
+            if (numSizes == 0) {
+                usage(argv[0]);
+            }
+        }
+        else if (strcmp(option, "--kernel") == 0) {
+            kernelName = readOptionValue(argc, argv, &argIndex);
+        }
+        else if (strcmp(option, "--list") == 0) {
+            for (k = 0; k < NUM_BENCH_KERNELS; k++) {
+                printf("%s\n", benchKernels[k].name);
+            }
+            return(0);
+        }
+        else if (strcmp(option, "--repetitions") == 0) {
+            repetitions = readIntArg("Number of repetitions",
+                                     readOptionValue(argc, argv, &argIndex), 1);
+        }
+        else if (strcmp(option, "--warmup") == 0) {
+            warmup = readIntArg("Number of warmup calls",
+                                readOptionValue(argc, argv, &argIndex), 0);
+        }
+        else if (strcmp(option, "--min-time") == 0) {
+            minTimeMs = readIntArg("Minimum time",
+                                   readOptionValue(argc, argv, &argIndex), 0);
+        }
+        else if (strcmp(option, "--cpu") == 0) {
+            cpu = readIntArg("Processor", readOptionValue(argc, argv,
+                                                          &argIndex), 0);
+        }
+        else {
+            fprintf(stderr, "Unknown option '%s'.\n", option);
+            usage(argv[0]);
+        }
+    }
+
+    if (kernelName != 0) {
+        for (k = 0; k < NUM_BENCH_KERNELS; k++) {
+            if (strcmp(kernelName, benchKernels[k].name) == 0) break;
+        }
+        if (k == NUM_BENCH_KERNELS) {
+            fprintf(stderr, "Unknown kernel '%s'; see --list.\n", kernelName);
+            exit(1);
+        }
+    }
+    if (cpu >= 0) {
+        if (!pinToProcessor(cpu)) {
+            fprintf(stderr, "Could not pin to processor %d.\n", cpu);
+            exit(1);
+        }
+        printf("pinned to processor %d\n", cpu);
+    }
+
+    nsPerPixel = (double *) malloc(repetitions * sizeof(double));
+    if (nsPerPixel == 0) {
+        fprintf(stderr, "Could not allocate memory.\n");
+        exit(1);
+    }
+    printf("%-28s %11s %10s %10s %10s\n", "kernel", "size",
+           "min ns/px", "median", "max");
+    for (s = 0; s < numSizes; s++) {
+        BenchImages* images = allocateBenchImages(sizes[s]);
+        char sizeString[32];
+        if (images == 0) {
+            fprintf(stderr, "Could not allocate %d x %d images.\n",
+                    sizes[s], sizes[s]);
+            exit(1);
+        }
+        sprintf(sizeString, "%dx%d", sizes[s], sizes[s]);
+        for (k = 0; k < NUM_BENCH_KERNELS; k++) {
+            if ((kernelName != 0) &&
+                (strcmp(kernelName, benchKernels[k].name) != 0)) {
+                continue;
+            }
+            benchmarkKernel(benchKernels[k].kernel, images, warmup,
+                            repetitions, minTimeMs / 1000.0, nsPerPixel);
+            printf("%-28s %11s %10.3f %10.3f %10.3f\n", benchKernels[k].name,
+                   sizeString, nsPerPixel[0], nsPerPixel[repetitions / 2],
+                   nsPerPixel[repetitions - 1]);
+            fflush(stdout);
+        }
+        freeBenchImages(images);
+    }
+
+    free(nsPerPixel);
+    return(0);
+}
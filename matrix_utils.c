@@ -32,6 +32,7 @@ at The University of Texas at Austin, and can be reached at
 #include <string.h>
 
 #include "matrix_utils.h"
+#include "memory_usage.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -46,13 +47,13 @@ at The University of Texas at Austin, and can be reached at
 float **allocateFloatMatrix(int height, int width)
 {
     int i;
-    float **floatMatrix = (float **) malloc(height*sizeof(float *));
+    float **floatMatrix = (float **) trackedMalloc(height*sizeof(float *));
   
     if (!floatMatrix) {
         fprintf(stderr, "Cannot allocate memory in allocateFloatMatrix.\n");
         exit(1);
     }
-    floatMatrix[0] = (float *) malloc(width*height*sizeof(float));
+    floatMatrix[0] = (float *) trackedMalloc(width*height*sizeof(float));
     if (!floatMatrix[0]) {
         fprintf(stderr, "Cannot allocate matrix in allocateFloatMatrix.\n");
         exit(2);
@@ -68,9 +69,257 @@ int freeFloatMatrix(float **floatMatrix)
         return FALSE;
     }
     if (floatMatrix[0]) {
-        free(floatMatrix[0]);
+        trackedFree(floatMatrix[0]);
         floatMatrix[0] = 0;
     }
-    free(floatMatrix);
+    trackedFree(floatMatrix);
     return TRUE;
 }
+
+/* Size in bytes of one element of the given type */
+static int imagePlaneElementSize(int elementType)
+{
+    switch(elementType) {
+      case IMAGE_PLANE_UINT8:
+        return(1);
+      case IMAGE_PLANE_INT16:
+        return(2);
+      case IMAGE_PLANE_INT32:
+        return(4);
+      case IMAGE_PLANE_FLOAT:
+        return(sizeof(float));
+    }
+    return(0);
+}
+
+/*
+Allocate an image plane of up to maxRows by maxColumns elements of
+elementType, with a border of border elements on every side.  The
+plane starts out at its maximum size.  Returns a null pointer if
+memory could not be allocated.
+*/
+ImagePlane *allocateImagePlane(int elementType, int maxRows, int maxColumns,
+                               int border)
+{
+    return(allocateLaneImagePlane(elementType, 1, maxRows, maxColumns,
+                                  border));
+}
+
+/*
+Allocate an image plane as allocateImagePlane does, whose elements
+are numLanes values of elementType, one from each of numLanes images
+of the same size.  Value k of element (i, j) is value j*numLanes + k
+of row i, so that a row of the plane is one row of every image,
+interleaved, and a filter that reads element (i, j + d) reads value
+d*numLanes further along the row.
+*/
+ImagePlane *allocateLaneImagePlane(int elementType, int numLanes,
+                                   int maxRows, int maxColumns, int border)
+{
+    ImagePlane *plane = 0;
+    int elementSize = imagePlaneElementSize(elementType) * numLanes;
+    int elementsPerBlock, leftPad;
+    size_t numBytes;
+
+    if ((elementSize <= 0) || (maxRows < 1) || (maxColumns < 1) ||
+        (border < 0)) {
+        return(0);
+    }
+    plane = (ImagePlane *) trackedCalloc(1, sizeof(ImagePlane));
+    if (plane == 0) {
+        return(0);
+    }
+
+    /* Pad the left border and the stride to whole alignment blocks */
+    elementsPerBlock = IMAGE_PLANE_ALIGNMENT / elementSize;
+    if (elementsPerBlock < 1) elementsPerBlock = 1;
+    leftPad = ((border + elementsPerBlock - 1) / elementsPerBlock) *
+              elementsPerBlock;
+    plane->stride = ((leftPad + maxColumns + border + elementsPerBlock - 1) /
+                     elementsPerBlock) * elementsPerBlock;
+
+    plane->elementType = elementType;
+    plane->elementSize = elementSize;
+    plane->numLanes = numLanes;
+    plane->maxRows = maxRows;
+    plane->maxColumns = maxColumns;
+    plane->border = border;
+    numBytes = (size_t) (maxRows + 2*border) * plane->stride * elementSize;
+    plane->numBytes = numBytes;
+    plane->memory = trackedMalloc(numBytes + IMAGE_PLANE_ALIGNMENT);
+    plane->rowReflection = (int *) trackedMalloc((4*border + 1)*sizeof(int));
+    if ((plane->memory == 0) || (plane->rowReflection == 0)) {
+        freeImagePlane(plane);
+        return(0);
+    }
+    plane->columnReflection = plane->rowReflection + 2*border;
+
+    /* Round the start of the block up to the alignment */
+    plane->origin = (char *) plane->memory + IMAGE_PLANE_ALIGNMENT -
+                    ((unsigned long) plane->memory % IMAGE_PLANE_ALIGNMENT);
+    plane->origin = (char *) plane->origin +
+                    ((size_t) border * plane->stride + leftPad) * elementSize;
+
+    setImagePlaneSize(plane, maxRows, maxColumns);
+    return(plane);
+}
+
+/*  Deallocate an image plane */
+void freeImagePlane(ImagePlane *plane)
+{
+    if (plane == 0) {
+        return;
+    }
+    trackedFree(plane->memory);
+    trackedFree(plane->rowReflection);
+    trackedFree(plane);
+}
+
+/* Fill the reflection table for a border of the given width and size */
+static void fillReflectionTable(int *table, int border, int size)
+{
+    int k;
+    for (k = 0; k < border; k++) {
+        table[k] = reflectIndex(-1 - k, size);
+        table[border + k] = reflectIndex(size + k, size);
+    }
+}
+
+/*
+Use the first numRows by numColumns elements of the plane, updating
+the reflection tables if the size changed.  Returns FALSE if the
+plane is too small.
+*/
+int setImagePlaneSize(ImagePlane *plane, int numRows, int numColumns)
+{
+    if ((numRows < 1) || (numColumns < 1) ||
+        (numRows > plane->maxRows) || (numColumns > plane->maxColumns)) {
+        return FALSE;
+    }
+    if (numRows != plane->numRows) {
+        fillReflectionTable(plane->rowReflection, plane->border, numRows);
+        plane->numRows = numRows;
+    }
+    if (numColumns != plane->numColumns) {
+        fillReflectionTable(plane->columnReflection, plane->border,
+                            numColumns);
+        plane->numColumns = numColumns;
+    }
+    return TRUE;
+}
+
+/*
+Reflect index into the range 0 to size - 1 by mirroring about the
+first and last elements, without repeating them: -1 maps to 1 and
+size maps to size - 2.  This is how the filters treat the boundaries.
+*/
+int reflectIndex(int index, int size)
+{
+    if (size == 1) {
+        return(0);
+    }
+    while ((index < 0) || (index >= size)) {
+        if (index < 0) index = -index;
+        if (index >= size) index = 2*size - index - 2;
+    }
+    return(index);
+}
+
+/*
+Mirror the left and right borders of one row of elements of the given
+type, using the column reflection table of the plane.
+*/
+#define MIRROR_ROW_SIDES(type, plane, i) \
+    { \
+        type *row = (type *) IMAGE_PLANE_ROW(plane, i); \
+        int *table = (plane)->columnReflection; \
+        int border = (plane)->border, n = (plane)->numColumns, k; \
+        for (k = 0; k < border; k++) { \
+            row[-1 - k] = row[table[k]]; \
+            row[n + k] = row[table[border + k]]; \
+        } \
+    }
+
+/*
+Mirror the left and right borders of row i of the plane, which may be
+written row by row, as given by the column reflection table.
+*/
+void mirrorImagePlaneRowSides(ImagePlane *plane, int i)
+{
+    switch(plane->elementSize) {
+      case 1:
+        MIRROR_ROW_SIDES(unsigned char, plane, i);
+        break;
+      case 2:
+        MIRROR_ROW_SIDES(short, plane, i);
+        break;
+      case 4:                           /* float elements copied as bits */
+        MIRROR_ROW_SIDES(int, plane, i);
+        break;
+      default: {                        /* interleaved elements */
+        char *row = (char *) IMAGE_PLANE_ROW(plane, i);
+        int *table = plane->columnReflection;
+        int border = plane->border, n = plane->numColumns;
+        int size = plane->elementSize, k;
+        for (k = 0; k < border; k++) {
+            memcpy(row + (-1 - k)*size, row + table[k]*size, size);
+            memcpy(row + (n + k)*size, row + table[border + k]*size, size);
+        }
+        break;
+      }
+    }
+}
+
+/*
+Fill the border of the plane by mirroring its interior about the
+first and last rows and columns, as given by reflectIndex.  Only the
+border is touched; the reflected indices come from the tables computed
+by setImagePlaneSize.
+*/
+void mirrorImagePlaneBorder(ImagePlane *plane)
+{
+    int m = plane->numRows, n = plane->numColumns;
+    int border = plane->border, size = plane->elementSize;
+    int i, k;
+
+    if (border == 0) {
+        return;
+    }
+
+    /* Left and right borders of the interior rows */
+    for (i = 0; i < m; i++) {
+        mirrorImagePlaneRowSides(plane, i);
+    }
+
+    /* Top and bottom borders, including their corners */
+    for (k = 0; k < border; k++) {
+        memcpy((char *) IMAGE_PLANE_ROW(plane, -1 - k) - border*size,
+               (char *) IMAGE_PLANE_ROW(plane, plane->rowReflection[k]) -
+                   border*size,
+               (n + 2*border)*size);
+        memcpy((char *) IMAGE_PLANE_ROW(plane, m + k) - border*size,
+               (char *) IMAGE_PLANE_ROW(plane,
+                                        plane->rowReflection[border + k]) -
+                   border*size,
+               (n + 2*border)*size);
+    }
+}
+
+/*  Set the border of the plane to zero */
+void clearImagePlaneBorder(ImagePlane *plane)
+{
+    int m = plane->numRows, n = plane->numColumns;
+    int border = plane->border, size = plane->elementSize;
+    int i;
+
+    for (i = -border; i < m + border; i++) {
+        char *row = (char *) IMAGE_PLANE_ROW(plane, i);
+        if ((i < 0) || (i >= m)) {
+            memset(row - border*size, 0, (n + 2*border)*size);
+        }
+        else {
+            memset(row - border*size, 0, border*size);
+            memset(row + n*size, 0, border*size);
+        }
+    }
+}
@@ -36,8 +36,68 @@ at The University of Texas at Austin, and can be reached at
 
 #define FLOAT_TO_INT_OFFSET 0.5
 
+/* Rows of image planes start on boundaries of this many bytes */
+#define IMAGE_PLANE_ALIGNMENT 64
+
+/* Element types of image planes */
+#define IMAGE_PLANE_UINT8 1
+#define IMAGE_PLANE_INT16 2
+#define IMAGE_PLANE_INT32 3
+#define IMAGE_PLANE_FLOAT 4
+
+/*
+An image plane of numRows by numColumns elements surrounded by a border
+of border elements on every side.  Row i starts stride elements after
+row i - 1, so that elements (i, -border) through (i, numColumns +
+border - 1) are valid for rows -border through numRows + border - 1.
+Element (i, 0) of every row is aligned to IMAGE_PLANE_ALIGNMENT bytes
+if the element size divides it.
+The border lets filters read beyond the edges of the image without
+checking indices; it is filled by mirrorImagePlaneBorder or
+clearImagePlaneBorder after the interior has been written.  The
+reflection tables hold the interior row (column) copied into each
+border row (column): entry k for k < border is the source of row -1 - k,
+and entry border + k is the source of row numRows + k.  They are
+recomputed only when the size of the plane changes.
+*/
+typedef struct ImagePlane {
+    int elementType;            /* IMAGE_PLANE_UINT8, ... */
+    int elementSize;            /* bytes per element */
+    int numLanes;               /* interleaved values per element */
+    int numRows;                /* current size, at most maxRows */
+    int numColumns;             /* current size, at most maxColumns */
+    int maxRows;
+    int maxColumns;
+    int border;
+    int stride;                 /* elements from one row to the next */
+    size_t numBytes;            /* size of the block at memory */
+    void* memory;               /* block returned by trackedMalloc */
+    void* origin;               /* element (0, 0) */
+    int* rowReflection;         /* rows mirrored into the border */
+    int* columnReflection;      /* columns mirrored into the border */
+} ImagePlane;
+
+/* Address of the first element of row i, which may be in the border */
+#define IMAGE_PLANE_ROW(plane, i) \
+    ((void *) ((char *) (plane)->origin + \
+               (long) (i) * (plane)->stride * (plane)->elementSize))
+#define FLOAT_PLANE_ROW(plane, i) ((float *) IMAGE_PLANE_ROW(plane, i))
+#define BYTE_PLANE_ROW(plane, i) ((unsigned char *) IMAGE_PLANE_ROW(plane, i))
+
 /*  Allocate a float matrix */
 float **allocateFloatMatrix(int height, int width);
 int freeFloatMatrix(float **floatMatrix);
 
+/*  Allocate an image plane */
+ImagePlane *allocateImagePlane(int elementType, int maxRows, int maxColumns,
+                               int border);
+ImagePlane *allocateLaneImagePlane(int elementType, int numLanes,
+                                   int maxRows, int maxColumns, int border);
+void freeImagePlane(ImagePlane *plane);
+int setImagePlaneSize(ImagePlane *plane, int numRows, int numColumns);
+int reflectIndex(int index, int size);
+void mirrorImagePlaneRowSides(ImagePlane *plane, int i);
+void mirrorImagePlaneBorder(ImagePlane *plane);
+void clearImagePlaneBorder(ImagePlane *plane);
+
 #endif
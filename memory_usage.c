@@ -0,0 +1,152 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+/*
+Accounting of the heap memory held by the image planes, the image
+buffers and the other large blocks of the programs, so that the memory
+given to a worker can be set from measured numbers.  Every block is
+preceded by a header that records its size, so a block must be
+released by trackedFree and never by free.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "memory_usage.h"
+
+/* Header size that keeps the block aligned as malloc aligns it */
+#define TRACKED_HEADER_SIZE 16
+
+static MemoryUsage memoryUsage;
+static pthread_mutex_t memoryUsageLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Allocate numBytes, or return a null pointer, like malloc */
+void* trackedMalloc(size_t numBytes)
+{
+    char* block = (char*) malloc(numBytes + TRACKED_HEADER_SIZE);
+
+    if (block == 0) {
+        return(0);
+    }
+    *(size_t*) block = numBytes;
+    pthread_mutex_lock(&memoryUsageLock);
+    memoryUsage.liveBytes += numBytes;
+    if (memoryUsage.liveBytes > memoryUsage.peakBytes) {
+        memoryUsage.peakBytes = memoryUsage.liveBytes;
+    }
+    if (memoryUsage.liveBytes > memoryUsage.intervalPeakBytes) {
+        memoryUsage.intervalPeakBytes = memoryUsage.liveBytes;
+    }
+    if (memoryUsage.liveBytes > memoryUsage.imagePeakBytes) {
+        memoryUsage.imagePeakBytes = memoryUsage.liveBytes;
+    }
+    memoryUsage.numAllocations++;
+    pthread_mutex_unlock(&memoryUsageLock);
+    return(block + TRACKED_HEADER_SIZE);
+}
+
+/* Allocate numElements cleared elements, like calloc */
+void* trackedCalloc(size_t numElements, size_t elementSize)
+{
+    void* block;
+
+    if ((elementSize != 0) && (numElements > (size_t) -1 / elementSize)) {
+        return(0);
+    }
+    block = trackedMalloc(numElements * elementSize);
+    if (block != 0) {
+        memset(block, 0, numElements * elementSize);
+    }
+    return(block);
+}
+
+/* Release a block from trackedMalloc or trackedCalloc */
+void trackedFree(void* block)
+{
+    char* start;
+
+    if (block == 0) {
+        return;
+    }
+    start = (char*) block - TRACKED_HEADER_SIZE;
+    pthread_mutex_lock(&memoryUsageLock);
+    memoryUsage.liveBytes -= *(size_t*) start;
+    pthread_mutex_unlock(&memoryUsageLock);
+    free(start);
+}
+
+void getMemoryUsage(MemoryUsage* usage)
+{
+    pthread_mutex_lock(&memoryUsageLock);
+    *usage = memoryUsage;
+    pthread_mutex_unlock(&memoryUsageLock);
+}
+
+/*
+Start an interval, such as a stage of the algorithm, over which
+memoryIntervalPeak measures the peak
+*/
+void startMemoryInterval(void)
+{
+    pthread_mutex_lock(&memoryUsageLock);
+    memoryUsage.intervalPeakBytes = memoryUsage.liveBytes;
+    pthread_mutex_unlock(&memoryUsageLock);
+}
+
+size_t memoryIntervalPeak(void)
+{
+    size_t peakBytes;
+
+    pthread_mutex_lock(&memoryUsageLock);
+    peakBytes = memoryUsage.intervalPeakBytes;
+    pthread_mutex_unlock(&memoryUsageLock);
+    return(peakBytes);
+}
+
+/*
+Start the processing of an image of a batch, over which imageMemoryPeak
+measures the peak.  It is kept apart from the interval so that the
+stages measured within the image do not restart it.
+*/
+void startImageMemory(void)
+{
+    pthread_mutex_lock(&memoryUsageLock);
+    memoryUsage.imagePeakBytes = memoryUsage.liveBytes;
+    pthread_mutex_unlock(&memoryUsageLock);
+}
+
+size_t imageMemoryPeak(void)
+{
+    size_t peakBytes;
+
+    pthread_mutex_lock(&memoryUsageLock);
+    peakBytes = memoryUsage.imagePeakBytes;
+    pthread_mutex_unlock(&memoryUsageLock);
+    return(peakBytes);
+}
+
+void printMemoryUsage(FILE* file, char* name, MemoryUsage* usage)
+{
+    fprintf(file, "%s: %.2f MB live, %.2f MB peak, %ld allocations\n",
+            name, usage->liveBytes / 1048576.0, usage->peakBytes / 1048576.0,
+            usage->numAllocations);
+}
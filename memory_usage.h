@@ -0,0 +1,49 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+#ifndef _MEMORY_USAGE_H
+#define _MEMORY_USAGE_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+Heap memory allocated through trackedMalloc and trackedCalloc and not
+yet released by trackedFree, over all threads: the bytes live now, the
+most live since the start, the most live since startMemoryInterval and
+since startImageMemory, and the number of allocations made.
+*/
+typedef struct MemoryUsage {
+    size_t liveBytes;
+    size_t peakBytes;
+    size_t intervalPeakBytes;
+    size_t imagePeakBytes;
+    long numAllocations;
+} MemoryUsage;
+
+void* trackedMalloc(size_t numBytes);
+void* trackedCalloc(size_t numElements, size_t elementSize);
+void trackedFree(void* block);
+void getMemoryUsage(MemoryUsage* usage);
+void startMemoryInterval(void);
+size_t memoryIntervalPeak(void);
+void startImageMemory(void);
+size_t imageMemoryPeak(void);
+void printMemoryUsage(FILE* file, char* name, MemoryUsage* usage);
+
+#endif
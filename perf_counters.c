@@ -0,0 +1,216 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+/*
+Hardware performance counters for finding out whether a stage is bound
+by computation, by the caches or by mispredicted branches.  The counts
+are reported as instructions per cycle (IPC), cycles and cache misses
+per pixel, and the fraction of branches mispredicted.  Only user-space
+events of the calling thread are counted.  Where perf_event_open is
+not available, no counter opens and openPerfCounters returns a null
+pointer.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "perf_counters.h"
+
+#ifdef __linux__
+
+/* Open a counter of the calling thread for one event; -1 on failure */
+static int openPerfEvent(unsigned int type, uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return((int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+/*
+Open the counters.  Returns a null pointer if no event can be counted,
+for example on a virtual machine without a performance monitoring unit.
+*/
+PerfCounters* openPerfCounters(void)
+{
+    static unsigned int types[NUM_PERF_COUNTERS] = {
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+        PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE
+    };
+    static uint64_t configs[NUM_PERF_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+            (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_INSTRUCTIONS,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    PerfCounters* counters = (PerfCounters*) malloc(sizeof(PerfCounters));
+    int k;
+
+    if (counters == 0) {
+        return(0);
+    }
+    counters->availableMask = 0;
+    for (k = 0; k < NUM_PERF_COUNTERS; k++) {
+        counters->fd[k] = openPerfEvent(types[k], configs[k]);
+        if (counters->fd[k] >= 0) {
+            counters->availableMask |= 1 << k;
+        }
+    }
+    if (counters->availableMask == 0) {
+        free(counters);
+        return(0);
+    }
+    return(counters);
+}
+
+void closePerfCounters(PerfCounters* counters)
+{
+    int k;
+
+    if (counters == 0) {
+        return;
+    }
+    for (k = 0; k < NUM_PERF_COUNTERS; k++) {
+        if (counters->fd[k] >= 0) {
+            close(counters->fd[k]);
+        }
+    }
+    free(counters);
+}
+
+/*
+Read the counts so far.  When the kernel has had to share the hardware
+among more events than it can count at once, each count is scaled up
+by the fraction of the time the event was actually counted.
+*/
+void readPerfCounters(PerfCounters* counters,
+                      double counts[NUM_PERF_COUNTERS])
+{
+    uint64_t values[3];         /* count, time enabled, time running */
+    int k;
+
+    for (k = 0; k < NUM_PERF_COUNTERS; k++) {
+        counts[k] = 0.0;
+        if ((counters->fd[k] >= 0) &&
+            (read(counters->fd[k], values, sizeof(values)) ==
+             sizeof(values))) {
+            counts[k] = (double) values[0];
+            if ((values[2] > 0) && (values[2] < values[1])) {
+                counts[k] *= (double) values[1] / values[2];
+            }
+        }
+    }
+}
+
+#else
+
+PerfCounters* openPerfCounters(void)
+{
+    return(0);
+}
+
+void closePerfCounters(PerfCounters* counters)
+{
+}
+
+void readPerfCounters(PerfCounters* counters,
+                      double counts[NUM_PERF_COUNTERS])
+{
+    int k;
+    for (k = 0; k < NUM_PERF_COUNTERS; k++) {
+        counts[k] = 0.0;
+    }
+}
+
+#endif
+
+void printPerfCountersHeader(FILE* file)
+{
+    fprintf(file, "%-10s %8s %8s %8s %8s %10s\n", "stage", "IPC",
+            "cyc/pix", "L1D/pix", "LLC/pix", "br miss %");
+}
+
+/* Print one line of counts for numPixels pixels; n/a for missing events */
+void printPerfCounters(FILE* file, char* name,
+                       double counts[NUM_PERF_COUNTERS], double numPixels,
+                       int availableMask)
+{
+    int cyclesMask = 1 << PERF_CYCLES;
+    int ipcMask = cyclesMask | (1 << PERF_INSTRUCTIONS);
+    int branchMask = (1 << PERF_BRANCHES) | (1 << PERF_BRANCH_MISSES);
+
+    if (numPixels <= 0.0) {
+        numPixels = 1.0;
+    }
+    fprintf(file, "%-10s", name);
+    if (((availableMask & ipcMask) == ipcMask) &&
+        (counts[PERF_CYCLES] > 0.0)) {
+        fprintf(file, " %8.2f",
+                counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES]);
+    }
+    else {
+        fprintf(file, " %8s", "n/a");
+    }
+    if (availableMask & cyclesMask) {
+        fprintf(file, " %8.2f", counts[PERF_CYCLES] / numPixels);
+    }
+    else {
+        fprintf(file, " %8s", "n/a");
+    }
+    if (availableMask & (1 << PERF_L1D_MISSES)) {
+        fprintf(file, " %8.4f", counts[PERF_L1D_MISSES] / numPixels);
+    }
+    else {
+        fprintf(file, " %8s", "n/a");
+    }
+    if (availableMask & (1 << PERF_LLC_MISSES)) {
+        fprintf(file, " %8.4f", counts[PERF_LLC_MISSES] / numPixels);
+    }
+    else {
+        fprintf(file, " %8s", "n/a");
+    }
+    if (((availableMask & branchMask) == branchMask) &&
+        (counts[PERF_BRANCHES] > 0.0)) {
+        fprintf(file, " %10.2f",
+                100.0 * counts[PERF_BRANCH_MISSES] / counts[PERF_BRANCHES]);
+    }
+    else {
+        fprintf(file, " %10s", "n/a");
+    }
+    fprintf(file, "\n");
+}
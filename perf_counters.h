@@ -0,0 +1,52 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+#ifndef _PERF_COUNTERS_H
+#define _PERF_COUNTERS_H
+
+#include <stdio.h>
+
+/* Hardware events counted by PerfCounters */
+#define PERF_CYCLES             0
+#define PERF_INSTRUCTIONS       1
+#define PERF_L1D_MISSES         2       /* level 1 data cache read misses */
+#define PERF_LLC_MISSES         3       /* last level cache misses */
+#define PERF_BRANCHES           4
+#define PERF_BRANCH_MISSES      5
+#define NUM_PERF_COUNTERS       6
+
+/*
+Hardware performance counters of the calling thread, from the Linux
+perf_event_open system call.  Events that the processor or the kernel
+does not support have a file descriptor of -1 and always read as 0.
+*/
+typedef struct PerfCounters {
+    int fd[NUM_PERF_COUNTERS];
+    int availableMask;          /* bit k set if event k is counted */
+} PerfCounters;
+
+PerfCounters* openPerfCounters(void);
+void closePerfCounters(PerfCounters* counters);
+void readPerfCounters(PerfCounters* counters,
+                      double counts[NUM_PERF_COUNTERS]);
+void printPerfCountersHeader(FILE* file);
+void printPerfCounters(FILE* file, char* name,
+                       double counts[NUM_PERF_COUNTERS], double numPixels,
+                       int availableMask);
+
+#endif
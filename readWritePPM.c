@@ -340,6 +340,15 @@ ReadPPMFileHeader(chan, widthPtr, heightPtr, maxIntensityPtr)
     if (fread(&c, 1, 1, chan) != 1) {
 	return 0;
     }
+
+    /*
+     * Every header starts with "P", so a raw image is recognized
+     * without scanning its pixels for white space.
+     */
+
+    if (c != 'P') {
+	return 0;
+    }
     firstInLine = 1;
     i = 0;
     for (numFields = 0; numFields < 4; numFields++) {
@@ -0,0 +1,223 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+/*
+The recursive Gaussian filter is explained in the following paper:
+
+  I. T. Young and L. J. van Vliet, ``Recursive Implementation of the
+    Gaussian Filter,'' Signal Processing, vol. 44, pp. 139-151, 1995.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "matrix_utils.h"
+#include "recursive_gaussian.h"
+
+/*
+Compute the coefficients of the recursive filter for standard deviation
+sigma, which is raised to MIN_RECURSIVE_GAUSSIAN_SIGMA if smaller.  The
+lines are padded by four standard deviations, beyond which the Gaussian
+is negligible, plus the three outputs the recursion looks back on.
+*/
+void initRecursiveGaussian(RecursiveGaussian* filter, double sigma)
+{
+    double q, b0, b1, b2, b3;
+
+    if (sigma < MIN_RECURSIVE_GAUSSIAN_SIGMA) {
+        sigma = MIN_RECURSIVE_GAUSSIAN_SIGMA;
+    }
+    if (sigma >= 2.5) {
+        q = 0.98711*sigma - 0.96330;
+    }
+    else {
+        q = 3.97156 - 4.14554*sqrt(1.0 - 0.26891*sigma);
+    }
+    b0 = 1.57825 + 2.44413*q + 1.4281*q*q + 0.422205*q*q*q;
+    b1 = 2.44413*q + 2.85619*q*q + 1.26661*q*q*q;
+    b2 = -(1.4281*q*q + 1.26661*q*q*q);
+    b3 = 0.422205*q*q*q;
+
+    filter->sigma = sigma;
+    filter->a1 = (float) (b1/b0);
+    filter->a2 = (float) (b2/b0);
+    filter->a3 = (float) (b3/b0);
+    filter->b = (float) (1.0 - (b1 + b2 + b3)/b0);
+    filter->padding = (int) ceil(4.0*sigma) + 3;
+}
+
+/*
+Allocate the buffer used by recursiveGaussianImagePlane for filters
+whose padding is at most maxPadding, on images of up to maxColumns
+columns.  Returns a null pointer if memory could not be allocated.
+*/
+ImagePlane* allocateRecursiveGaussianBuffer(int maxPadding, int maxColumns)
+{
+    if (maxColumns < maxPadding) {
+        maxColumns = maxPadding;
+    }
+    return(allocateImagePlane(IMAGE_PLANE_FLOAT, maxPadding + 3,
+                              maxColumns, 0));
+}
+
+/*
+Filter one row of n pixels in place, forward then backward.  The
+mirrored pixels beyond the end of the row are saved in tail before the
+forward pass overwrites them.
+*/
+static void filterRow(float* x, int n, RecursiveGaussian* filter,
+                      float* tail)
+{
+    float b = filter->b, a1 = filter->a1, a2 = filter->a2, a3 = filter->a3;
+    int padding = filter->padding;
+    float w, w1, w2, w3;
+    int j, k;
+
+    for (k = 0; k < padding; k++) {
+        tail[k] = x[reflectIndex(n + k, n)];
+    }
+
+    /* Forward, starting in the steady state of the first padding pixel */
+    w1 = w2 = w3 = x[reflectIndex(-padding, n)];
+    for (k = padding - 1; k >= 1; k--) {
+        w = b*x[reflectIndex(-k, n)] + a1*w1 + a2*w2 + a3*w3;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+    for (j = 0; j < n; j++) {
+        w = b*x[j] + a1*w1 + a2*w2 + a3*w3;
+        x[j] = w;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+    for (k = 0; k < padding; k++) {
+        w = b*tail[k] + a1*w1 + a2*w2 + a3*w3;
+        tail[k] = w;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+
+    /* Backward, starting in the steady state of the last padding pixel */
+    w1 = w2 = w3 = tail[padding - 1];
+    for (k = padding - 2; k >= 0; k--) {
+        w = b*tail[k] + a1*w1 + a2*w2 + a3*w3;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+    for (j = n - 1; j >= 0; j--) {
+        w = b*x[j] + a1*w1 + a2*w2 + a3*w3;
+        x[j] = w;
+        w3 = w2; w2 = w1; w1 = w;
+    }
+}
+
+/*
+One step of the recursion for a whole row of n pixels: dest = b times
+source plus a1, a2 and a3 times the last three output rows, the most
+recent first.  The loop runs across the columns, so it vectorizes.
+dest may be source or the oldest output row.
+*/
+static void filterStep(float* dest, float* source, float** previous,
+                       RecursiveGaussian* filter, int n)
+{
+    float b = filter->b, a1 = filter->a1, a2 = filter->a2, a3 = filter->a3;
+    float *p1 = previous[0], *p2 = previous[1], *p3 = previous[2];
+    int j;
+
+    for (j = 0; j < n; j++) {
+        dest[j] = b*source[j] + a1*p1[j] + a2*p2[j] + a3*p3[j];
+    }
+    previous[2] = p2;
+    previous[1] = p1;
+    previous[0] = dest;
+}
+
+/*
+Filter the columns of the plane in place, a row at a time.  The first
+padding rows of buffer keep the mirrored rows beyond the last row, and
+its last three rows the outputs before the first row and after the
+padding.
+*/
+static void filterColumns(ImagePlane* plane, RecursiveGaussian* filter,
+                          ImagePlane* buffer)
+{
+    int m = plane->numRows, n = plane->numColumns;
+    int padding = filter->padding;
+    float *previous[3], *state[3];
+    float *row, *firstRow;
+    int i, k;
+
+    for (k = 0; k < padding; k++) {
+        memcpy(FLOAT_PLANE_ROW(buffer, k),
+               FLOAT_PLANE_ROW(plane, reflectIndex(m + k, m)),
+               n*sizeof(float));
+    }
+
+    /* Forward, starting in the steady state of the first padding row */
+    firstRow = FLOAT_PLANE_ROW(plane, reflectIndex(-padding, m));
+    for (k = 0; k < 3; k++) {
+        state[k] = FLOAT_PLANE_ROW(buffer, padding + k);
+        memcpy(state[k], firstRow, n*sizeof(float));
+        previous[k] = state[k];
+    }
+    for (k = padding - 1; k >= 1; k--) {
+        filterStep(previous[2], FLOAT_PLANE_ROW(plane, reflectIndex(-k, m)),
+                   previous, filter, n);
+    }
+    for (i = 0; i < m; i++) {
+        row = FLOAT_PLANE_ROW(plane, i);
+        filterStep(row, row, previous, filter, n);
+    }
+    for (k = 0; k < padding; k++) {
+        row = FLOAT_PLANE_ROW(buffer, k);
+        filterStep(row, row, previous, filter, n);
+    }
+
+    /* Backward, starting in the steady state of the last padding row */
+    for (k = 0; k < 3; k++) {
+        memcpy(state[k], FLOAT_PLANE_ROW(buffer, padding - 1),
+               n*sizeof(float));
+        previous[k] = state[k];
+    }
+    for (k = padding - 2; k >= 0; k--) {
+        row = FLOAT_PLANE_ROW(buffer, k);
+        filterStep(row, row, previous, filter, n);
+    }
+    for (i = m - 1; i >= 0; i--) {
+        row = FLOAT_PLANE_ROW(plane, i);
+        filterStep(row, row, previous, filter, n);
+    }
+}
+
+/*
+Filter the numRows by numColumns pixels of the plane in place with the
+recursive Gaussian filter, along the rows and then along the columns.
+The buffer must have been allocated for a padding at least as large as
+that of the filter.  The border of the plane is not touched.
+*/
+void recursiveGaussianImagePlane(ImagePlane* plane, RecursiveGaussian* filter,
+                                 ImagePlane* buffer)
+{
+    float *tail = FLOAT_PLANE_ROW(buffer, 0);
+    int i;
+
+    for (i = 0; i < plane->numRows; i++) {
+        filterRow(FLOAT_PLANE_ROW(plane, i), plane->numColumns, filter, tail);
+    }
+    filterColumns(plane, filter, buffer);
+}
@@ -0,0 +1,50 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+#ifndef _RECURSIVE_GAUSSIAN_H
+#define _RECURSIVE_GAUSSIAN_H
+
+#include "matrix_utils.h"
+
+/* Smallest standard deviation the recursive filter approximates well */
+#define MIN_RECURSIVE_GAUSSIAN_SIGMA 0.5
+
+/*
+Coefficients of the recursive approximation of a Gaussian filter of
+standard deviation sigma by I. T. Young and L. J. van Vliet: a causal
+third-order filter run forward along a line, then the same filter run
+backward.  Each output is b times the input plus a1, a2 and a3 times
+the last three outputs, so the cost per pixel does not depend on sigma.
+The image is extended by mirroring padding pixels beyond each end of a
+line, as for the FIR filters.
+*/
+typedef struct RecursiveGaussian {
+    double sigma;
+    float b;
+    float a1;
+    float a2;
+    float a3;
+    int padding;
+} RecursiveGaussian;
+
+void initRecursiveGaussian(RecursiveGaussian* filter, double sigma);
+ImagePlane* allocateRecursiveGaussianBuffer(int maxPadding, int maxColumns);
+void recursiveGaussianImagePlane(ImagePlane* plane, RecursiveGaussian* filter,
+                                 ImagePlane* buffer);
+
+#endif
@@ -0,0 +1,109 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "reorder_buffer.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* Initialize an empty buffer for up to capacity outstanding items */
+int initReorderBuffer(ReorderBuffer* buffer, int capacity)
+{
+    if (capacity < 1) capacity = 1;
+    buffer->items = (void**) malloc(capacity * sizeof(void*));
+    buffer->filled = (char*) calloc(capacity, 1);
+    if ((buffer->items == 0) || (buffer->filled == 0)) {
+        free(buffer->items);
+        free(buffer->filled);
+        return FALSE;
+    }
+    buffer->capacity = capacity;
+    buffer->nextSequence = 0;
+    pthread_mutex_init(&buffer->lock, 0);
+    pthread_cond_init(&buffer->ready, 0);
+    pthread_cond_init(&buffer->space, 0);
+    return TRUE;
+}
+
+void destroyReorderBuffer(ReorderBuffer* buffer)
+{
+    pthread_mutex_destroy(&buffer->lock);
+    pthread_cond_destroy(&buffer->ready);
+    pthread_cond_destroy(&buffer->space);
+    free(buffer->items);
+    free(buffer->filled);
+    buffer->items = 0;
+    buffer->filled = 0;
+}
+
+/* Wait until item number sequence may be put into the buffer */
+void waitReorderBuffer(ReorderBuffer* buffer, int sequence)
+{
+    pthread_mutex_lock(&buffer->lock);
+    while (sequence >= buffer->nextSequence + buffer->capacity) {
+        pthread_cond_wait(&buffer->space, &buffer->lock);
+    }
+    pthread_mutex_unlock(&buffer->lock);
+}
+
+/* Put item number sequence, waiting until there is room for it */
+void putReorderBuffer(ReorderBuffer* buffer, int sequence, void* item)
+{
+    int slot;
+
+    pthread_mutex_lock(&buffer->lock);
+    while (sequence >= buffer->nextSequence + buffer->capacity) {
+        pthread_cond_wait(&buffer->space, &buffer->lock);
+    }
+    slot = sequence % buffer->capacity;
+    buffer->items[slot] = item;
+    buffer->filled[slot] = TRUE;
+    if (sequence == buffer->nextSequence) {
+        pthread_cond_signal(&buffer->ready);
+    }
+    pthread_mutex_unlock(&buffer->lock);
+}
+
+/* Take the next item in order, waiting until it has been put */
+void* takeReorderBuffer(ReorderBuffer* buffer)
+{
+    void* item;
+    int slot;
+
+    pthread_mutex_lock(&buffer->lock);
+    slot = buffer->nextSequence % buffer->capacity;
+    while (!buffer->filled[slot]) {
+        pthread_cond_wait(&buffer->ready, &buffer->lock);
+    }
+    item = buffer->items[slot];
+    buffer->filled[slot] = FALSE;
+    buffer->nextSequence++;
+    pthread_cond_broadcast(&buffer->space);
+    pthread_mutex_unlock(&buffer->lock);
+    return(item);
+}
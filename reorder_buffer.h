@@ -0,0 +1,47 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _REORDER_BUFFER_H
+#define _REORDER_BUFFER_H
+
+#include <pthread.h>
+
+/*
+A bounded buffer that takes items numbered 0, 1, 2, ... in any order
+and gives them back in the order of their numbers, for writing results
+in order when they are finished out of order.  At most capacity
+numbers, from the next to be taken onwards, may be outstanding;
+waitReorderBuffer blocks the producer of a later number, which bounds
+the number of items in flight.  A null item marks the end.
+*/
+typedef struct ReorderBuffer {
+    void** items;
+    char* filled;
+    int capacity;
+    int nextSequence;           /* number of the next item to take */
+    pthread_mutex_t lock;
+    pthread_cond_t ready;       /* the next item has been put */
+    pthread_cond_t space;       /* an item has been taken */
+} ReorderBuffer;
+
+int initReorderBuffer(ReorderBuffer* buffer, int capacity);
+void destroyReorderBuffer(ReorderBuffer* buffer);
+void waitReorderBuffer(ReorderBuffer* buffer, int sequence);
+void putReorderBuffer(ReorderBuffer* buffer, int sequence, void* item);
+void* takeReorderBuffer(ReorderBuffer* buffer);
+
+#endif
@@ -0,0 +1,209 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "row_queue.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/*
+Times a waiting side reads the other side's counter before it sleeps
+until the other side wakes it up, which it must do when both sides
+share one core
+*/
+#define ROW_QUEUE_SPINS 64
+
+/*
+The counters are read and written with the atomic builtins of GCC:
+a row is published with a release store after its slots are written,
+and the other side reads the counter with an acquire load before it
+touches the slots, so that it sees the rows as they were written.  The
+stores are sequentially consistent, as is the count of sleeping sides,
+so that a side about to sleep sees either the new counter or the other
+side sees it asleep and wakes it.
+*/
+#define STORE_COUNTER(counter, value) \
+    __atomic_store_n(&(counter), (value), __ATOMIC_SEQ_CST)
+
+/* Initialize an empty queue of numSlots rows, to which planes are added */
+void initRowQueue(RowQueue* queue, int numSlots)
+{
+    int k;
+
+    for (k = 0; k < MAX_ROW_QUEUE_PLANES; k++) {
+        queue->planes[k] = 0;
+    }
+    queue->numPlanes = 0;
+    queue->numSlots = numSlots;
+    queue->cancelled = FALSE;
+    queue->numSleeping = 0;
+    queue->published = 0;
+    queue->released = 0;
+    pthread_mutex_init(&queue->lock, 0);
+    pthread_cond_init(&queue->wakeup, 0);
+}
+
+/*
+Add a plane of numSlots rows of up to maxColumns elements with the
+given border to every slot of the queue.  Returns the plane, or a null
+pointer if memory could not be allocated.
+*/
+ImagePlane* addRowQueuePlane(RowQueue* queue, int elementType,
+                             int maxColumns, int border)
+{
+    ImagePlane* plane;
+
+    if (queue->numPlanes == MAX_ROW_QUEUE_PLANES) {
+        return(0);
+    }
+    plane = allocateImagePlane(elementType, queue->numSlots, maxColumns,
+                               border);
+    if (plane != 0) {
+        queue->planes[queue->numPlanes++] = plane;
+    }
+    return(plane);
+}
+
+void destroyRowQueue(RowQueue* queue)
+{
+    int k;
+
+    for (k = 0; k < queue->numPlanes; k++) {
+        freeImagePlane(queue->planes[k]);
+        queue->planes[k] = 0;
+    }
+    queue->numPlanes = 0;
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->wakeup);
+}
+
+/*
+Empty the queue for an image of numColumns columns.  Must not be
+called while either side is using the queue.  Returns FALSE if the
+planes are too narrow.
+*/
+int resetRowQueue(RowQueue* queue, int numColumns)
+{
+    int k;
+
+    for (k = 0; k < queue->numPlanes; k++) {
+        if (!setImagePlaneSize(queue->planes[k], queue->numSlots,
+                               numColumns)) {
+            return FALSE;
+        }
+    }
+    queue->cancelled = FALSE;
+    queue->published = 0;
+    queue->released = 0;
+    return TRUE;
+}
+
+/*
+Wait until *counter is at least value, spinning for a while and then
+sleeping.  Returns FALSE if the queue is cancelled first.
+*/
+static int waitForCounter(RowQueue* queue, volatile int* counter, int value)
+{
+    int spins;
+
+    for (spins = 0; spins < ROW_QUEUE_SPINS; spins++) {
+        if (__atomic_load_n(counter, __ATOMIC_ACQUIRE) >= value) {
+            return TRUE;
+        }
+        if (queue->cancelled) {
+            return FALSE;
+        }
+    }
+
+    pthread_mutex_lock(&queue->lock);
+    __atomic_add_fetch(&queue->numSleeping, 1, __ATOMIC_SEQ_CST);
+    while ((__atomic_load_n(counter, __ATOMIC_SEQ_CST) < value) &&
+           !queue->cancelled) {
+        pthread_cond_wait(&queue->wakeup, &queue->lock);
+    }
+    __atomic_sub_fetch(&queue->numSleeping, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&queue->lock);
+    return(__atomic_load_n(counter, __ATOMIC_ACQUIRE) >= value);
+}
+
+/* Wake up the other side if it sleeps, after a counter has moved */
+static void wakeOtherSide(RowQueue* queue)
+{
+    if (__atomic_load_n(&queue->numSleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&queue->lock);
+        pthread_cond_broadcast(&queue->wakeup);
+        pthread_mutex_unlock(&queue->lock);
+    }
+}
+
+/*
+Producer: wait until the slot of row is free, that is, until the
+consumer has released the row numSlots rows above it.  Returns FALSE
+if the queue is cancelled.
+*/
+int waitRowQueueSpace(RowQueue* queue, int row)
+{
+    return(waitForCounter(queue, &queue->released,
+                          row - queue->numSlots + 1));
+}
+
+/* Producer: make the first numRows rows visible to the consumer */
+void publishRowQueueRows(RowQueue* queue, int numRows)
+{
+    STORE_COUNTER(queue->published, numRows);
+    wakeOtherSide(queue);
+}
+
+/*
+Consumer: wait until the first numRows rows are published.  Returns
+FALSE if the queue is cancelled.
+*/
+int waitRowQueueRows(RowQueue* queue, int numRows)
+{
+    return(waitForCounter(queue, &queue->published, numRows));
+}
+
+/*
+Consumer: give the slots of the first numRows rows back to the
+producer.  Releasing fewer rows than before has no effect.
+*/
+void releaseRowQueueRows(RowQueue* queue, int numRows)
+{
+    if (numRows > queue->released) {
+        STORE_COUNTER(queue->released, numRows);
+        wakeOtherSide(queue);
+    }
+}
+
+/* Make both sides stop waiting, for when the other side cannot run */
+void cancelRowQueue(RowQueue* queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    queue->cancelled = TRUE;
+    pthread_cond_broadcast(&queue->wakeup);
+    pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,77 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _ROW_QUEUE_H
+#define _ROW_QUEUE_H
+
+#include <pthread.h>
+
+#include "matrix_utils.h"
+
+/* Most planes of rows that a row queue passes together */
+#define MAX_ROW_QUEUE_PLANES 3
+
+/*
+A queue of the rows of an image, passed in order from one producer
+thread to one consumer thread without locks while neither waits.
+Row i of every plane of the queue is held in slot i % numSlots, so the
+planes are rings of numSlots rows.  The producer and the consumer share only two counters,
+each written by one side: the number of rows published by the
+producer, and the number of rows that the consumer has released and
+whose slots may be overwritten.  A consumer may keep a window of rows,
+such as the rows a filter reads, by releasing only those above it.
+The counters are on cache lines of their own, so the two sides do not
+contend for the same line while they work on different rows.  A side
+that has waited a while for the other sleeps on the condition variable
+of the queue, and the other side wakes it when it moves its counter;
+the lock is taken only when a side is asleep.
+*/
+typedef struct RowQueue {
+    ImagePlane* planes[MAX_ROW_QUEUE_PLANES];
+    int numPlanes;
+    int numSlots;
+    volatile int cancelled;     /* set to make both sides stop waiting */
+    volatile int numSleeping;   /* sides waiting on wakeup */
+    pthread_mutex_t lock;       /* guards sleeping */
+    pthread_cond_t wakeup;
+    char producerLine[IMAGE_PLANE_ALIGNMENT];
+    volatile int published;     /* written by the producer */
+    char consumerLine[IMAGE_PLANE_ALIGNMENT];
+    volatile int released;      /* written by the consumer */
+    char endLine[IMAGE_PLANE_ALIGNMENT];
+} RowQueue;
+
+/* Address of row i of plane k of the queue, and the index of its slot */
+#define ROW_QUEUE_SLOT(queue, i) ((i) % (queue)->numSlots)
+#define ROW_QUEUE_ROW(queue, k, i) \
+    IMAGE_PLANE_ROW((queue)->planes[k], ROW_QUEUE_SLOT(queue, i))
+#define FLOAT_ROW_QUEUE_ROW(queue, k, i) ((float *) ROW_QUEUE_ROW(queue, k, i))
+#define BYTE_ROW_QUEUE_ROW(queue, k, i) \
+    ((unsigned char *) ROW_QUEUE_ROW(queue, k, i))
+
+void initRowQueue(RowQueue* queue, int numSlots);
+ImagePlane* addRowQueuePlane(RowQueue* queue, int elementType,
+                             int maxColumns, int border);
+void destroyRowQueue(RowQueue* queue);
+int resetRowQueue(RowQueue* queue, int numColumns);
+int waitRowQueueSpace(RowQueue* queue, int row);
+void publishRowQueueRows(RowQueue* queue, int numRows);
+int waitRowQueueRows(RowQueue* queue, int numRows);
+void releaseRowQueueRows(RowQueue* queue, int numRows);
+void cancelRowQueue(RowQueue* queue);
+
+#endif
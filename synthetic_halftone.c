@@ -0,0 +1,124 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Synthetic halftones for timing the inverse halftoning algorithms
+without test images: a smooth image of gradients and ripples,
+halftoned by error diffusion or by dispersed or clustered dot ordered
+dither.  The fixed pattern makes every run see the same data.
+*/
+
+/* Standard includes */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "inverse_halftone.h"
+#include "synthetic_halftone.h"
+#include "memory_usage.h"
+
+/* Bayer's dispersed dot and a clustered dot ordered dither matrix */
+static int dispersedDither[16] = {
+     0,  8,  2, 10,
+    12,  4, 14,  6,
+     3, 11,  1,  9,
+    15,  7, 13,  5
+};
+static int clusteredDither[16] = {
+    12,  5,  6, 13,
+     4,  0,  1,  7,
+    11,  3,  2,  8,
+    15, 10,  9, 14
+};
+
+/* Grey level of the synthetic image in row i and column j */
+static float syntheticGrey(int i, int j, int numColumns)
+{
+    return(128.0 + 90.0 * sin(0.031 * i) * cos(0.047 * j) +
+           30.0 * (j - numColumns / 2) / numColumns);
+}
+
+/* Floyd-Steinberg error diffusion of the synthetic image */
+static void errorDiffuse(unsigned char* halftone, int numRows,
+                         int numColumns)
+{
+    float* error = (float *) trackedCalloc(2 * (numColumns + 2),
+                                           sizeof(float));
+    float* thisRow = error + 1;
+    float* nextRow = error + numColumns + 3;
+    int i, j;
+
+    for (i = 0; i < numRows; i++) {
+        float* temp;
+        for (j = 0; j < numColumns; j++) {
+            float value = syntheticGrey(i, j, numColumns);
+            float quantized;
+            value += thisRow[j];
+            quantized = (value < 128.0) ? 0.0 : 255.0;
+            halftone[i*numColumns + j] = (unsigned char) quantized;
+            value -= quantized;
+            thisRow[j+1] += value * 7.0 / 16.0;
+            nextRow[j-1] += value * 3.0 / 16.0;
+            nextRow[j] += value * 5.0 / 16.0;
+            nextRow[j+1] += value * 1.0 / 16.0;
+        }
+        temp = thisRow;
+        thisRow = nextRow;
+        nextRow = temp;
+        memset(nextRow - 1, 0, (numColumns + 2) * sizeof(float));
+    }
+    trackedFree(error);
+}
+
+/* Ordered dither of the synthetic image with a 4 by 4 matrix */
+static void orderedDither(unsigned char* halftone, int numRows,
+                          int numColumns, int* matrix)
+{
+    int i, j;
+
+    for (i = 0; i < numRows; i++) {
+        for (j = 0; j < numColumns; j++) {
+            float level = (matrix[(i & 3)*4 + (j & 3)] + 0.5) * 16.0;
+            halftone[i*numColumns + j] =
+                (syntheticGrey(i, j, numColumns) < level) ? 0 : 255;
+        }
+    }
+}
+
+/*
+Fill halftone with a numRows by numColumns halftone of the synthetic
+image, as 0 and 255, by the method halftoningType, one of
+HALFTONING_BY_ERROR_DIFFUSION, HALFTONING_BY_DISPERED_DITHER and
+HALFTONING_BY_CLUSTERED_DITHER.  Error diffusion is used for any
+other value.
+*/
+void makeSyntheticHalftone(unsigned char* halftone, int numRows,
+                           int numColumns, int halftoningType)
+{
+    switch (halftoningType) {
+      case HALFTONING_BY_DISPERED_DITHER:
+        orderedDither(halftone, numRows, numColumns, dispersedDither);
+        break;
+      case HALFTONING_BY_CLUSTERED_DITHER:
+        orderedDither(halftone, numRows, numColumns, clusteredDither);
+        break;
+      default:
+        errorDiffuse(halftone, numRows, numColumns);
+        break;
+    }
+}
@@ -0,0 +1,294 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+A work-stealing task scheduler.  Each worker thread runs the tasks of
+its own deque, newest first, and when that is empty steals the oldest
+task of another worker, visiting the others in turn starting from its
+neighbour.  A task may submit further tasks to its own worker's deque,
+so a large piece of work split into subtasks is spread over the
+workers that run out of work of their own, while the others keep
+running the tasks they started.
+
+The number of tasks submitted but not yet taken is kept in one counter.
+A worker that finds no task sleeps only after announcing itself in the
+count of sleeping workers and seeing no queued task, and submitTask
+counts its task before looking for sleeping workers to wake, so a task
+is never left queued while every worker sleeps.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "task_scheduler.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define INITIAL_DEQUE_CAPACITY 64
+
+static int initTaskDeque(TaskDeque* deque)
+{
+    deque->tasks = (ScheduledTask*)
+        malloc(INITIAL_DEQUE_CAPACITY * sizeof(ScheduledTask));
+    if (deque->tasks == 0) {
+        return FALSE;
+    }
+    deque->capacity = INITIAL_DEQUE_CAPACITY;
+    deque->head = 0;
+    deque->count = 0;
+    pthread_mutex_init(&deque->lock, 0);
+    return TRUE;
+}
+
+static void destroyTaskDeque(TaskDeque* deque)
+{
+    if (deque->tasks == 0) {
+        return;
+    }
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->tasks);
+    deque->tasks = 0;
+}
+
+/* Add a task as the newest of deque, growing it if it is full */
+static int pushTaskDeque(TaskDeque* deque, SchedulerTask task, void* arg)
+{
+    ScheduledTask* slot;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        int capacity = 2 * deque->capacity, i;
+        ScheduledTask* tasks =
+            (ScheduledTask*) malloc(capacity * sizeof(ScheduledTask));
+        if (tasks == 0) {
+            pthread_mutex_unlock(&deque->lock);
+            return FALSE;
+        }
+        for (i = 0; i < deque->count; i++) {
+            tasks[i] = deque->tasks[(deque->head + i) % deque->capacity];
+        }
+        free(deque->tasks);
+        deque->tasks = tasks;
+        deque->capacity = capacity;
+        deque->head = 0;
+    }
+    slot = &deque->tasks[(deque->head + deque->count) % deque->capacity];
+    slot->task = task;
+    slot->arg = arg;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+    return TRUE;
+}
+
+/* Take the newest task of deque if newest is TRUE, or else the oldest */
+static int popTaskDeque(TaskDeque* deque, int newest, ScheduledTask* taskPtr)
+{
+    int found = FALSE;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        if (newest) {
+            *taskPtr = deque->tasks[(deque->head + deque->count - 1) %
+                                    deque->capacity];
+        }
+        else {
+            *taskPtr = deque->tasks[deque->head];
+            deque->head = (deque->head + 1) % deque->capacity;
+        }
+        deque->count--;
+        found = TRUE;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return(found);
+}
+
+/* Take a task from the deque of worker, or steal one from another */
+static int findTask(TaskWorker* worker, ScheduledTask* taskPtr)
+{
+    TaskScheduler* scheduler = worker->scheduler;
+    int k;
+
+    if (popTaskDeque(&worker->deque, TRUE, taskPtr)) {
+        return TRUE;
+    }
+    for (k = 1; k < scheduler->numWorkers; k++) {
+        TaskWorker* victim = &scheduler->workers[(worker->workerIndex + k) %
+                                                 scheduler->numWorkers];
+        if (popTaskDeque(&victim->deque, FALSE, taskPtr)) {
+            __atomic_add_fetch(&worker->numStolen, 1, __ATOMIC_RELAXED);
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static void* runTaskWorker(void* arg)
+{
+    TaskWorker* worker = (TaskWorker*) arg;
+    TaskScheduler* scheduler = worker->scheduler;
+    ScheduledTask task;
+
+    for (;;) {
+        int stopping;
+
+        if (findTask(worker, &task)) {
+            __atomic_sub_fetch(&scheduler->numQueued, 1, __ATOMIC_SEQ_CST);
+            task.task(task.arg, worker->workerIndex);
+            __atomic_add_fetch(&worker->numTasks, 1, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        /* Sleep until a task is queued or the scheduler stops */
+        pthread_mutex_lock(&scheduler->lock);
+        __atomic_add_fetch(&scheduler->numSleeping, 1, __ATOMIC_SEQ_CST);
+        while ((__atomic_load_n(&scheduler->numQueued,
+                                __ATOMIC_SEQ_CST) <= 0) &&
+               !scheduler->stopping) {
+            pthread_cond_wait(&scheduler->wakeup, &scheduler->lock);
+        }
+        __atomic_sub_fetch(&scheduler->numSleeping, 1, __ATOMIC_SEQ_CST);
+        stopping = scheduler->stopping &&
+                   (__atomic_load_n(&scheduler->numQueued,
+                                    __ATOMIC_SEQ_CST) <= 0);
+        pthread_mutex_unlock(&scheduler->lock);
+        if (stopping) {
+            break;
+        }
+    }
+    return(0);
+}
+
+/*
+Start a scheduler with numWorkers worker threads.  Returns a null
+pointer if memory could not be allocated or no thread could be
+started.  The tasks given to a worker whose thread could not be
+started are stolen by the others.
+*/
+TaskScheduler* createTaskScheduler(int numWorkers)
+{
+    TaskScheduler* scheduler =
+        (TaskScheduler*) calloc(1, sizeof(TaskScheduler));
+    int numStarted = 0, i;
+
+    if (scheduler == 0) {
+        return(0);
+    }
+    if (numWorkers < 1) numWorkers = 1;
+    scheduler->workers = (TaskWorker*) calloc(numWorkers, sizeof(TaskWorker));
+    if (scheduler->workers == 0) {
+        free(scheduler);
+        return(0);
+    }
+    scheduler->numWorkers = numWorkers;
+    pthread_mutex_init(&scheduler->lock, 0);
+    pthread_cond_init(&scheduler->wakeup, 0);
+    for (i = 0; i < numWorkers; i++) {
+        TaskWorker* worker = &scheduler->workers[i];
+        worker->scheduler = scheduler;
+        worker->workerIndex = i;
+        if (!initTaskDeque(&worker->deque)) {
+            destroyTaskScheduler(scheduler);
+            return(0);
+        }
+    }
+    for (i = 0; i < numWorkers; i++) {
+        TaskWorker* worker = &scheduler->workers[i];
+        worker->started = (pthread_create(&worker->thread, 0, runTaskWorker,
+                                          worker) == 0);
+        if (worker->started) numStarted++;
+    }
+    if (numStarted == 0) {
+        destroyTaskScheduler(scheduler);
+        return(0);
+    }
+    return(scheduler);
+}
+
+/* Run the tasks still queued, stop the workers and free the scheduler */
+void destroyTaskScheduler(TaskScheduler* scheduler)
+{
+    int i;
+
+    if (scheduler == 0) {
+        return;
+    }
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stopping = TRUE;
+    pthread_cond_broadcast(&scheduler->wakeup);
+    pthread_mutex_unlock(&scheduler->lock);
+    for (i = 0; i < scheduler->numWorkers; i++) {
+        if (scheduler->workers[i].started) {
+            pthread_join(scheduler->workers[i].thread, 0);
+        }
+        destroyTaskDeque(&scheduler->workers[i].deque);
+    }
+    pthread_mutex_destroy(&scheduler->lock);
+    pthread_cond_destroy(&scheduler->wakeup);
+    free(scheduler->workers);
+    free(scheduler);
+}
+
+/*
+Queue task to be run with arg.  A task running on a worker passes its
+workerIndex, to queue the new task on its own worker's deque; other
+threads pass -1, and their tasks are dealt to the workers in turn.
+Returns FALSE if memory could not be allocated to queue the task.
+*/
+int submitTask(TaskScheduler* scheduler, int workerIndex,
+               SchedulerTask task, void* arg)
+{
+    if ((workerIndex < 0) || (workerIndex >= scheduler->numWorkers)) {
+        unsigned int next = __atomic_fetch_add(&scheduler->nextWorker, 1,
+                                               __ATOMIC_RELAXED);
+        workerIndex = (int) (next % scheduler->numWorkers);
+    }
+    if (!pushTaskDeque(&scheduler->workers[workerIndex].deque, task, arg)) {
+        return FALSE;
+    }
+    __atomic_add_fetch(&scheduler->numQueued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&scheduler->numSleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&scheduler->lock);
+        pthread_cond_signal(&scheduler->wakeup);
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+    return TRUE;
+}
+
+/* Total the tasks run by the workers so far, and how many were stolen */
+void getTaskSchedulerStats(TaskScheduler* scheduler,
+                           int* numTasksPtr, int* numStolenPtr)
+{
+    int i;
+
+    *numTasksPtr = 0;
+    *numStolenPtr = 0;
+    for (i = 0; i < scheduler->numWorkers; i++) {
+        TaskWorker* worker = &scheduler->workers[i];
+        *numTasksPtr += __atomic_load_n(&worker->numTasks, __ATOMIC_RELAXED);
+        *numStolenPtr += __atomic_load_n(&worker->numStolen,
+                                         __ATOMIC_RELAXED);
+    }
+}
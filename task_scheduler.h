@@ -0,0 +1,83 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _TASK_SCHEDULER_H
+#define _TASK_SCHEDULER_H
+
+#include <pthread.h>
+
+/*
+Task run by a worker of a task scheduler.  The workerIndex, from 0 to
+numWorkers - 1, identifies the worker running the task, so that tasks
+can use per-worker workspaces without locking them.
+*/
+typedef void (*SchedulerTask)(void* arg, int workerIndex);
+
+typedef struct ScheduledTask {
+    SchedulerTask task;
+    void* arg;
+} ScheduledTask;
+
+/*
+The tasks waiting to run on one worker, as a growable ring.  The worker
+takes its newest task, whose data is most likely still in its cache,
+while idle workers steal the oldest, which for tasks that split their
+work into subtasks is the largest.  Each deque has a lock of its own,
+so workers contend only when one steals from another.
+*/
+typedef struct TaskDeque {
+    ScheduledTask* tasks;
+    int capacity;
+    int head;                   /* oldest task */
+    int count;
+    pthread_mutex_t lock;
+} TaskDeque;
+
+typedef struct TaskWorker {
+    struct TaskScheduler* scheduler;
+    pthread_t thread;
+    int workerIndex;
+    int started;
+    TaskDeque deque;
+    int numTasks;               /* tasks run, updated by the worker */
+    int numStolen;              /* of which stolen from other workers */
+} TaskWorker;
+
+/*
+A fixed set of worker threads running tasks, each from its own deque
+and, when that is empty, stolen from the others.  Workers with nothing
+to run or steal sleep until a task is submitted.
+*/
+typedef struct TaskScheduler {
+    TaskWorker* workers;
+    int numWorkers;
+    unsigned int nextWorker;    /* deque for the next outside task */
+    volatile int numQueued;     /* tasks submitted but not yet taken */
+    volatile int numSleeping;
+    volatile int stopping;
+    pthread_mutex_t lock;       /* guards sleeping and stopping */
+    pthread_cond_t wakeup;
+} TaskScheduler;
+
+TaskScheduler* createTaskScheduler(int numWorkers);
+void destroyTaskScheduler(TaskScheduler* scheduler);
+int submitTask(TaskScheduler* scheduler, int workerIndex,
+               SchedulerTask task, void* arg);
+void getTaskSchedulerStats(TaskScheduler* scheduler,
+                           int* numTasksPtr, int* numStolenPtr);
+
+#endif
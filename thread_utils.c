@@ -0,0 +1,87 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "thread_utils.h"
+
+typedef struct ParallelChunk {
+    pthread_t thread;
+    ParallelTask task;
+    void* arg;
+    int first;
+    int last;
+    int chunkIndex;
+} ParallelChunk;
+
+static void* runParallelChunk(void* arg)
+{
+    ParallelChunk* chunk = (ParallelChunk*) arg;
+    chunk->task(chunk->arg, chunk->first, chunk->last, chunk->chunkIndex);
+    return(0);
+}
+
+/*
+Split the items 0 through numItems - 1 into numThreads contiguous
+chunks and run task on each chunk in its own thread; the calling thread
+takes the first chunk.  Returns the number of chunks, which is at most
+numThreads and at most numItems, so callers can size per-chunk results
+by numThreads.
+*/
+int parallelFor(int numItems, int numThreads, ParallelTask task, void* arg)
+{
+    ParallelChunk* chunks;
+    int numChunks = numThreads, i;
+
+    if (numChunks > numItems) numChunks = numItems;
+    if (numChunks < 1) numChunks = 1;
+
+    chunks = (numChunks > 1) ?
+             (ParallelChunk*) malloc(numChunks * sizeof(ParallelChunk)) : 0;
+    if (chunks == 0) {
+        task(arg, 0, numItems, 0);
+        return(1);
+    }
+
+    for (i = 0; i < numChunks; i++) {
+        chunks[i].task = task;
+        chunks[i].arg = arg;
+        chunks[i].first = (int) ((long long) numItems * i / numChunks);
+        chunks[i].last = (int) ((long long) numItems * (i + 1) / numChunks);
+        chunks[i].chunkIndex = i;
+    }
+    for (i = 1; i < numChunks; i++) {
+        if (pthread_create(&chunks[i].thread, 0, runParallelChunk,
+                           &chunks[i]) != 0) {
+            /* Run the chunk here if no thread could be started */
+            chunks[i].task = 0;
+            task(arg, chunks[i].first, chunks[i].last, i);
+        }
+    }
+    task(arg, chunks[0].first, chunks[0].last, 0);
+    for (i = 1; i < numChunks; i++) {
+        if (chunks[i].task != 0) {
+            pthread_join(chunks[i].thread, 0);
+        }
+    }
+    free(chunks);
+    return(numChunks);
+}
@@ -0,0 +1,30 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _THREAD_UTILS_H
+#define _THREAD_UTILS_H
+
+/*
+Task run by parallelFor on the items first through last - 1.  The
+chunkIndex identifies the chunk of items, from 0 to numChunks - 1, so
+that tasks can keep per-chunk partial results.
+*/
+typedef void (*ParallelTask)(void* arg, int first, int last, int chunkIndex);
+
+int parallelFor(int numItems, int numThreads, ParallelTask task, void* arg);
+
+#endif
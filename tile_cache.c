@@ -0,0 +1,413 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+/*
+Cache of inverse halftoned tiles for workloads with many repeated or
+near-identical halftones, such as re-scans and forms sharing the same
+background.  A tile is looked up by a hash of the tile plus its halo
+(see inverseHalftoneSupport) and the parameters, so identical tiles in
+the same or in different images are inverse halftoned only once.
+Because the halo holds every pixel that the tile depends on, a cached
+tile is identical to computing it again.
+
+In memory, the tiles form a hash table of TILE_CACHE_BUCKETS chains
+and a list from the most to the least recently used tile.  In the
+directory, each tile is a file named after its hash, holding its key,
+its halo and its output; the directory is never trimmed.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "memory_usage.h"
+#include "tile_cache.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define MAX_TILE_FILE_NAME_LENGTH 1024
+
+/* 64-bit FNV-1a hash */
+#define FNV_OFFSET_BASIS 14695981039346656037UL
+#define FNV_PRIME 1099511628211UL
+
+static unsigned long hashBytes(unsigned long hash,
+                               unsigned char* bytes, size_t length)
+{
+    size_t i;
+    for (i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * FNV_PRIME;
+    }
+    return(hash);
+}
+
+/*
+Allocate a cache holding up to maxBytes of tiles in memory and, unless
+directory is a null pointer, any number of tiles in directory.
+Returns a null pointer if memory could not be allocated.
+*/
+TileCache* allocateTileCache(size_t maxBytes, char* directory)
+{
+    TileCache* cache = (TileCache*) calloc(1, sizeof(TileCache));
+
+    if (cache == 0) {
+        return(0);
+    }
+    cache->maxBytes = maxBytes;
+    if (directory != 0) {
+        cache->directory = (char*) malloc(strlen(directory) + 1);
+        if (cache->directory == 0) {
+            free(cache);
+            return(0);
+        }
+        strcpy(cache->directory, directory);
+    }
+    pthread_mutex_init(&cache->lock, 0);
+    return(cache);
+}
+
+void freeTileCache(TileCache* cache)
+{
+    TileCacheEntry* entry;
+
+    if (cache == 0) {
+        return;
+    }
+    while ((entry = cache->oldest) != 0) {
+        cache->oldest = entry->newer;
+        trackedFree(entry);
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->directory);
+    free(cache);
+}
+
+/* Fill in key for the tile at (firstRow, firstColumn) of input */
+void makeTileKey(TileKey* key, unsigned char* input,
+                 int inputRows, int inputColumns,
+                 int firstRow, int firstColumn, int tileRows, int tileColumns,
+                 int halftoningType, int gain, int threshold)
+{
+    int fields[9];
+
+    key->input = input;
+    key->inputRows = inputRows;
+    key->inputColumns = inputColumns;
+    key->firstRow = firstRow;
+    key->firstColumn = firstColumn;
+    key->tileRows = tileRows;
+    key->tileColumns = tileColumns;
+    key->halftoningType = halftoningType;
+    key->gain = gain;
+    key->threshold = threshold;
+    fields[0] = inputRows;
+    fields[1] = inputColumns;
+    fields[2] = firstRow;
+    fields[3] = firstColumn;
+    fields[4] = tileRows;
+    fields[5] = tileColumns;
+    fields[6] = halftoningType;
+    fields[7] = gain;
+    fields[8] = threshold;
+    key->hash = hashBytes(FNV_OFFSET_BASIS, (unsigned char*) fields,
+                          sizeof(fields));
+    key->hash = hashBytes(key->hash, input,
+                          (size_t) inputRows * inputColumns);
+}
+
+/* Whether the keys a and b are the same apart from their hashes */
+static int sameTileKey(TileKey* a, TileKey* b)
+{
+    return((a->inputRows == b->inputRows) &&
+           (a->inputColumns == b->inputColumns) &&
+           (a->firstRow == b->firstRow) &&
+           (a->firstColumn == b->firstColumn) &&
+           (a->tileRows == b->tileRows) &&
+           (a->tileColumns == b->tileColumns) &&
+           (a->halftoningType == b->halftoningType) &&
+           (a->gain == b->gain) &&
+           (a->threshold == b->threshold) &&
+           (memcmp(a->input, b->input,
+                   (size_t) a->inputRows * a->inputColumns) == 0));
+}
+
+/* Copy tileRows rows of tileColumns pixels between strided images */
+static void copyTile(unsigned char* to, int toStride,
+                     unsigned char* from, int fromStride,
+                     int tileRows, int tileColumns)
+{
+    int i;
+    for (i = 0; i < tileRows; i++) {
+        memcpy(to + (size_t) i*toStride, from + (size_t) i*fromStride,
+               tileColumns);
+    }
+}
+
+/* Take entry out of the list of tiles by use */
+static void unlinkEntry(TileCache* cache, TileCacheEntry* entry)
+{
+    if (entry->newer != 0) entry->newer->older = entry->older;
+    else cache->newest = entry->older;
+    if (entry->older != 0) entry->older->newer = entry->newer;
+    else cache->oldest = entry->newer;
+}
+
+/* Put entry at the most recently used end of the list */
+static void linkNewestEntry(TileCache* cache, TileCacheEntry* entry)
+{
+    entry->newer = 0;
+    entry->older = cache->newest;
+    if (cache->newest != 0) cache->newest->newer = entry;
+    else cache->oldest = entry;
+    cache->newest = entry;
+}
+
+/* Find the entry for key; call with the lock held */
+static TileCacheEntry* findEntry(TileCache* cache, TileKey* key)
+{
+    TileCacheEntry* entry = cache->buckets[key->hash % TILE_CACHE_BUCKETS];
+
+    while ((entry != 0) &&
+           ((entry->key.hash != key->hash) ||
+            !sameTileKey(&entry->key, key))) {
+        entry = entry->hashNext;
+    }
+    return(entry);
+}
+
+/* Drop the least recently used entry; call with the lock held */
+static void evictOldestEntry(TileCache* cache)
+{
+    TileCacheEntry* entry = cache->oldest;
+    TileCacheEntry** link = &cache->buckets[entry->key.hash %
+                                            TILE_CACHE_BUCKETS];
+
+    while (*link != entry) {
+        link = &(*link)->hashNext;
+    }
+    *link = entry->hashNext;
+    unlinkEntry(cache, entry);
+    cache->numBytes -= entry->size;
+    cache->evictions++;
+    trackedFree(entry);
+}
+
+/* Keep a copy of the tile in memory, dropping old tiles to make room */
+static void storeMemoryTile(TileCache* cache, TileKey* key,
+                            unsigned char* output, int outputStride)
+{
+    size_t inputSize = (size_t) key->inputRows * key->inputColumns;
+    size_t size = sizeof(TileCacheEntry) + inputSize +
+                  (size_t) key->tileRows * key->tileColumns;
+    TileCacheEntry* entry;
+
+    if (size > cache->maxBytes) {
+        return;
+    }
+    entry = (TileCacheEntry*) trackedMalloc(size);
+    if (entry == 0) {
+        return;
+    }
+    entry->key = *key;
+    entry->key.input = (unsigned char*) (entry + 1);
+    entry->output = entry->key.input + inputSize;
+    entry->size = size;
+    memcpy(entry->key.input, key->input, inputSize);
+    copyTile(entry->output, key->tileColumns, output, outputStride,
+             key->tileRows, key->tileColumns);
+
+    pthread_mutex_lock(&cache->lock);
+    if (findEntry(cache, key) != 0) {
+        /* Another thread got there first */
+        trackedFree(entry);
+    }
+    else {
+        while (cache->numBytes + size > cache->maxBytes) {
+            evictOldestEntry(cache);
+        }
+        entry->hashNext = cache->buckets[key->hash % TILE_CACHE_BUCKETS];
+        cache->buckets[key->hash % TILE_CACHE_BUCKETS] = entry;
+        linkNewestEntry(cache, entry);
+        cache->numBytes += size;
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static void tileFileName(char* buffer, TileCache* cache, TileKey* key)
+{
+    sprintf(buffer, "%.*s/%016lx.tile", MAX_TILE_FILE_NAME_LENGTH - 32,
+            cache->directory, key->hash);
+}
+
+static void writeTileFileHeader(FILE* file, TileKey* key)
+{
+    fprintf(file, "IHTILE %d %d %d %d %d %d %d %d %d\n",
+            key->inputRows, key->inputColumns,
+            key->firstRow, key->firstColumn,
+            key->tileRows, key->tileColumns,
+            key->halftoningType, key->gain, key->threshold);
+}
+
+/*
+Read the tile for key from the directory into output.  Returns TRUE if
+the directory holds a tile with the same key.
+*/
+static int readDiskTile(TileCache* cache, TileKey* key,
+                        unsigned char* output, int outputStride)
+{
+    char fileName[MAX_TILE_FILE_NAME_LENGTH];
+    TileKey fileKey;
+    FILE* file;
+    int i, found;
+
+    tileFileName(fileName, cache, key);
+    file = fopen(fileName, "rb");
+    if (file == 0) {
+        return(FALSE);
+    }
+    fileKey.input = (unsigned char*) malloc((size_t) key->inputRows *
+                                            key->inputColumns);
+    found = (fileKey.input != 0) &&
+            (fscanf(file, "IHTILE %d %d %d %d %d %d %d %d %d",
+                    &fileKey.inputRows, &fileKey.inputColumns,
+                    &fileKey.firstRow, &fileKey.firstColumn,
+                    &fileKey.tileRows, &fileKey.tileColumns,
+                    &fileKey.halftoningType, &fileKey.gain,
+                    &fileKey.threshold) == 9) &&
+            (fgetc(file) == '\n') &&
+            (fileKey.inputRows == key->inputRows) &&
+            (fileKey.inputColumns == key->inputColumns) &&
+            (fread(fileKey.input, 1,
+                   (size_t) key->inputRows * key->inputColumns, file) ==
+             (size_t) key->inputRows * key->inputColumns) &&
+            sameTileKey(&fileKey, key);
+    for (i = 0; found && (i < key->tileRows); i++) {
+        found = (fread(output + (size_t) i*outputStride, 1,
+                       key->tileColumns, file) ==
+                 (size_t) key->tileColumns);
+    }
+    free(fileKey.input);
+    fclose(file);
+    return(found);
+}
+
+/*
+Write the tile to the directory.  The file is written under a
+temporary name and then renamed, so that other threads and programs
+sharing the directory never see a partial tile.
+*/
+static void writeDiskTile(TileCache* cache, TileKey* key,
+                          unsigned char* output, int outputStride)
+{
+    char fileName[MAX_TILE_FILE_NAME_LENGTH];
+    char temporaryName[MAX_TILE_FILE_NAME_LENGTH + 32];
+    FILE* file;
+    int i, ok, temporary;
+
+    pthread_mutex_lock(&cache->lock);
+    temporary = cache->nextTemporary++;
+    pthread_mutex_unlock(&cache->lock);
+
+    tileFileName(fileName, cache, key);
+    sprintf(temporaryName, "%s.%ld.%d", fileName, (long) getpid(),
+            temporary);
+    file = fopen(temporaryName, "wb");
+    if (file == 0) {
+        return;
+    }
+    writeTileFileHeader(file, key);
+    ok = (fwrite(key->input, 1, (size_t) key->inputRows * key->inputColumns,
+                 file) == (size_t) key->inputRows * key->inputColumns);
+    for (i = 0; ok && (i < key->tileRows); i++) {
+        ok = (fwrite(output + (size_t) i*outputStride, 1, key->tileColumns,
+                     file) == (size_t) key->tileColumns);
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || (rename(temporaryName, fileName) != 0)) {
+        remove(temporaryName);
+    }
+}
+
+/*
+Look up the tile for key and, if it is cached, copy it to output, whose
+rows are outputStride pixels apart.  Returns TRUE on a hit.
+*/
+int lookupTileCache(TileCache* cache, TileKey* key,
+                    unsigned char* output, int outputStride)
+{
+    TileCacheEntry* entry;
+
+    pthread_mutex_lock(&cache->lock);
+    entry = findEntry(cache, key);
+    if (entry != 0) {
+        unlinkEntry(cache, entry);
+        linkNewestEntry(cache, entry);
+        copyTile(output, outputStride, entry->output, key->tileColumns,
+                 key->tileRows, key->tileColumns);
+        cache->hits++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    if (entry != 0) {
+        return(TRUE);
+    }
+
+    if ((cache->directory != 0) &&
+        readDiskTile(cache, key, output, outputStride)) {
+        storeMemoryTile(cache, key, output, outputStride);
+        pthread_mutex_lock(&cache->lock);
+        cache->hits++;
+        cache->diskHits++;
+        pthread_mutex_unlock(&cache->lock);
+        return(TRUE);
+    }
+
+    pthread_mutex_lock(&cache->lock);
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return(FALSE);
+}
+
+/* Add the newly computed tile for key, held in output, to the cache */
+void storeTileCache(TileCache* cache, TileKey* key,
+                    unsigned char* output, int outputStride)
+{
+    storeMemoryTile(cache, key, output, outputStride);
+    if (cache->directory != 0) {
+        writeDiskTile(cache, key, output, outputStride);
+    }
+}
+
+void printTileCacheStats(FILE* stream, TileCache* cache)
+{
+    long lookups = cache->hits + cache->misses;
+
+    fprintf(stream, "Tile cache: %ld hits (%ld from disk), %ld misses, "
+            "%.1f%% hit rate, %ld evicted, %.1f MB in memory\n",
+            cache->hits, cache->diskHits, cache->misses,
+            (lookups > 0) ? 100.0 * cache->hits / lookups : 0.0,
+            cache->evictions, cache->numBytes / 1048576.0);
+}
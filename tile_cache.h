@@ -0,0 +1,90 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+
+#ifndef _TILE_CACHE_H
+#define _TILE_CACHE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define DEFAULT_CACHE_TILE_SIZE 128
+#define TILE_CACHE_BUCKETS 4096
+
+/*
+Everything a cached tile depends on: the tile plus its halo as read
+from the halftone, where the tile lies in it, and the parameters.
+The hash covers all of it; the halo bytes are also compared on a hit,
+so a hash collision can never return the wrong tile.
+*/
+typedef struct TileKey {
+    unsigned long hash;
+    unsigned char* input;       /* tile plus halo */
+    int inputRows;
+    int inputColumns;
+    int firstRow;               /* position of the tile in the input */
+    int firstColumn;
+    int tileRows;
+    int tileColumns;
+    int halftoningType;
+    int gain;
+    int threshold;
+} TileKey;
+
+typedef struct TileCacheEntry {
+    TileKey key;                /* key.input points to a private copy */
+    unsigned char* output;      /* tileRows by tileColumns pixels */
+    size_t size;
+    struct TileCacheEntry* hashNext;
+    struct TileCacheEntry* newer;
+    struct TileCacheEntry* older;
+} TileCacheEntry;
+
+/*
+Inverse halftoned tiles kept in memory, up to maxBytes, with the least
+recently used tile dropped first, and optionally in a directory, where
+they outlive the program.  Safe to share among threads.
+*/
+typedef struct TileCache {
+    size_t maxBytes;
+    size_t numBytes;
+    char* directory;
+    TileCacheEntry* buckets[TILE_CACHE_BUCKETS];
+    TileCacheEntry* newest;
+    TileCacheEntry* oldest;
+    long hits;
+    long diskHits;              /* hits found in the directory */
+    long misses;
+    long evictions;
+    int nextTemporary;
+    pthread_mutex_t lock;
+} TileCache;
+
+TileCache* allocateTileCache(size_t maxBytes, char* directory);
+void freeTileCache(TileCache* cache);
+void makeTileKey(TileKey* key, unsigned char* input,
+                 int inputRows, int inputColumns,
+                 int firstRow, int firstColumn, int tileRows, int tileColumns,
+                 int halftoningType, int gain, int threshold);
+int lookupTileCache(TileCache* cache, TileKey* key,
+                    unsigned char* output, int outputStride);
+void storeTileCache(TileCache* cache, TileKey* key,
+                    unsigned char* output, int outputStride);
+void printTileCacheStats(FILE* stream, TileCache* cache);
+
+#endif
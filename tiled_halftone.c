@@ -0,0 +1,561 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Tiled inverse halftoning for images that are too large to process in
+one piece.  The image is cut into tiles; each tile is inverse halftoned
+together with a halo of neighbouring pixels as wide as the support of
+the whole pipeline (see inverseHalftoneSupport), and only the interior
+of the tile is kept.  Because the halo covers every pixel that an
+output pixel depends on, and tiles on the image border see the same
+mirrored boundary as the whole image, the result is identical to
+inverse halftoning the whole image at once.
+
+The memory needed is that of one tile plus halo per thread, whatever
+the size of the image.  inverseHalftoneFileTiled memory-maps the input
+and output files, so the image itself never has to fit in memory.
+Given a TileCache, tiles that were inverse halftoned before, in this
+image or an earlier one, are copied from the cache instead.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "inverse_halftone.h"
+#include "memory_usage.h"
+#include "readWriteImage.h"
+#include "readWritePPM.h"
+#include "tiled_halftone.h"
+#include "timer_utils.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+/* Tiles of one image shared out among the worker threads */
+typedef struct TiledJob {
+    unsigned char* inputImage;
+    unsigned char* outputImage;
+    int numRows;
+    int numColumns;
+    int gain;
+    int threshold;
+    int halftoningType;
+    int tileSize;
+    int numTileRows;
+    int numTileColumns;
+    int nextTile;
+    TileCache* cache;
+    double errorCode;
+    pthread_mutex_t lock;
+} TiledJob;
+
+/*
+Allocate a workspace for tiles of up to maxTileRows by maxTileColumns
+pixels.  Returns a null pointer if memory could not be allocated or
+the halftoning type is unknown.
+*/
+TileWorkspace* allocateTileWorkspace(int maxTileRows, int maxTileColumns,
+                                     int halftoningType)
+{
+    int maxRows, maxColumns;
+    TileWorkspace* tileWorkspace =
+        (TileWorkspace*) calloc(1, sizeof(TileWorkspace));
+
+    if (tileWorkspace == 0) {
+        return(0);
+    }
+    if (!inverseHalftoneSupport(halftoningType, &tileWorkspace->haloBefore,
+                                &tileWorkspace->haloAfter)) {
+        free(tileWorkspace);
+        return(0);
+    }
+    tileWorkspace->maxTileRows = maxTileRows;
+    tileWorkspace->maxTileColumns = maxTileColumns;
+    tileWorkspace->halftoningType = halftoningType;
+
+    maxRows = maxTileRows + tileWorkspace->haloBefore +
+              tileWorkspace->haloAfter;
+    maxColumns = maxTileColumns + tileWorkspace->haloBefore +
+                 tileWorkspace->haloAfter;
+    tileWorkspace->inputTile =
+        (unsigned char*) trackedMalloc((size_t) maxRows*maxColumns);
+    tileWorkspace->outputTile =
+        (unsigned char*) trackedMalloc((size_t) maxRows*maxColumns);
+    tileWorkspace->workspace = allocateInverseHalftoneWorkspace(maxRows,
+                                                                maxColumns);
+    if ((tileWorkspace->inputTile == 0) || (tileWorkspace->outputTile == 0) ||
+        (tileWorkspace->workspace == 0)) {
+        freeTileWorkspace(tileWorkspace);
+        return(0);
+    }
+    return(tileWorkspace);
+}
+
+void freeTileWorkspace(TileWorkspace* tileWorkspace)
+{
+    if (tileWorkspace == 0) {
+        return;
+    }
+    trackedFree(tileWorkspace->inputTile);
+    trackedFree(tileWorkspace->outputTile);
+    freeInverseHalftoneWorkspace(tileWorkspace->workspace);
+    free(tileWorkspace);
+}
+
+/*
+Inverse halftone the region of regionRows by regionColumns pixels whose
+upper left corner is at (firstRow, firstColumn) in the numRows by
+numColumns image inputImage.  Only the region and its halo are read.
+Row i of the result is stored at outputRegion + i*outputStride.  The
+result is identical to the corresponding pixels of inverse halftoning
+the whole image.  Returns 0.0, or a negative value on an error.
+*/
+double inverseHalftoneRegion(TileWorkspace* tileWorkspace,
+                             unsigned char* inputImage,
+                             int numRows, int numColumns,
+                             int firstRow, int firstColumn,
+                             int regionRows, int regionColumns,
+                             unsigned char* outputRegion, int outputStride,
+                             int gain, int threshold)
+{
+    int top, bottom, left, right, subRows, subColumns, i;
+    TileKey key;
+    double status;
+
+    if ((regionRows > tileWorkspace->maxTileRows) ||
+        (regionColumns > tileWorkspace->maxTileColumns)) {
+        return(INVERSE_HALFTONING_NO_MEMORY);
+    }
+
+    /* Clip the region plus halo to the image */
+    top = firstRow - tileWorkspace->haloBefore;
+    if (top < 0) top = 0;
+    bottom = firstRow + regionRows + tileWorkspace->haloAfter;
+    if (bottom > numRows) bottom = numRows;
+    left = firstColumn - tileWorkspace->haloBefore;
+    if (left < 0) left = 0;
+    right = firstColumn + regionColumns + tileWorkspace->haloAfter;
+    if (right > numColumns) right = numColumns;
+    subRows = bottom - top;
+    subColumns = right - left;
+
+    for (i = 0; i < subRows; i++) {
+        memcpy(tileWorkspace->inputTile + (size_t) i*subColumns,
+               inputImage + (size_t) (top + i)*numColumns + left,
+               subColumns);
+    }
+    if (tileWorkspace->cache != 0) {
+        makeTileKey(&key, tileWorkspace->inputTile, subRows, subColumns,
+                    firstRow - top, firstColumn - left,
+                    regionRows, regionColumns,
+                    tileWorkspace->halftoningType, gain, threshold);
+        if (lookupTileCache(tileWorkspace->cache, &key,
+                            outputRegion, outputStride)) {
+            return(0.0);
+        }
+    }
+
+    status = inverseHalftoneWithWorkspace(tileWorkspace->workspace,
+                                          tileWorkspace->inputTile,
+                                          tileWorkspace->outputTile,
+                                          subRows, subColumns,
+                                          gain, threshold, FALSE,
+                                          tileWorkspace->halftoningType);
+    if (status < 0.0) {
+        return(status);
+    }
+
+    /* Keep the interior of the tile */
+    for (i = 0; i < regionRows; i++) {
+        memcpy(outputRegion + (size_t) i*outputStride,
+               tileWorkspace->outputTile +
+                   (size_t) (firstRow - top + i)*subColumns +
+                   (firstColumn - left),
+               regionColumns);
+    }
+    if (tileWorkspace->cache != 0) {
+        storeTileCache(tileWorkspace->cache, &key,
+                       outputRegion, outputStride);
+    }
+    return(0.0);
+}
+
+/* Process tiles of job until there are none left */
+static void* tileWorker(void* arg)
+{
+    TiledJob* job = (TiledJob*) arg;
+    int numTiles = job->numTileRows * job->numTileColumns;
+    TileWorkspace* tileWorkspace = allocateTileWorkspace(job->tileSize,
+                                                         job->tileSize,
+                                                         job->halftoningType);
+
+    if (tileWorkspace != 0) {
+        tileWorkspace->cache = job->cache;
+    }
+    for (;;) {
+        int tile, firstRow, firstColumn, regionRows, regionColumns;
+        double status;
+
+        pthread_mutex_lock(&job->lock);
+        tile = job->nextTile++;
+        if (tileWorkspace == 0) {
+            job->errorCode = INVERSE_HALFTONING_NO_MEMORY;
+        }
+        if (job->errorCode < 0.0) {
+            tile = numTiles;
+        }
+        pthread_mutex_unlock(&job->lock);
+        if (tile >= numTiles) {
+            break;
+        }
+
+        firstRow = (tile / job->numTileColumns) * job->tileSize;
+        firstColumn = (tile % job->numTileColumns) * job->tileSize;
+        regionRows = job->numRows - firstRow;
+        if (regionRows > job->tileSize) regionRows = job->tileSize;
+        regionColumns = job->numColumns - firstColumn;
+        if (regionColumns > job->tileSize) regionColumns = job->tileSize;
+
+        status = inverseHalftoneRegion(tileWorkspace, job->inputImage,
+                                       job->numRows, job->numColumns,
+                                       firstRow, firstColumn,
+                                       regionRows, regionColumns,
+                                       job->outputImage +
+                                           (size_t) firstRow*job->numColumns +
+                                           firstColumn,
+                                       job->numColumns,
+                                       job->gain, job->threshold);
+        if (status < 0.0) {
+            pthread_mutex_lock(&job->lock);
+            job->errorCode = status;
+            pthread_mutex_unlock(&job->lock);
+        }
+    }
+
+    freeTileWorkspace(tileWorkspace);
+    return(0);
+}
+
+/*
+Inverse halftone inputImage into outputImage tile by tile, using tiles
+of tileSize by tileSize pixels spread over numThreads threads, and the
+cache unless it is a null pointer.  Returns the wall clock time taken,
+or a negative value on an error.
+*/
+double inverseHalftoneTiled(unsigned char* inputImage,
+                            unsigned char* outputImage,
+                            int numRows, int numColumns,
+                            int gain, int threshold, int halftoningType,
+                            int tileSize, int numThreads,
+                            TileCache* cache)
+{
+    TiledJob job;
+    pthread_t* threads = 0;
+    double startTime = currentTimeInSeconds();
+    int before, after, i;
+
+    if (!inverseHalftoneSupport(halftoningType, &before, &after)) {
+        return(INVERSE_HALFTONING_BAD_METHOD);
+    }
+    if (tileSize < 1) tileSize = DEFAULT_TILE_SIZE;
+    if (numThreads < 1) numThreads = 1;
+
+    memset(&job, 0, sizeof(job));
+    job.inputImage = inputImage;
+    job.outputImage = outputImage;
+    job.numRows = numRows;
+    job.numColumns = numColumns;
+    job.gain = gain;
+    job.threshold = threshold;
+    job.halftoningType = halftoningType;
+    job.tileSize = tileSize;
+    job.cache = cache;
+    job.numTileRows = (numRows + tileSize - 1) / tileSize;
+    job.numTileColumns = (numColumns + tileSize - 1) / tileSize;
+    if (numThreads > job.numTileRows * job.numTileColumns) {
+        numThreads = job.numTileRows * job.numTileColumns;
+    }
+    pthread_mutex_init(&job.lock, 0);
+
+    /* The calling thread is one of the workers */
+    if (numThreads > 1) {
+        threads = (pthread_t*) malloc((numThreads - 1) * sizeof(pthread_t));
+        if (threads == 0) {
+            numThreads = 1;
+        }
+    }
+    for (i = 0; i < numThreads - 1; i++) {
+        pthread_create(&threads[i], 0, tileWorker, &job);
+    }
+    tileWorker(&job);
+    for (i = 0; i < numThreads - 1; i++) {
+        pthread_join(threads[i], 0);
+    }
+    free(threads);
+    pthread_mutex_destroy(&job.lock);
+
+    if (job.errorCode < 0.0) {
+        return(job.errorCode);
+    }
+    return(currentTimeInSeconds() - startTime);
+}
+
+/*
+Inverse halftone the file halfFile into the file inverseFile tile by
+tile.  Both files are memory-mapped, so only the tiles being processed
+need to be in memory.  The input can be a raw image of *numRowsPtr by
+*numColumnsPtr pixels or a PGM file, and the output has the same format.
+The cache is used unless it is a null pointer.  Returns the wall clock
+time taken, or a negative value on an error.
+*/
+double inverseHalftoneFileTiled(char* halfFile, char* inverseFile,
+                                int* numRowsPtr, int* numColumnsPtr,
+                                int gain, int threshold, int halftoningType,
+                                int tileSize, int numThreads,
+                                TileCache* cache)
+{
+    FILE *inputFile = 0, *outputFile = 0;
+    struct stat inputInfo;
+    Tk_PhotoImageBlock block;
+    unsigned char *inputMap = 0, *outputMap = 0;
+    size_t imageSize, inputHeaderLength = 0, outputHeaderLength = 0;
+    int imageType, maxIntensity;
+    double status;
+
+    /* Find the image type, size and start of the pixel data */
+    inputFile = fopen(halfFile, "r");
+    if (inputFile == 0) {
+        fprintf(stderr, "Error opening file '%s' for reading.\n", halfFile);
+        return(INVERSE_HALFTONING_IO_ERROR);
+    }
+    imageType = ReadPPMFileHeader(inputFile, numColumnsPtr, numRowsPtr,
+                                  &maxIntensity);
+    switch (imageType) {
+      case RAW:
+        inputHeaderLength = 0;
+        break;
+
+      case PGM:
+        inputHeaderLength = ftell(inputFile);
+        break;
+
+      default:
+        fprintf(stderr,
+                "File '%s' is a color image, but color images "
+                "are currently not supported.\n",
+                halfFile);
+        fclose(inputFile);
+        return(INVERSE_HALFTONING_IO_ERROR);
+    }
+    imageSize = (size_t) *numRowsPtr * *numColumnsPtr;
+    if ((fstat(fileno(inputFile), &inputInfo) != 0) ||
+        ((size_t) inputInfo.st_size < inputHeaderLength + imageSize)) {
+        fprintf(stderr, "Error reading file '%s'.\n", halfFile);
+        fclose(inputFile);
+        return(INVERSE_HALFTONING_IO_ERROR);
+    }
+    inputMap = (unsigned char*) mmap(0, inputHeaderLength + imageSize,
+                                     PROT_READ, MAP_PRIVATE,
+                                     fileno(inputFile), 0);
+
+    /* Write the header and size the output file to hold the image */
+    outputFile = fopen(inverseFile, "w+");
+    if (outputFile == 0) {
+        fprintf(stderr, "Error opening file '%s' for writing.\n",
+                inverseFile);
+        fclose(inputFile);
+        return(INVERSE_HALFTONING_IO_ERROR);
+    }
+    if (imageType == PGM) {
+        InitImageInfo(&block, 0, PGM, *numColumnsPtr, *numRowsPtr);
+        FileWritePPMHeader(outputFile, &block);
+        fflush(outputFile);
+        outputHeaderLength = ftell(outputFile);
+    }
+    if (ftruncate(fileno(outputFile),
+                  (off_t) (outputHeaderLength + imageSize)) == 0) {
+        outputMap = (unsigned char*) mmap(0, outputHeaderLength + imageSize,
+                                          PROT_READ | PROT_WRITE, MAP_SHARED,
+                                          fileno(outputFile), 0);
+    }
+
+    if ((inputMap == (unsigned char*) MAP_FAILED) ||
+        (outputMap == 0) || (outputMap == (unsigned char*) MAP_FAILED)) {
+        fprintf(stderr, "Could not memory-map '%s' and '%s'.\n",
+                halfFile, inverseFile);
+        status = INVERSE_HALFTONING_IO_ERROR;
+    }
+    else {
+        status = inverseHalftoneTiled(inputMap + inputHeaderLength,
+                                      outputMap + outputHeaderLength,
+                                      *numRowsPtr, *numColumnsPtr,
+                                      gain, threshold, halftoningType,
+                                      tileSize, numThreads, cache);
+    }
+
+    if ((inputMap != 0) && (inputMap != (unsigned char*) MAP_FAILED)) {
+        munmap(inputMap, inputHeaderLength + imageSize);
+    }
+    if ((outputMap != 0) && (outputMap != (unsigned char*) MAP_FAILED)) {
+        munmap(outputMap, outputHeaderLength + imageSize);
+    }
+    fclose(inputFile);
+    fclose(outputFile);
+    return(status);
+}
+
+/*
+Inverse halftone the region of regionRows by regionColumns pixels whose
+upper left corner is at (firstRow, firstColumn) in the file halfFile,
+and write it to the file inverseFile.  Only the rows and columns of the
+region and its halo are read from the file, and the result is identical
+to the corresponding crop of inverse halftoning the whole image.  The
+input can be a raw image of *numRowsPtr by *numColumnsPtr pixels or a
+PGM file, and the output has the same format.  Returns the wall clock
+time taken, or a negative value on an error.
+*/
+double inverseHalftoneFileRegion(char* halfFile, char* inverseFile,
+                                 int* numRowsPtr, int* numColumnsPtr,
+                                 int firstRow, int firstColumn,
+                                 int regionRows, int regionColumns,
+                                 int gain, int threshold, int halftoningType)
+{
+    FILE *inputFile = 0, *outputFile = 0;
+    Tk_PhotoImageBlock block;
+    TileWorkspace* tileWorkspace = 0;
+    unsigned char *haloImage = 0, *outputRegion = 0;
+    long headerLength = 0;
+    int imageType, maxIntensity, top, bottom, left, right, i;
+    double startTime = currentTimeInSeconds();
+    double status = 0.0;
+
+    if (!inverseHalftoneSupport(halftoningType, &top, &bottom)) {
+        return(INVERSE_HALFTONING_BAD_METHOD);
+    }
+    inputFile = fopen(halfFile, "r");
+    if (inputFile == 0) {
+        fprintf(stderr, "Error opening file '%s' for reading.\n", halfFile);
+        return(INVERSE_HALFTONING_IO_ERROR);
+    }
+    imageType = ReadPPMFileHeader(inputFile, numColumnsPtr, numRowsPtr,
+                                  &maxIntensity);
+    if ((imageType != RAW) && (imageType != PGM)) {
+        fprintf(stderr,
+                "File '%s' is a color image, but color images "
+                "are currently not supported.\n",
+                halfFile);
+        fclose(inputFile);
+        return(INVERSE_HALFTONING_IO_ERROR);
+    }
+    if (imageType == PGM) {
+        headerLength = ftell(inputFile);
+    }
+    if ((firstRow + regionRows > *numRowsPtr) ||
+        (firstColumn + regionColumns > *numColumnsPtr)) {
+        fprintf(stderr, "The region does not fit in the %d by %d image "
+                "'%s'.\n", *numRowsPtr, *numColumnsPtr, halfFile);
+        fclose(inputFile);
+        return(INVERSE_HALFTONING_IO_ERROR);
+    }
+
+    tileWorkspace = allocateTileWorkspace(regionRows, regionColumns,
+                                          halftoningType);
+    if (tileWorkspace == 0) {
+        fclose(inputFile);
+        return(INVERSE_HALFTONING_NO_MEMORY);
+    }
+
+    /* Read the region plus halo, clipped to the image */
+    top = firstRow - tileWorkspace->haloBefore;
+    if (top < 0) top = 0;
+    bottom = firstRow + regionRows + tileWorkspace->haloAfter;
+    if (bottom > *numRowsPtr) bottom = *numRowsPtr;
+    left = firstColumn - tileWorkspace->haloBefore;
+    if (left < 0) left = 0;
+    right = firstColumn + regionColumns + tileWorkspace->haloAfter;
+    if (right > *numColumnsPtr) right = *numColumnsPtr;
+    haloImage = (unsigned char*) trackedMalloc((size_t) (bottom - top) *
+                                               (right - left));
+    outputRegion = (unsigned char*) trackedMalloc((size_t) regionRows *
+                                                  regionColumns);
+    if ((haloImage == 0) || (outputRegion == 0)) {
+        status = INVERSE_HALFTONING_NO_MEMORY;
+    }
+    for (i = top; (i < bottom) && (status == 0.0); i++) {
+        if ((fseek(inputFile, headerLength +
+                   (long) i * *numColumnsPtr + left, SEEK_SET) != 0) ||
+            (fread(haloImage + (size_t) (i - top)*(right - left), 1,
+                   right - left, inputFile) != (size_t) (right - left))) {
+            fprintf(stderr, "Error reading file '%s'.\n", halfFile);
+            status = INVERSE_HALFTONING_IO_ERROR;
+        }
+    }
+    fclose(inputFile);
+
+    /* The halo image has the image boundary wherever the halo was clipped */
+    if (status == 0.0) {
+        status = inverseHalftoneRegion(tileWorkspace, haloImage,
+                                       bottom - top, right - left,
+                                       firstRow - top, firstColumn - left,
+                                       regionRows, regionColumns,
+                                       outputRegion, regionColumns,
+                                       gain, threshold);
+    }
+
+    if (status == 0.0) {
+        outputFile = fopen(inverseFile, "w");
+        if (outputFile == 0) {
+            fprintf(stderr, "Error opening file '%s' for writing.\n",
+                    inverseFile);
+            status = INVERSE_HALFTONING_IO_ERROR;
+        }
+        else {
+            if (imageType == PGM) {
+                InitImageInfo(&block, 0, PGM, regionColumns, regionRows);
+                FileWritePPMHeader(outputFile, &block);
+            }
+            if ((fwrite(outputRegion, 1, (size_t) regionRows*regionColumns,
+                        outputFile) != (size_t) regionRows*regionColumns) ||
+                (fclose(outputFile) != 0)) {
+                fprintf(stderr, "Error writing file '%s'.\n", inverseFile);
+                status = INVERSE_HALFTONING_IO_ERROR;
+            }
+        }
+    }
+
+    trackedFree(haloImage);
+    trackedFree(outputRegion);
+    freeTileWorkspace(tileWorkspace);
+    if (status < 0.0) {
+        return(status);
+    }
+    return(currentTimeInSeconds() - startTime);
+}
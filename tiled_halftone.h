@@ -0,0 +1,74 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _TILED_HALFTONE_H
+#define _TILED_HALFTONE_H
+
+#include "inverse_halftone.h"
+#include "tile_cache.h"
+
+#define DEFAULT_TILE_SIZE 1024
+
+/*
+Workspace for inverse halftoning one tile: the intermediate images for
+a tile plus its halo, and byte buffers for the tile's input and output.
+Tiles are looked up in and added to cache unless it is a null pointer.
+*/
+typedef struct TileWorkspace {
+    int maxTileRows;
+    int maxTileColumns;
+    int halftoningType;
+    int haloBefore;
+    int haloAfter;
+    unsigned char* inputTile;
+    unsigned char* outputTile;
+    InverseHalftoneWorkspace* workspace;
+    TileCache* cache;
+} TileWorkspace;
+
+TileWorkspace* allocateTileWorkspace(int maxTileRows, int maxTileColumns,
+                                     int halftoningType);
+void freeTileWorkspace(TileWorkspace* tileWorkspace);
+
+double inverseHalftoneRegion(TileWorkspace* tileWorkspace,
+                             unsigned char* inputImage,
+                             int numRows, int numColumns,
+                             int firstRow, int firstColumn,
+                             int regionRows, int regionColumns,
+                             unsigned char* outputRegion, int outputStride,
+                             int gain, int threshold);
+
+double inverseHalftoneTiled(unsigned char* inputImage,
+                            unsigned char* outputImage,
+                            int numRows, int numColumns,
+                            int gain, int threshold, int halftoningType,
+                            int tileSize, int numThreads,
+                            TileCache* cache);
+
+double inverseHalftoneFileTiled(char* halfFile, char* inverseFile,
+                                int* numRowsPtr, int* numColumnsPtr,
+                                int gain, int threshold, int halftoningType,
+                                int tileSize, int numThreads,
+                            TileCache* cache);
+
+double inverseHalftoneFileRegion(char* halfFile, char* inverseFile,
+                                 int* numRowsPtr, int* numColumnsPtr,
+                                 int firstRow, int firstColumn,
+                                 int regionRows, int regionColumns,
+                                 int gain, int threshold, int halftoningType);
+
+#endif
@@ -0,0 +1,31 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <sys/time.h>
+
+#include "timer_utils.h"
+
+/* Wall clock time in seconds, with microsecond resolution */
+double currentTimeInSeconds(void)
+{
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return(now.tv_sec + 1.0e-6 * now.tv_usec);
+}
@@ -0,0 +1,197 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+/*
+Profile of the configuration of fastiht1 and fastiht2 tuned for the
+local machine.  The profile is a text file of "key value" lines, with
+# starting a comment:
+
+    fastiht1-kernels smoothing=unrolled,median=network
+    fastiht1-tile-size 512
+    fastiht1-threads 8
+    fastiht2-strip-height 64
+    fastiht2-threads 8
+
+Unknown keys are skipped, so that older programs can read the
+profiles of newer ones.
+*/
+
+/* Standard includes */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tuning_profile.h"
+
+#ifndef TRUE
+#define TRUE 1
+#endif
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#define MAX_PROFILE_LINE_LENGTH 512
+
+/* Set every field of profile to not tuned */
+void clearTuningProfile(TuningProfile* profile)
+{
+    memset(profile, 0, sizeof(TuningProfile));
+}
+
+/*
+Store the name of the profile file in buffer and return buffer, or
+return a null pointer if the profile is turned off or the name does
+not fit.
+*/
+char* tuningProfileFileName(char* buffer, int bufferSize)
+{
+    char* name = getenv(TUNING_PROFILE_VARIABLE);
+    char* home;
+
+    if (name != 0) {
+        if ((name[0] == 0) || ((int) strlen(name) >= bufferSize)) {
+            return(0);
+        }
+        strcpy(buffer, name);
+        return(buffer);
+    }
+    home = getenv("HOME");
+    if ((home == 0) || (home[0] == 0) ||
+        ((int) (strlen(home) + strlen(DEFAULT_TUNING_PROFILE)) + 2 >
+         bufferSize)) {
+        return(0);
+    }
+    sprintf(buffer, "%s/%s", home, DEFAULT_TUNING_PROFILE);
+    return(buffer);
+}
+
+/* Read the positive integer value into *valuePtr, or warn and keep it */
+static void readProfileInt(char* fileName, int lineNumber, char* key,
+                           char* value, int* valuePtr)
+{
+    int number = 0;
+
+    if ((sscanf(value, "%d", &number) != 1) || (number < 1)) {
+        fprintf(stderr, "%s:%d: %s, %s, is not a positive integer.\n",
+                fileName, lineNumber, key, value);
+        return;
+    }
+    *valuePtr = number;
+}
+
+/*
+Read the profile fileName into profile, over the fields already in
+it.  Lines with bad values are reported and skipped.  Returns FALSE if
+the file could not be opened.
+*/
+int readTuningProfile(char* fileName, TuningProfile* profile)
+{
+    char line[MAX_PROFILE_LINE_LENGTH];
+    FILE* file = fopen(fileName, "r");
+    int lineNumber = 0;
+
+    if (file == 0) {
+        return FALSE;
+    }
+    while (fgets(line, sizeof(line), file) != 0) {
+        char *key, *value, *end;
+        lineNumber++;
+        if ((end = strchr(line, '#')) != 0) *end = 0;
+        key = strtok(line, " \t\r\n");
+        if (key == 0) continue;
+        value = strtok(0, " \t\r\n");
+        if (value == 0) {
+            fprintf(stderr, "%s:%d: %s has no value.\n", fileName,
+                    lineNumber, key);
+        }
+        else if (strcmp(key, "fastiht1-kernels") == 0) {
+            if (strlen(value) < sizeof(profile->kernels)) {
+                strcpy(profile->kernels, value);
+            }
+        }
+        else if (strcmp(key, "fastiht1-tile-size") == 0) {
+            readProfileInt(fileName, lineNumber, key, value,
+                           &profile->tileSize);
+        }
+        else if (strcmp(key, "fastiht1-threads") == 0) {
+            readProfileInt(fileName, lineNumber, key, value,
+                           &profile->numThreads);
+        }
+        else if (strcmp(key, "fastiht2-strip-height") == 0) {
+            readProfileInt(fileName, lineNumber, key, value,
+                           &profile->stripHeight);
+        }
+        else if (strcmp(key, "fastiht2-threads") == 0) {
+            readProfileInt(fileName, lineNumber, key, value,
+                           &profile->stripThreads);
+        }
+    }
+    fclose(file);
+    return TRUE;
+}
+
+/*
+Write the tuned fields of profile to fileName.  Returns FALSE if the
+file could not be written.
+*/
+int writeTuningProfile(char* fileName, TuningProfile* profile)
+{
+    FILE* file = fopen(fileName, "w");
+    int status;
+
+    if (file == 0) {
+        return FALSE;
+    }
+    fprintf(file, "# Fast inverse halftoning configuration tuned for this "
+            "machine by fastihttune\n");
+    if (profile->kernels[0] != 0) {
+        fprintf(file, "fastiht1-kernels %s\n", profile->kernels);
+    }
+    if (profile->tileSize > 0) {
+        fprintf(file, "fastiht1-tile-size %d\n", profile->tileSize);
+    }
+    if (profile->numThreads > 0) {
+        fprintf(file, "fastiht1-threads %d\n", profile->numThreads);
+    }
+    if (profile->stripHeight > 0) {
+        fprintf(file, "fastiht2-strip-height %d\n", profile->stripHeight);
+    }
+    if (profile->stripThreads > 0) {
+        fprintf(file, "fastiht2-threads %d\n", profile->stripThreads);
+    }
+    status = !ferror(file);
+    if (fclose(file) != 0) {
+        status = FALSE;
+    }
+    return(status);
+}
+
+/*
+Clear profile and read the profile of this machine into it, if there
+is one.  Returns FALSE if no profile was read.
+*/
+int loadTuningProfile(TuningProfile* profile)
+{
+    char fileName[MAX_PROFILE_NAME_LENGTH];
+
+    clearTuningProfile(profile);
+    if (tuningProfileFileName(fileName, sizeof(fileName)) == 0) {
+        return FALSE;
+    }
+    return(readTuningProfile(fileName, profile));
+}
@@ -0,0 +1,51 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _TUNING_PROFILE_H
+#define _TUNING_PROFILE_H
+
+/*
+The profile is read from the file named by this environment variable,
+or from DEFAULT_TUNING_PROFILE in the home directory if it is not
+set.  Setting it to the empty string turns the profile off.
+*/
+#define TUNING_PROFILE_VARIABLE "FASTIHT_PROFILE"
+#define DEFAULT_TUNING_PROFILE ".fastiht_profile"
+
+#define MAX_PROFILE_KERNELS_LENGTH 256
+#define MAX_PROFILE_NAME_LENGTH 1024
+
+/*
+Configuration of fastiht1 and fastiht2 measured fastest on a machine
+by fastihttune.  Every field is 0, or the empty string, if it was not
+tuned, so that the programs keep their own defaults for it.
+*/
+typedef struct TuningProfile {
+    char kernels[MAX_PROFILE_KERNELS_LENGTH];   /* fastiht1 --kernel list */
+    int tileSize;                               /* fastiht1 --tile */
+    int numThreads;                             /* fastiht1 --threads */
+    int stripHeight;                            /* fastiht2 --strip */
+    int stripThreads;                           /* fastiht2 --threads */
+} TuningProfile;
+
+void clearTuningProfile(TuningProfile* profile);
+char* tuningProfileFileName(char* buffer, int bufferSize);
+int readTuningProfile(char* fileName, TuningProfile* profile);
+int writeTuningProfile(char* fileName, TuningProfile* profile);
+int loadTuningProfile(TuningProfile* profile);
+
+#endif
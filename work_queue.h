@@ -0,0 +1,43 @@
+/*
+This program is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation; either version 2 of the License, or
+(at your option) any later version.
+ 
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+ 
+The GNU Public License is available in the file LICENSE, or you
+can write to the Free Software Foundation, Inc., 59 Temple Place -
+Suite 330, Boston, MA 02111-1307, USA, or you can find it on the
+World Wide Web at http://www.fsf.org.
+*/
+
+#ifndef _WORK_QUEUE_H
+#define _WORK_QUEUE_H
+
+#include <pthread.h>
+
+/*
+A bounded blocking first-in first-out queue of pointers for passing
+work between threads.  Pushing to a full queue and popping from an
+empty queue block, which gives back pressure between pipeline stages.
+*/
+typedef struct WorkQueue {
+    void** items;
+    int capacity;
+    int head;
+    int count;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+} WorkQueue;
+
+int initWorkQueue(WorkQueue* queue, int capacity);
+void destroyWorkQueue(WorkQueue* queue);
+void pushWorkQueue(WorkQueue* queue, void* item);
+void* popWorkQueue(WorkQueue* queue);
+
+#endif